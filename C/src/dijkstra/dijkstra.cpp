@@ -33,6 +33,7 @@
 
 // includes, kernels
 #include "dijkstra_kernel.h"
+#include "dijkstra_access.h"
 
 ///
 //  Macro Options
@@ -132,37 +133,16 @@ float weightArray[] =
 ////////////////////////////////////////////////////////////////////////////////
 // declaration, forward
 void runTest( int argc, char** argv);
+void runSimulation( int argc, char** argv);
 void printDeviceInfo( int argc, char** argv);
 
-///
-//  Generate a random graph
-//
-void generateRandomGraph(GraphData *graph, int numVertices, int neighborsPerVertex)
-{
-    graph->vertexCount = numVertices;
-    graph->vertexArray = (int*) malloc(graph->vertexCount * sizeof(int));
-    graph->edgeCount = numVertices * neighborsPerVertex;
-    graph->edgeArray = (int*)malloc(graph->edgeCount * sizeof(int));
-    graph->weightArray = (float*)malloc(graph->edgeCount * sizeof(float));
-
-    for(int i = 0; i < graph->vertexCount; i++)
-    {
-        graph->vertexArray[i] = i * neighborsPerVertex;
-    }
-
-    for(int i = 0; i < graph->edgeCount; i++)
-    {
-        graph->edgeArray[i] = (rand() % graph->vertexCount);
-        graph->weightArray[i] = (float)(rand() % 1000) / 1000.0f;
-    }
-}
-
 ///
 //  Parse command line arguments
 //
 void parseCommandLineArgs(int argc, const char **argv, bool &doGPU,
                           bool &doMultiGPU, bool &doRef,
-                          int *numSources, int *generateVerts, int *generateEdgesPerVert)
+                          int *numSources, int *generateVerts, int *generateEdgesPerVert,
+                          char **backendName)
 {
     doGPU = shrCheckCmdLineFlag(argc, argv, "gpu");
     doMultiGPU = shrCheckCmdLineFlag(argc, argv, "multigpu");
@@ -170,6 +150,7 @@ void parseCommandLineArgs(int argc, const char **argv, bool &doGPU,
     shrGetCmdLineArgumenti(argc, argv, "sources", numSources);   
     shrGetCmdLineArgumenti(argc, argv, "verts", generateVerts);
     shrGetCmdLineArgumenti(argc, argv, "edges", generateEdgesPerVert);
+    shrGetCmdLineArgumentstr(argc, argv, "backend", backendName);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -178,6 +159,13 @@ void parseCommandLineArgs(int argc, const char **argv, bool &doGPU,
 int
 main( int argc, char** argv) 
 {
+    // The access simulation runs entirely on the CPU, no device needed
+    if (shrCheckCmdLineFlag(argc, (const char**)argv, "simulate"))
+    {
+        runSimulation(argc, argv);
+        return 0;
+    }
+
     printDeviceInfo(argc, argv);
     runTest( argc, argv);
 
@@ -205,8 +193,14 @@ cutWaitForThreads(NULL,0);
     int generateVerts;
     int generateEdgesPerVert;
     int numSources;
+    char *backendName = NULL;
+
+    parseCommandLineArgs(argc, (const char**)argv, doGPU, doMultiGPU, doRef, &numSources, &generateVerts, &generateEdgesPerVert,
+                         &backendName);
 
-    parseCommandLineArgs(argc, (const char**)argv, doGPU, doMultiGPU, doRef, &numSources, &generateVerts, &generateEdgesPerVert);
+    // Make every engine available by name for -backend
+    registerCPUBackends();
+    registerCUDABackends();
 
     // Allocate memory for arrays
     GraphData graph;
@@ -272,6 +266,30 @@ cutWaitForThreads(NULL,0);
 
     cutilCheckError(cutStopTimer(refTimer));
 
+    unsigned int backendTimer = 0;
+    cutilCheckError(cutCreateTimer(&backendTimer));
+    cutilCheckError(cutStartTimer(backendTimer));
+
+    if ( backendName != NULL )
+    {
+        SSSPBackend *backend = findSSSPBackend(backendName);
+        if (backend == NULL)
+        {
+            printf("Unknown backend %s, available:", backendName);
+            for (int i = 0; i < getSSSPBackendCount(); i++)
+            {
+                printf(" %s", getSSSPBackend(i)->getName());
+            }
+            printf("\n");
+        }
+        else
+        {
+            runSSSP(backend, &graph, sourceVertArray, results, sourceVertices.size());
+        }
+    }
+
+    cutilCheckError(cutStopTimer(backendTimer));
+
 #ifdef CITY_DATA
     for (unsigned int i = 0; i < sourceVertices.size(); i++)
     {
@@ -305,15 +323,60 @@ cutWaitForThreads(NULL,0);
         shrLog("\nrunDijkstra - Reference (CPU):        %f s\n", cutGetTimerValue(refTimer) / 1000.0f);
         oss << (cutGetTimerValue(refTimer) / 1000.0f) << " ";
     }
+    if (backendName != NULL)
+    {
+        shrLog("\nrunSSSP - %s Time: %f s\n", backendName, cutGetTimerValue(backendTimer) / 1000.0f);
+        oss << (cutGetTimerValue(backendTimer) / 1000.0f) << " ";
+    }
     oss << "\n";
     shrLog(oss.str().c_str());
 
     free(sourceVertArray);
     free(results);
 
+    releaseSSSPBackends();
     cudaThreadExit();
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//! Replay the kernels' memory accesses for one source on the CPU and report
+//! coalescing, cache line utilization and shared memory bank conflicts
+////////////////////////////////////////////////////////////////////////////////
+void
+runSimulation( int argc, char** argv)
+{
+    int generateVerts = 0;
+    int generateEdgesPerVert = 0;
+    int sourceVertex = 0;
+    int blockSize = 512;
+
+    shrGetCmdLineArgumenti(argc, (const char**)argv, "verts", &generateVerts);
+    shrGetCmdLineArgumenti(argc, (const char**)argv, "edges", &generateEdgesPerVert);
+    shrGetCmdLineArgumenti(argc, (const char**)argv, "source", &sourceVertex);
+    shrGetCmdLineArgumenti(argc, (const char**)argv, "blocksize", &blockSize);
+
+    if (generateVerts <= 0 || generateEdgesPerVert <= 0 || blockSize <= 0 || (blockSize % 32) != 0 ||
+        sourceVertex < 0 || sourceVertex >= generateVerts)
+    {
+        printf("Usage: dijkstra -simulate -verts=<n> -edges=<n> [-source=<v>] [-blocksize=<multiple of 32>]\n");
+        return;
+    }
+
+    GraphData graph;
+    generateRandomGraph(&graph, generateVerts, generateEdgesPerVert);
+
+    printf("Vertex Count: %d\n", graph.vertexCount);
+    printf("Edge Count: %d\n", graph.edgeCount);
+
+    AccessSimulator simulator;
+    int iterations = simulateDijkstraAccess(&graph, sourceVertex, blockSize, &simulator);
+
+    printf("Simulated %d iterations, block size %d\n\n", iterations, blockSize);
+    simulator.report(std::cout);
+
+    freeGraph(&graph);
+}
+
 ///
 /// Print Device info
 ///
@@ -0,0 +1,262 @@
+//
+//
+//  Description:
+//      CPU-side simulator for the memory transactions issued by a warp.  See
+//      access_simulator.h.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+// includes, system
+#include <algorithm>
+#include <iomanip>
+#include <set>
+#include <stdexcept>
+
+// includes, project
+#include "access_simulator.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//! Constructor
+///////////////////////////////////////////////////////////////////////////////
+AccessSimulator::AccessSimulator( unsigned int warp_size,
+                                  unsigned int segment_size,
+                                  unsigned int cache_line_size,
+                                  unsigned int num_banks,
+                                  unsigned int bank_width ) :
+    warp_size( warp_size),
+    segment_size( segment_size),
+    cache_line_size( cache_line_size),
+    num_banks( num_banks),
+    bank_width( bank_width),
+    current_space( GLOBAL_MEMORY)
+{
+    current_accesses.reserve( warp_size);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Destructor
+///////////////////////////////////////////////////////////////////////////////
+AccessSimulator::~AccessSimulator()
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Start a warp-wide execution of an instruction
+///////////////////////////////////////////////////////////////////////////////
+void
+AccessSimulator::beginInstruction( const std::string& name, MemorySpace space)
+{
+    current_name = name;
+    current_space = space;
+    current_accesses.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Side effect of a memory access by one lane of the current instruction
+///////////////////////////////////////////////////////////////////////////////
+void
+AccessSimulator::access( unsigned int lane, unsigned long long address, unsigned int size)
+{
+    LaneAccess a;
+    a.lane = lane;
+    a.address = address;
+    a.size = size;
+    current_accesses.push_back( a);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Analyse the accesses recorded since beginInstruction()
+///////////////////////////////////////////////////////////////////////////////
+void
+AccessSimulator::endInstruction()
+{
+    // inactive warps do not issue the instruction at all
+    if ( current_accesses.empty())
+    {
+        return;
+    }
+
+    std::map<std::string, Statistics>::iterator it = statistics.find( current_name);
+    if ( it == statistics.end())
+    {
+        Statistics empty;
+        empty.space = current_space;
+        empty.executions = 0;
+        empty.active_lanes = 0;
+        empty.requested_bytes = 0;
+        empty.segments = 0;
+        empty.cache_lines = 0;
+        empty.bank_conflicts = 0;
+        empty.max_conflict_degree = 0;
+
+        it = statistics.insert( std::make_pair( current_name, empty)).first;
+        instruction_order.push_back( current_name);
+    }
+
+    Statistics& stats = it->second;
+
+    // lanes that access more than once (vector accesses) still count once
+    std::set<unsigned int> lanes;
+    std::set<unsigned long long> bytes;
+    for ( size_t i = 0; i < current_accesses.size(); ++i)
+    {
+        lanes.insert( current_accesses[i].lane);
+        for ( unsigned int b = 0; b < current_accesses[i].size; ++b)
+        {
+            bytes.insert( current_accesses[i].address + b);
+        }
+    }
+
+    stats.executions++;
+    stats.active_lanes += lanes.size();
+    stats.requested_bytes += bytes.size();
+
+    if ( GLOBAL_MEMORY == stats.space)
+    {
+        analyseGlobal( stats);
+    }
+    else
+    {
+        analyseShared( stats);
+    }
+
+    current_accesses.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Analyse a global memory instruction: every distinct segment touched is
+//! one transaction, every distinct cache line is one line fetched
+///////////////////////////////////////////////////////////////////////////////
+void
+AccessSimulator::analyseGlobal( Statistics& stats)
+{
+    std::set<unsigned long long> segments;
+    std::set<unsigned long long> lines;
+
+    for ( size_t i = 0; i < current_accesses.size(); ++i)
+    {
+        const LaneAccess& a = current_accesses[i];
+        unsigned long long last = a.address + a.size - 1;
+
+        for ( unsigned long long s = a.address / segment_size; s <= last / segment_size; ++s)
+        {
+            segments.insert( s);
+        }
+        for ( unsigned long long l = a.address / cache_line_size; l <= last / cache_line_size; ++l)
+        {
+            lines.insert( l);
+        }
+    }
+
+    stats.segments += segments.size();
+    stats.cache_lines += lines.size();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Analyse a shared memory instruction: lanes that access different words in
+//! the same bank are serialized, lanes reading the same word are served by a
+//! broadcast.  The conflict degree is the largest number of distinct words
+//! any single bank has to deliver.
+///////////////////////////////////////////////////////////////////////////////
+void
+AccessSimulator::analyseShared( Statistics& stats)
+{
+    std::vector< std::set<unsigned long long> > bank_words( num_banks);
+
+    for ( size_t i = 0; i < current_accesses.size(); ++i)
+    {
+        const LaneAccess& a = current_accesses[i];
+        unsigned long long last = a.address + a.size - 1;
+
+        for ( unsigned long long w = a.address / bank_width; w <= last / bank_width; ++w)
+        {
+            bank_words[w % num_banks].insert( w);
+        }
+    }
+
+    unsigned int degree = 1;
+    for ( unsigned int b = 0; b < num_banks; ++b)
+    {
+        degree = std::max( degree, (unsigned int) bank_words[b].size());
+    }
+
+    stats.bank_conflicts += degree - 1;
+    stats.max_conflict_degree = std::max( stats.max_conflict_degree, degree);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Clear all accumulated statistics
+///////////////////////////////////////////////////////////////////////////////
+void
+AccessSimulator::reset()
+{
+    statistics.clear();
+    instruction_order.clear();
+    current_accesses.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Get the statistics of one instruction
+///////////////////////////////////////////////////////////////////////////////
+const AccessSimulator::Statistics&
+AccessSimulator::getStatistics( const std::string& name) const
+{
+    std::map<std::string, Statistics>::const_iterator it = statistics.find( name);
+    if ( it == statistics.end())
+    {
+        throw std::invalid_argument( "AccessSimulator: unknown instruction " + name);
+    }
+
+    return it->second;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//! Print a table with the statistics of every instruction.
+//!   lanes    average fraction of the warp that is active
+//!   coalesc  requested bytes / bytes transferred in segments
+//!   lines    requested bytes / bytes of the cache lines touched
+//!   trans    average segments per execution (global) or replays (shared)
+///////////////////////////////////////////////////////////////////////////////
+void
+AccessSimulator::report( std::ostream& os) const
+{
+    os << std::left << std::setw( 44) << "instruction"
+       << std::right << std::setw( 12) << "executions"
+       << std::setw( 9) << "lanes"
+       << std::setw( 9) << "coalesc"
+       << std::setw( 9) << "lines"
+       << std::setw( 9) << "trans"
+       << std::setw( 9) << "conflict" << "\n";
+
+    std::ios_base::fmtflags flags = os.flags();
+    os << std::fixed << std::setprecision( 2);
+
+    for ( size_t i = 0; i < instruction_order.size(); ++i)
+    {
+        const Statistics& s = statistics.find( instruction_order[i])->second;
+        double executions = (double) s.executions;
+
+        os << std::left << std::setw( 44) << instruction_order[i]
+           << std::right << std::setw( 12) << s.executions
+           << std::setw( 8) << 100.0 * s.active_lanes / (executions * warp_size) << "%";
+
+        if ( GLOBAL_MEMORY == s.space)
+        {
+            os << std::setw( 8) << 100.0 * s.requested_bytes / ((double) s.segments * segment_size) << "%"
+               << std::setw( 8) << 100.0 * s.requested_bytes / ((double) s.cache_lines * cache_line_size) << "%"
+               << std::setw( 9) << s.segments / executions
+               << std::setw( 9) << "-";
+        }
+        else
+        {
+            os << std::setw( 9) << "-"
+               << std::setw( 9) << "-"
+               << std::setw( 9) << (s.executions + s.bank_conflicts) / executions
+               << std::setw( 8) << s.max_conflict_degree << "x";
+        }
+        os << "\n";
+    }
+
+    os.flags( flags);
+}
@@ -0,0 +1,156 @@
+//
+//
+//  Description:
+//      CPU-side simulator for the memory transactions issued by a warp.  This
+//      follows the approach of the emulation-mode BankChecker in cutil: the
+//      per-thread accesses of one warp-wide instruction are collected and then
+//      analysed together.  Besides shared (local) memory bank conflicts it
+//      models global memory coalescing into fixed size segments and the
+//      utilization of the cache lines that are fetched.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#ifndef ACCESS_SIMULATOR_H
+#define ACCESS_SIMULATOR_H
+
+// includes, system
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+//! Helper class to simulate the memory transactions of warp-wide accesses
+class AccessSimulator
+{
+public:
+
+    //! Memory space an instruction accesses
+    enum MemorySpace
+    {
+        GLOBAL_MEMORY,
+        SHARED_MEMORY
+    };
+
+    //! Accumulated statistics for one instruction (source location)
+    struct Statistics
+    {
+        //! memory space of the instruction
+        MemorySpace space;
+
+        //! number of warp-wide executions with at least one active lane
+        unsigned long long executions;
+
+        //! active lanes summed over all executions
+        unsigned long long active_lanes;
+
+        //! bytes requested by the active lanes (duplicates counted once)
+        unsigned long long requested_bytes;
+
+        //! global memory: number of segments (transactions) transferred
+        unsigned long long segments;
+
+        //! global memory: number of distinct cache lines touched
+        unsigned long long cache_lines;
+
+        //! shared memory: number of extra replays caused by bank conflicts
+        unsigned long long bank_conflicts;
+
+        //! shared memory: worst conflict degree seen in a single execution
+        unsigned int max_conflict_degree;
+    };
+
+public:
+
+    //! Constructor
+    //! @param warp_size        threads per warp / sub-group
+    //! @param segment_size     bytes per global memory transaction
+    //! @param cache_line_size  bytes per cache line
+    //! @param num_banks        number of shared memory banks
+    //! @param bank_width       bytes per shared memory bank
+    AccessSimulator( unsigned int warp_size = 32,
+                     unsigned int segment_size = 32,
+                     unsigned int cache_line_size = 128,
+                     unsigned int num_banks = 32,
+                     unsigned int bank_width = 4 );
+
+    //! Destructor
+    ~AccessSimulator();
+
+public:
+
+    //! Start a warp-wide execution of an instruction
+    //! @param name   unique name of the instruction, e.g. "K1 edgeArray[edge]"
+    //! @param space  memory space accessed by the instruction
+    void beginInstruction( const std::string& name, MemorySpace space);
+
+    //! Side effect of a memory access by one lane of the current instruction
+    //! @param lane     lane within the warp
+    //! @param address  byte address of the access
+    //! @param size     size of the access in bytes
+    void access( unsigned int lane, unsigned long long address, unsigned int size);
+
+    //! Analyse the accesses recorded since beginInstruction()
+    void endInstruction();
+
+    //! Clear all accumulated statistics
+    void reset();
+
+    //! Get the statistics of all instructions, in order of first execution
+    const std::vector<std::string>& getInstructionNames() const
+    {
+        return instruction_order;
+    }
+
+    //! Get the statistics of one instruction
+    //! @param name  name used in beginInstruction()
+    const Statistics& getStatistics( const std::string& name) const;
+
+    //! Print a table with coalescing efficiency, cache line utilization and
+    //! bank conflicts for every instruction
+    void report( std::ostream& os) const;
+
+    //! Get the warp size used by the simulation
+    unsigned int getWarpSize() const
+    {
+        return warp_size;
+    }
+
+private:
+
+    //! One lane access of the current instruction
+    struct LaneAccess
+    {
+        unsigned int lane;
+        unsigned long long address;
+        unsigned int size;
+    };
+
+    //! Analyse a global memory instruction
+    void analyseGlobal( Statistics& stats);
+
+    //! Analyse a shared memory instruction
+    void analyseShared( Statistics& stats);
+
+private:
+
+    // configuration
+    unsigned int warp_size;
+    unsigned int segment_size;
+    unsigned int cache_line_size;
+    unsigned int num_banks;
+    unsigned int bank_width;
+
+    //! statistics per instruction name
+    std::map<std::string, Statistics> statistics;
+
+    //! instruction names in order of first execution, for reporting
+    std::vector<std::string> instruction_order;
+
+    //! instruction currently being recorded
+    std::string current_name;
+    MemorySpace current_space;
+    std::vector<LaneAccess> current_accesses;
+};
+
+#endif // ACCESS_SIMULATOR_H
@@ -0,0 +1,295 @@
+//
+//
+//  Description:
+//      Replays the memory accesses of CUDA_SSSP_KERNEL1 and CUDA_SSSP_KERNEL2
+//      through an AccessSimulator.  See dijkstra_access.h.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <stdlib.h>
+#include <float.h>
+#include <vector>
+#include <dijkstraFrontier.h>
+
+#include "dijkstra_access.h"
+
+///
+//  Constants
+//
+
+// Simulated device addresses of the kernel arguments.  Each buffer gets its
+// own region so that arrays never share a segment, matching cudaMalloc which
+// returns allocations aligned to at least 256 bytes.
+enum
+{
+    VERTEX_BUFFER,
+    EDGE_BUFFER,
+    WEIGHT_BUFFER,
+    MASK_BUFFER,
+    COST_BUFFER,
+    UPDATING_COST_BUFFER,
+    NUM_BUFFERS
+};
+
+const unsigned long long SIMULATED_BUFFER_STRIDE = 1ull << 40;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+///
+/// Simulated device address of element index of a buffer
+///
+static unsigned long long bufferAddress(int buffer, size_t index, size_t elementSize)
+{
+    return (buffer + 1) * SIMULATED_BUFFER_STRIDE + index * elementSize;
+}
+
+///
+/// Record one warp-wide global memory instruction.  lanes holds the thread
+/// ids of the active lanes (-1 for inactive), indices the element each lane
+/// accesses.
+///
+static void recordGlobal(AccessSimulator *simulator, const char *name, int buffer, size_t elementSize,
+                         const std::vector<int> &lanes, const std::vector<int> &indices)
+{
+    simulator->beginInstruction(name, AccessSimulator::GLOBAL_MEMORY);
+    for (size_t lane = 0; lane < lanes.size(); lane++)
+    {
+        if (lanes[lane] >= 0)
+        {
+            simulator->access((unsigned int) lane, bufferAddress(buffer, indices[lane], elementSize),
+                              (unsigned int) elementSize);
+        }
+    }
+    simulator->endInstruction();
+}
+
+///
+/// Replay CUDA_SSSP_KERNEL1 for one warp
+///
+static void simulateKernel1Warp(GraphData *graph, AccessSimulator *simulator, int firstThread,
+                                const FrontierWord *maskArray, const float *costArray,
+                                float *updatingCostArray)
+{
+    int warpSize = (int) simulator->getWarpSize();
+    std::vector<int> all(warpSize), active(warpSize, -1), indices(warpSize);
+    std::vector<int> edgeStart(warpSize), edgeEnd(warpSize);
+
+    // if ( maskArray[tid >> 5] & ... )
+    for (int lane = 0; lane < warpSize; lane++)
+    {
+        int tid = firstThread + lane;
+        all[lane] = tid;
+        indices[lane] = tid >> FRONTIER_WORD_SHIFT;
+    }
+    recordGlobal(simulator, "K1 load  maskArray[tid>>5]", MASK_BUFFER, sizeof(FrontierWord), all, indices);
+
+    int maxDegree = 0;
+    for (int lane = 0; lane < warpSize; lane++)
+    {
+        int tid = firstThread + lane;
+        if (tid < graph->vertexCount && frontierTest(maskArray, tid))
+        {
+            active[lane] = tid;
+            edgeStart[lane] = graph->vertexArray[tid];
+            edgeEnd[lane] = (tid + 1 < graph->vertexCount) ? graph->vertexArray[tid + 1] : graph->edgeCount;
+            if (edgeEnd[lane] - edgeStart[lane] > maxDegree)
+            {
+                maxDegree = edgeEnd[lane] - edgeStart[lane];
+            }
+        }
+        indices[lane] = tid;
+    }
+
+    // edgeStart = vertexArray[tid], edgeEnd = vertexArray[tid + 1]
+    recordGlobal(simulator, "K1 load  vertexArray[tid]", VERTEX_BUFFER, sizeof(int), active, indices);
+
+    std::vector<int> next(active);
+    for (int lane = 0; lane < warpSize; lane++)
+    {
+        if (next[lane] >= 0 && next[lane] + 1 >= graph->vertexCount)
+        {
+            next[lane] = -1;
+        }
+        indices[lane] = firstThread + lane + 1;
+    }
+    recordGlobal(simulator, "K1 load  vertexArray[tid+1]", VERTEX_BUFFER, sizeof(int), next, indices);
+
+    // The edge loop: lanes leave the loop as their vertex runs out of edges
+    std::vector<int> edgeLanes(warpSize), nids(warpSize), tids(warpSize), stores(warpSize);
+    for (int step = 0; step < maxDegree; step++)
+    {
+        for (int lane = 0; lane < warpSize; lane++)
+        {
+            int edge = edgeStart[lane] + step;
+            bool inLoop = active[lane] >= 0 && edge < edgeEnd[lane];
+
+            edgeLanes[lane] = inLoop ? active[lane] : -1;
+            indices[lane] = inLoop ? edge : 0;
+            nids[lane] = inLoop ? graph->edgeArray[edge] : 0;
+            tids[lane] = active[lane];
+        }
+
+        recordGlobal(simulator, "K1 load  edgeArray[edge]", EDGE_BUFFER, sizeof(int), edgeLanes, indices);
+        recordGlobal(simulator, "K1 load  updatingCostArray[nid]", UPDATING_COST_BUFFER, sizeof(float), edgeLanes, nids);
+        recordGlobal(simulator, "K1 load  costArray[tid]", COST_BUFFER, sizeof(float), edgeLanes, tids);
+        recordGlobal(simulator, "K1 load  weightArray[edge]", WEIGHT_BUFFER, sizeof(float), edgeLanes, indices);
+
+        // Conditional store.  Lanes are applied in lane order, which is one
+        // of the orders the hardware may serialize conflicting writes in.
+        for (int lane = 0; lane < warpSize; lane++)
+        {
+            stores[lane] = -1;
+            if (edgeLanes[lane] >= 0)
+            {
+                float cost = costArray[active[lane]] + graph->weightArray[indices[lane]];
+                if (updatingCostArray[nids[lane]] > cost)
+                {
+                    updatingCostArray[nids[lane]] = cost;
+                    stores[lane] = active[lane];
+                }
+            }
+        }
+        recordGlobal(simulator, "K1 store updatingCostArray[nid]", UPDATING_COST_BUFFER, sizeof(float), stores, nids);
+    }
+}
+
+///
+/// Replay CUDA_SSSP_KERNEL2 for one block and build the next frontier
+///
+static void simulateKernel2Block(AccessSimulator *simulator, int block, int blockSize,
+                                 FrontierWord *maskArray, float *costArray, float *updatingCostArray)
+{
+    int warpSize = (int) simulator->getWarpSize();
+    int wordsPerBlock = blockSize >> FRONTIER_WORD_SHIFT;
+    std::vector<unsigned char> changedFlags(blockSize);
+    std::vector<int> all(warpSize), changed(warpSize), indices(warpSize);
+
+    for (int firstThread = 0; firstThread < blockSize; firstThread += warpSize)
+    {
+        for (int lane = 0; lane < warpSize; lane++)
+        {
+            int tid = block * blockSize + firstThread + lane;
+            all[lane] = tid;
+            indices[lane] = tid;
+            changed[lane] = -1;
+
+            changedFlags[firstThread + lane] = 0;
+            if (costArray[tid] > updatingCostArray[tid])
+            {
+                costArray[tid] = updatingCostArray[tid];
+                changedFlags[firstThread + lane] = 1;
+                changed[lane] = tid;
+            }
+            updatingCostArray[tid] = costArray[tid];
+        }
+
+        recordGlobal(simulator, "K2 load  costArray[tid]", COST_BUFFER, sizeof(float), all, indices);
+        recordGlobal(simulator, "K2 load  updatingCostArray[tid]", UPDATING_COST_BUFFER, sizeof(float), all, indices);
+        recordGlobal(simulator, "K2 store costArray[tid]", COST_BUFFER, sizeof(float), changed, indices);
+        recordGlobal(simulator, "K2 store updatingCostArray[tid]", UPDATING_COST_BUFFER, sizeof(float), all, indices);
+
+        // changedFlags[threadIdx.x] = changed
+        simulator->beginInstruction("K2 store changedFlags[threadIdx.x]", AccessSimulator::SHARED_MEMORY);
+        for (int lane = 0; lane < warpSize; lane++)
+        {
+            simulator->access(lane, firstThread + lane, sizeof(unsigned char));
+        }
+        simulator->endInstruction();
+    }
+
+    // The first wordsPerBlock threads pack the flags, one bit per loop trip
+    for (int firstThread = 0; firstThread < wordsPerBlock; firstThread += warpSize)
+    {
+        int lanes = (wordsPerBlock - firstThread < warpSize) ? wordsPerBlock - firstThread : warpSize;
+
+        for (int bit = 0; bit < FRONTIER_WORD_BITS; bit++)
+        {
+            simulator->beginInstruction("K2 load  changedFlags[(threadIdx.x<<5)+bit]",
+                                        AccessSimulator::SHARED_MEMORY);
+            for (int lane = 0; lane < lanes; lane++)
+            {
+                simulator->access(lane, ((firstThread + lane) << FRONTIER_WORD_SHIFT) + bit,
+                                  sizeof(unsigned char));
+            }
+            simulator->endInstruction();
+        }
+
+        std::vector<int> packing(warpSize, -1);
+        for (int lane = 0; lane < lanes; lane++)
+        {
+            int word = firstThread + lane;
+            FrontierWord value = 0;
+            for (int bit = 0; bit < FRONTIER_WORD_BITS; bit++)
+            {
+                value |= ((FrontierWord) changedFlags[(word << FRONTIER_WORD_SHIFT) + bit]) << bit;
+            }
+
+            packing[lane] = word;
+            indices[lane] = block * wordsPerBlock + word;
+            maskArray[indices[lane]] = value;
+        }
+        recordGlobal(simulator, "K2 store maskArray[word]", MASK_BUFFER, sizeof(FrontierWord), packing, indices);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+/// Simulate one single-source run of the GPU algorithm and record every global
+/// and shared memory access of both kernels in the simulator.
+///
+int simulateDijkstraAccess( GraphData *graph, int sourceVertex, int blockSize,
+                            AccessSimulator *simulator )
+{
+    int warpSize = (int) simulator->getWarpSize();
+
+    // Same padding as runDijkstra: whole blocks, costs of the padding
+    // threads stay at FLT_MAX so they never join the frontier
+    int globalWorkSize = ((graph->vertexCount + blockSize - 1) / blockSize) * blockSize;
+    int maskWordCount = globalWorkSize / FRONTIER_WORD_BITS;
+
+    FrontierWord *maskArray = (FrontierWord*) calloc(maskWordCount, sizeof(FrontierWord));
+    float *costArray = (float*) malloc(sizeof(float) * globalWorkSize);
+    float *updatingCostArray = (float*) malloc(sizeof(float) * globalWorkSize);
+
+    for (int i = 0; i < globalWorkSize; i++)
+    {
+        costArray[i] = FLT_MAX;
+        updatingCostArray[i] = FLT_MAX;
+    }
+
+    frontierSet(maskArray, sourceVertex);
+    costArray[sourceVertex] = 0.0f;
+    updatingCostArray[sourceVertex] = 0.0f;
+
+    int iterations = 0;
+    while (!frontierEmpty(maskArray, maskWordCount))
+    {
+        for (int firstThread = 0; firstThread < globalWorkSize; firstThread += warpSize)
+        {
+            simulateKernel1Warp(graph, simulator, firstThread, maskArray, costArray, updatingCostArray);
+        }
+
+        for (int block = 0; block < globalWorkSize / blockSize; block++)
+        {
+            simulateKernel2Block(simulator, block, blockSize, maskArray, costArray, updatingCostArray);
+        }
+
+        iterations++;
+    }
+
+    free(maskArray);
+    free(costArray);
+    free(updatingCostArray);
+
+    return iterations;
+}
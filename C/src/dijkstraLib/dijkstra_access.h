@@ -0,0 +1,35 @@
+//
+//
+//  Description:
+//      Replays the memory accesses of CUDA_SSSP_KERNEL1 and CUDA_SSSP_KERNEL2
+//      through an AccessSimulator.  The replay walks the same frontiers the
+//      kernels would see for a given graph and source vertex, so the effect of
+//      vertex ordering, edge layout or block size on coalescing and bank
+//      conflicts can be measured without a GPU.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#ifndef DIJKSTRA_ACCESS_H
+#define DIJKSTRA_ACCESS_H
+
+#include "dijkstra_kernel.h"
+#include "access_simulator.h"
+
+///
+/// Simulate one single-source run of the GPU algorithm and record every global
+/// and shared memory access of both kernels in the simulator.  Lanes of a warp
+/// are executed in lock-step: the edge loop of CUDA_SSSP_KERNEL1 issues one
+/// instruction per iteration for all lanes whose vertex still has edges left.
+///
+/// \param graph Graph to replay, arrays are only read
+/// \param sourceVertex Vertex the search starts from
+/// \param blockSize Threads per block, must be a multiple of 32
+/// \param simulator Simulator the accesses are recorded in.  Its warp size
+///                  determines how threads are grouped.
+/// \return Number of iterations (kernel pairs) that were replayed
+///
+int simulateDijkstraAccess( GraphData *graph, int sourceVertex, int blockSize,
+                            AccessSimulator *simulator );
+
+#endif // DIJKSTRA_ACCESS_H
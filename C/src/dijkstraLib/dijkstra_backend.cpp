@@ -0,0 +1,102 @@
+//
+//
+//  Description:
+//      SSSPBackend implementation for CUDA devices.  Each backend drives one
+//      device; the device is selected on the thread that runs the session.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <stdio.h>
+#include <cuda_runtime_api.h>
+
+#include "dijkstra_kernel.h"
+
+///
+//  Types
+//
+
+//
+//  Graph bound to one CUDA device
+//
+class CUDASession : public SSSPSession
+{
+public:
+    CUDASession(int device, const GraphData *graph) :
+        device(device),
+        graph(graph)
+    {
+    }
+
+    virtual bool run( const int *sourceVertices, float *outResultCosts, int numResults )
+    {
+        if (cudaSetDevice(device) != cudaSuccess)
+        {
+            return false;
+        }
+
+        runDijkstra( const_cast<GraphData*>(graph), const_cast<int*>(sourceVertices),
+                     outResultCosts, numResults );
+        return cudaGetLastError() == cudaSuccess;
+    }
+
+private:
+    int device;
+    const GraphData *graph;
+};
+
+//
+//  One CUDA device
+//
+class CUDABackend : public SSSPBackend
+{
+public:
+    CUDABackend(int device) :
+        device(device)
+    {
+        snprintf(name, sizeof(name), "cuda%d", device);
+    }
+
+    virtual const char *getName() const { return name; }
+    virtual SSSPDeviceType getDeviceType() const { return SSSP_DEVICE_GPU; }
+
+    virtual SSSPSession *createSession( const GraphData *graph )
+    {
+        return new CUDASession(device, graph);
+    }
+
+private:
+    int device;
+    char name[16];
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+/// Create an SSSPBackend for one CUDA device
+///
+SSSPBackend *createCUDABackend( int device )
+{
+    return new CUDABackend(device);
+}
+
+///
+/// Register one backend per CUDA device
+///
+void registerCUDABackends()
+{
+    int deviceCount = 0;
+    if (cudaGetDeviceCount(&deviceCount) != cudaSuccess)
+    {
+        return;
+    }
+
+    for (int device = 0; device < deviceCount; device++)
+    {
+        registerSSSPBackend(createCUDABackend(device));
+    }
+}
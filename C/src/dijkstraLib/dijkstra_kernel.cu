@@ -18,39 +18,12 @@
 #include <cutil_inline.h>
 #include <stdio.h>
 #include <float.h>
-#include <multithreading.h>
+#include <vector>
+#include <dijkstraFrontier.h>
+#include <dijkstraMemory.h>
 
 #include "dijkstra_kernel.h"
 
-///
-//  Types
-//
-
-// This structure is used in the multi-GPU implementation of the algorithm.
-// This structure defines the workload for each GPU.  The code chunks up
-// the work on a per-GPU basis.
-typedef struct
-{
-    // GPU number to run algorithm on
-    int device;
-
-    // Pointer to graph data
-    GraphData *graph;
-
-    // Source vertex indices to process
-    int *sourceVertices;
-
-    // End vertex indices to process
-    int *endVertices;
-
-    // Results of processing
-    float *outResultCosts;
-
-    // Number of results
-    int numResults;
-
-} GPUPlan;
-
 ///////////////////////////////////////////////////////////////////////////////
 //
 //  CUDA Compute Kernels
@@ -58,19 +31,19 @@ typedef struct
 //
 
 ///
-/// This is part 1 of the Kernel from Algorithm 4 in the paper
+/// This is part 1 of the Kernel from Algorithm 4 in the paper.  The mask is a
+/// bitmap (see dijkstraFrontier.h); the bit is not cleared here because
+/// CUDA_SSSP_KERNEL2 rewrites every mask word for the next iteration.
 ///
 __global__  void CUDA_SSSP_KERNEL1( int *vertexArray, int *edgeArray, float *weightArray,
-                                    unsigned char *maskArray, float *costArray, float *updatingCostArray,
+                                    FrontierWord *maskArray, float *costArray, float *updatingCostArray,
                                     int vertexCount, int edgeCount )
 {
     // access thread id
     unsigned int tid = blockIdx.x * blockDim.x + threadIdx.x;
 
-    if ( maskArray[tid] != 0 )
+    if ( (maskArray[tid >> FRONTIER_WORD_SHIFT] & (1u << (tid & FRONTIER_WORD_MASK))) != 0 )
     {
-        maskArray[tid] = 0;
-
         int edgeStart = vertexArray[tid];
         int edgeEnd;
         if (tid + 1 < (vertexCount))
@@ -102,19 +75,41 @@ __global__  void CUDA_SSSP_KERNEL1( int *vertexArray, int *edgeArray, float *wei
 /// This is part 2 of the Kernel from Algorithm 5 in the paper.  The only modification
 /// is to stop the search after hitting endVertex
 ///
+/// Each block gathers one flag per thread in shared memory and the first
+/// (blockDim.x / 32) threads pack them into mask words, so the mask is written
+/// with whole-word stores and no atomics.  blockDim.x must be a multiple of 32
+/// and the launch must provide blockDim.x bytes of dynamic shared memory.
+///
 __global__  void CUDA_SSSP_KERNEL2(  int *vertexArray, int *edgeArray, float *weightArray,
-                                     unsigned char *maskArray, float *costArray, float *updatingCostArray)
+                                     FrontierWord *maskArray, float *costArray, float *updatingCostArray)
 {
+    extern __shared__ unsigned char changedFlags[];
+
     // access thread id
     unsigned int tid = blockIdx.x * blockDim.x + threadIdx.x;
 
+    unsigned char changed = 0;
     if (costArray[tid] > updatingCostArray[tid])
     {
         costArray[tid] = updatingCostArray[tid];
-        maskArray[tid] = 1;
+        changed = 1;
     }
 
     updatingCostArray[tid] = costArray[tid];
+
+    changedFlags[threadIdx.x] = changed;
+    __syncthreads();
+
+    unsigned int wordsPerBlock = blockDim.x >> FRONTIER_WORD_SHIFT;
+    if (threadIdx.x < wordsPerBlock)
+    {
+        FrontierWord word = 0;
+        for (int bit = 0; bit < FRONTIER_WORD_BITS; bit++)
+        {
+            word |= ((FrontierWord) changedFlags[(threadIdx.x << FRONTIER_WORD_SHIFT) + bit]) << bit;
+        }
+        maskArray[blockIdx.x * wordsPerBlock + threadIdx.x] = word;
+    }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -140,30 +135,43 @@ size_t roundUp(int group_size, int global_size)
 }
 
 ///
-/// Check whether the mask array is empty.  This tells the algorithm whether
-/// it needs to continue running or not.
+/// Memory account of the current CUDA device, "cuda:N"
 ///
-bool maskArrayEmpty(unsigned char *maskArray, int count)
+int getCUDAMemoryDevice()
 {
-    for(int i = 0; i < count; i++ )
-    {
-        if (maskArray[i] == 1)
-        {
-            return false;
-        }
-    }
+    int device = 0;
+    cudaGetDevice(&device);
 
-    return true;
+    char name[MEMORY_DEVICE_NAME_MAX];
+    snprintf(name, sizeof(name), "cuda:%d", device);
+    return getMemoryDevice(name);
+}
+
+///
+/// Device bytes allocateCUDABuffers() allocates for the graph and for the search state
+///
+void getCUDABufferBytes(const GraphData *graph, int globalWorkSize, size_t *outGraphBytes, size_t *outStateBytes)
+{
+    *outGraphBytes = sizeof(int) * graph->vertexCount + (sizeof(int) + sizeof(float)) * graph->edgeCount;
+    *outStateBytes = sizeof(FrontierWord) * (globalWorkSize / FRONTIER_WORD_BITS) + 3 * sizeof(float) * globalWorkSize;
 }
 
 ///
-///  Allocate memory for input CUDA buffers and copy the data into device memory
+///  Allocate memory for input CUDA buffers and copy the data into device memory.  The
+///  buffers are charged to the device's memory account until freeCUDABuffers().
 ///
 void allocateCUDABuffers(GraphData *graph,
                          int **vertexArrayDevice, int **edgeArrayDevice, float **weightArrayDevice,
-                         unsigned char **maskArrayDevice, float **costArrayDevice, float **updatingCostArrayDevice,
+                         FrontierWord **maskArrayDevice, float **costArrayDevice, float **updatingCostArrayDevice,
                          float **infinitiArrayDevice, int globalWorkSize)
 {
+    size_t graphBytes;
+    size_t stateBytes;
+    getCUDABufferBytes(graph, globalWorkSize, &graphBytes, &stateBytes);
+    int memoryDevice = getCUDAMemoryDevice();
+    chargeMemory(memoryDevice, MEMORY_GRAPH, graphBytes);
+    chargeMemory(memoryDevice, MEMORY_STATE, stateBytes);
+
     // V
     cutilSafeCall( cudaMalloc( (void**) vertexArrayDevice, sizeof(int) * graph->vertexCount) );
     cutilSafeCall( cudaMemcpy( *vertexArrayDevice, graph->vertexArray, sizeof(int) * graph->vertexCount, cudaMemcpyHostToDevice) );
@@ -177,7 +185,7 @@ void allocateCUDABuffers(GraphData *graph,
     cutilSafeCall( cudaMemcpy( *weightArrayDevice, graph->weightArray, sizeof(float) * graph->edgeCount, cudaMemcpyHostToDevice) );
 
     // M, C, U
-    cutilSafeCall( cudaMalloc( (void**) maskArrayDevice, sizeof(unsigned char) * globalWorkSize) );
+    cutilSafeCall( cudaMalloc( (void**) maskArrayDevice, sizeof(FrontierWord) * (globalWorkSize / FRONTIER_WORD_BITS)) );
     cutilSafeCall( cudaMalloc( (void**) costArrayDevice, sizeof(float) * globalWorkSize) );
     cutilSafeCall( cudaMalloc( (void**) updatingCostArrayDevice, sizeof(float) * globalWorkSize) );
 
@@ -196,14 +204,38 @@ void allocateCUDABuffers(GraphData *graph,
     free (infinityArray);
 }
 
+///
+/// Free the buffers of allocateCUDABuffers() and give them back to the device's memory account
+///
+void freeCUDABuffers(GraphData *graph,
+                     int *vertexArrayDevice, int *edgeArrayDevice, float *weightArrayDevice,
+                     FrontierWord *maskArrayDevice, float *costArrayDevice, float *updatingCostArrayDevice,
+                     float *infinityArrayDevice, int globalWorkSize)
+{
+    cutilSafeCall(cudaFree(vertexArrayDevice));
+    cutilSafeCall(cudaFree(edgeArrayDevice));
+    cutilSafeCall(cudaFree(weightArrayDevice));
+    cutilSafeCall(cudaFree(maskArrayDevice));
+    cutilSafeCall(cudaFree(costArrayDevice));
+    cutilSafeCall(cudaFree(updatingCostArrayDevice));
+    cutilSafeCall(cudaFree(infinityArrayDevice));
+
+    size_t graphBytes;
+    size_t stateBytes;
+    getCUDABufferBytes(graph, globalWorkSize, &graphBytes, &stateBytes);
+    int memoryDevice = getCUDAMemoryDevice();
+    releaseMemory(memoryDevice, MEMORY_GRAPH, graphBytes);
+    releaseMemory(memoryDevice, MEMORY_STATE, stateBytes);
+}
+
 ///
 /// Initialize CUDA buffers for single run of Dijkstra
 ///
 void initializeCUDABuffers(GraphData *graph, int sourceVertex,
-                           unsigned char *maskArrayDevice, float *costArrayDevice, float *updatingCostArrayDevice,
+                           FrontierWord *maskArrayDevice, float *costArrayDevice, float *updatingCostArrayDevice,
                            float *infinityArrayDevice, int globalWorkSize)
 {
-    cudaMemset( maskArrayDevice, 0, sizeof(unsigned char) * graph->vertexCount );
+    cudaMemset( maskArrayDevice, 0, sizeof(FrontierWord) * (globalWorkSize / FRONTIER_WORD_BITS) );
 
     // FUTURE OPTIMIZATION: Figure out how to do this with a memset, or at least something not requiring a
     //                      full memcpy.
@@ -211,24 +243,12 @@ void initializeCUDABuffers(GraphData *graph, int sourceVertex,
     cudaMemcpy( updatingCostArrayDevice, infinityArrayDevice, sizeof(float) * globalWorkSize, cudaMemcpyDeviceToDevice );
 
     // Set M[S] = true, C[S] = 0, U[S] = 0
-    cudaMemset( &maskArrayDevice[sourceVertex], 1, sizeof(unsigned char) );
+    FrontierWord sourceWord = 1u << (sourceVertex & FRONTIER_WORD_MASK);
+    cudaMemcpy( &maskArrayDevice[sourceVertex >> FRONTIER_WORD_SHIFT], &sourceWord, sizeof(FrontierWord), cudaMemcpyHostToDevice );
     cudaMemset( &costArrayDevice[sourceVertex], 0, sizeof(float) );
     cudaMemset( &updatingCostArrayDevice[sourceVertex], 0, sizeof(float) );
 }
 
-///
-/// Worker thread for running the algorithm on one of the GPUs
-///
-CUT_THREADPROC dijkstraThread(GPUPlan *plan)
-{
-    // Set GPU device
-    cutilSafeCall( cudaSetDevice(plan->device) );
-
-    runDijkstra( plan->graph, plan->sourceVertices, 
-                 plan->outResultCosts, plan->numResults );
-
-}
-
 
 ///////////////////////////////////////////////////////////////////////////////
 //
@@ -259,7 +279,7 @@ void runDijkstra( GraphData* graph, int *sourceVertices, float *outResultCosts,
     int *vertexArrayDevice;
     int *edgeArrayDevice;
     float *weightArrayDevice;
-    unsigned char *maskArrayDevice;
+    FrontierWord *maskArrayDevice;
     float *costArrayDevice;
     float *updatingCostArrayDevice;
     float *infinityArrayDevice;
@@ -275,7 +295,8 @@ void runDijkstra( GraphData* graph, int *sourceVertices, float *outResultCosts,
                          &maskArrayDevice, &costArrayDevice, &updatingCostArrayDevice,
                          &infinityArrayDevice, globalWorkSize);
 
-    unsigned char *maskArrayHost = (unsigned char*) malloc(sizeof(unsigned char) * graph->vertexCount);
+    int maskWordCount = frontierWordCount(graph->vertexCount);
+    FrontierWord *maskArrayHost = (FrontierWord*) malloc(sizeof(FrontierWord) * maskWordCount);
 
     unsigned int timer = 0;
     cutilCheckError( cutCreateTimer( &timer));
@@ -288,9 +309,9 @@ void runDijkstra( GraphData* graph, int *sourceVertices, float *outResultCosts,
                               maskArrayDevice, costArrayDevice, updatingCostArrayDevice,
                               infinityArrayDevice, globalWorkSize);
         
-        cudaMemcpy( maskArrayHost, maskArrayDevice, sizeof(unsigned char) * graph->vertexCount, cudaMemcpyDeviceToHost );
+        cudaMemcpy( maskArrayHost, maskArrayDevice, sizeof(FrontierWord) * maskWordCount, cudaMemcpyDeviceToHost );
 
-        while(!maskArrayEmpty(maskArrayHost, graph->vertexCount))
+        while(!frontierEmpty(maskArrayHost, maskWordCount))
         {
             int gridSize = globalWorkSize / localWorkSize;
 
@@ -302,11 +323,11 @@ void runDijkstra( GraphData* graph, int *sourceVertices, float *outResultCosts,
                                                     graph->vertexCount, graph->edgeCount );
             CUT_CHECK_ERROR("CUDA_SSSP_KERNEL1");
 
-            CUDA_SSSP_KERNEL2<<< grid, threads >>>( vertexArrayDevice, edgeArrayDevice, weightArrayDevice,
+            CUDA_SSSP_KERNEL2<<< grid, threads, sizeof(unsigned char) * localWorkSize >>>( vertexArrayDevice, edgeArrayDevice, weightArrayDevice,
                                                     maskArrayDevice, costArrayDevice, updatingCostArrayDevice );
             CUT_CHECK_ERROR("CUDA_SSSP_KERNEL2");
 
-            cudaMemcpy( maskArrayHost, maskArrayDevice, sizeof(unsigned char) * graph->vertexCount, cudaMemcpyDeviceToHost );
+            cudaMemcpy( maskArrayHost, maskArrayDevice, sizeof(FrontierWord) * maskWordCount, cudaMemcpyDeviceToHost );
         }
 
         // Copy the result back
@@ -319,13 +340,9 @@ void runDijkstra( GraphData* graph, int *sourceVertices, float *outResultCosts,
     free (maskArrayHost);
 
     // Free all the buffers
-    cutilSafeCall(cudaFree(vertexArrayDevice));
-    cutilSafeCall(cudaFree(edgeArrayDevice));
-    cutilSafeCall(cudaFree(weightArrayDevice));
-    cutilSafeCall(cudaFree(maskArrayDevice));
-    cutilSafeCall(cudaFree(costArrayDevice));
-    cutilSafeCall(cudaFree(updatingCostArrayDevice));
-    cutilSafeCall(cudaFree(infinityArrayDevice));
+    freeCUDABuffers( graph, vertexArrayDevice, edgeArrayDevice, weightArrayDevice,
+                     maskArrayDevice, costArrayDevice, updatingCostArrayDevice,
+                     infinityArrayDevice, globalWorkSize);
 }
 
 
@@ -337,8 +354,8 @@ void runDijkstra( GraphData* graph, int *sourceVertices, float *outResultCosts,
 /// it will compute is given by numResults.
 ///
 /// This function will run the algorithm on as many GPUs as is available.  It will
-/// create N threads, one for each GPU, and chunk the workload up to perform
-/// (numResults / N) searches per GPU.
+/// create N threads, one for each GPU, which take chunks of the sources from a
+/// shared queue (see runSSSPMultiBackend()).
 ///
 /// \param graph Structure containing the vertex, edge, and weight arra
 ///              for the input graph
@@ -366,147 +383,16 @@ void runDijkstraMultiGPU( GraphData* graph, int *sourceVertices,
         return;
     }
 
-    GPUPlan *gpuPlans = (GPUPlan*) malloc(sizeof(GPUPlan) * numGPUs);
-    CUTThread *threadIDs = (CUTThread*) malloc(sizeof(CUTThread) * numGPUs);
-
-    // Divide the workload out per GPU
-    int resultsPerGPU = numResults / numGPUs;
-
-    int offset = 0;
-
+    std::vector<SSSPBackend*> backends;
     for (int i = 0; i < numGPUs; i++)
     {
-        gpuPlans[i].device = i;
-        gpuPlans[i].graph = graph;
-        gpuPlans[i].sourceVertices = &sourceVertices[offset];
-        gpuPlans[i].outResultCosts = &outResultCosts[offset * graph->vertexCount];
-        gpuPlans[i].numResults = resultsPerGPU;
-
-        offset += resultsPerGPU;
+        backends.push_back(createCUDABackend(i));
     }
 
-    // Add any remaining work to the last GPU
-    if (offset < numResults)
-    {
-        gpuPlans[numGPUs - 1].numResults += (numResults - offset);
-    }
+    runSSSPMultiBackend(&backends[0], numGPUs, graph, sourceVertices, outResultCosts, numResults);
 
-    // Launch all the threads
     for (int i = 0; i < numGPUs; i++)
     {
-        threadIDs[i] = cutStartThread((CUT_THREADROUTINE)dijkstraThread, (void*)(gpuPlans + i));
+        delete backends[i];
     }
-
-    // Wait for the results from all threads
-    cutWaitForThreads(threadIDs, numGPUs);
-
-    free (gpuPlans);
-    free (threadIDs);
 }
-
-///
-/// Run Dijkstra's shortest path on the GraphData provided to this function.  This
-/// function will compute the shortest path distance from sourceVertices[n] ->
-/// endVertices[n] and store the cost in outResultCosts[n].  The number of results
-/// it will compute is given by numResults.
-///
-/// This is a CPU *REFERENCE* implementation for use as a fallback.
-///
-/// \param graph Structure containing the vertex, edge, and weight arra
-///              for the input graph
-/// \param startVertices Indices into the vertex array from which to
-///                      start the search
-/// \param outResultsCosts A pre-allocated array where the results for
-///                        each shortest path search will be written.
-///                        This must be sized numResults * graph->numVertices.
-/// \param numResults Should be the size of all three passed inarrays
-///
-void runDijkstraRef( GraphData* graph, int *sourceVertices,
-                     float *outResultCosts, int numResults )
-{
-
-    // Create the arrays needed for processing the algorithm
-    float *costArray = new float[graph->vertexCount];
-    float *updatingCostArray = new float[graph->vertexCount];
-    unsigned char *maskArray = new unsigned char[graph->vertexCount];
-
-    for (int i = 0; i < numResults; i++)
-    {
-        // Initialize the buffer for this run
-        for (int v = 0; v < graph->vertexCount; v++)
-        {
-            if (v == sourceVertices[i])
-            {
-                maskArray[v] = 1;
-                costArray[v] = 0.0;
-                updatingCostArray[v] = 0.0;
-            }
-            else
-            {
-                maskArray[v] = 0;
-                costArray[v] = FLT_MAX;
-                updatingCostArray[v] = FLT_MAX;
-            }
-        }
-
-        while(!maskArrayEmpty(maskArray, graph->vertexCount))
-        {
-            // Equivalent of OCL_SSSP_KERNEL1()
-            for (int tid = 0; tid < graph->vertexCount; tid++)
-            {
-                if ( maskArray[tid] != 0 )
-                {
-                    maskArray[tid] = 0;
-
-                    int edgeStart = graph->vertexArray[tid];
-                    int edgeEnd;
-                    if (tid + 1 < (graph->vertexCount))
-                    {
-                        edgeEnd = graph->vertexArray[tid + 1];
-                    }
-                    else
-                    {
-                        edgeEnd = graph->edgeCount;
-                    }
-
-                    for(int edge = edgeStart; edge < edgeEnd; edge++)
-                    {
-                        int nid = graph->edgeArray[edge];
-
-                        // One note here: whereas the paper specified weightArray[nid], I
-                        //  found that the correct thing to do was weightArray[edge].  I think
-                        //  this was a typo in the paper.  Either that, or I misunderstood
-                        //  the data structure.
-                        if (updatingCostArray[nid] > (costArray[tid] + graph->weightArray[edge]))
-                        {
-                            updatingCostArray[nid] = (costArray[tid] + graph->weightArray[edge]);
-                        }
-                    }
-                }
-            }
-
-            // Equivalent of OCL_SSSP_KERNEL2()
-            for (int tid = 0; tid < graph->vertexCount; tid++)
-            {
-                if (costArray[tid] > updatingCostArray[tid])
-                {
-                    costArray[tid] = updatingCostArray[tid];
-                    maskArray[tid] = 1;
-                }
-
-                updatingCostArray[tid] = costArray[tid];
-            }
-        }
-
-        // Copy the result back
-        memcpy(&outResultCosts[i * graph->vertexCount], costArray, sizeof(float) * graph->vertexCount);
-    }
-
-    // Free temporary computation buffers
-    delete [] costArray;
-    delete [] updatingCostArray;
-    delete [] maskArray;
-}
-
-
-
@@ -17,32 +17,8 @@
 #ifndef DIJKSTRA_KERNEL_H
 #define DIJKSTRA_KERNEL_H
 
-///
-//  Types
-//
-//
-//  This data structure and algorithm implementation is based on
-//  Accelerating large graph algorithms on the GPU using CUDA by
-//  Parwan Harish and P.J. Narayanan
-//
-typedef struct
-{
-    // (V) This contains a pointer to the edge list for each vertex
-    int *vertexArray;
-
-    // Vertex count
-    int vertexCount;
-
-    // (E) This contains pointers to the vertices that each edge is attached to
-    int *edgeArray;
-
-    // Edge count
-    int edgeCount;
-
-    // (W) Weight array
-    float *weightArray;
-
-} GraphData;
+#include <dijkstraGraph.h>
+#include <dijkstraBackend.h>
 
 ///
 /// Run Dijkstra's shortest path on the GraphData provided to this function.  This
@@ -72,8 +48,8 @@ void runDijkstra( GraphData* graph, int *sourceVertices, float *outResultCosts,
 /// it will compute is given by numResults.
 ///
 /// This function will run the algorithm on as many GPUs as is available.  It will
-/// create N threads, one for each GPU, and chunk the workload up to perform
-/// (numResults / N) searches per GPU.
+/// create N threads, one for each GPU, which take chunks of the sources from a
+/// shared queue (see runSSSPMultiBackend()).
 ///
 /// \param graph Structure containing the vertex, edge, and weight arra
 ///              for the input graph
@@ -89,23 +65,15 @@ void runDijkstra( GraphData* graph, int *sourceVertices, float *outResultCosts,
 void runDijkstraMultiGPU( GraphData* graph, int *sourceVertices, float *outResultCosts, int numResults );
 
 ///
-/// Run Dijkstra's shortest path on the GraphData provided to this function.  This
-/// function will compute the shortest path distance from sourceVertices[n] ->
-/// endVertices[n] and store the cost in outResultCosts[n].  The number of results
-/// it will compute is given by numResults.
+/// Create an SSSPBackend for one CUDA device
 ///
-/// This is a CPU *REFERENCE* implementation for use as a fallback.
+/// \param device CUDA device ordinal
 ///
-/// \param graph Structure containing the vertex, edge, and weight arra
-///              for the input graph
-/// \param startVertices Indices into the vertex array from which to
-///                      start the search
-/// \param outResultsCosts A pre-allocated array where the results for
-///                        each shortest path search will be written.
-///                        This must be sized numResults * graph->numVertices.
-/// \param numResults Should be the size of all three passed inarrays
+SSSPBackend *createCUDABackend( int device );
+
+///
+/// Register one backend per CUDA device, named cuda<n>
 ///
-void runDijkstraRef( GraphData* graph, int *sourceVertices,
-                     float *outResultCosts, int numResults );
+void registerCUDABackends();
 
 #endif // DIJKSTRA_KERNEL_H
@@ -16,29 +16,84 @@
 //
 
 ///
-/// This is part 1 of the Kernel from Algorithm 4 in the paper
+//  The mask array is a bitmap holding one bit per vertex: vertex v is bit (v & 31)
+//  of word (v >> 5).  All 32 work-items of a warp/wavefront read the same word.
+//
+#define MASK_WORD_BITS  32
+#define MASK_WORD_SHIFT 5
+#define MASK_WORD_MASK  31
+
+///
+//  Specialization.  The host may build this file with -D options describing the
+//  graph and launch, which turns runtime values into compile-time constants:
+//
+//      VERTEX_COUNT    number of vertices, replaces the vertexCount argument
+//      EDGE_COUNT      number of edges, replaces the edgeCount argument
+//      LOCAL_SIZE      work-group size, required via reqd_work_group_size
+//      WEIGHT_T        type of the weight array (default float)
+//      UNIFORM_DEGREE  every vertex has this many edges, vertex v owns edges
+//                      [v * UNIFORM_DEGREE, (v + 1) * UNIFORM_DEGREE) and the
+//                      vertex array is not read
+//
+//  Without any of them the file builds the generic kernels, which the host
+//  falls back to if a specialized build fails.
+//
+#ifdef VERTEX_COUNT
+#define SSSP_VERTEX_COUNT VERTEX_COUNT
+#else
+#define SSSP_VERTEX_COUNT vertexCount
+#endif
+
+#ifdef EDGE_COUNT
+#define SSSP_EDGE_COUNT EDGE_COUNT
+#else
+#define SSSP_EDGE_COUNT edgeCount
+#endif
+
+#ifdef LOCAL_SIZE
+#define SSSP_WORK_GROUP __attribute__((reqd_work_group_size(LOCAL_SIZE, 1, 1)))
+#define SSSP_LOCAL_SIZE LOCAL_SIZE
+#else
+#define SSSP_WORK_GROUP
+#define SSSP_LOCAL_SIZE get_local_size(0)
+#endif
+
+#ifndef WEIGHT_T
+#define WEIGHT_T float
+#endif
+
+///
+/// This is part 1 of the Kernel from Algorithm 4 in the paper.  The mask bit is
+/// not cleared here, OCL_SSSP_KERNEL2 rewrites every mask word with the vertices
+/// for the next iteration.
 ///
-__kernel  void OCL_SSSP_KERNEL1(__global int *vertexArray, __global int *edgeArray, __global float *weightArray,
-                               __global int *maskArray, __global float *costArray, __global float *updatingCostArray,
-                               int vertexCount, int edgeCount )
+__kernel SSSP_WORK_GROUP
+void OCL_SSSP_KERNEL1(__global int *vertexArray, __global int *edgeArray, __global WEIGHT_T *weightArray,
+                      __global uint *maskArray, __global float *costArray, __global float *updatingCostArray,
+                      int vertexCount, int edgeCount )
 {
     // access thread id
     int tid = get_global_id(0);
 
-    if ( maskArray[tid] != 0 )
+    if ( (maskArray[tid >> MASK_WORD_SHIFT] & (1u << (tid & MASK_WORD_MASK))) != 0 )
     {
-        maskArray[tid] = 0;
+#ifdef UNIFORM_DEGREE
+        int edgeStart = tid * UNIFORM_DEGREE;
+        int edgeEnd = edgeStart + UNIFORM_DEGREE;
 
+        #pragma unroll
+#else
         int edgeStart = vertexArray[tid];
         int edgeEnd;
-        if (tid + 1 < (vertexCount))
+        if (tid + 1 < (SSSP_VERTEX_COUNT))
         {
             edgeEnd = vertexArray[tid + 1];
         }
         else
         {
-            edgeEnd = edgeCount;
+            edgeEnd = SSSP_EDGE_COUNT;
         }
+#endif
 
         for(int edge = edgeStart; edge < edgeEnd; edge++)
         {
@@ -56,33 +111,99 @@ __kernel  void OCL_SSSP_KERNEL1(__global int *vertexArray, __global int *edgeArr
     }
 }
 
+///
+/// Pull variant of OCL_SSSP_KERNEL1.  Every vertex takes the cheapest of its
+/// in-edges whose source is in the frontier, so each work-item writes only its
+/// own updating cost.  The arrays hold the reverse graph: the in-edges of a
+/// vertex with their source vertex and weight.
+///
+__kernel SSSP_WORK_GROUP
+void OCL_SSSP_PULL(__global int *reverseVertexArray, __global int *reverseEdgeArray,
+                   __global WEIGHT_T *reverseWeightArray, __global uint *maskArray,
+                   __global float *costArray, __global float *updatingCostArray,
+                   int vertexCount, int edgeCount )
+{
+    // access thread id
+    int tid = get_global_id(0);
+
+    if (tid >= (SSSP_VERTEX_COUNT))
+    {
+        return;
+    }
+
+    int edgeStart = reverseVertexArray[tid];
+    int edgeEnd;
+    if (tid + 1 < (SSSP_VERTEX_COUNT))
+    {
+        edgeEnd = reverseVertexArray[tid + 1];
+    }
+    else
+    {
+        edgeEnd = SSSP_EDGE_COUNT;
+    }
+
+    float best = updatingCostArray[tid];
+    for(int edge = edgeStart; edge < edgeEnd; edge++)
+    {
+        int sid = reverseEdgeArray[edge];
+        if ( (maskArray[sid >> MASK_WORD_SHIFT] & (1u << (sid & MASK_WORD_MASK))) != 0 )
+        {
+            best = min(best, costArray[sid] + reverseWeightArray[edge]);
+        }
+    }
+
+    updatingCostArray[tid] = best;
+}
+
 ///
 /// This is part 2 of the Kernel from Algorithm 5 in the paper.  The only modification
 /// is to stop the search after hitting endVertex
 ///
-__kernel  void OCL_SSSP_KERNEL2(__global int *vertexArray, __global int *edgeArray, __global float *weightArray,
-                                __global int *maskArray, __global float *costArray, __global float *updatingCostArray,
-                                int vertexCount)
+/// The work-group collects one flag per vertex in local memory and the first
+/// (local size / 32) work-items pack them into mask words, so the mask is written
+/// with whole-word stores and no atomics.  The local size must be a multiple of 32
+/// and changedFlags must hold one uchar per work-item.
+///
+__kernel SSSP_WORK_GROUP
+void OCL_SSSP_KERNEL2(__global int *vertexArray, __global int *edgeArray, __global WEIGHT_T *weightArray,
+                      __global uint *maskArray, __global float *costArray, __global float *updatingCostArray,
+                      int vertexCount, __local uchar *changedFlags)
 {
     // access thread id
     int tid = get_global_id(0);
+    int lid = get_local_id(0);
 
-
+    uchar changed = 0;
     if (costArray[tid] > updatingCostArray[tid])
     {
         costArray[tid] = updatingCostArray[tid];
-        maskArray[tid] = 1;
+        changed = 1;
     }
 
     updatingCostArray[tid] = costArray[tid];
+
+    changedFlags[lid] = changed;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    int wordsPerGroup = SSSP_LOCAL_SIZE >> MASK_WORD_SHIFT;
+    if (lid < wordsPerGroup)
+    {
+        uint word = 0;
+        for (int bit = 0; bit < MASK_WORD_BITS; bit++)
+        {
+            word |= ((uint) changedFlags[(lid << MASK_WORD_SHIFT) + bit]) << bit;
+        }
+        maskArray[get_group_id(0) * wordsPerGroup + lid] = word;
+    }
 }
 
 
 ///
 /// Kernel to initialize buffers
 ///
-__kernel void initializeBuffers( __global int *maskArray, __global float *costArray, __global float *updatingCostArray,
-                                 int sourceVertex, int vertexCount )
+__kernel SSSP_WORK_GROUP
+void initializeBuffers( __global uint *maskArray, __global float *costArray, __global float *updatingCostArray,
+                       int sourceVertex, int vertexCount )
 {
     // access thread id
     int tid = get_global_id(0);
@@ -90,15 +211,355 @@ __kernel void initializeBuffers( __global int *maskArray, __global float *costAr
 
     if (sourceVertex == tid)
     {
-        maskArray[tid] = 1;
         costArray[tid] = 0.0;
         updatingCostArray[tid] = 0.0;
     }
     else
     {
-        maskArray[tid] = 0;
         costArray[tid] = FLT_MAX;
         updatingCostArray[tid] = FLT_MAX;
     }
 
+    // The first work-item of each group of 32 owns the mask word
+    if ((tid & MASK_WORD_MASK) == 0)
+    {
+        maskArray[tid >> MASK_WORD_SHIFT] = ((sourceVertex >> MASK_WORD_SHIFT) == (tid >> MASK_WORD_SHIFT)) ?
+                                            (1u << (sourceVertex & MASK_WORD_MASK)) : 0;
+    }
+}
+
+///
+//  Persistent-threads engine.  The whole search runs in one launch of
+//  OCL_SSSP_PERSISTENT over a fixed number of work-groups, which must all be
+//  resident at once (the host launches one per compute unit).  Vertices whose
+//  cost dropped are kept in a global ring queue; each work-group repeatedly
+//  claims up to one vertex per work-item from the head, relaxes their edges
+//  with atomic_min on the cost bits and appends the improved neighbors at the
+//  tail.  Costs are non-negative, so their float bits order like ints.
+//
+//  counters[QUEUE_PENDING] counts vertices enqueued but not yet relaxed.  It
+//  is raised before a vertex is appended and lowered only after the vertex's
+//  own neighbors were appended, so it is zero exactly when the search is done.
+//
+//  inQueue keeps a vertex in the ring at most once.  With a ring of more than
+//  vertexCount slots (a power of two, queueMask + 1) the slot a work-item
+//  appends to was therefore claimed already, though its consumer may not have
+//  taken the old entry yet; the producer waits for that.
+//
+#define QUEUE_HEAD    0
+#define QUEUE_TAIL    1
+#define QUEUE_PENDING 2
+
+///
+/// Run one search to completion
+///
+/// \param claim Two uints of local memory for the work-group's claim
+///
+__kernel SSSP_WORK_GROUP
+void OCL_SSSP_PERSISTENT(__global int *vertexArray, __global int *edgeArray, __global WEIGHT_T *weightArray,
+                         volatile __global int *costBits, volatile __global int *inQueue,
+                         volatile __global int *queue, volatile __global uint *counters,
+                         uint queueMask, int vertexCount, int edgeCount, __local uint *claim)
+{
+    int lid = get_local_id(0);
+
+    for (;;)
+    {
+        // The first work-item claims a range of the queue for the work-group
+        if (lid == 0)
+        {
+            uint first = 0;
+            uint count = 0;
+            for (;;)
+            {
+                uint head = counters[QUEUE_HEAD];
+                uint tail = counters[QUEUE_TAIL];
+                int available = (int) (tail - head);
+                if (available > 0)
+                {
+                    uint taken = min((uint) available, (uint) SSSP_LOCAL_SIZE);
+                    if (atomic_cmpxchg(&counters[QUEUE_HEAD], head, head + taken) == head)
+                    {
+                        first = head;
+                        count = taken;
+                        break;
+                    }
+                }
+                else if (counters[QUEUE_PENDING] == 0)
+                {
+                    break;
+                }
+            }
+            claim[0] = first;
+            claim[1] = count;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        uint first = claim[0];
+        uint count = claim[1];
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        if (count == 0)
+        {
+            return;
+        }
+
+        if (lid < count)
+        {
+            // The slot may have been reserved by another work-group that has
+            // not written it yet
+            int vertex;
+            volatile __global int *slot = &queue[(first + lid) & queueMask];
+            while ((vertex = atomic_xchg(slot, -1)) < 0)
+            {
+            }
+
+            // Improvements from here on queue the vertex again
+            atomic_xchg(&inQueue[vertex], 0);
+            float cost = as_float(costBits[vertex]);
+
+            int edgeStart = vertexArray[vertex];
+            int edgeEnd;
+            if (vertex + 1 < (SSSP_VERTEX_COUNT))
+            {
+                edgeEnd = vertexArray[vertex + 1];
+            }
+            else
+            {
+                edgeEnd = SSSP_EDGE_COUNT;
+            }
+
+            for(int edge = edgeStart; edge < edgeEnd; edge++)
+            {
+                int nid = edgeArray[edge];
+                int newCost = as_int(cost + weightArray[edge]);
+                if (newCost < atomic_min(&costBits[nid], newCost) &&
+                    atomic_xchg(&inQueue[nid], 1) == 0)
+                {
+                    atomic_inc(&counters[QUEUE_PENDING]);
+                    uint tail = atomic_inc(&counters[QUEUE_TAIL]);
+                    while (atomic_cmpxchg(&queue[tail & queueMask], -1, nid) != -1)
+                    {
+                    }
+                }
+            }
+
+            atomic_dec(&counters[QUEUE_PENDING]);
+        }
+    }
+}
+
+///
+/// Reset the persistent engine's buffers for a search from sourceVertex
+///
+__kernel SSSP_WORK_GROUP
+void initializePersistent(volatile __global int *costBits, volatile __global int *inQueue,
+                          volatile __global int *queue, volatile __global uint *counters,
+                          uint queueMask, int sourceVertex, int vertexCount)
+{
+    // access thread id
+    int tid = get_global_id(0);
+
+    if (tid < (SSSP_VERTEX_COUNT))
+    {
+        costBits[tid] = (tid == sourceVertex) ? as_int(0.0f) : as_int(FLT_MAX);
+        inQueue[tid] = (tid == sourceVertex) ? 1 : 0;
+    }
+
+    // The ring may be larger than the NDRange
+    for (uint slot = tid; slot <= queueMask; slot += get_global_size(0))
+    {
+        queue[slot] = (slot == 0) ? sourceVertex : -1;
+    }
+
+    if (tid == 0)
+    {
+        counters[QUEUE_HEAD] = 0;
+        counters[QUEUE_TAIL] = 1;
+        counters[QUEUE_PENDING] = 1;
+    }
+}
+
+///
+//  Batched small graphs.  Many graphs are packed one after the other into
+//  one set of CSR arrays; graphVertexOffsets[g] and graphEdgeOffsets[g] give
+//  where graph g starts (with one extra entry for the end), and the vertex
+//  and edge arrays hold graph-local indices.  Each work-group runs one
+//  (graph, source) query to completion with its costs and frontiers in local
+//  memory, so a whole batch of queries is one launch.
+//
+
+///
+/// Run the query of this work-group and write its costs to
+/// resultCosts[resultOffsets[query]...]
+///
+/// \param costBits One int of local memory per vertex of the largest graph
+/// \param frontiers Two uchars of local memory per vertex of the largest graph
+/// \param active Three ints of local memory
+///
+__kernel SSSP_WORK_GROUP
+void OCL_SSSP_BATCHED(__global int *graphVertexOffsets, __global int *graphEdgeOffsets,
+                      __global int *vertexArray, __global int *edgeArray, __global WEIGHT_T *weightArray,
+                      __global int *queryGraphs, __global int *querySources,
+                      __global int *resultOffsets, __global float *resultCosts,
+                      __local int *costBits, __local uchar *frontiers, __local int *active,
+                      int maxVertexCount)
+{
+    int query = get_group_id(0);
+    int lid = get_local_id(0);
+
+    int graph = queryGraphs[query];
+    int sourceVertex = querySources[query];
+    int vertexBase = graphVertexOffsets[graph];
+    int vertexCount = graphVertexOffsets[graph + 1] - vertexBase;
+    int edgeBase = graphEdgeOffsets[graph];
+    int edgeCount = graphEdgeOffsets[graph + 1] - edgeBase;
+
+    __local uchar *frontier = frontiers;
+    __local uchar *nextFrontier = frontiers + maxVertexCount;
+
+    for (int vertex = lid; vertex < vertexCount; vertex += SSSP_LOCAL_SIZE)
+    {
+        costBits[vertex] = (vertex == sourceVertex) ? as_int(0.0f) : as_int(FLT_MAX);
+        frontier[vertex] = (vertex == sourceVertex) ? 1 : 0;
+        nextFrontier[vertex] = 0;
+    }
+    if (lid < 3)
+    {
+        active[lid] = 0;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Iteration i raises active[i % 3] when it queues a vertex and clears
+    // active[(i + 1) % 3], which every work-item read before iteration i - 1
+    // ended, so one barrier per iteration is enough
+    for (int iteration = 0; ; iteration++)
+    {
+        if (lid == 0)
+        {
+            active[(iteration + 1) % 3] = 0;
+        }
+
+        for (int vertex = lid; vertex < vertexCount; vertex += SSSP_LOCAL_SIZE)
+        {
+            if (frontier[vertex] == 0)
+            {
+                continue;
+            }
+            frontier[vertex] = 0;
+
+            // Costs are non-negative, so their float bits order like ints
+            float cost = as_float(costBits[vertex]);
+
+            int edgeStart = edgeBase + vertexArray[vertexBase + vertex];
+            int edgeEnd = (vertex + 1 < vertexCount) ? edgeBase + vertexArray[vertexBase + vertex + 1] :
+                                                       edgeBase + edgeCount;
+
+            for(int edge = edgeStart; edge < edgeEnd; edge++)
+            {
+                int nid = edgeArray[edge];
+                int newCost = as_int(cost + weightArray[edge]);
+                if (newCost < atomic_min(&costBits[nid], newCost))
+                {
+                    nextFrontier[nid] = 1;
+                    active[iteration % 3] = 1;
+                }
+            }
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        if (active[iteration % 3] == 0)
+        {
+            break;
+        }
+
+        __local uchar *swap = frontier;
+        frontier = nextFrontier;
+        nextFrontier = swap;
+    }
+
+    __global float *costs = &resultCosts[resultOffsets[query]];
+    for (int vertex = lid; vertex < vertexCount; vertex += SSSP_LOCAL_SIZE)
+    {
+        costs[vertex] = as_float(costBits[vertex]);
+    }
+}
+
+///
+//  Edge checks of the certificate of one result row, see dijkstraVerify.h;
+//  the slack is that of ssspVerifySlack().  Every work-item checks the
+//  in-edges of one vertex and counts its failures in counters;
+//  counters[VERIFY_FIRST_BAD] receives the lowest failing vertex and must
+//  start at INT_MAX, the others at 0.
+//
+#define VERIFY_SOURCE_ERRORS    0
+#define VERIFY_EDGE_VIOLATIONS  1
+#define VERIFY_UNTIGHT          2
+#define VERIFY_INVALID          3
+#define VERIFY_FIRST_BAD        4
+
+__kernel SSSP_WORK_GROUP
+void OCL_SSSP_VERIFY(__global int *reverseVertexArray, __global int *reverseEdgeArray,
+                     __global WEIGHT_T *reverseWeightArray, __global float *costArray,
+                     __global int *counters, int sourceVertex, float absoluteTolerance,
+                     float ulpTolerance, int vertexCount, int edgeCount)
+{
+    int tid = get_global_id(0);
+
+    if (tid >= (SSSP_VERTEX_COUNT))
+    {
+        return;
+    }
+
+    float cost = costArray[tid];
+    int failure = -1;
+    if (isnan(cost) || cost < 0.0f)
+    {
+        failure = VERIFY_INVALID;
+    }
+    else if (tid == sourceVertex)
+    {
+        failure = (cost != 0.0f) ? VERIFY_SOURCE_ERRORS : -1;
+    }
+    else
+    {
+        int edgeStart = reverseVertexArray[tid];
+        int edgeEnd = (tid + 1 < (SSSP_VERTEX_COUNT)) ? reverseVertexArray[tid + 1] : (SSSP_EDGE_COUNT);
+
+        int violations = 0;
+        bool tight = false;
+        for (int edge = edgeStart; edge < edgeEnd; edge++)
+        {
+            float fromCost = costArray[reverseEdgeArray[edge]];
+            if (fromCost == FLT_MAX)
+            {
+                continue;
+            }
+
+            float bound = fromCost + reverseWeightArray[edge];
+            float magnitude = (cost == FLT_MAX) ? bound : fmax(cost, bound);
+            float slack = absoluteTolerance + ulpTolerance * magnitude;
+            if (cost > bound + slack)
+            {
+                violations++;
+            }
+            else if (cost >= bound - slack)
+            {
+                tight = true;
+            }
+        }
+
+        if (violations > 0)
+        {
+            atomic_add(&counters[VERIFY_EDGE_VIOLATIONS], violations);
+            atomic_min(&counters[VERIFY_FIRST_BAD], tid);
+        }
+        failure = (cost != FLT_MAX && !tight) ? VERIFY_UNTIGHT : -1;
+    }
+
+    if (failure >= 0)
+    {
+        atomic_inc(&counters[failure]);
+        atomic_min(&counters[VERIFY_FIRST_BAD], tid);
+    }
 }
@@ -26,6 +26,23 @@
 #include <oclUtils.h>
 #include <pthread.h>
 #include <sstream>
+#include <string>
+#include <vector>
+#include <dijkstraAsync.h>
+#include <dijkstraCluster.h>
+#include <dijkstraComponents.h>
+#include <dijkstraContract.h>
+#include <dijkstraDirection.h>
+#include <dijkstraHubLabels.h>
+#include <dijkstraLoad.h>
+#include <dijkstraMemory.h>
+#include <dijkstraMetrics.h>
+#include <dijkstraOracle.h>
+#include <dijkstraResidency.h>
+#include <dijkstraSharedGraph.h>
+#include <dijkstraSnapshot.h>
+#include <dijkstraVerify.h>
+#include <dijkstraWorkload.h>
 #include "oclDijkstraKernel.h"
 
 ///
@@ -34,6 +51,103 @@
 
 //#define CITY_DATA
 
+///
+//  Constants
+//
+
+// Sources per batch submitted by -async
+const int ASYNC_BATCH_SIZE = 16;
+
+// Sources whose exact costs -oracle compares the estimates against
+const int ORACLE_ERROR_SAMPLES = 16;
+
+// Estimates -oracle times
+const int ORACLE_TIMED_QUERIES = 1000000;
+
+// Workers -coordinator reports on
+const int CLUSTER_REPORTED_WORKERS = 64;
+
+// Sources per request -regions sends to one regional graph
+const int REGION_BATCH_SIZE = 16;
+
+// Threads -verify checks the results on
+const int VERIFY_THREADS = 4;
+
+// Runs of a -loadsweep reported per backend configuration
+const int LOAD_REPORTED_STEPS = 64;
+
+///
+//  Types
+//
+
+//
+//  What the command line asks the driver to run, see parseCommandLineArgs()
+//
+typedef struct
+{
+    // -cpu, -gpu, -multigpu, -cpugpu, -ref and -async runs, the -backend run
+    // on the -contract or -components graph, and the -warmstart comparison
+    bool doCPU;
+    bool doGPU;
+    bool doMultiGPU;
+    bool doCPUGPU;
+    bool doRef;
+    bool doAsync;
+    bool doContract;
+    bool doComponents;
+    bool doWarmStart;
+
+    // -sources, and the graph -verts and -edges generate or -road lays out
+    int numSources;
+    int generateVerts;
+    int generateEdgesPerVert;
+    int roadSegments;
+
+    // -oracle, -oraclefile, -hublabels, -hubfile and -snapshot
+    int oracleLandmarks;
+    char *oracleFileName;
+    int hubLabelThreads;
+    char *hubLabelFileName;
+    char *snapshotFileName;
+
+    // -checkpoint, -coordinator and -worker
+    char *checkpointDirectory;
+    int coordinatorPort;
+    char *workerAddress;
+
+    // -batchgraphs, -regions, -residentmb and -sizeaware
+    int batchGraphs;
+    int regionCount;
+    int residentBudgetMB;
+    bool doSizeAwareEviction;
+
+    // -interactive, -record, -replay and -replayspeed
+    int interactiveQueries;
+    char *recordFileName;
+    char *replayFileName;
+    float replaySpeed;
+
+    // -loadrate, -loadtime, -loadsources, -bursty, -loadsweep and -loadp99
+    LoadSpec loadSpec;
+    bool doLoad;
+    bool doLoadSweep;
+    float loadP99Limit;
+
+    // -metricsport, -metricsfile, -hostlimitmb, -devicelimitmb and -memreport
+    int metricsPort;
+    char *metricsFileName;
+    int hostLimitMB;
+    int deviceLimitMB;
+    bool doMemoryReport;
+
+    // -verify, -verifyocl, -shmgraph and -backend
+    bool doVerify;
+    bool doVerifyOCL;
+    char *sharedGraphName;
+    char *backendName;
+
+} DriverOptions;
+
 ///
 //  Some test data
 //      http://en.literateprograms.org/Dijkstra%27s_algorithm_%28Scala%29
@@ -128,64 +242,749 @@ float weightArray[] =
 ////////////////////////////////////////////////////////////////////////////////
 
 ///
-//  Generate a random graph
+//  Defaults of the options the command line does not set
+//
+void initDriverOptions(DriverOptions *options)
+{
+    memset(options, 0, sizeof(DriverOptions));
+    options->numSources = 100;
+    options->generateVerts = 100000;
+    options->generateEdgesPerVert = 10;
+    options->replaySpeed = 1.0f;
+    initLoadSpec(&options->loadSpec);
+    options->loadP99Limit = 1.0f;
+}
+
+///
+//  Parse command line arguments into options, which initDriverOptions() set
+//  to the defaults
+//
+void parseCommandLineArgs(int argc, const char **argv, DriverOptions *options)
+{
+    options->doCPU = shrCheckCmdLineFlag(argc, argv, "cpu");
+    options->doGPU = shrCheckCmdLineFlag(argc, argv, "gpu");
+    options->doMultiGPU = shrCheckCmdLineFlag(argc, argv, "multigpu");
+    options->doCPUGPU = shrCheckCmdLineFlag(argc, argv, "cpugpu");
+    options->doRef = shrCheckCmdLineFlag(argc, argv, "ref");
+    options->doAsync = shrCheckCmdLineFlag(argc, argv, "async");
+    options->doContract = shrCheckCmdLineFlag(argc, argv, "contract");
+    options->doComponents = shrCheckCmdLineFlag(argc, argv, "components");
+    options->doWarmStart = shrCheckCmdLineFlag(argc, argv, "warmstart");
+    shrGetCmdLineArgumenti(argc, argv, "sources", &options->numSources);
+    shrGetCmdLineArgumenti(argc, argv, "verts", &options->generateVerts);
+    shrGetCmdLineArgumenti(argc, argv, "edges", &options->generateEdgesPerVert);
+    shrGetCmdLineArgumenti(argc, argv, "road", &options->roadSegments);
+    shrGetCmdLineArgumenti(argc, argv, "oracle", &options->oracleLandmarks);
+    shrGetCmdLineArgumentstr(argc, argv, "oraclefile", &options->oracleFileName);
+    shrGetCmdLineArgumenti(argc, argv, "hublabels", &options->hubLabelThreads);
+    shrGetCmdLineArgumentstr(argc, argv, "hubfile", &options->hubLabelFileName);
+    shrGetCmdLineArgumentstr(argc, argv, "snapshot", &options->snapshotFileName);
+    shrGetCmdLineArgumentstr(argc, argv, "checkpoint", &options->checkpointDirectory);
+    shrGetCmdLineArgumenti(argc, argv, "coordinator", &options->coordinatorPort);
+    shrGetCmdLineArgumentstr(argc, argv, "worker", &options->workerAddress);
+    shrGetCmdLineArgumenti(argc, argv, "batchgraphs", &options->batchGraphs);
+    shrGetCmdLineArgumenti(argc, argv, "regions", &options->regionCount);
+    shrGetCmdLineArgumenti(argc, argv, "residentmb", &options->residentBudgetMB);
+    options->doSizeAwareEviction = shrCheckCmdLineFlag(argc, argv, "sizeaware");
+    shrGetCmdLineArgumenti(argc, argv, "interactive", &options->interactiveQueries);
+    shrGetCmdLineArgumentstr(argc, argv, "record", &options->recordFileName);
+    shrGetCmdLineArgumentstr(argc, argv, "replay", &options->replayFileName);
+    shrGetCmdLineArgumentf(argc, argv, "replayspeed", &options->replaySpeed);
+
+    // Open-loop load and its arrival process
+    float loadRate = 0.0f;
+    float loadTime = (float) options->loadSpec.duration;
+    shrGetCmdLineArgumentf(argc, argv, "loadrate", &loadRate);
+    options->doLoad = loadRate > 0.0f;
+    options->doLoadSweep = shrCheckCmdLineFlag(argc, argv, "loadsweep");
+    shrGetCmdLineArgumentf(argc, argv, "loadtime", &loadTime);
+    shrGetCmdLineArgumentf(argc, argv, "loadp99", &options->loadP99Limit);
+    shrGetCmdLineArgumenti(argc, argv, "loadsources", &options->loadSpec.sourcesPerQuery);
+    if (loadRate > 0.0f)
+    {
+        options->loadSpec.rate = loadRate;
+    }
+    options->loadSpec.duration = loadTime;
+    options->loadSpec.arrivals = shrCheckCmdLineFlag(argc, argv, "bursty") ? LOAD_ARRIVAL_BURSTY :
+                                                                             LOAD_ARRIVAL_POISSON;
+    shrGetCmdLineArgumenti(argc, argv, "metricsport", &options->metricsPort);
+    shrGetCmdLineArgumentstr(argc, argv, "metricsfile", &options->metricsFileName);
+    shrGetCmdLineArgumenti(argc, argv, "hostlimitmb", &options->hostLimitMB);
+    shrGetCmdLineArgumenti(argc, argv, "devicelimitmb", &options->deviceLimitMB);
+    options->doMemoryReport = shrCheckCmdLineFlag(argc, argv, "memreport");
+    options->doVerifyOCL = shrCheckCmdLineFlag(argc, argv, "verifyocl");
+    options->doVerify = shrCheckCmdLineFlag(argc, argv, "verify") || options->doVerifyOCL;
+    shrGetCmdLineArgumentstr(argc, argv, "shmgraph", &options->sharedGraphName);
+    shrGetCmdLineArgumentstr(argc, argv, "backend", &options->backendName);
+    setOCLKernelSpecialization(!shrCheckCmdLineFlag(argc, argv, "generic"));
+
+    // Push/pull switching and its thresholds
+    SSSPDirectionPolicy policy = getSSSPDirectionPolicy();
+    shrGetCmdLineArgumentf(argc, argv, "pullfactor", &policy.pullFactor);
+    shrGetCmdLineArgumentf(argc, argv, "pushfactor", &policy.pushFactor);
+    policy.logSwitches = shrCheckCmdLineFlag(argc, argv, "logdirection");
+    setSSSPDirectionPolicy(&policy);
+    setOCLDirectionSwitching(shrCheckCmdLineFlag(argc, argv, "pushpull"));
+    setOCLPersistentKernel(shrCheckCmdLineFlag(argc, argv, "persistent"));
+
+    // Hybrid host/device execution and its frontier thresholds
+    int hybridDeviceFrontier = 4096;
+    int hybridHostFrontier = 1024;
+    shrGetCmdLineArgumenti(argc, argv, "hybriddevice", &hybridDeviceFrontier);
+    shrGetCmdLineArgumenti(argc, argv, "hybridhost", &hybridHostFrontier);
+    setOCLHybrid(shrCheckCmdLineFlag(argc, argv, "hybrid"), hybridDeviceFrontier, hybridHostFrontier);
+}
+
+///
+//  Attach to the graph published under sharedGraphName by another worker, or
+//  generate it and publish it so that later workers can attach to it
+//
+bool loadSharedGraph(SharedGraph *sharedGraph, const char *sharedGraphName,
+                     int numVertices, int neighborsPerVertex)
+{
+    int numEdges = numVertices * neighborsPerVertex;
+    if (attachSharedGraph(sharedGraphName, numVertices, numEdges, sharedGraph))
+    {
+        shrLog("Attached to shared graph %s\n", sharedGraph->name);
+        return true;
+    }
+
+    GraphData generated;
+    generateRandomGraph(&generated, numVertices, neighborsPerVertex);
+
+    // Another worker may have published in the meantime, fall back to attaching
+    bool loaded = publishSharedGraph(sharedGraphName, &generated, sharedGraph) ||
+                  attachSharedGraph(sharedGraphName, numVertices, numEdges, sharedGraph);
+    if (loaded)
+    {
+        shrLog("Using shared graph %s\n", sharedGraph->name);
+    }
+
+    freeGraph(&generated);
+
+    return loaded;
+}
+
+///
+//  Log a run of every source outside an SSSPEngine as one bulk query, so that
+//  a recording holds the direct runs as well as the engine's batches.  Does
+//  nothing if recorder is NULL.
+//
+void recordDirectRun(WorkloadRecorder *recorder, const int *sourceVertArray, int numSources)
+{
+    if (recorder != NULL)
+    {
+        recordWorkloadQuery(recorder, WORKLOAD_QUERY_SSSP, SSSP_CLASS_BULK, 0, sourceVertArray, numSources, -1);
+    }
+}
+
+///
+//  Completion callback of the -async batches, counts finished batches
+//
+void onBatchFinished(void *userData)
+{
+    __sync_fetch_and_add((int*) userData, 1);
+}
+
+///
+//  Run the sources through an SSSPEngine over every registered backend.  All
+//  batches are submitted up front and complete on the engine's threads while
+//  this thread waits on the futures in submission order.  The batches are
+//  logged to recorder unless it is NULL.
 //
-void generateRandomGraph(GraphData *graph, int numVertices, int neighborsPerVertex)
+bool runAsync(const GraphData *graph, const int *sourceVertArray, float *results, int numSources,
+              WorkloadRecorder *recorder)
 {
-    graph->vertexCount = numVertices;
-    graph->vertexArray = (int*) malloc(graph->vertexCount * sizeof(int));
-    graph->edgeCount = numVertices * neighborsPerVertex;
-    graph->edgeArray = (int*)malloc(graph->edgeCount * sizeof(int));
-    graph->weightArray = (float*)malloc(graph->edgeCount * sizeof(float));
+    std::vector<SSSPBackend*> backends;
+    for (int i = 0; i < getSSSPBackendCount(); i++)
+    {
+        backends.push_back(getSSSPBackend(i));
+    }
 
-    for(int i = 0; i < graph->vertexCount; i++)
+    SSSPEngine engine;
+    if (backends.empty() || !engine.start(&backends[0], (int) backends.size(), graph))
     {
-        graph->vertexArray[i] = i * neighborsPerVertex;
+        shrLog("ERROR: no backend could load the graph\n");
+        return false;
     }
+    engine.setWorkloadRecorder(recorder);
 
-    for(int i = 0; i < graph->edgeCount; i++)
+    int batchesFinished = 0;
+    std::vector<SSSPFuture> futures;
+    for (int first = 0; first < numSources; first += ASYNC_BATCH_SIZE)
     {
-        graph->edgeArray[i] = (rand() % graph->vertexCount);
-        graph->weightArray[i] = (float)(rand() % 1000) / 1000.0f;
+        int count = (numSources - first < ASYNC_BATCH_SIZE) ? numSources - first : ASYNC_BATCH_SIZE;
+        futures.push_back(engine.submit(&sourceVertArray[first],
+                                        &results[(size_t) first * graph->vertexCount], count));
+        futures.back().then(onBatchFinished, &batchesFinished);
     }
+
+    bool succeeded = true;
+    for (size_t i = 0; i < futures.size(); i++)
+    {
+        succeeded = (futures[i].wait() == SSSP_REQUEST_COMPLETED) && succeeded;
+    }
+    shrLog("runAsync: %d batches finished on %d backends\n", batchesFinished, engine.getWorkerCount());
+
+    return succeeded;
 }
 
 ///
-//  Parse command line arguments
+//  Log the latency figures of one class of an SSSPEngine
 //
-void parseCommandLineArgs(int argc, const char **argv, bool &doCPU, bool &doGPU,
-                          bool &doMultiGPU, bool &doCPUGPU, bool &doRef,
-                          int *sourceVerts,
-                          int *generateVerts, int *generateEdgesPerVert)
+void logClassStats(const SSSPEngine &engine, SSSPRequestClass requestClass, const char *name)
 {
-    doCPU = shrCheckCmdLineFlag(argc, argv, "cpu");
-    doGPU = shrCheckCmdLineFlag(argc, argv, "gpu");
-    doMultiGPU = shrCheckCmdLineFlag(argc, argv, "multigpu");
-    doCPUGPU = shrCheckCmdLineFlag(argc, argv, "cpugpu");
-    doRef = shrCheckCmdLineFlag(argc, argv, "ref");
-    shrGetCmdLineArgumenti(argc, argv, "sources", sourceVerts);
-    shrGetCmdLineArgumenti(argc, argv, "verts", generateVerts);
-    shrGetCmdLineArgumenti(argc, argv, "edges", generateEdgesPerVert);
+    SSSPClassStats stats = engine.getClassStats(requestClass);
+    shrLog("  %-11s %lld completed, %lld chunks, latency mean %f p50 %f p95 %f p99 %f max %f s, "
+           "%lld over the %f s target\n", name, stats.completed, stats.chunks, stats.meanLatency,
+           stats.p50Latency, stats.p95Latency, stats.p99Latency, stats.maxLatency,
+           stats.sloMisses, engine.getClassPolicy().latencyTarget[requestClass]);
 }
 
+///
+//  Run the sources as one bulk job through an SSSPEngine over every registered
+//  backend while interactiveQueries single-source queries are issued one at a
+//  time, each waiting for the previous, and report the latency of both
+//  classes.  The queries are logged to recorder unless it is NULL.
+//
+bool runMixedClasses(const GraphData *graph, const int *sourceVertArray, float *results, int numSources,
+                     int interactiveQueries, WorkloadRecorder *recorder)
+{
+    std::vector<SSSPBackend*> backends;
+    for (int i = 0; i < getSSSPBackendCount(); i++)
+    {
+        backends.push_back(getSSSPBackend(i));
+    }
+
+    SSSPEngine engine;
+    if (backends.empty() || !engine.start(&backends[0], (int) backends.size(), graph))
+    {
+        shrLog("ERROR: no backend could load the graph\n");
+        return false;
+    }
+    engine.setWorkloadRecorder(recorder);
+
+    SSSPFuture bulk = engine.submit(sourceVertArray, results, numSources, 0, SSSP_CLASS_BULK);
+
+    bool succeeded = true;
+    float *queryCosts = (float*) trackedMalloc(MEMORY_RESULTS, sizeof(float) * graph->vertexCount);
+    for (int q = 0; q < interactiveQueries; q++)
+    {
+        int source = (int) ((long long) graph->vertexCount * q / interactiveQueries);
+        SSSPFuture query = engine.submit(&source, queryCosts, 1, 0, SSSP_CLASS_INTERACTIVE);
+        succeeded = (query.wait() == SSSP_REQUEST_COMPLETED) && succeeded;
+    }
+    succeeded = (bulk.wait() == SSSP_REQUEST_COMPLETED) && succeeded;
+    trackedFree(queryCosts);
+
+    shrLog("runMixedClasses: %d interactive queries during a %d source bulk job\n",
+           interactiveQueries, numSources);
+    logClassStats(engine, SSSP_CLASS_INTERACTIVE, "interactive");
+    logClassStats(engine, SSSP_CLASS_BULK, "bulk");
+
+    return succeeded;
+}
+
+///
+//  Replay a recorded workload over every registered backend at speed times
+//  the recorded rate (0 for as fast as possible) and report its latencies
+//
+bool runReplay(const GraphData *graph, const char *replayFileName, float speed)
+{
+    std::vector<SSSPBackend*> backends;
+    for (int i = 0; i < getSSSPBackendCount(); i++)
+    {
+        backends.push_back(getSSSPBackend(i));
+    }
+
+    WorkloadReplayStats stats;
+    bool succeeded = !backends.empty() &&
+                     replayWorkload(replayFileName, &backends[0], (int) backends.size(), graph, speed, &stats);
+    if (!backends.empty())
+    {
+        shrLog("Replayed %lld queries from %s in %f s, %lld failed, latency mean %f p50 %f p95 %f "
+               "p99 %f max %f s, submit lag up to %f s\n", stats.queries, replayFileName, stats.duration,
+               stats.failed, stats.meanLatency, stats.p50Latency, stats.p95Latency, stats.p99Latency,
+               stats.maxLatency, stats.maxSubmitLag);
+    }
+
+    return succeeded;
+}
+
+///
+//  Log one open-loop run
+//
+void logLoadResult(const LoadResult &result)
+{
+    shrLog("  %10.1f offered %10.1f achieved queries/s, %lld failed, latency p50 %f p90 %f p99 %f "
+           "p99.9 %f max %f s, behind schedule up to %f s\n", result.offeredRate, result.achievedRate,
+           result.failed, result.p50Latency, result.p90Latency, result.p99Latency, result.p999Latency,
+           result.maxLatency, result.maxSubmitLag);
+}
+
+///
+//  Drive an SSSPEngine with open-loop load, over the -backend engine alone if
+//  one is given and every registered backend otherwise.  With doSweep, find
+//  the saturation throughput of each backend on its own and of all of them
+//  together instead of running at loadSpec->rate.
+//
+bool runLoadGenerator(const GraphData *graph, const char *backendName, const LoadSpec *loadSpec,
+                      bool doSweep, float p99Limit)
+{
+    std::vector<SSSPBackend*> backends;
+    for (int i = 0; i < getSSSPBackendCount(); i++)
+    {
+        if (backendName == NULL || strcmp(getSSSPBackend(i)->getName(), backendName) == 0)
+        {
+            backends.push_back(getSSSPBackend(i));
+        }
+    }
+    if (backends.empty())
+    {
+        shrLog("ERROR: unknown backend %s\n", backendName);
+        return false;
+    }
+
+    // Configurations: the whole set, and with a sweep each backend on its own
+    std::vector< std::vector<SSSPBackend*> > configurations(1, backends);
+    if (doSweep && backends.size() > 1)
+    {
+        for (size_t i = 0; i < backends.size(); i++)
+        {
+            configurations.push_back(std::vector<SSSPBackend*>(1, backends[i]));
+        }
+    }
+
+    bool succeeded = true;
+    for (size_t c = 0; c < configurations.size(); c++)
+    {
+        std::string name = configurations[c][0]->getName();
+        for (size_t i = 1; i < configurations[c].size(); i++)
+        {
+            name = name + "+" + configurations[c][i]->getName();
+        }
+
+        SSSPEngine engine;
+        if (!engine.start(&configurations[c][0], (int) configurations[c].size(), graph))
+        {
+            shrLog("ERROR: %s could not load the graph\n", name.c_str());
+            succeeded = false;
+            continue;
+        }
+
+        if (!doSweep)
+        {
+            LoadResult result;
+            succeeded = runLoad(&engine, graph, loadSpec, &result) && succeeded;
+            shrLog("Open-loop load on %s for %f s:\n", name.c_str(), loadSpec->duration);
+            logLoadResult(result);
+            continue;
+        }
+
+        double saturation = 0.0;
+        LoadResult steps[LOAD_REPORTED_STEPS];
+        int stepCount = 0;
+        succeeded = findSaturationRate(&engine, graph, loadSpec, p99Limit, &saturation,
+                                       steps, LOAD_REPORTED_STEPS, &stepCount) && succeeded;
+        shrLog("Saturation of %s: %f queries/s at p99 <= %f s\n", name.c_str(), saturation, p99Limit);
+        for (int i = 0; i < stepCount && i < LOAD_REPORTED_STEPS; i++)
+        {
+            logLoadResult(steps[i]);
+        }
+    }
+
+    return succeeded;
+}
+
+///
+//  Generate graphCount small graphs and run numQueries searches spread over
+//  them in one batched launch.  Query n searches graph n % graphCount.
+//
+bool runBatchedGraphs(cl_context context, cl_device_id deviceId, int graphCount,
+                      int numVertices, int neighborsPerVertex, int numQueries)
+{
+    std::vector<GraphData> graphs(graphCount);
+    for (int g = 0; g < graphCount; g++)
+    {
+        generateRandomGraph(&graphs[g], numVertices, neighborsPerVertex);
+    }
+
+    std::vector<int> queryGraphs(numQueries);
+    std::vector<int> querySources(numQueries);
+    size_t resultCount = 0;
+    for (int q = 0; q < numQueries; q++)
+    {
+        queryGraphs[q] = q % graphCount;
+        querySources[q] = (q / graphCount) % graphs[queryGraphs[q]].vertexCount;
+        resultCount += graphs[queryGraphs[q]].vertexCount;
+    }
+
+    float *results = (float*) trackedMalloc(MEMORY_RESULTS, sizeof(float) * resultCount);
+    bool succeeded = runDijkstraBatchedGraphs(context, deviceId, &graphs[0], graphCount,
+                                              &queryGraphs[0], &querySources[0], results, numQueries);
+
+    trackedFree(results);
+    for (int g = 0; g < graphCount; g++)
+    {
+        freeGraph(&graphs[g]);
+    }
+
+    return succeeded;
+}
+
+///
+//  Build a landmark distance oracle with the -backend engine (cpu-heap if none
+//  is given), or restore it from the snapshot or load it from oracleFileName if
+//  either holds one, then time its estimates and measure their error against
+//  the same engine.  The oracle is added to writer unless it is NULL, and the
+//  timed estimates are logged to recorder unless it is NULL.
+//
+bool runOracle(const GraphData *graph, const char *backendName, int landmarkCount,
+               const char *oracleFileName, const Snapshot *snapshot, SnapshotWriter *writer,
+               WorkloadRecorder *recorder)
+{
+    SSSPBackend *backend = findSSSPBackend((backendName != NULL) ? backendName : SSSP_BACKEND_CPU_HEAP);
+    if (backend == NULL)
+    {
+        shrLog("ERROR: unknown backend %s\n", backendName);
+        return false;
+    }
+
+    DistanceOracle oracle;
+    shrDeltaT(0);
+    if (restoreDistanceOracle(snapshot, &oracle))
+    {
+        shrLog("Restored oracle with %d landmarks from the snapshot in %f s\n", oracle.landmarkCount, shrDeltaT(0));
+    }
+    else if (oracleFileName != NULL && loadDistanceOracle(oracleFileName, &oracle) &&
+             oracle.vertexCount == graph->vertexCount)
+    {
+        shrLog("Loaded oracle with %d landmarks from %s in %f s\n", oracle.landmarkCount, oracleFileName, shrDeltaT(0));
+    }
+    else
+    {
+        if (oracleFileName != NULL && oracle.landmarks != NULL)
+        {
+            shrLog("%s holds an oracle for another graph, rebuilding it\n", oracleFileName);
+            freeDistanceOracle(&oracle);
+        }
+
+        if (!buildDistanceOracle(backend, graph, landmarkCount, 0, &oracle))
+        {
+            return false;
+        }
+        shrLog("Built oracle with %d landmarks on %s in %f s\n", oracle.landmarkCount, backend->getName(), shrDeltaT(0));
+
+        if (oracleFileName != NULL)
+        {
+            saveDistanceOracle(&oracle, oracleFileName);
+        }
+    }
+
+    if (writer != NULL)
+    {
+        snapshotDistanceOracle(writer, &oracle);
+    }
+
+    // Pseudo-random pairs, summed so the estimates are not optimized away
+    float checksum = 0.0f;
+    unsigned int pair = 1;
+    shrDeltaT(0);
+    for (int q = 0; q < ORACLE_TIMED_QUERIES; q++)
+    {
+        pair = pair * 1664525u + 1013904223u;
+        int u = (int) ((pair >> 8) % (unsigned int) graph->vertexCount);
+        int v = (int) ((pair * 2654435761u >> 8) % (unsigned int) graph->vertexCount);
+        if (recorder != NULL)
+        {
+            recordWorkloadQuery(recorder, WORKLOAD_QUERY_DISTANCE, SSSP_CLASS_INTERACTIVE, 0, &u, 1, v);
+        }
+        float estimate = estimateDistance(&oracle, u, v);
+        checksum += (estimate < FLT_MAX) ? estimate : 0.0f;
+    }
+    double queryTime = shrDeltaT(0);
+    shrLog("Oracle: %f million estimates/s (checksum %f)\n", ORACLE_TIMED_QUERIES / queryTime / 1.0e6, checksum);
+
+    DistanceOracleError error;
+    bool measured = measureDistanceOracleError(&oracle, backend, graph, ORACLE_ERROR_SAMPLES, &error);
+    if (measured)
+    {
+        shrLog("Oracle error over %lld reachable pairs: %lld exact, %lld missed, stretch mean %f max %f\n",
+               error.pairs, error.exactPairs, error.missedPairs, error.meanStretch, error.maxStretch);
+    }
+
+    freeDistanceOracle(&oracle);
+    return measured;
+}
+///
+//  Build hub labels with threadCount threads, or restore them from the
+//  snapshot or map them from hubLabelFileName if either holds labels, then
+//  time their queries and check them against the -backend engine (cpu-heap if
+//  none is given).  The labels are added to writer unless it is NULL, and the
+//  timed queries are logged to recorder unless it is NULL.
+//
+bool runHubLabels(const GraphData *graph, const char *backendName, int threadCount,
+                  const char *hubLabelFileName, const Snapshot *snapshot, SnapshotWriter *writer,
+                  WorkloadRecorder *recorder)
+{
+    SSSPBackend *backend = findSSSPBackend((backendName != NULL) ? backendName : SSSP_BACKEND_CPU_HEAP);
+    if (backend == NULL)
+    {
+        shrLog("ERROR: unknown backend %s\n", backendName);
+        return false;
+    }
+
+    HubLabels labels;
+    shrDeltaT(0);
+    if (restoreHubLabels(snapshot, &labels))
+    {
+        shrLog("Restored hub labels from the snapshot in %f s\n", shrDeltaT(0));
+    }
+    else if (hubLabelFileName != NULL && loadHubLabels(hubLabelFileName, &labels) &&
+             labels.vertexCount == graph->vertexCount)
+    {
+        shrLog("Mapped hub labels from %s in %f s\n", hubLabelFileName, shrDeltaT(0));
+    }
+    else
+    {
+        if (labels.mapping != NULL)
+        {
+            shrLog("%s holds labels for another graph, rebuilding them\n", hubLabelFileName);
+            freeHubLabels(&labels);
+        }
+
+        buildHubLabels(graph, NULL, threadCount, &labels);
+        shrLog("Built hub labels with %d threads in %f s\n", threadCount, shrDeltaT(0));
+
+        if (hubLabelFileName != NULL)
+        {
+            saveHubLabels(&labels, hubLabelFileName);
+        }
+    }
+
+    if (writer != NULL)
+    {
+        snapshotHubLabels(writer, &labels);
+    }
+    shrLog("Hub labels: %lld entries, %f per label, %f MB\n", hubLabelEntryCount(&labels),
+           (double) hubLabelEntryCount(&labels) / (2.0 * graph->vertexCount),
+           sizeof(HubLabelEntry) * (double) labels.labelStart[2 * graph->vertexCount] / (1024.0 * 1024.0));
+
+    // Pseudo-random pairs, summed so the queries are not optimized away
+    float checksum = 0.0f;
+    unsigned int pair = 1;
+    shrDeltaT(0);
+    for (int q = 0; q < ORACLE_TIMED_QUERIES; q++)
+    {
+        pair = pair * 1664525u + 1013904223u;
+        int u = (int) ((pair >> 8) % (unsigned int) graph->vertexCount);
+        int v = (int) ((pair * 2654435761u >> 8) % (unsigned int) graph->vertexCount);
+        if (recorder != NULL)
+        {
+            recordWorkloadQuery(recorder, WORKLOAD_QUERY_DISTANCE, SSSP_CLASS_INTERACTIVE, 0, &u, 1, v);
+        }
+        float cost = queryHubLabels(&labels, u, v);
+        checksum += (cost < FLT_MAX) ? cost : 0.0f;
+    }
+    double queryTime = shrDeltaT(0);
+    shrLog("Hub labels: %f us/query (checksum %f)\n", queryTime / ORACLE_TIMED_QUERIES * 1.0e6, checksum);
+
+    // Same sources as the oracle error, every target
+    int sampleCount = (ORACLE_ERROR_SAMPLES < graph->vertexCount) ? ORACLE_ERROR_SAMPLES : graph->vertexCount;
+    int *sources = (int*) malloc(sizeof(int) * sampleCount);
+    float *exact = (float*) malloc(sizeof(float) * (size_t) sampleCount * graph->vertexCount);
+    for (int i = 0; i < sampleCount; i++)
+    {
+        sources[i] = (int) ((long long) graph->vertexCount * i / sampleCount);
+    }
+
+    bool passed = runSSSP(backend, graph, sources, exact, sampleCount);
+    long long mismatches = 0;
+    for (int i = 0; i < sampleCount && passed; i++)
+    {
+        for (int v = 0; v < graph->vertexCount; v++)
+        {
+            float expected = exact[(size_t) i * graph->vertexCount + v];
+            float cost = queryHubLabels(&labels, sources[i], v);
+            if (fabs(cost - expected) > 1.0e-4f * expected)
+            {
+                mismatches++;
+            }
+        }
+    }
+    passed = passed && mismatches == 0;
+    shrLog("Hub labels vs %s: %lld mismatches\n", backend->getName(), mismatches);
+
+    free(sources);
+    free(exact);
+    freeHubLabels(&labels);
+    return passed;
+}
+
+///
+//  Coordinate the batch over the worker processes that connect to port, then
+//  report what each of them did
+//
+bool runCoordinator(const GraphData *graph, int port, const int *sourceVertices,
+                    float *outResultCosts, int numResults)
+{
+    shrLog("Coordinating %d sources on port %d\n", numResults, port);
+
+    ClusterWorkerStats workers[CLUSTER_REPORTED_WORKERS];
+    int workerCount = 0;
+    bool succeeded = runSSSPCoordinator(port, graph, sourceVertices, outResultCosts, numResults,
+                                        workers, CLUSTER_REPORTED_WORKERS, &workerCount);
+
+    for (int i = 0; i < workerCount && i < CLUSTER_REPORTED_WORKERS; i++)
+    {
+        shrLog("  %-32s %6d sources in %8.3f s (%10.1f sources/s), backups %d (%d won), "
+               "discarded %d%s\n", workers[i].name, workers[i].sources, workers[i].busySeconds,
+               (workers[i].busySeconds > 0.0) ? workers[i].sources / workers[i].busySeconds : 0.0,
+               workers[i].backupChunks, workers[i].backupsWon, workers[i].discardedChunks,
+               workers[i].failed ? ", FAILED" : "");
+    }
+
+    return succeeded;
+}
+
+///
+//  Serve the coordinator at host:port with the -backend engine (cpu-heap if
+//  none is given)
+//
+bool runWorker(const GraphData *graph, const char *workerAddress, const char *backendName)
+{
+    SSSPBackend *backend = findSSSPBackend((backendName != NULL) ? backendName : SSSP_BACKEND_CPU_HEAP);
+    const char *separator = strrchr(workerAddress, ':');
+    if (backend == NULL || separator == NULL)
+    {
+        shrLog("ERROR: -worker needs host:port and a known backend\n");
+        return false;
+    }
+
+    std::string host(workerAddress, separator - workerAddress);
+    int port = atoi(separator + 1);
+    shrLog("Serving %s:%d with %s\n", host.c_str(), port, backend->getName());
+
+    return runSSSPWorker(host.c_str(), port, backend, graph, NULL);
+}
+
+///
+//  Generate regionCount graphs of different sizes, the largest numVertices,
+//  and serve numSources sources from them in requests of REGION_BATCH_SIZE
+//  through a GraphRegistry on the -backend engine (cpu-heap if none is
+//  given).  Requests favour the small regions, as a service's traffic
+//  favours its busiest ones.
+//
+bool runRegions(const char *backendName, int regionCount, int numVertices, int neighborsPerVertex,
+                int numSources, int budgetMB, bool sizeAware)
+{
+    SSSPBackend *backend = findSSSPBackend((backendName != NULL) ? backendName : SSSP_BACKEND_CPU_HEAP);
+    if (backend == NULL)
+    {
+        shrLog("ERROR: unknown backend %s\n", backendName);
+        return false;
+    }
+
+    std::vector<GraphData> regions(regionCount);
+    for (int r = 0; r < regionCount; r++)
+    {
+        int vertexCount = (int) ((long long) numVertices * (r + 1) / regionCount);
+        generateRandomGraph(&regions[r], (vertexCount > 0) ? vertexCount : 1, neighborsPerVertex);
+    }
+
+    GraphRegistry registry(backend, (size_t) budgetMB << 20,
+                           sizeAware ? GRAPH_EVICT_SIZE_AWARE : GRAPH_EVICT_LRU);
+    shrLog("Serving %d regions on %s, budget %lu MB\n", regionCount, backend->getName(),
+           (unsigned long) (registry.getBudget() >> 20));
+
+    int sources[REGION_BATCH_SIZE];
+    float *results = (float*) trackedMalloc(MEMORY_RESULTS,
+                                            sizeof(float) * REGION_BATCH_SIZE * regions[regionCount - 1].vertexCount);
+    bool succeeded = true;
+    unsigned int draw = 1;
+    for (int first = 0; first < numSources; first += REGION_BATCH_SIZE)
+    {
+        // Square of a uniform draw, so region r is asked for more often than r + 1
+        draw = draw * 1664525u + 1013904223u;
+        double uniform = (draw >> 8) / (double) (1 << 24);
+        int r = (int) (uniform * uniform * regionCount);
+
+        char name[GRAPH_REGISTRY_NAME_MAX];
+        snprintf(name, sizeof(name), "region%d", r);
+        int count = (numSources - first < REGION_BATCH_SIZE) ? numSources - first : REGION_BATCH_SIZE;
+        for (int i = 0; i < count; i++)
+        {
+            sources[i] = (first + i) % regions[r].vertexCount;
+        }
+
+        SSSPSession *session = registry.acquire(name, &regions[r]);
+        if (session == NULL)
+        {
+            succeeded = false;
+            continue;
+        }
+        succeeded = session->run(sources, results, count) && succeeded;
+        registry.release(session);
+    }
+
+    GraphRegistryStats stats = registry.getStats();
+    shrLog("Registry: %llu requests, %llu hits (%.1f%%), %llu uploads, %llu rejected, "
+           "%llu evictions (%f MB), %d graphs resident (%f MB)\n",
+           stats.lookups, stats.hits, (stats.lookups > 0) ? 100.0 * stats.hits / stats.lookups : 0.0,
+           stats.misses, stats.rejections, stats.evictions, stats.evictedBytes / (1024.0 * 1024.0),
+           stats.residentGraphs, stats.residentBytes / (1024.0 * 1024.0));
+
+    trackedFree(results);
+    for (int r = 0; r < regionCount; r++)
+    {
+        freeGraph(&regions[r]);
+    }
+
+    return succeeded;
+}
+
+///
+//  Check the results of a run with the optimality certificate of
+//  dijkstraVerify.h rather than a second search: on the host, or on the
+//  device of context if it is not NULL
+//
+bool verifyResults(const char *runName, cl_context context, const GraphData *graph,
+                   const int *sourceVertices, const float *results, int numResults)
+{
+    SSSPVerification verification;
+    shrDeltaT(2);
+    bool verified = (context != NULL) ?
+                    verifyOCLDijkstraResults(context, oclGetMaxFlopsDev(context), graph, sourceVertices,
+                                             results, numResults, &verification) :
+                    verifySSSP(graph, NULL, sourceVertices, results, numResults, VERIFY_THREADS, &verification);
+    double verifyTime = shrDeltaT(2);
+
+    if (verified)
+    {
+        shrLog("Verified %s: %lld rows, %f s\n", runName, verification.rows, verifyTime);
+    }
+    else
+    {
+        shrLog("ERROR: %s results fail verification: %lld source costs, %lld edge violations, "
+               "%lld vertices without a tight in-edge, %lld without a tight path, %lld invalid costs; "
+               "first at row %d vertex %d\n",
+               runName, verification.sourceErrors, verification.edgeViolations, verification.untightVertices,
+               verification.unsupportedVertices, verification.invalidCosts, verification.firstBadRow,
+               verification.firstBadVertex);
+    }
+
+    return verified;
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 // Program main
 ////////////////////////////////////////////////////////////////////////////////
 int main(int argc, const char **argv)
 {
-    bool doCPU = false;
-    bool doGPU = false;
-    bool doMultiGPU = false;
-    bool doCPUGPU = false;
-    bool doRef = false;
-    int numSources = 100;
-    int generateVerts = 100000;
-    int generateEdgesPerVert = 10;
-
-    parseCommandLineArgs(argc, argv, doCPU, doGPU,
-                         doMultiGPU, doCPUGPU, doRef,
-                         &numSources, &generateVerts, &generateEdgesPerVert);
+    DriverOptions options;
+    initDriverOptions(&options);
+    parseCommandLineArgs(argc, argv, &options);
+
     // start logs 
     shrSetLogFileName ("oclDijkstra.txt");
 
@@ -234,8 +1033,35 @@ int main(int argc, const char **argv)
     cpuContext = clCreateContext(0, cpuDeviceCount, cpuDevices, NULL, NULL, &errNum);
     shrLog("clCreateContextFromType");
 
+    // Make every engine available by name for -backend
+    registerCPUBackends();
+    registerOCLBackends(gpuContext, cpuContext);
+
+    // -hostlimitmb and -devicelimitmb refuse sessions that would exceed them;
+    // the devices have their memory accounts once their backends are registered
+    setMemoryLimit(MEMORY_HOST, (size_t) options.hostLimitMB * 1024 * 1024);
+    for (int device = MEMORY_HOST + 1; device < getMemoryDeviceCount(); device++)
+    {
+        setMemoryLimit(device, (size_t) options.deviceLimitMB * 1024 * 1024);
+    }
+
+    // -metricsport serves the engine metrics for scraping while the run goes on
+    if (options.metricsPort > 0)
+    {
+        if (startMetricsServer(options.metricsPort))
+        {
+            shrLog("Serving metrics at http://127.0.0.1:%d/metrics\n", options.metricsPort);
+        }
+        else
+        {
+            shrLog("ERROR: unable to serve metrics on port %d\n", options.metricsPort);
+        }
+    }
+
     // Allocate memory for arrays
     GraphData graph;
+    SharedGraph sharedGraph;
+    memset(&sharedGraph, 0, sizeof(SharedGraph));
 #ifdef CITY_DATA
     graph.vertexCount = sizeof(vertexArray) / sizeof(int);
     graph.edgeCount = sizeof(edgeArray) / sizeof(int);
@@ -243,17 +1069,65 @@ int main(int argc, const char **argv)
     graph.edgeArray = &edgeArray[0];
     graph.weightArray = &weightArray[0];
 #else
-    generateRandomGraph(&graph, generateVerts, generateEdgesPerVert);
+    if (options.sharedGraphName != NULL)
+    {
+        if (!loadSharedGraph(&sharedGraph, options.sharedGraphName, options.generateVerts,
+                             options.generateEdgesPerVert))
+        {
+            shrLog("ERROR: unable to load shared graph %s\n", options.sharedGraphName);
+            return -1;
+        }
+        graph = sharedGraph.graph;
+    }
+    else if (options.roadSegments > 0)
+    {
+        generateRoadGraph(&graph, options.generateVerts, options.roadSegments);
+    }
+    else
+    {
+        generateRandomGraph(&graph, options.generateVerts, options.generateEdgesPerVert);
+    }
 #endif
 
 
     printf("Vertex Count: %d\n", graph.vertexCount);
     printf("Edge Count: %d\n", graph.edgeCount);
 
+    // -snapshot restores the derived state of an earlier run on the same
+    // graph, or records this run's into a new snapshot
+    Snapshot snapshot;
+    SnapshotWriter snapshotWriter;
+    memset(&snapshot, 0, sizeof(Snapshot));
+    memset(&snapshotWriter, 0, sizeof(SnapshotWriter));
+    if (options.snapshotFileName != NULL)
+    {
+        shrDeltaT(0);
+        if (openSnapshot(options.snapshotFileName, &graph, &snapshot))
+        {
+            int programCount = restoreOCLEngine(&snapshot, gpuContext) + restoreOCLEngine(&snapshot, cpuContext);
+            shrLog("Restored %d programs from %s in %f s\n",
+                   programCount, options.snapshotFileName, shrDeltaT(0));
+        }
+        else if (!beginSnapshot(options.snapshotFileName, &graph, &snapshotWriter))
+        {
+            shrLog("ERROR: unable to create snapshot %s\n", options.snapshotFileName);
+        }
+    }
+    SnapshotWriter *writer = (snapshotWriter.file != NULL) ? &snapshotWriter : NULL;
+
+    // -record logs the queries of every run on this graph for -replay
+    WorkloadRecorder workloadRecorder;
+    memset(&workloadRecorder, 0, sizeof(WorkloadRecorder));
+    if (options.recordFileName != NULL && !beginWorkloadRecording(options.recordFileName, &graph, &workloadRecorder))
+    {
+        shrLog("ERROR: unable to record to %s\n", options.recordFileName);
+    }
+    WorkloadRecorder *recorder = (workloadRecorder.file != NULL) ? &workloadRecorder : NULL;
+
     std::vector<int> sourceVertices;
 
 
-    for(int source = 0; source < numSources; source++)
+    for(int source = 0; source < options.numSources; source++)
     {
         sourceVertices.push_back(source % graph.vertexCount);
     }
@@ -261,50 +1135,276 @@ int main(int argc, const char **argv)
     int *sourceVertArray = (int*) malloc(sizeof(int) * sourceVertices.size());
     std::copy(sourceVertices.begin(), sourceVertices.end(), sourceVertArray);
 
-    float *results = (float*) malloc(sizeof(float) * sourceVertices.size() * graph.vertexCount);
+    float *results = (float*) trackedMalloc(MEMORY_RESULTS, sizeof(float) * sourceVertices.size() * graph.vertexCount);
+
+    // -backend then runs on the graph with its degree-2 chains contracted
+    ContractedGraph contracted;
+    memset(&contracted, 0, sizeof(ContractedGraph));
+    if (options.doContract)
+    {
+        contractGraph(&graph, NULL, 0, &contracted);
+        shrLog("Contracted %d chains: %d -> %d vertices, %d -> %d edges\n", contracted.chainCount,
+               graph.vertexCount, contracted.graph.vertexCount, graph.edgeCount, contracted.graph.edgeCount);
+    }
+
+    // -backend then runs each search on its source's component only
+    ComponentIndex components;
+    memset(&components, 0, sizeof(ComponentIndex));
+    if (options.doComponents)
+    {
+        shrDeltaT(0);
+        if (!restoreComponentIndex(&snapshot, &components))
+        {
+            buildComponentIndex(&graph, 4, &components);
+        }
+        shrLog("Component index: %d weak, %d strong components, %f s\n",
+               components.wccCount, components.sccCount, shrDeltaT(0));
+
+        if (writer != NULL)
+        {
+            snapshotComponentIndex(writer, &components);
+        }
+    }
 
+    // -verify checks every run below on the host, -verifyocl on the GPU
+    cl_context verifyContext = options.doVerifyOCL ? gpuContext : NULL;
 
     // Run Dijkstra's algorithm
     shrDeltaT(0);
     double startTimeCPU = shrDeltaT(0);
-    if (doCPU)
+    if (options.doCPU)
     {
+        recordDirectRun(recorder, sourceVertArray, sourceVertices.size());
         runDijkstra(cpuContext, oclGetMaxFlopsDev(cpuContext), &graph, sourceVertArray,
                     results, sourceVertices.size() );
     }
     double endTimeCPU = shrDeltaT(0);
+    if (options.doCPU && options.doVerify)
+    {
+        verifyResults("CPU", verifyContext, &graph, sourceVertArray, results, sourceVertices.size());
+    }
 
     double startTimeGPU = shrDeltaT(0);
-    if (doGPU)
+    if (options.doGPU)
     {
+        recordDirectRun(recorder, sourceVertArray, sourceVertices.size());
         runDijkstra(gpuContext, oclGetMaxFlopsDev(gpuContext), &graph, sourceVertArray,
                     results, sourceVertices.size() );
     }
     double endTimeGPU = shrDeltaT(0);
+    if (options.doGPU && options.doVerify)
+    {
+        verifyResults("GPU", verifyContext, &graph, sourceVertArray, results, sourceVertices.size());
+    }
 
     double startTimeMultiGPU = shrDeltaT(0);
-    if (doMultiGPU)
+    if (options.doMultiGPU)
     {
+        recordDirectRun(recorder, sourceVertArray, sourceVertices.size());
         runDijkstraMultiGPU(gpuContext, &graph, sourceVertArray,
                             results, sourceVertices.size() );
     }
     double endTimeMultiGPU = shrDeltaT(0);
+    if (options.doMultiGPU && options.doVerify)
+    {
+        verifyResults("Multi GPU", verifyContext, &graph, sourceVertArray, results, sourceVertices.size());
+    }
 
     double startTimeGPUCPU = shrDeltaT(0);
-    if (doCPUGPU)
+    if (options.doCPUGPU)
     {
+        recordDirectRun(recorder, sourceVertArray, sourceVertices.size());
         runDijkstraMultiGPUandCPU(gpuContext, cpuContext, &graph, sourceVertArray,
                                   results, sourceVertices.size() );
     }
     double endTimeGPUCPU = shrDeltaT(0);
+    if (options.doCPUGPU && options.doVerify)
+    {
+        verifyResults("GPU and CPU", verifyContext, &graph, sourceVertArray, results, sourceVertices.size());
+    }
+
+    double startTimeCheckpoint = shrDeltaT(0);
+    if (options.checkpointDirectory != NULL)
+    {
+        recordDirectRun(recorder, sourceVertArray, sourceVertices.size());
+        runDijkstraMultiGPUCheckpointed(gpuContext, cpuContext, &graph, sourceVertArray,
+                                        results, sourceVertices.size(), options.checkpointDirectory);
+    }
+    double endTimeCheckpoint = shrDeltaT(0);
+    if (options.checkpointDirectory != NULL && options.doVerify)
+    {
+        verifyResults("checkpointed job", verifyContext, &graph, sourceVertArray, results, sourceVertices.size());
+    }
+
+    double startTimeCoordinator = shrDeltaT(0);
+    if (options.coordinatorPort > 0)
+    {
+        recordDirectRun(recorder, sourceVertArray, sourceVertices.size());
+        runCoordinator(&graph, options.coordinatorPort, sourceVertArray, results, sourceVertices.size());
+    }
+    double endTimeCoordinator = shrDeltaT(0);
+    if (options.coordinatorPort > 0 && options.doVerify)
+    {
+        verifyResults("coordinator", verifyContext, &graph, sourceVertArray, results, sourceVertices.size());
+    }
+
+    if (options.workerAddress != NULL)
+    {
+        runWorker(&graph, options.workerAddress, options.backendName);
+    }
 
     double startTimeRef = shrDeltaT(0);
-    if (doRef)
+    if (options.doRef)
     {
+        recordDirectRun(recorder, sourceVertArray, sourceVertices.size());
         runDijkstraRef( &graph, sourceVertArray,
                         results, sourceVertices.size() );
     }
     double endTimeRef = shrDeltaT(0);
+    if (options.doRef && options.doVerify)
+    {
+        verifyResults("reference", verifyContext, &graph, sourceVertArray, results, sourceVertices.size());
+    }
+
+    double startTimeBackend = shrDeltaT(0);
+    if (options.backendName != NULL)
+    {
+        SSSPBackend *backend = findSSSPBackend(options.backendName);
+        if (backend == NULL)
+        {
+            shrLog("ERROR: unknown backend %s, available:", options.backendName);
+            for (int i = 0; i < getSSSPBackendCount(); i++)
+            {
+                shrLog(" %s", getSSSPBackend(i)->getName());
+            }
+            shrLog("\n");
+        }
+        else if (options.doContract)
+        {
+            recordDirectRun(recorder, sourceVertArray, sourceVertices.size());
+            runSSSPContracted(backend, &contracted, sourceVertArray, results, sourceVertices.size());
+        }
+        else if (options.doComponents)
+        {
+            recordDirectRun(recorder, sourceVertArray, sourceVertices.size());
+            SSSPSession *session = createComponentSession(backend, &graph, &components);
+            session->run(sourceVertArray, results, sourceVertices.size());
+            delete session;
+        }
+        else
+        {
+            recordDirectRun(recorder, sourceVertArray, sourceVertices.size());
+            runSSSP(backend, &graph, sourceVertArray, results, sourceVertices.size());
+        }
+    }
+    double endTimeBackend = shrDeltaT(0);
+    if (options.backendName != NULL && options.doVerify)
+    {
+        verifyResults("backend", verifyContext, &graph, sourceVertArray, results, sourceVertices.size());
+    }
+
+    double startTimeAsync = shrDeltaT(0);
+    if (options.doAsync)
+    {
+        runAsync(&graph, sourceVertArray, results, sourceVertices.size(), recorder);
+    }
+    double endTimeAsync = shrDeltaT(0);
+    if (options.doAsync && options.doVerify)
+    {
+        verifyResults("async engine", verifyContext, &graph, sourceVertArray, results, sourceVertices.size());
+    }
+
+    double startTimeMixed = shrDeltaT(0);
+    if (options.interactiveQueries > 0)
+    {
+        runMixedClasses(&graph, sourceVertArray, results, sourceVertices.size(), options.interactiveQueries, recorder);
+    }
+    double endTimeMixed = shrDeltaT(0);
+    if (options.interactiveQueries > 0 && options.doVerify)
+    {
+        verifyResults("bulk job", verifyContext, &graph, sourceVertArray, results, sourceVertices.size());
+    }
+
+    double startTimeReplay = shrDeltaT(0);
+    if (options.replayFileName != NULL)
+    {
+        runReplay(&graph, options.replayFileName, options.replaySpeed);
+    }
+    double endTimeReplay = shrDeltaT(0);
+
+    double startTimeLoad = shrDeltaT(0);
+    if (options.doLoad || options.doLoadSweep)
+    {
+        runLoadGenerator(&graph, options.backendName, &options.loadSpec, options.doLoadSweep, options.loadP99Limit);
+    }
+    double endTimeLoad = shrDeltaT(0);
+
+    // Cold baseline first, then the same batch warm-started
+    OCLSearchStats coldStats;
+    OCLSearchStats warmStats;
+    memset(&coldStats, 0, sizeof(OCLSearchStats));
+    memset(&warmStats, 0, sizeof(OCLSearchStats));
+    if (options.doWarmStart)
+    {
+        resetOCLSearchStats();
+        recordDirectRun(recorder, sourceVertArray, sourceVertices.size());
+        runDijkstra(gpuContext, oclGetMaxFlopsDev(gpuContext), &graph, sourceVertArray,
+                    results, sourceVertices.size() );
+        coldStats = getOCLSearchStats();
+        setOCLWarmStart(true);
+        resetOCLSearchStats();
+    }
+
+    double startTimeWarmStart = shrDeltaT(0);
+    if (options.doWarmStart)
+    {
+        recordDirectRun(recorder, sourceVertArray, sourceVertices.size());
+        runDijkstra(gpuContext, oclGetMaxFlopsDev(gpuContext), &graph, sourceVertArray,
+                    results, sourceVertices.size() );
+        warmStats = getOCLSearchStats();
+        setOCLWarmStart(false);
+    }
+    double endTimeWarmStart = shrDeltaT(0);
+    if (options.doWarmStart && options.doVerify)
+    {
+        verifyResults("warm start", verifyContext, &graph, sourceVertArray, results, sourceVertices.size());
+    }
+
+    if (options.oracleLandmarks > 0)
+    {
+        runOracle(&graph, options.backendName, options.oracleLandmarks, options.oracleFileName, &snapshot, writer,
+                  recorder);
+    }
+
+    if (options.hubLabelThreads > 0)
+    {
+        runHubLabels(&graph, options.backendName, options.hubLabelThreads, options.hubLabelFileName, &snapshot,
+                     writer, recorder);
+    }
+
+    if (recorder != NULL)
+    {
+        long long records = recorder->records;
+        bool written = finishWorkloadRecording(recorder);
+        shrLog("%s %lld queries to %s\n", written ? "Recorded" : "ERROR: unable to record",
+               records, options.recordFileName);
+    }
+
+    double startTimeBatched = shrDeltaT(0);
+    if (options.batchGraphs > 0)
+    {
+        runBatchedGraphs(gpuContext, oclGetMaxFlopsDev(gpuContext), options.batchGraphs,
+                         options.generateVerts, options.generateEdgesPerVert, options.numSources);
+    }
+    double endTimeBatched = shrDeltaT(0);
+
+    double startTimeRegions = shrDeltaT(0);
+    if (options.regionCount > 0)
+    {
+        runRegions(options.backendName, options.regionCount, options.generateVerts, options.generateEdgesPerVert,
+                   options.numSources, options.residentBudgetMB, options.doSizeAwareEviction);
+    }
+    double endTimeRegions = shrDeltaT(0);
 
 #ifdef CITY_DATA
     for (unsigned int i = 0; i < sourceVertices.size(); i++)
@@ -321,44 +1421,137 @@ int main(int argc, const char **argv)
 
 
     std::ostringstream oss;
-    oss << "\nCSV: " << graph.vertexCount << " " << generateEdgesPerVert << " " << numSources << " ";
-    if (doCPU)
+    oss << "\nCSV: " << graph.vertexCount << " " << options.generateEdgesPerVert << " " << options.numSources << " ";
+    if (options.doCPU)
     {
         shrLog("\nrunDijkstra - CPU Time:               %f s\n", endTimeCPU - startTimeCPU);
         oss << (endTimeCPU - startTimeCPU) << " ";
     }
 
-    if (doGPU)
+    if (options.doGPU)
     {
         shrLog("\nrunDijkstra - Single GPU Time:        %f s\n", endTimeGPU - startTimeGPU);
         oss << (endTimeGPU - startTimeGPU) << " ";
     }
 
-    if (doMultiGPU)
+    if (options.doMultiGPU)
     {
         shrLog("\nrunDijkstra - Multi GPU Time:         %f s\n", endTimeMultiGPU - startTimeMultiGPU);
         oss << (endTimeMultiGPU - startTimeMultiGPU) << " ";
     }
 
-    if (doCPUGPU)
+    if (options.doCPUGPU)
     {
         shrLog("\nrunDijkstra - Multi GPU and CPU Time: %f s\n", endTimeGPUCPU - startTimeGPUCPU);
         oss << (endTimeGPUCPU - startTimeGPUCPU) << " ";
     }
 
-    if (doRef)
+    if (options.checkpointDirectory != NULL)
+    {
+        shrLog("\nrunDijkstra - Checkpointed Job Time:  %f s\n", endTimeCheckpoint - startTimeCheckpoint);
+        oss << (endTimeCheckpoint - startTimeCheckpoint) << " ";
+    }
+
+    if (options.coordinatorPort > 0)
+    {
+        shrLog("\nrunSSSPCoordinator - All Workers Time: %f s\n", endTimeCoordinator - startTimeCoordinator);
+        oss << (endTimeCoordinator - startTimeCoordinator) << " ";
+    }
+
+    if (options.doRef)
     {
         shrLog("\nrunDijkstra - Reference (CPU):        %f s\n", endTimeRef - startTimeRef);
         oss << (endTimeRef - startTimeRef) << " ";
     }
+    if (options.backendName != NULL)
+    {
+        shrLog("\nrunSSSP - %s Time: %f s\n", options.backendName, endTimeBackend - startTimeBackend);
+        oss << (endTimeBackend - startTimeBackend) << " ";
+    }
+    if (options.doAsync)
+    {
+        shrLog("\nSSSPEngine - All Backends Time:       %f s\n", endTimeAsync - startTimeAsync);
+        oss << (endTimeAsync - startTimeAsync) << " ";
+    }
+    if (options.interactiveQueries > 0)
+    {
+        shrLog("\nSSSPEngine - Bulk and Interactive Time: %f s\n", endTimeMixed - startTimeMixed);
+        oss << (endTimeMixed - startTimeMixed) << " ";
+    }
+    if (options.replayFileName != NULL)
+    {
+        shrLog("\nreplayWorkload - All Backends Time:   %f s\n", endTimeReplay - startTimeReplay);
+        oss << (endTimeReplay - startTimeReplay) << " ";
+    }
+    if (options.doLoad || options.doLoadSweep)
+    {
+        shrLog("\nrunLoad - Open-Loop Load Time:       %f s\n", endTimeLoad - startTimeLoad);
+        oss << (endTimeLoad - startTimeLoad) << " ";
+    }
+    if (options.doWarmStart)
+    {
+        shrLog("\nrunDijkstra - Warm Start GPU Time:    %f s\n", endTimeWarmStart - startTimeWarmStart);
+        shrLog("Warm start: %lld of %lld searches seeded, iterations %lld -> %lld (%lld saved), "
+               "relaxations %lld -> %lld (%lld saved)\n",
+               warmStats.warmStartedSearches, warmStats.searches,
+               coldStats.iterations, warmStats.iterations, coldStats.iterations - warmStats.iterations,
+               coldStats.relaxations, warmStats.relaxations, coldStats.relaxations - warmStats.relaxations);
+        oss << (endTimeWarmStart - startTimeWarmStart) << " ";
+    }
+    if (options.batchGraphs > 0)
+    {
+        shrLog("\nrunDijkstraBatchedGraphs - %d Graphs Time: %f s\n", options.batchGraphs,
+               endTimeBatched - startTimeBatched);
+        oss << (endTimeBatched - startTimeBatched) << " ";
+    }
+    if (options.regionCount > 0)
+    {
+        shrLog("\nGraphRegistry - %d Regions Time: %f s\n", options.regionCount, endTimeRegions - startTimeRegions);
+        oss << (endTimeRegions - startTimeRegions) << " ";
+    }
     oss << "\n";
     shrLog(oss.str().c_str());
 
     free(sourceVertArray);
-    free(results);
+    trackedFree(results);
     free(gpuDevices);
     free(cpuDevices);
 
+    if (options.doContract)
+    {
+        freeContractedGraph(&contracted);
+    }
+    if (options.doComponents)
+    {
+        freeComponentIndex(&components);
+    }
+    // Programs are only known once the sessions have built them
+    if (writer != NULL)
+    {
+        bool written = snapshotOCLEngine(writer);
+        written = finishSnapshot(writer) && written;
+        shrLog("%s snapshot %s\n", written ? "Wrote" : "ERROR: unable to write", options.snapshotFileName);
+    }
+    closeSnapshot(&snapshot);
+
+    if (options.metricsFileName != NULL)
+    {
+        bool written = writeMetricsFile(options.metricsFileName);
+        shrLog("%s metrics %s\n", written ? "Wrote" : "ERROR: unable to write", options.metricsFileName);
+    }
+
+    if (options.doMemoryReport)
+    {
+        std::string report;
+        formatMemoryReport(report);
+        shrLog("\n%s", report.c_str());
+    }
+
+    releaseSSSPBackends();
+    releaseOCLProgramCache();
+    detachSharedGraph(&sharedGraph);
+    releaseMetrics();
+
     clReleaseContext(gpuContext);
 
     // finish
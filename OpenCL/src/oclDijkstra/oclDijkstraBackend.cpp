@@ -0,0 +1,154 @@
+//
+//
+//  Description:
+//      SSSPBackend implementation for OpenCL devices.  Each backend drives one
+//      device of a context; its sessions keep the graph resident on the device.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <stdio.h>
+#include <string.h>
+#include <oclUtils.h>
+#include "oclDijkstraKernel.h"
+
+///
+//  Constants
+//
+const int OCL_BACKEND_NAME_MAX = 64;
+
+// Share of the device global memory resident graphs may use, the rest is left
+// for programs, queues and the result buffers of the runs
+const int OCL_RESIDENT_MEMORY_PERCENT = 80;
+
+///
+//  Types
+//
+
+//
+//  Graph resident on one device
+//
+class OCLSession : public SSSPSession
+{
+public:
+    OCLSession(OCLDijkstraSession *session) :
+        session(session)
+    {
+    }
+
+    virtual ~OCLSession()
+    {
+        releaseOCLDijkstraSession(session);
+    }
+
+    virtual bool run( const int *sourceVertices, float *outResultCosts, int numResults )
+    {
+        return runOCLDijkstraSession(session, sourceVertices, outResultCosts, numResults);
+    }
+
+private:
+    OCLDijkstraSession *session;
+};
+
+//
+//  One OpenCL device
+//
+class OCLBackend : public SSSPBackend
+{
+public:
+    OCLBackend(cl_context context, cl_device_id deviceId, const char *backendName) :
+        context(context),
+        deviceId(deviceId)
+    {
+        strncpy(name, backendName, OCL_BACKEND_NAME_MAX - 1);
+        name[OCL_BACKEND_NAME_MAX - 1] = '\0';
+
+        cl_device_type type = CL_DEVICE_TYPE_GPU;
+        clGetDeviceInfo(deviceId, CL_DEVICE_TYPE, sizeof(cl_device_type), &type, NULL);
+        deviceType = (type & CL_DEVICE_TYPE_CPU) ? SSSP_DEVICE_CPU :
+                     (type & CL_DEVICE_TYPE_GPU) ? SSSP_DEVICE_GPU : SSSP_DEVICE_ACCELERATOR;
+
+        registerOCLMemoryDevice(deviceId, name);
+    }
+
+    virtual const char *getName() const { return name; }
+    virtual SSSPDeviceType getDeviceType() const { return deviceType; }
+
+    virtual SSSPSession *createSession( const GraphData *graph )
+    {
+        OCLDijkstraSession *session = createOCLDijkstraSession(context, deviceId, graph);
+        return (session != NULL) ? new OCLSession(session) : NULL;
+    }
+
+    virtual size_t getMemoryBudget() const
+    {
+        cl_ulong globalMemSize = 0;
+        clGetDeviceInfo(deviceId, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong), &globalMemSize, NULL);
+        return (size_t) (globalMemSize / 100 * OCL_RESIDENT_MEMORY_PERCENT);
+    }
+
+    virtual size_t estimateSessionBytes( const GraphData *graph ) const
+    {
+        return estimateOCLDijkstraSessionBytes(deviceId, graph);
+    }
+
+private:
+    cl_context context;
+    cl_device_id deviceId;
+    SSSPDeviceType deviceType;
+    char name[OCL_BACKEND_NAME_MAX];
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+///
+/// Register one backend per device of a context
+///
+static void registerContextBackends(cl_context context, const char *prefix)
+{
+    if (context == NULL)
+    {
+        return;
+    }
+
+    size_t deviceBytes;
+    if (clGetContextInfo(context, CL_CONTEXT_DEVICES, 0, NULL, &deviceBytes) != CL_SUCCESS)
+    {
+        return;
+    }
+
+    cl_uint deviceCount = (cl_uint)deviceBytes/sizeof(cl_device_id);
+    for (unsigned int i = 0; i < deviceCount; i++)
+    {
+        char name[OCL_BACKEND_NAME_MAX];
+        snprintf(name, sizeof(name), "%s%u", prefix, i);
+        registerSSSPBackend(createOCLBackend(context, oclGetDev(context, i), name));
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+/// Create an SSSPBackend for one OpenCL device
+///
+SSSPBackend *createOCLBackend( cl_context context, cl_device_id deviceId, const char *name )
+{
+    return new OCLBackend(context, deviceId, name);
+}
+
+///
+/// Register one backend per device of each context
+///
+void registerOCLBackends( cl_context gpuContext, cl_context cpuContext )
+{
+    registerContextBackends(gpuContext, "opencl-gpu");
+    registerContextBackends(cpuContext, "opencl-cpu");
+}
@@ -15,8 +15,19 @@
 //  GPL v2
 //
 #include <float.h>
+#include <limits.h>
 #include <oclUtils.h>
 #include <pthread.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <dijkstraFrontier.h>
+#include <dijkstraDirection.h>
+#include <dijkstraWarmStart.h>
+#include <dijkstraCheckpoint.h>
+#include <dijkstraMemory.h>
+#include <dijkstraMetrics.h>
+#include <dijkstraVerify.h>
 #include "oclDijkstraKernel.h"
 
 ///
@@ -24,37 +35,170 @@
 //
 const int NUM_ASYNC_ITERATIONS = 1;
 
+// Longest build option string generated for a specialized program
+const int OCL_BUILD_OPTIONS_MAX = 256;
+
+// Longest device name kept for the direction switch log and snapshots
+const int OCL_DEVICE_NAME_MAX = 64;
+
+// Longest driver version a snapshot matches program binaries against
+const int OCL_DRIVER_VERSION_MAX = 64;
+
+// Hybrid mode tracks changed costs in blocks of 1 << HYBRID_BLOCK_SHIFT
+// vertices and moves only the changed blocks between host and device
+const int HYBRID_BLOCK_SHIFT = 10;
+
+// Largest work-group that runs one query of a batch of small graphs
+const size_t BATCHED_LOCAL_SIZE_MAX = 128;
+
 ///
 //  Types
 //
 
-// This structure is used in the multi-GPU implementation of the algorithm.
-// This structure defines the workload for each GPU.  The code chunks up
-// the work on a per-GPU basis.
+// Everything one device needs to run searches on a graph.  The graph arrays
+// are copied to the device when the session is created; the host arrays are
+// not referenced afterwards, except by hybrid and warm-started sessions.  A
+// host copy of the vertex array sizes the frontier for push/pull switching and
+// the relaxation counts; sessions that switch between push and pull also hold
+// the reverse graph on the device.
+struct OCLDijkstraSession
+{
+    // Device and its queue
+    cl_context context;
+    cl_device_id deviceId;
+    cl_command_queue commandQueue;
+
+    // Program and kernels
+    cl_program program;
+    cl_kernel initializeBuffersKernel;
+    cl_kernel ssspKernel1;
+    cl_kernel ssspKernel2;
+    cl_kernel ssspPullKernel;
+
+    // Graph dimensions
+    int vertexCount;
+    int edgeCount;
+
+    // NDRange, globalWorkSize is vertexCount rounded up to localWorkSize
+    size_t localWorkSize;
+    size_t globalWorkSize;
+
+    // Device buffers
+    cl_mem vertexArrayDevice;
+    cl_mem edgeArrayDevice;
+    cl_mem weightArrayDevice;
+    cl_mem maskArrayDevice;
+    cl_mem costArrayDevice;
+    cl_mem updatingCostArrayDevice;
+
+    // Host copy of the mask, read back every iteration
+    int maskWordCount;
+    FrontierWord *maskArrayHost;
+
+    // Host copy of the vertex array, to count the edges of a frontier
+    GraphData vertexOffsetsHost;
+
+    // Push/pull switching, ssspPullKernel is NULL when disabled
+    SSSPDirectionPolicy directionPolicy;
+    cl_mem reverseVertexArrayDevice;
+    cl_mem reverseEdgeArrayDevice;
+    cl_mem reverseWeightArrayDevice;
+    char deviceName[OCL_DEVICE_NAME_MAX];
+
+    // Persistent-threads engine, persistentKernel is NULL when disabled
+    cl_kernel persistentKernel;
+    cl_kernel initializePersistentKernel;
+    cl_mem inQueueDevice;
+    cl_mem queueDevice;
+    cl_mem countersDevice;
+    cl_uint queueMask;
+    size_t persistentGlobalWorkSize;
+
+    // Hybrid host/device execution, hybridGraph is NULL when disabled.  The
+    // dirty bitmaps hold one bit per block of costs changed on that side
+    // since the state last moved to the other side.  touchedVerticesHost
+    // lists the vertices a host iteration lowered the updating cost of.
+    const GraphData *hybridGraph;
+    int hybridDeviceFrontier;
+    int hybridHostFrontier;
+    float *updatingCostArrayHost;
+    int *touchedVerticesHost;
+    int blockWordCount;
+    FrontierWord *hostDirtyBlocks;
+    FrontierWord *deviceDirtyBlocks;
+
+    // Warm start, warmStartGraph is NULL when disabled.  seedCostsHost holds
+    // the upper bounds uploaded in place of the initial costs.
+    const GraphData *warmStartGraph;
+    float *seedCostsHost;
+
+    // Memory account of the device and the bytes reserved in it
+    int memoryDevice;
+    size_t graphBytes;
+    size_t stateBytes;
+};
+
+// A built program, keyed by device and the build options it was built with
 typedef struct
 {
-    // Context
     cl_context context;
+    cl_device_id deviceId;
+    std::string options;
+    cl_program program;
+
+} CachedProgram;
+
+// Program binary kept in a snapshot, followed by binarySize bytes.  The
+// binary is only loaded on a device with the same name and driver version.
+typedef struct
+{
+    char deviceName[OCL_DEVICE_NAME_MAX];
+    char driverVersion[OCL_DRIVER_VERSION_MAX];
+    char options[OCL_BUILD_OPTIONS_MAX];
+    long long binarySize;
 
-    // Device number to run algorithm on
+} OCLProgramRecord;
+
+// Memory account of a device, see getOCLMemoryDevice()
+typedef struct
+{
     cl_device_id deviceId;
+    int memoryDevice;
+
+} OCLMemoryDevice;
+
+///
+//  Globals
+//
+
+// Programs built so far.  Sessions for graphs of the same shape on the same
+// device share one program, so the compiler only runs once per shape.
+static std::vector<CachedProgram> programCache;
+static pthread_mutex_t programCacheLock = PTHREAD_MUTEX_INITIALIZER;
 
-    // Pointer to graph data
-    GraphData *graph;
+// Whether sessions build programs specialized for their graph
+static bool kernelSpecialization = true;
 
-    // Source vertex indices to process
-    int *sourceVertices;
+// Whether sessions switch between push and pull iterations
+static bool directionSwitching = false;
 
-    // End vertex indices to process
-    int *endVertices;
+// Whether sessions run each search in one launch of the persistent kernel
+static bool persistentKernel = false;
 
-    // Results of processing
-    float *outResultCosts;
+// Hybrid host/device execution and its frontier thresholds
+static bool hybridExecution = false;
+static int hybridDeviceFrontier = 4096;
+static int hybridHostFrontier = 1024;
 
-    // Number of results
-    int numResults;
+// Warm-started batches, see dijkstraWarmStart.h
+static bool warmStart = false;
 
-} DevicePlan;
+// Work done by the searches of every session since resetOCLSearchStats()
+static OCLSearchStats searchStats = { 0, 0, 0, 0 };
+
+// Memory accounts of the devices seen so far
+static std::vector<OCLMemoryDevice> memoryDevices;
+static pthread_mutex_t memoryDevicesLock = PTHREAD_MUTEX_INITIALIZER;
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -63,13 +207,47 @@ typedef struct
 //
 //
 
+///
+/// Create one backend for every device of each context, either may be NULL
+///
+static void createDeviceBackends( cl_context gpuContext, cl_context cpuContext,
+                                  std::vector<SSSPBackend*> *outBackends )
+{
+    cl_context contexts[2] = { gpuContext, cpuContext };
+
+    for (int c = 0; c < 2; c++)
+    {
+        if (contexts[c] == NULL)
+        {
+            continue;
+        }
+
+        // Find out how many devices to compute on
+        cl_int errNum;
+        size_t deviceBytes;
+        errNum = clGetContextInfo(contexts[c], CL_CONTEXT_DEVICES, 0, NULL, &deviceBytes);
+        shrCheckError(errNum, CL_SUCCESS);
+        cl_uint deviceCount = (cl_uint)deviceBytes/sizeof(cl_device_id);
+
+        for (unsigned int i = 0; i < deviceCount; i++)
+        {
+            cl_device_id deviceId = oclGetDev(contexts[c], i);
+            oclPrintDevInfo(LOGBOTH, deviceId);
+            outBackends->push_back(createOCLBackend(contexts[c], deviceId, "opencl"));
+        }
+    }
+}
+
 ///
 /// Load and build an OpenCL program from source file
 /// \param gpuContext GPU context on which to load and build the program
+/// \param deviceId Device to build the program for
 /// \param fileName File name of source file that holds the kernels
-/// \return Handle to the program
+/// \param options Build options, "" for the generic program
+/// \return Handle to the program, NULL if the build failed
 ///
-cl_program loadAndBuildProgram( cl_context gpuContext, const char *fileName )
+cl_program loadAndBuildProgram( cl_context gpuContext, cl_device_id deviceId, const char *fileName,
+                                const char *options )
 {
     size_t programLength;
     cl_int errNum;
@@ -83,45 +261,112 @@ cl_program loadAndBuildProgram( cl_context gpuContext, const char *fileName )
 
     // Create the program for all GPUs in the context
     program = clCreateProgramWithSource(gpuContext, 1, (const char **)&source, &programLength, &errNum);
+    free(source);
     shrCheckError(errNum, CL_SUCCESS);
     shrLog("clCreateProgramWithSource\n");
 
-    // build the program for all devices on the context
-    errNum = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
+    // build the program for the device the session runs on
+    errNum = clBuildProgram(program, 1, &deviceId, options, NULL, NULL);
     if (errNum != CL_SUCCESS)
     {
-        // write out standard error, Build Log and PTX, then cleanup and exit
+        // write out standard error, Build Log and PTX, then cleanup
         shrLogEx(LOGBOTH | ERRORMSG, (double)errNum, STDERROR);
-        oclLogBuildInfo(program, oclGetFirstDev(gpuContext));
-        oclLogPtx(program, oclGetFirstDev(gpuContext), "oclDijkstra.ptx");
-        shrCheckError(errNum, CL_SUCCESS);
+        oclLogBuildInfo(program, deviceId);
+        oclLogPtx(program, deviceId, "oclDijkstra.ptx");
+        clReleaseProgram(program);
+        return NULL;
     }
-    shrLog("clBuildProgram\n");
+    shrLog("clBuildProgram %s\n", options);
 
     return program;
 }
 
 ///
-/// Check whether the mask array is empty.  This tells the algorithm whether
-/// it needs to continue running or not.
+/// Build options that turn the graph dimensions and launch configuration into
+/// compile-time constants, see the specialization notes in dijkstra.cl
 ///
-bool maskArrayEmpty(int *maskArray, int count)
+void buildSpecializationOptions( const GraphData *graph, size_t localWorkSize,
+                                 char *options, size_t optionsSize )
 {
-    for(int i = 0; i < count; i++ )
+    int written = snprintf(options, optionsSize, "-D VERTEX_COUNT=%d -D EDGE_COUNT=%d -D LOCAL_SIZE=%d -D WEIGHT_T=float",
+                           graph->vertexCount, graph->edgeCount, (int) localWorkSize);
+
+    // Generated graphs give every vertex the same number of edges, which lets
+    // KERNEL1 compute the edge range and unroll the edge loop
+    if (graph->vertexCount > 0 && graph->edgeCount % graph->vertexCount == 0)
     {
-        if (maskArray[i] == 1)
+        int degree = graph->edgeCount / graph->vertexCount;
+        bool uniform = true;
+        for (int v = 0; v < graph->vertexCount && uniform; v++)
         {
-            return false;
+            uniform = (graph->vertexArray[v] == v * degree);
+        }
+
+        if (uniform && written > 0 && (size_t) written < optionsSize)
+        {
+            snprintf(options + written, optionsSize - written, " -D UNIFORM_DEGREE=%d", degree);
+        }
+    }
+}
+
+///
+/// Get the program for a device and set of build options, building it on
+/// first use.  The returned program carries a reference owned by the caller.
+///
+cl_program getCachedProgram( cl_context context, cl_device_id deviceId, const char *options )
+{
+    cl_program program = NULL;
+
+    pthread_mutex_lock(&programCacheLock);
+
+    for (size_t i = 0; i < programCache.size() && program == NULL; i++)
+    {
+        if (programCache[i].context == context && programCache[i].deviceId == deviceId &&
+            programCache[i].options == options)
+        {
+            program = programCache[i].program;
+        }
+    }
+
+    // Looked up per call, programs are fetched once per session
+    if (program != NULL)
+    {
+        addMetric(getMetricCounter("sssp_program_cache_hits_total",
+                                   "OpenCL program lookups served from the cache.", NULL), 1.0);
+    }
+    else
+    {
+        addMetric(getMetricCounter("sssp_program_cache_misses_total",
+                                   "OpenCL program lookups that built the program.", NULL), 1.0);
+    }
+
+    if (program == NULL)
+    {
+        program = loadAndBuildProgram( context, deviceId, "dijkstra.cl", options );
+        if (program != NULL)
+        {
+            CachedProgram entry;
+            entry.context = context;
+            entry.deviceId = deviceId;
+            entry.options = options;
+            entry.program = program;
+            programCache.push_back(entry);
         }
     }
 
-    return true;
+    if (program != NULL)
+    {
+        clRetainProgram(program);
+    }
+
+    pthread_mutex_unlock(&programCacheLock);
+    return program;
 }
 
 ///
 ///  Allocate memory for input CUDA buffers and copy the data into device memory
 ///
-void allocateOCLBuffers(cl_context gpuContext, cl_command_queue commandQueue, GraphData *graph,
+void allocateOCLBuffers(cl_context gpuContext, cl_command_queue commandQueue, const GraphData *graph,
                         cl_mem *vertexArrayDevice, cl_mem *edgeArrayDevice, cl_mem *weightArrayDevice,
                         cl_mem *maskArrayDevice, cl_mem *costArrayDevice, cl_mem *updatingCostArrayDevice,
                         size_t globalWorkSize)
@@ -132,6 +377,8 @@ void allocateOCLBuffers(cl_context gpuContext, cl_command_queue commandQueue, Gr
     cl_mem hostWeightArrayBuffer;
 
     // First, need to create OpenCL Host buffers that can be copied to device buffers
+    size_t stagingBytes = sizeof(int) * graph->vertexCount + (sizeof(int) + sizeof(float)) * graph->edgeCount;
+    chargeMemory(MEMORY_HOST, MEMORY_STAGING, stagingBytes);
     hostVertexArrayBuffer = clCreateBuffer(gpuContext, CL_MEM_COPY_HOST_PTR | CL_MEM_ALLOC_HOST_PTR,
                                            sizeof(int) * graph->vertexCount, graph->vertexArray, &errNum);
     shrCheckError(errNum, CL_SUCCESS);
@@ -151,7 +398,8 @@ void allocateOCLBuffers(cl_context gpuContext, cl_command_queue commandQueue, Gr
     shrCheckError(errNum, CL_SUCCESS);
     *weightArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_ONLY, sizeof(float) * graph->edgeCount, NULL, &errNum);
     shrCheckError(errNum, CL_SUCCESS);
-    *maskArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, sizeof(int) * globalWorkSize, NULL, &errNum);
+    *maskArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, sizeof(cl_uint) * (globalWorkSize / FRONTIER_WORD_BITS),
+                                      NULL, &errNum);
     shrCheckError(errNum, CL_SUCCESS);
     *costArrayDevice = clCreateBuffer(gpuContext, CL_MEM_READ_WRITE, sizeof(float) * globalWorkSize, NULL, &errNum);
     shrCheckError(errNum, CL_SUCCESS);
@@ -174,18 +422,16 @@ void allocateOCLBuffers(cl_context gpuContext, cl_command_queue commandQueue, Gr
     clReleaseMemObject(hostVertexArrayBuffer);
     clReleaseMemObject(hostEdgeArrayBuffer);
     clReleaseMemObject(hostWeightArrayBuffer);
+    releaseMemory(MEMORY_HOST, MEMORY_STAGING, stagingBytes);
 }
 
 ///
 /// Initialize OpenCL buffers for single run of Dijkstra
 ///
-void initializeOCLBuffers(cl_command_queue commandQueue, cl_kernel initializeKernel, GraphData *graph,
-                          size_t maxWorkGroupSize)
+void initializeOCLBuffers(cl_command_queue commandQueue, cl_kernel initializeKernel,
+                          size_t localWorkSize, size_t globalWorkSize)
 {
     cl_int errNum;
-    // Set # of work items in work group and total in 1 dimensional range
-    size_t localWorkSize = maxWorkGroupSize;
-    size_t globalWorkSize = shrRoundUp(localWorkSize, graph->vertexCount);
 
     errNum = clEnqueueNDRangeKernel(commandQueue, initializeKernel, 1, NULL, &globalWorkSize, &localWorkSize,
                                     0, NULL, NULL);
@@ -193,396 +439,1086 @@ void initializeOCLBuffers(cl_command_queue commandQueue, cl_kernel initializeKer
 }
 
 ///
-/// Worker thread for running the algorithm on one of the compute devices
+/// Upload the reverse graph and create the pull kernel of a session
 ///
-void dijkstraThread(DevicePlan *plan)
+void createPullKernel( OCLDijkstraSession *session, const GraphData *graph )
 {
-    runDijkstra( plan->context, plan->deviceId, plan->graph, plan->sourceVertices,
-                 plan->outResultCosts, plan->numResults );
+    cl_int errNum;
+    GraphData reverseGraph;
+    buildReverseGraph(graph, &reverseGraph);
 
-    shrLog("Thread Done Device (%d)\n", plan->deviceId );
-}
+    session->reverseVertexArrayDevice = clCreateBuffer(session->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                                       sizeof(int) * graph->vertexCount, reverseGraph.vertexArray, &errNum);
+    shrCheckError(errNum, CL_SUCCESS);
+    session->reverseEdgeArrayDevice = clCreateBuffer(session->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                                     sizeof(int) * graph->edgeCount, reverseGraph.edgeArray, &errNum);
+    shrCheckError(errNum, CL_SUCCESS);
+    session->reverseWeightArrayDevice = clCreateBuffer(session->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                                       sizeof(float) * graph->edgeCount, reverseGraph.weightArray, &errNum);
+    shrCheckError(errNum, CL_SUCCESS);
+    freeGraph(&reverseGraph);
 
-///////////////////////////////////////////////////////////////////////////////
-//
-//  Public Functions
-//
-//
+    session->ssspPullKernel = clCreateKernel(session->program, "OCL_SSSP_PULL", &errNum);
+    shrCheckError(errNum, CL_SUCCESS);
+    errNum |= clSetKernelArg(session->ssspPullKernel, 0, sizeof(cl_mem), &session->reverseVertexArrayDevice);
+    errNum |= clSetKernelArg(session->ssspPullKernel, 1, sizeof(cl_mem), &session->reverseEdgeArrayDevice);
+    errNum |= clSetKernelArg(session->ssspPullKernel, 2, sizeof(cl_mem), &session->reverseWeightArrayDevice);
+    errNum |= clSetKernelArg(session->ssspPullKernel, 3, sizeof(cl_mem), &session->maskArrayDevice);
+    errNum |= clSetKernelArg(session->ssspPullKernel, 4, sizeof(cl_mem), &session->costArrayDevice);
+    errNum |= clSetKernelArg(session->ssspPullKernel, 5, sizeof(cl_mem), &session->updatingCostArrayDevice);
+    errNum |= clSetKernelArg(session->ssspPullKernel, 6, sizeof(int), &session->vertexCount);
+    errNum |= clSetKernelArg(session->ssspPullKernel, 7, sizeof(int), &session->edgeCount);
+    shrCheckError(errNum, CL_SUCCESS);
+
+    session->directionPolicy = getSSSPDirectionPolicy();
+    clGetDeviceInfo(session->deviceId, CL_DEVICE_NAME, sizeof(session->deviceName), session->deviceName, NULL);
+    session->deviceName[OCL_DEVICE_NAME_MAX - 1] = '\0';
+}
 
 ///
-/// Run Dijkstra's shortest path on the GraphData provided to this function.  This
-/// function will compute the shortest path distance from sourceVertices[n] ->
-/// endVertices[n] and store the cost in outResultCosts[n].  The number of results
-/// it will compute is given by numResults.
-///
-/// This function will run the algorithm on a single GPU.
-///
-/// \param gpuContext Current GPU context, must be created by caller
-/// \param deviceId The device ID on which to run the kernel.  This can
-///                 be determined externally by the caller or the multi
-///                 GPU version will automatically split the work across
-///                 devices
-/// \param graph Structure containing the vertex, edge, and weight arra
-///              for the input graph
-/// \param startVertices Indices into the vertex array from which to
-///                      start the search
-/// \param outResultsCosts A pre-allocated array where the results for
-///                        each shortest path search will be written
-/// \param numResults Should be the size of all three passed inarrays
+/// Allocate the work queue and create the kernels of the persistent engine
 ///
-void runDijkstra( cl_context gpuContext, cl_device_id deviceId, GraphData* graph,
-                  int *sourceVertices, float *outResultCosts, int numResults)
+void createPersistentKernel( OCLDijkstraSession *session )
 {
-    // Create command queue
     cl_int errNum;
-    cl_command_queue commandQueue;
-    commandQueue = clCreateCommandQueue( gpuContext, deviceId, 0, &errNum );
-    shrCheckError(errNum, CL_SUCCESS);
-    shrLog("clCreateCommandQueue\n\n");
 
-    // Program handle
-    cl_program program = loadAndBuildProgram( gpuContext, "dijkstra.cl" );
-    if (program <= 0 )
+    // The ring needs more slots than vertices, see dijkstra.cl
+    cl_uint queueSize = 1;
+    while (queueSize <= (cl_uint) session->vertexCount)
     {
-        return;
+        queueSize <<= 1;
     }
+    session->queueMask = queueSize - 1;
 
-    // Get the max workgroup size
-    size_t maxWorkGroupSize;
-    clGetDeviceInfo(deviceId, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &maxWorkGroupSize, NULL);
+    session->inQueueDevice = clCreateBuffer(session->context, CL_MEM_READ_WRITE, sizeof(cl_int) * session->globalWorkSize,
+                                            NULL, &errNum);
     shrCheckError(errNum, CL_SUCCESS);
-    shrLog("MAX_WORKGROUP_SIZE: %d\n", maxWorkGroupSize);
-
-    // Set # of work items in work group and total in 1 dimensional range
-    size_t localWorkSize = maxWorkGroupSize;
-    size_t globalWorkSize = shrRoundUp(localWorkSize, graph->vertexCount);
-
-    cl_mem vertexArrayDevice;
-    cl_mem edgeArrayDevice;
-    cl_mem weightArrayDevice;
-    cl_mem maskArrayDevice;
-    cl_mem costArrayDevice;
-    cl_mem updatingCostArrayDevice;
-
-    // Allocate buffers in Device memory
-    allocateOCLBuffers( gpuContext, commandQueue, graph, &vertexArrayDevice, &edgeArrayDevice, &weightArrayDevice,
-                        &maskArrayDevice, &costArrayDevice, &updatingCostArrayDevice, globalWorkSize);
-
-
-    // Create the Kernels
-    cl_kernel initializeBuffersKernel;
-    initializeBuffersKernel = clCreateKernel(program, "initializeBuffers", &errNum);
+    session->queueDevice = clCreateBuffer(session->context, CL_MEM_READ_WRITE, sizeof(cl_int) * queueSize, NULL, &errNum);
+    shrCheckError(errNum, CL_SUCCESS);
+    session->countersDevice = clCreateBuffer(session->context, CL_MEM_READ_WRITE, sizeof(cl_uint) * 3, NULL, &errNum);
     shrCheckError(errNum, CL_SUCCESS);
 
-    // Set the args values and check for errors
-    errNum |= clSetKernelArg(initializeBuffersKernel, 0, sizeof(cl_mem), &maskArrayDevice);
-    errNum |= clSetKernelArg(initializeBuffersKernel, 1, sizeof(cl_mem), &costArrayDevice);
-    errNum |= clSetKernelArg(initializeBuffersKernel, 2, sizeof(cl_mem), &updatingCostArrayDevice);
-
-    // 3 set below in loop
-    errNum |= clSetKernelArg(initializeBuffersKernel, 4, sizeof(cl_int), &graph->vertexCount);
+    // The work-groups spin on each other, so they must all be resident: launch
+    // one per compute unit
+    cl_uint computeUnits;
+    errNum = clGetDeviceInfo(session->deviceId, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL);
     shrCheckError(errNum, CL_SUCCESS);
+    session->persistentGlobalWorkSize = session->localWorkSize * computeUnits;
 
-    // Kernel 1
-    cl_kernel ssspKernel1;
-    ssspKernel1 = clCreateKernel(program, "OCL_SSSP_KERNEL1", &errNum);
+    // The costs live in costArrayDevice as int bits
+    session->initializePersistentKernel = clCreateKernel(session->program, "initializePersistent", &errNum);
     shrCheckError(errNum, CL_SUCCESS);
-    errNum |= clSetKernelArg(ssspKernel1, 0, sizeof(cl_mem), &vertexArrayDevice);
-    errNum |= clSetKernelArg(ssspKernel1, 1, sizeof(cl_mem), &edgeArrayDevice);
-    errNum |= clSetKernelArg(ssspKernel1, 2, sizeof(cl_mem), &weightArrayDevice);
-    errNum |= clSetKernelArg(ssspKernel1, 3, sizeof(cl_mem), &maskArrayDevice);
-    errNum |= clSetKernelArg(ssspKernel1, 4, sizeof(cl_mem), &costArrayDevice);
-    errNum |= clSetKernelArg(ssspKernel1, 5, sizeof(cl_mem), &updatingCostArrayDevice);
-    errNum |= clSetKernelArg(ssspKernel1, 6, sizeof(int), &graph->vertexCount);
-    errNum |= clSetKernelArg(ssspKernel1, 7, sizeof(int), &graph->edgeCount);
+    errNum |= clSetKernelArg(session->initializePersistentKernel, 0, sizeof(cl_mem), &session->costArrayDevice);
+    errNum |= clSetKernelArg(session->initializePersistentKernel, 1, sizeof(cl_mem), &session->inQueueDevice);
+    errNum |= clSetKernelArg(session->initializePersistentKernel, 2, sizeof(cl_mem), &session->queueDevice);
+    errNum |= clSetKernelArg(session->initializePersistentKernel, 3, sizeof(cl_mem), &session->countersDevice);
+    errNum |= clSetKernelArg(session->initializePersistentKernel, 4, sizeof(cl_uint), &session->queueMask);
+
+    // 5 set in runPersistentSession()
+    errNum |= clSetKernelArg(session->initializePersistentKernel, 6, sizeof(int), &session->vertexCount);
     shrCheckError(errNum, CL_SUCCESS);
 
-    // Kernel 2
-    cl_kernel ssspKernel2;
-    ssspKernel2 = clCreateKernel(program, "OCL_SSSP_KERNEL2", &errNum);
+    session->persistentKernel = clCreateKernel(session->program, "OCL_SSSP_PERSISTENT", &errNum);
     shrCheckError(errNum, CL_SUCCESS);
-    errNum |= clSetKernelArg(ssspKernel2, 0, sizeof(cl_mem), &vertexArrayDevice);
-    errNum |= clSetKernelArg(ssspKernel2, 1, sizeof(cl_mem), &edgeArrayDevice);
-    errNum |= clSetKernelArg(ssspKernel2, 2, sizeof(cl_mem), &weightArrayDevice);
-    errNum |= clSetKernelArg(ssspKernel2, 3, sizeof(cl_mem), &maskArrayDevice);
-    errNum |= clSetKernelArg(ssspKernel2, 4, sizeof(cl_mem), &costArrayDevice);
-    errNum |= clSetKernelArg(ssspKernel2, 5, sizeof(cl_mem), &updatingCostArrayDevice);
-    errNum |= clSetKernelArg(ssspKernel2, 6, sizeof(int), &graph->vertexCount);
-
+    errNum |= clSetKernelArg(session->persistentKernel, 0, sizeof(cl_mem), &session->vertexArrayDevice);
+    errNum |= clSetKernelArg(session->persistentKernel, 1, sizeof(cl_mem), &session->edgeArrayDevice);
+    errNum |= clSetKernelArg(session->persistentKernel, 2, sizeof(cl_mem), &session->weightArrayDevice);
+    errNum |= clSetKernelArg(session->persistentKernel, 3, sizeof(cl_mem), &session->costArrayDevice);
+    errNum |= clSetKernelArg(session->persistentKernel, 4, sizeof(cl_mem), &session->inQueueDevice);
+    errNum |= clSetKernelArg(session->persistentKernel, 5, sizeof(cl_mem), &session->queueDevice);
+    errNum |= clSetKernelArg(session->persistentKernel, 6, sizeof(cl_mem), &session->countersDevice);
+    errNum |= clSetKernelArg(session->persistentKernel, 7, sizeof(cl_uint), &session->queueMask);
+    errNum |= clSetKernelArg(session->persistentKernel, 8, sizeof(int), &session->vertexCount);
+    errNum |= clSetKernelArg(session->persistentKernel, 9, sizeof(int), &session->edgeCount);
+    errNum |= clSetKernelArg(session->persistentKernel, 10, sizeof(cl_uint) * 2, NULL);
     shrCheckError(errNum, CL_SUCCESS);
+}
 
-    int *maskArrayHost = (int*) malloc(sizeof(int) * graph->vertexCount);
+///
+/// Run a batch of sources with the persistent kernel, one launch per source
+///
+bool runPersistentSession( OCLDijkstraSession *session, const int *sourceVertices,
+                           float *outResultCosts, int numResults )
+{
+    cl_int errNum = CL_SUCCESS;
+    cl_uint counters[3];
+    long long queuedVertexCount = 0;
 
     shrLog("Num results: %d\n", numResults);
 
     for ( int i = 0 ; i < numResults; i++ )
     {
-
-        errNum |= clSetKernelArg(initializeBuffersKernel, 3, sizeof(int), &sourceVertices[i]);
+        errNum = clSetKernelArg(session->initializePersistentKernel, 5, sizeof(int), &sourceVertices[i]);
         shrCheckError(errNum, CL_SUCCESS);
+        initializeOCLBuffers( session->commandQueue, session->initializePersistentKernel,
+                              session->localWorkSize, session->globalWorkSize );
 
-        // Initialize mask array to false, C and U to infiniti
-        initializeOCLBuffers( commandQueue, initializeBuffersKernel, graph, maxWorkGroupSize );
+        errNum = clEnqueueNDRangeKernel(session->commandQueue, session->persistentKernel, 1, 0,
+                                        &session->persistentGlobalWorkSize, &session->localWorkSize,
+                                        0, NULL, NULL);
+        shrCheckError(errNum, CL_SUCCESS);
 
-        // Read mask array from device -> host
-        cl_event readDone;
+        // The costs are final when the launch returns
+        errNum = clEnqueueReadBuffer(session->commandQueue, session->costArrayDevice, CL_FALSE, 0,
+                                     sizeof(float) * session->vertexCount,
+                                     &outResultCosts[(size_t) i * session->vertexCount], 0, NULL, NULL);
+        shrCheckError(errNum, CL_SUCCESS);
 
-        errNum = clEnqueueReadBuffer( commandQueue, maskArrayDevice, CL_FALSE, 0, sizeof(unsigned char) * graph->vertexCount,
-                                      maskArrayHost, 0, NULL, &readDone);
+        errNum = clEnqueueReadBuffer(session->commandQueue, session->countersDevice, CL_TRUE, 0,
+                                     sizeof(counters), counters, 0, NULL, NULL);
         shrCheckError(errNum, CL_SUCCESS);
-        clWaitForEvents(1, &readDone);
+        queuedVertexCount += counters[1];
+    }
 
-        while(!maskArrayEmpty(maskArrayHost, graph->vertexCount))
-        {
+    shrLog("Launches: %d, queued vertices: %lld\n", numResults, queuedVertexCount);
 
-            //for (int asyncIter = 0; asyncIter < NUM_ASYNC_ITERATIONS; asyncIter++)
-            {
-                size_t localWorkSize = maxWorkGroupSize;
-                size_t globalWorkSize = shrRoundUp(localWorkSize, graph->vertexCount);
+    return errNum == CL_SUCCESS;
+}
 
-                // execute the kernel
-                errNum = clEnqueueNDRangeKernel(commandQueue, ssspKernel1, 1, 0, &globalWorkSize, &localWorkSize,
-                                               0, NULL, NULL);
-                shrCheckError(errNum, CL_SUCCESS);
+///
+/// Run one iteration on the device, pushing or pulling as the direction
+/// policy decides, and read the next frontier back into maskArrayHost
+///
+void runDeviceIteration( OCLDijkstraSession *session, SSSPDirection *direction, int iteration,
+                         int frontierVertexCount )
+{
+    cl_int errNum;
 
-                errNum = clEnqueueNDRangeKernel(commandQueue, ssspKernel2, 1, 0, &globalWorkSize, &localWorkSize,
-                                               0, NULL, NULL);
-                shrCheckError(errNum, CL_SUCCESS);
-            }
-            errNum = clEnqueueReadBuffer(commandQueue, maskArrayDevice, CL_FALSE, 0, sizeof(unsigned char) * graph->vertexCount,
-                                                         maskArrayHost, 0, NULL, &readDone);
-            shrCheckError(errNum, CL_SUCCESS);
-            clWaitForEvents(1, &readDone);
-        }
+    if (session->ssspPullKernel != NULL)
+    {
+        *direction = chooseSSSPDirection(&session->directionPolicy, &session->vertexOffsetsHost,
+                                         *direction, session->deviceName, iteration, frontierVertexCount,
+                                         frontierEdgeCount(&session->vertexOffsetsHost,
+                                                           session->maskArrayHost, session->maskWordCount));
+    }
 
+    //for (int asyncIter = 0; asyncIter < NUM_ASYNC_ITERATIONS; asyncIter++)
+    {
+        // execute the kernel, pushing along out-edges or pulling along in-edges
+        cl_kernel relaxKernel = (*direction == SSSP_PULL) ? session->ssspPullKernel : session->ssspKernel1;
+        errNum = clEnqueueNDRangeKernel(session->commandQueue, relaxKernel, 1, 0,
+                                        &session->globalWorkSize, &session->localWorkSize,
+                                        0, NULL, NULL);
+        shrCheckError(errNum, CL_SUCCESS);
 
-        // Copy the result back
-        errNum = clEnqueueReadBuffer(commandQueue, costArrayDevice, CL_FALSE, 0, sizeof(float) * graph->vertexCount,
-                                     &outResultCosts[i * graph->vertexCount], 0, NULL, &readDone);
+        errNum = clEnqueueNDRangeKernel(session->commandQueue, session->ssspKernel2, 1, 0,
+                                        &session->globalWorkSize, &session->localWorkSize,
+                                        0, NULL, NULL);
         shrCheckError(errNum, CL_SUCCESS);
-        clWaitForEvents(1, &readDone);
     }
-
-    free (maskArrayHost);
-
-    clReleaseMemObject(vertexArrayDevice);
-    clReleaseMemObject(edgeArrayDevice);
-    clReleaseMemObject(weightArrayDevice);
-    clReleaseMemObject(maskArrayDevice);
-    clReleaseMemObject(costArrayDevice);
-    clReleaseMemObject(updatingCostArrayDevice);
-
-    clReleaseKernel(initializeBuffersKernel);
-    clReleaseKernel(ssspKernel1);
-    clReleaseKernel(ssspKernel2);
-
-    clReleaseCommandQueue(commandQueue);
-    clReleaseProgram(program);
+    errNum = clEnqueueReadBuffer(session->commandQueue, session->maskArrayDevice, CL_TRUE, 0,
+                                 sizeof(FrontierWord) * session->maskWordCount,
+                                 session->maskArrayHost, 0, NULL, NULL);
+    shrCheckError(errNum, CL_SUCCESS);
 }
 
-
-
 ///
-/// Run Dijkstra's shortest path on the GraphData provided to this function.  This
-/// function will compute the shortest path distance from sourceVertices[n] ->
-/// endVertices[n] and store the cost in outResultCosts[n].  The number of results
-/// it will compute is given by numResults.
+/// Allocate the host state of hybrid execution
 ///
-/// This function will run the algorithm on as many GPUs as is available.  It will
-/// create N threads, one for each GPU, and chunk the workload up to perform
-/// (numResults / N) searches per GPU.
+void createHybridState( OCLDijkstraSession *session, const GraphData *graph )
+{
+    int blockCount = (graph->vertexCount + (1 << HYBRID_BLOCK_SHIFT) - 1) >> HYBRID_BLOCK_SHIFT;
+
+    session->hybridGraph = graph;
+    session->hybridDeviceFrontier = hybridDeviceFrontier;
+    session->hybridHostFrontier = hybridHostFrontier;
+    session->updatingCostArrayHost = (float*) trackedMalloc(MEMORY_STATE, sizeof(float) * graph->vertexCount);
+    session->touchedVerticesHost = (int*) trackedMalloc(MEMORY_STATE, sizeof(int) * graph->vertexCount);
+    session->blockWordCount = frontierWordCount(blockCount);
+    session->hostDirtyBlocks = (FrontierWord*) trackedMalloc(MEMORY_STATE,
+                                                             sizeof(FrontierWord) * session->blockWordCount);
+    session->deviceDirtyBlocks = (FrontierWord*) trackedMalloc(MEMORY_STATE,
+                                                               sizeof(FrontierWord) * session->blockWordCount);
+}
+
 ///
-/// \param gpuContext Current GPU context, must be created by caller
-/// \param graph Structure containing the vertex, edge, and weight arra
-///              for the input graph
-/// \param startVertices Indices into the vertex array from which to
-///                      start the search
-/// \param endVertices Indices into the vertex array from which to end
-///                    the search.
-/// \param outResultsCosts A pre-allocated array where the results for
-///                        each shortest path search will be written
-/// \param numResults Should be the size of all three passed inarrays
+/// Mark the blocks of the vertices in a frontier dirty.  The frontier after an
+/// iteration is exactly the set of vertices whose cost changed.
+///
+void markDirtyBlocks( FrontierWord *dirtyBlocks, const FrontierWord *frontier, int wordCount )
+{
+    const int wordsPerBlockShift = HYBRID_BLOCK_SHIFT - FRONTIER_WORD_SHIFT;
+    for (int word = 0; word < wordCount; word++)
+    {
+        if (frontier[word] != 0)
+        {
+            frontierSet(dirtyBlocks, word >> wordsPerBlockShift);
+        }
+    }
+}
+
 ///
+/// Copy the dirty cost blocks between host and device, one transfer per run
+/// of consecutive dirty blocks, and clear the dirty bitmap
 ///
-void runDijkstraMultiGPU( cl_context gpuContext, GraphData* graph, int *sourceVertices,
-                          float *outResultCosts, int numResults )
+void transferDirtyBlocks( OCLDijkstraSession *session, FrontierWord *dirtyBlocks, float *costArray,
+                          bool toDevice )
 {
+    cl_int errNum = CL_SUCCESS;
+    int blockCount = (session->vertexCount + (1 << HYBRID_BLOCK_SHIFT) - 1) >> HYBRID_BLOCK_SHIFT;
 
-    // Find out how many GPU's to compute on all available GPUs
-    cl_int errNum;
-    size_t deviceBytes;
-    cl_uint deviceCount;
+    for (int block = 0; block < blockCount; block++)
+    {
+        if (!frontierTest(dirtyBlocks, block))
+        {
+            continue;
+        }
 
-    errNum = clGetContextInfo(gpuContext, CL_CONTEXT_DEVICES, 0, NULL, &deviceBytes);
-    shrCheckError(errNum, CL_SUCCESS);
-    deviceCount = (cl_uint)deviceBytes/sizeof(cl_device_id);
+        int lastBlock = block;
+        while (lastBlock + 1 < blockCount && frontierTest(dirtyBlocks, lastBlock + 1))
+        {
+            lastBlock++;
+        }
 
-    if (deviceCount == 0)
-    {
-        shrLog("ERROR: no GPUs present!");
-        return;
+        int first = block << HYBRID_BLOCK_SHIFT;
+        int end = (lastBlock + 1) << HYBRID_BLOCK_SHIFT;
+        if (end > session->vertexCount)
+        {
+            end = session->vertexCount;
+        }
+        size_t offset = sizeof(float) * first;
+        size_t bytes = sizeof(float) * (end - first);
+
+        if (toDevice)
+        {
+            // Between iterations the updating costs equal the costs
+            errNum |= clEnqueueWriteBuffer(session->commandQueue, session->costArrayDevice, CL_FALSE,
+                                           offset, bytes, &costArray[first], 0, NULL, NULL);
+            errNum |= clEnqueueWriteBuffer(session->commandQueue, session->updatingCostArrayDevice, CL_FALSE,
+                                           offset, bytes, &costArray[first], 0, NULL, NULL);
+        }
+        else
+        {
+            errNum |= clEnqueueReadBuffer(session->commandQueue, session->costArrayDevice, CL_FALSE,
+                                          offset, bytes, &costArray[first], 0, NULL, NULL);
+        }
+
+        block = lastBlock;
     }
 
-    DevicePlan *devicePlans = (DevicePlan*) malloc(sizeof(DevicePlan) * deviceCount);
-    pthread_t *threadIDs = (pthread_t*) malloc(sizeof(pthread_t) * deviceCount);
+    shrCheckError(errNum, CL_SUCCESS);
+    clFinish(session->commandQueue);
 
-    // Divide the workload out per device
-    int resultsPerDevice = numResults / deviceCount;
+    memset(dirtyBlocks, 0, sizeof(FrontierWord) * session->blockWordCount);
+}
 
-    int offset = 0;
+///
+/// Run one iteration of the frontier algorithm on the host, the equivalent of
+/// OCL_SSSP_KERNEL1 and OCL_SSSP_KERNEL2, and mark the blocks it changed
+/// dirty.  Only the frontier and the vertices it lowers are visited, apart
+/// from a scan of the mask words, so that a small frontier stays cheap.
+///
+void runHostIteration( OCLDijkstraSession *session, float *costArray )
+{
+    const GraphData *graph = session->hybridGraph;
+    float *updatingCostArray = session->updatingCostArrayHost;
+    FrontierWord *maskArray = session->maskArrayHost;
+    int *touchedVertices = session->touchedVerticesHost;
+    int touchedCount = 0;
 
-    for (unsigned int i = 0; i < deviceCount; i++)
+    for (int word = 0; word < session->maskWordCount; word++)
     {
-        devicePlans[i].context = gpuContext;
-        devicePlans[i].deviceId = oclGetDev(gpuContext, i);;
-        devicePlans[i].graph = graph;
-        devicePlans[i].sourceVertices = &sourceVertices[offset];
-        devicePlans[i].outResultCosts = &outResultCosts[offset * graph->vertexCount];
-        devicePlans[i].numResults = resultsPerDevice;
+        FrontierWord bits = maskArray[word];
+        if (bits == 0)
+        {
+            continue;
+        }
+        maskArray[word] = 0;
 
-        oclPrintDevInfo(LOGBOTH, devicePlans[i].deviceId);
-        offset += resultsPerDevice;
-    }
+        while (bits != 0)
+        {
+            int tid = (word << FRONTIER_WORD_SHIFT) + frontierWordLowestBit(bits);
+            bits &= bits - 1;
 
-    // Add any remaining work to the last GPU
-    if (offset < numResults)
-    {
-        devicePlans[deviceCount - 1].numResults += (numResults - offset);
+            int edgeEnd = graphEdgeEnd(graph, tid);
+            for(int edge = graph->vertexArray[tid]; edge < edgeEnd; edge++)
+            {
+                int nid = graph->edgeArray[edge];
+                if (updatingCostArray[nid] > (costArray[tid] + graph->weightArray[edge]))
+                {
+                    // Between iterations the updating costs equal the costs,
+                    // so the first lowering of nid is the one to list
+                    if (updatingCostArray[nid] == costArray[nid])
+                    {
+                        touchedVertices[touchedCount++] = nid;
+                    }
+                    updatingCostArray[nid] = (costArray[tid] + graph->weightArray[edge]);
+                }
+            }
+        }
     }
 
-    // Launch all the threads
-    for (unsigned int i = 0; i < deviceCount; i++)
+    for (int i = 0; i < touchedCount; i++)
     {
-        pthread_create(&threadIDs[i], NULL, (void* (*)(void*))dijkstraThread, (void*)(devicePlans + i));
+        int tid = touchedVertices[i];
+        costArray[tid] = updatingCostArray[tid];
+        frontierSet(maskArray, tid);
+        frontierSet(session->hostDirtyBlocks, tid >> HYBRID_BLOCK_SHIFT);
     }
+}
 
-    // Wait for the results from all threads
-    for (unsigned int i = 0; i < deviceCount; i++)
-    {
-        pthread_join(threadIDs[i], NULL);
+///
+/// Run a batch of sources in hybrid mode.  Each search starts on the host and
+/// moves to the device once its frontier grows past hybridDeviceFrontier
+/// vertices, and back to the host once it shrinks below hybridHostFrontier.
+/// The frontier travels whole, the costs only as the blocks that changed on
+/// the side being left.
+///
+bool runHybridSession( OCLDijkstraSession *session, const int *sourceVertices,
+                       float *outResultCosts, int numResults )
+{
+    cl_int errNum = CL_SUCCESS;
+    int hostIterationCount = 0;
+    int deviceIterationCount = 0;
+    int migrationCount = 0;
+
+    shrLog("Num results: %d\n", numResults);
+
+    for ( int i = 0 ; i < numResults; i++ )
+    {
+        float *costArray = &outResultCosts[(size_t) i * session->vertexCount];
+
+        // Same initial state on both sides, so nothing is dirty yet
+        errNum = clSetKernelArg(session->initializeBuffersKernel, 3, sizeof(int), &sourceVertices[i]);
+        shrCheckError(errNum, CL_SUCCESS);
+        initializeOCLBuffers( session->commandQueue, session->initializeBuffersKernel,
+                              session->localWorkSize, session->globalWorkSize );
+
+        for (int v = 0; v < session->vertexCount; v++)
+        {
+            costArray[v] = FLT_MAX;
+            session->updatingCostArrayHost[v] = FLT_MAX;
+        }
+        costArray[sourceVertices[i]] = 0.0f;
+        session->updatingCostArrayHost[sourceVertices[i]] = 0.0f;
+
+        memset(session->maskArrayHost, 0, sizeof(FrontierWord) * session->maskWordCount);
+        frontierSet(session->maskArrayHost, sourceVertices[i]);
+        memset(session->hostDirtyBlocks, 0, sizeof(FrontierWord) * session->blockWordCount);
+        memset(session->deviceDirtyBlocks, 0, sizeof(FrontierWord) * session->blockWordCount);
+
+        bool onDevice = false;
+        SSSPDirection direction = SSSP_PUSH;
+        int frontierVertexCount;
+        for (int iteration = 0;
+             (frontierVertexCount = frontierSize(session->maskArrayHost, session->maskWordCount)) > 0;
+             iteration++)
+        {
+            if (!onDevice && frontierVertexCount > session->hybridDeviceFrontier)
+            {
+                transferDirtyBlocks( session, session->hostDirtyBlocks, costArray, true );
+                errNum = clEnqueueWriteBuffer(session->commandQueue, session->maskArrayDevice, CL_TRUE, 0,
+                                              sizeof(FrontierWord) * session->maskWordCount,
+                                              session->maskArrayHost, 0, NULL, NULL);
+                shrCheckError(errNum, CL_SUCCESS);
+                onDevice = true;
+                migrationCount++;
+            }
+            else if (onDevice && frontierVertexCount < session->hybridHostFrontier)
+            {
+                transferDirtyBlocks( session, session->deviceDirtyBlocks, costArray, false );
+                memcpy(session->updatingCostArrayHost, costArray, sizeof(float) * session->vertexCount);
+                onDevice = false;
+                migrationCount++;
+            }
+
+            if (onDevice)
+            {
+                runDeviceIteration( session, &direction, iteration, frontierVertexCount );
+                markDirtyBlocks( session->deviceDirtyBlocks, session->maskArrayHost, session->maskWordCount );
+                deviceIterationCount++;
+            }
+            else
+            {
+                runHostIteration( session, costArray );
+                hostIterationCount++;
+            }
+        }
+
+        // Collect what the device changed since the search last left the host
+        if (onDevice)
+        {
+            transferDirtyBlocks( session, session->deviceDirtyBlocks, costArray, false );
+        }
     }
 
-    free (devicePlans);
-    free (threadIDs);
+    shrLog("Host iterations: %d, device iterations: %d, migrations: %d\n",
+           hostIterationCount, deviceIterationCount, migrationCount);
+
+    return errNum == CL_SUCCESS;
 }
 
 ///
-/// Run Dijkstra's shortest path on the GraphData provided to this function.  This
-/// function will compute the shortest path distance from sourceVertices[n] ->
-/// endVertices[n] and store the cost in outResultCosts[n].  The number of results
-/// it will compute is given by numResults.
+/// Device bytes a session of the graph allocates under the current settings,
+/// mirroring createOCLDijkstraSession(): the graph arrays and the search state
 ///
-/// This function will run the algorithm on as many GPUs as is available along with
-/// the CPU.  It will create N threads, one for each device, and chunk the workload up to perform
-/// (numResults / N) searches per device.
-///
-/// \param gpuContext Current GPU context, must be created by caller
-/// \param cpuContext Current CPU context, must be created by caller
-/// \param graph Structure containing the vertex, edge, and weight arra
-///              for the input graph
-/// \param startVertices Indices into the vertex array from which to
-///                      start the search
-/// \param outResultsCosts A pre-allocated array where the results for
-///                        each shortest path search will be written
-/// \param numResults Should be the size of all three passed inarrays
+static void sessionDeviceBytes( cl_device_id deviceId, const GraphData *graph,
+                                size_t *outGraphBytes, size_t *outStateBytes )
+{
+    size_t maxWorkGroupSize = FRONTIER_WORD_BITS;
+    clGetDeviceInfo(deviceId, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &maxWorkGroupSize, NULL);
+    size_t localWorkSize = (maxWorkGroupSize / FRONTIER_WORD_BITS) * FRONTIER_WORD_BITS;
+    size_t globalWorkSize = shrRoundUp(localWorkSize, graph->vertexCount);
+
+    // Vertex array padded to the work size, plus the edges and their weights
+    size_t graphBytes = sizeof(int) * globalWorkSize +
+                        (sizeof(int) + sizeof(float)) * (size_t) graph->edgeCount;
+
+    // Mask, cost and updating cost arrays padded to the work size
+    size_t stateBytes = sizeof(cl_uint) * (globalWorkSize / FRONTIER_WORD_BITS) +
+                        2 * sizeof(float) * globalWorkSize;
+
+    if (directionSwitching)
+    {
+        graphBytes += sizeof(int) * (size_t) graph->vertexCount +
+                      (sizeof(int) + sizeof(float)) * (size_t) graph->edgeCount;
+    }
+
+    if (persistentKernel)
+    {
+        size_t queueSize = 1;
+        while (queueSize <= (size_t) graph->vertexCount)
+        {
+            queueSize <<= 1;
+        }
+        stateBytes += sizeof(cl_int) * globalWorkSize + sizeof(cl_int) * queueSize + sizeof(cl_uint) * 3;
+    }
+
+    *outGraphBytes = graphBytes;
+    *outStateBytes = stateBytes;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
 ///
+/// Upload a graph to a device and build the kernels for it.
 ///
-void runDijkstraMultiGPUandCPU( cl_context gpuContext, cl_context cpuContext, GraphData* graph,
-                                int *sourceVertices,
-                                float *outResultCosts, int numResults )
+OCLDijkstraSession *createOCLDijkstraSession( cl_context context, cl_device_id deviceId,
+                                              const GraphData *graph )
 {
-    float ratioCPUtoGPU = 1; // CPU seems to run it at 2.26X on GT120 GPU
-
-    // Find out how many GPU's to compute on all available GPUs
     cl_int errNum;
-    size_t deviceBytes;
-    cl_uint gpuDeviceCount;
-    cl_uint cpuDeviceCount;
 
-    errNum = clGetContextInfo(gpuContext, CL_CONTEXT_DEVICES, 0, NULL, &deviceBytes);
+    // Get the max workgroup size
+    size_t maxWorkGroupSize;
+    errNum = clGetDeviceInfo(deviceId, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &maxWorkGroupSize, NULL);
     shrCheckError(errNum, CL_SUCCESS);
-    gpuDeviceCount = (cl_uint)deviceBytes/sizeof(cl_device_id);
+    shrLog("MAX_WORKGROUP_SIZE: %d\n", maxWorkGroupSize);
+
+    // Set # of work items in work group and total in 1 dimensional range.  The
+    // work group packs its mask bits into whole words, so it must be a multiple
+    // of the mask word size.
+    size_t localWorkSize = (maxWorkGroupSize / FRONTIER_WORD_BITS) * FRONTIER_WORD_BITS;
 
-    if (gpuDeviceCount == 0)
+    // Program handle, specialized for this graph if possible
+    cl_program program = NULL;
+    if (kernelSpecialization)
     {
-        shrLog("ERROR: no GPUs present!");
-        return;
+        char options[OCL_BUILD_OPTIONS_MAX];
+        buildSpecializationOptions(graph, localWorkSize, options, sizeof(options));
+        program = getCachedProgram( context, deviceId, options );
+        if (program == NULL)
+        {
+            shrLog("Specialized build failed, falling back to the generic program\n");
+        }
+    }
+
+    if (program == NULL)
+    {
+        program = getCachedProgram( context, deviceId, "" );
+        if (program == NULL)
+        {
+            return NULL;
+        }
     }
 
-    errNum = clGetContextInfo(cpuContext, CL_CONTEXT_DEVICES, 0, NULL, &deviceBytes);
+    // Refuse the session if it would not fit in the device's memory limit
+    int memoryDevice = getOCLMemoryDevice(deviceId);
+    size_t graphBytes;
+    size_t stateBytes;
+    sessionDeviceBytes(deviceId, graph, &graphBytes, &stateBytes);
+    if (!reserveMemory(memoryDevice, MEMORY_GRAPH, graphBytes))
+    {
+        fprintf(stderr, "createOCLDijkstraSession: the graph does not fit in the memory limit of the device\n");
+        clReleaseProgram(program);
+        return NULL;
+    }
+    if (!reserveMemory(memoryDevice, MEMORY_STATE, stateBytes))
+    {
+        fprintf(stderr, "createOCLDijkstraSession: the search state does not fit in the memory limit of the device\n");
+        releaseMemory(memoryDevice, MEMORY_GRAPH, graphBytes);
+        clReleaseProgram(program);
+        return NULL;
+    }
+
+    OCLDijkstraSession *session = (OCLDijkstraSession*) malloc(sizeof(OCLDijkstraSession));
+    session->memoryDevice = memoryDevice;
+    session->graphBytes = graphBytes;
+    session->stateBytes = stateBytes;
+    session->context = context;
+    session->deviceId = deviceId;
+    session->program = program;
+    session->vertexCount = graph->vertexCount;
+    session->edgeCount = graph->edgeCount;
+    session->localWorkSize = localWorkSize;
+    session->globalWorkSize = shrRoundUp(localWorkSize, graph->vertexCount);
+
+    // Create command queue
+    session->commandQueue = clCreateCommandQueue( context, deviceId, 0, &errNum );
     shrCheckError(errNum, CL_SUCCESS);
-    cpuDeviceCount = (cl_uint)deviceBytes/sizeof(cl_device_id);
+    shrLog("clCreateCommandQueue\n\n");
 
-    if (cpuDeviceCount == 0)
+    // Allocate buffers in Device memory
+    allocateOCLBuffers( context, session->commandQueue, graph,
+                        &session->vertexArrayDevice, &session->edgeArrayDevice, &session->weightArrayDevice,
+                        &session->maskArrayDevice, &session->costArrayDevice, &session->updatingCostArrayDevice,
+                        session->globalWorkSize);
+
+    // Create the Kernels
+    session->initializeBuffersKernel = clCreateKernel(program, "initializeBuffers", &errNum);
+    shrCheckError(errNum, CL_SUCCESS);
+
+    // Set the args values and check for errors
+    errNum |= clSetKernelArg(session->initializeBuffersKernel, 0, sizeof(cl_mem), &session->maskArrayDevice);
+    errNum |= clSetKernelArg(session->initializeBuffersKernel, 1, sizeof(cl_mem), &session->costArrayDevice);
+    errNum |= clSetKernelArg(session->initializeBuffersKernel, 2, sizeof(cl_mem), &session->updatingCostArrayDevice);
+
+    // 3 set in runOCLDijkstraSession()
+    errNum |= clSetKernelArg(session->initializeBuffersKernel, 4, sizeof(cl_int), &session->vertexCount);
+    shrCheckError(errNum, CL_SUCCESS);
+
+    // Kernel 1
+    session->ssspKernel1 = clCreateKernel(program, "OCL_SSSP_KERNEL1", &errNum);
+    shrCheckError(errNum, CL_SUCCESS);
+    errNum |= clSetKernelArg(session->ssspKernel1, 0, sizeof(cl_mem), &session->vertexArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel1, 1, sizeof(cl_mem), &session->edgeArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel1, 2, sizeof(cl_mem), &session->weightArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel1, 3, sizeof(cl_mem), &session->maskArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel1, 4, sizeof(cl_mem), &session->costArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel1, 5, sizeof(cl_mem), &session->updatingCostArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel1, 6, sizeof(int), &session->vertexCount);
+    errNum |= clSetKernelArg(session->ssspKernel1, 7, sizeof(int), &session->edgeCount);
+    shrCheckError(errNum, CL_SUCCESS);
+
+    // Kernel 2
+    session->ssspKernel2 = clCreateKernel(program, "OCL_SSSP_KERNEL2", &errNum);
+    shrCheckError(errNum, CL_SUCCESS);
+    errNum |= clSetKernelArg(session->ssspKernel2, 0, sizeof(cl_mem), &session->vertexArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel2, 1, sizeof(cl_mem), &session->edgeArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel2, 2, sizeof(cl_mem), &session->weightArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel2, 3, sizeof(cl_mem), &session->maskArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel2, 4, sizeof(cl_mem), &session->costArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel2, 5, sizeof(cl_mem), &session->updatingCostArrayDevice);
+    errNum |= clSetKernelArg(session->ssspKernel2, 6, sizeof(int), &session->vertexCount);
+    errNum |= clSetKernelArg(session->ssspKernel2, 7, sizeof(cl_uchar) * session->localWorkSize, NULL);
+    shrCheckError(errNum, CL_SUCCESS);
+
+    session->maskWordCount = frontierWordCount(graph->vertexCount);
+    session->maskArrayHost = (FrontierWord*) trackedMalloc(MEMORY_STATE, sizeof(FrontierWord) * session->maskWordCount);
+
+    // Only the offsets are needed to count the edges of a frontier
+    session->vertexOffsetsHost.vertexCount = graph->vertexCount;
+    session->vertexOffsetsHost.edgeCount = graph->edgeCount;
+    session->vertexOffsetsHost.vertexArray = (int*) trackedMalloc(MEMORY_GRAPH, sizeof(int) * graph->vertexCount);
+    memcpy(session->vertexOffsetsHost.vertexArray, graph->vertexArray, sizeof(int) * graph->vertexCount);
+    session->vertexOffsetsHost.edgeArray = NULL;
+    session->vertexOffsetsHost.weightArray = NULL;
+
+    session->ssspPullKernel = NULL;
+    if (directionSwitching)
+    {
+        createPullKernel( session, graph );
+    }
+
+    session->persistentKernel = NULL;
+    if (persistentKernel)
+    {
+        createPersistentKernel( session );
+    }
+
+    session->hybridGraph = NULL;
+    if (hybridExecution)
+    {
+        createHybridState( session, graph );
+    }
+
+    session->warmStartGraph = NULL;
+    if (warmStart)
+    {
+        session->warmStartGraph = graph;
+        session->seedCostsHost = (float*) trackedMalloc(MEMORY_STATE, sizeof(float) * graph->vertexCount);
+    }
+
+    return session;
+}
+
+///
+/// Run a batch of sources on a session
+///
+bool runOCLDijkstraSession( OCLDijkstraSession *session, const int *sourceVertices,
+                            float *outResultCosts, int numResults )
+{
+    cl_int errNum = CL_SUCCESS;
+    int iterationCount = 0;
+    int expandedVertexCount = 0;
+
+    if (session->persistentKernel != NULL)
+    {
+        return runPersistentSession( session, sourceVertices, outResultCosts, numResults );
+    }
+
+    if (session->hybridGraph != NULL)
+    {
+        return runHybridSession( session, sourceVertices, outResultCosts, numResults );
+    }
+
+    shrLog("Num results: %d\n", numResults);
+
+    // Warm start runs the batch nearest source first; results stay in batch order
+    std::vector<int> pending(numResults);
+    for (int n = 0; n < numResults; n++)
+    {
+        pending[n] = n;
+    }
+    int previous = -1;
+    int seededCount = 0;
+    long long relaxationCount = 0;
+
+    for ( int n = 0 ; n < numResults; n++ )
+    {
+        int i = n;
+        bool seeded = false;
+        if (session->warmStartGraph != NULL)
+        {
+            if (previous >= 0)
+            {
+                const float *previousCosts = &outResultCosts[(size_t) previous * session->vertexCount];
+                int next = nextWarmStartSource(previousCosts, sourceVertices, &pending[n], numResults - n);
+                std::swap(pending[n], pending[n + next]);
+                seeded = seedWarmStart(session->warmStartGraph, previousCosts, sourceVertices[previous],
+                                       sourceVertices[pending[n]], session->seedCostsHost);
+            }
+            i = pending[n];
+            previous = i;
+        }
+
+        cl_event readDone;
+        if (seeded)
+        {
+            // Upper bounds in C and U, only the source in the mask
+            seededCount++;
+            memset(session->maskArrayHost, 0, sizeof(FrontierWord) * session->maskWordCount);
+            frontierSet(session->maskArrayHost, sourceVertices[i]);
+
+            errNum = clEnqueueWriteBuffer( session->commandQueue, session->costArrayDevice, CL_FALSE, 0,
+                                           sizeof(float) * session->vertexCount, session->seedCostsHost,
+                                           0, NULL, NULL);
+            errNum |= clEnqueueWriteBuffer( session->commandQueue, session->updatingCostArrayDevice, CL_FALSE, 0,
+                                            sizeof(float) * session->vertexCount, session->seedCostsHost,
+                                            0, NULL, NULL);
+            errNum |= clEnqueueWriteBuffer( session->commandQueue, session->maskArrayDevice, CL_TRUE, 0,
+                                            sizeof(FrontierWord) * session->maskWordCount,
+                                            session->maskArrayHost, 0, NULL, NULL);
+            shrCheckError(errNum, CL_SUCCESS);
+        }
+        else
+        {
+            errNum |= clSetKernelArg(session->initializeBuffersKernel, 3, sizeof(int), &sourceVertices[i]);
+            shrCheckError(errNum, CL_SUCCESS);
+
+            // Initialize mask array to false, C and U to infiniti
+            initializeOCLBuffers( session->commandQueue, session->initializeBuffersKernel,
+                                  session->localWorkSize, session->globalWorkSize );
+
+            // Read mask array from device -> host
+            errNum = clEnqueueReadBuffer( session->commandQueue, session->maskArrayDevice, CL_FALSE, 0,
+                                          sizeof(FrontierWord) * session->maskWordCount,
+                                          session->maskArrayHost, 0, NULL, &readDone);
+            shrCheckError(errNum, CL_SUCCESS);
+            clWaitForEvents(1, &readDone);
+        }
+
+        SSSPDirection direction = SSSP_PUSH;
+        int frontierVertexCount;
+        for (int iteration = 0;
+             (frontierVertexCount = frontierSize(session->maskArrayHost, session->maskWordCount)) > 0;
+             iteration++)
+        {
+            iterationCount++;
+            expandedVertexCount += frontierVertexCount;
+            relaxationCount += frontierEdgeCount(&session->vertexOffsetsHost, session->maskArrayHost,
+                                                 session->maskWordCount);
+
+            runDeviceIteration( session, &direction, iteration, frontierVertexCount );
+        }
+
+
+        // Copy the result back
+        errNum = clEnqueueReadBuffer(session->commandQueue, session->costArrayDevice, CL_FALSE, 0,
+                                     sizeof(float) * session->vertexCount,
+                                     &outResultCosts[(size_t) i * session->vertexCount], 0, NULL, &readDone);
+        shrCheckError(errNum, CL_SUCCESS);
+        clWaitForEvents(1, &readDone);
+    }
+
+    __sync_fetch_and_add(&searchStats.searches, (long long) numResults);
+    __sync_fetch_and_add(&searchStats.warmStartedSearches, (long long) seededCount);
+    __sync_fetch_and_add(&searchStats.iterations, (long long) iterationCount);
+    __sync_fetch_and_add(&searchStats.relaxations, relaxationCount);
+
+    shrLog("Iterations: %d, expanded vertices: %d\n", iterationCount, expandedVertexCount);
+
+    return errNum == CL_SUCCESS;
+}
+
+///
+/// Release the device resources of a session
+///
+void releaseOCLDijkstraSession( OCLDijkstraSession *session )
+{
+    if (session == NULL)
     {
-        shrLog("ERROR: no CPUs present!");
         return;
     }
 
-    cl_uint totalDeviceCount = gpuDeviceCount + cpuDeviceCount;
+    trackedFree (session->maskArrayHost);
+    trackedFree (session->vertexOffsetsHost.vertexArray);
+
+    if (session->warmStartGraph != NULL)
+    {
+        trackedFree (session->seedCostsHost);
+    }
+
+    if (session->hybridGraph != NULL)
+    {
+        trackedFree (session->updatingCostArrayHost);
+        trackedFree (session->touchedVerticesHost);
+        trackedFree (session->hostDirtyBlocks);
+        trackedFree (session->deviceDirtyBlocks);
+    }
+
+    if (session->persistentKernel != NULL)
+    {
+        clReleaseMemObject(session->inQueueDevice);
+        clReleaseMemObject(session->queueDevice);
+        clReleaseMemObject(session->countersDevice);
+        clReleaseKernel(session->initializePersistentKernel);
+        clReleaseKernel(session->persistentKernel);
+    }
+
+    if (session->ssspPullKernel != NULL)
+    {
+        clReleaseMemObject(session->reverseVertexArrayDevice);
+        clReleaseMemObject(session->reverseEdgeArrayDevice);
+        clReleaseMemObject(session->reverseWeightArrayDevice);
+        clReleaseKernel(session->ssspPullKernel);
+    }
 
-    DevicePlan *devicePlans = (DevicePlan*) malloc(sizeof(DevicePlan) * totalDeviceCount);
-    pthread_t *threadIDs = (pthread_t*) malloc(sizeof(pthread_t) * totalDeviceCount);
+    clReleaseMemObject(session->vertexArrayDevice);
+    clReleaseMemObject(session->edgeArrayDevice);
+    clReleaseMemObject(session->weightArrayDevice);
+    clReleaseMemObject(session->maskArrayDevice);
+    clReleaseMemObject(session->costArrayDevice);
+    clReleaseMemObject(session->updatingCostArrayDevice);
 
-    int gpuResults = numResults / (ratioCPUtoGPU);
-    int cpuResults = numResults - gpuResults;
+    clReleaseKernel(session->initializeBuffersKernel);
+    clReleaseKernel(session->ssspKernel1);
+    clReleaseKernel(session->ssspKernel2);
 
-    // Divide the workload out per device
-    int resultsPerGPU = gpuResults / totalDeviceCount;
+    clReleaseCommandQueue(session->commandQueue);
+    clReleaseProgram(session->program);
 
-    int offset = 0;
+    releaseMemory(session->memoryDevice, MEMORY_GRAPH, session->graphBytes);
+    releaseMemory(session->memoryDevice, MEMORY_STATE, session->stateBytes);
+    free (session);
+}
+
+///
+/// Device bytes a session of the graph allocates under the current settings
+///
+size_t estimateOCLDijkstraSessionBytes( cl_device_id deviceId, const GraphData *graph )
+{
+    size_t graphBytes;
+    size_t stateBytes;
+    sessionDeviceBytes(deviceId, graph, &graphBytes, &stateBytes);
+    return graphBytes + stateBytes;
+}
+
+///
+/// Memory account of a device, registering it under the given name
+///
+int registerOCLMemoryDevice( cl_device_id deviceId, const char *name )
+{
+    pthread_mutex_lock(&memoryDevicesLock);
 
-    int curDevice = 0;
-    for (unsigned int i = 0; i < gpuDeviceCount; i++)
+    size_t i = 0;
+    while (i < memoryDevices.size() && memoryDevices[i].deviceId != deviceId)
     {
-        devicePlans[curDevice].context = gpuContext;
-        devicePlans[curDevice].deviceId = oclGetDev(gpuContext, i);;
-        devicePlans[curDevice].graph = graph;
-        devicePlans[curDevice].sourceVertices = &sourceVertices[offset];
-        devicePlans[curDevice].outResultCosts = &outResultCosts[offset * graph->vertexCount];
-        devicePlans[curDevice].numResults = resultsPerGPU;
+        i++;
+    }
 
-        oclPrintDevInfo(LOGBOTH, devicePlans[curDevice].deviceId);
-        offset += resultsPerGPU;
-        curDevice++;
+    if (i == memoryDevices.size())
+    {
+        OCLMemoryDevice device;
+        device.deviceId = deviceId;
+        device.memoryDevice = getMemoryDevice(name);
+        memoryDevices.push_back(device);
     }
+    int memoryDevice = memoryDevices[i].memoryDevice;
 
-    int resultsPerCPU = cpuResults;
+    pthread_mutex_unlock(&memoryDevicesLock);
+    return memoryDevice;
+}
 
-    for (unsigned int i = 0; i < cpuDeviceCount; i++)
+///
+/// Memory account of a device, registered under the device name if the
+/// device has not been seen before
+///
+int getOCLMemoryDevice( cl_device_id deviceId )
+{
+    char deviceName[OCL_DEVICE_NAME_MAX] = "";
+    clGetDeviceInfo(deviceId, CL_DEVICE_NAME, sizeof(deviceName), deviceName, NULL);
+    deviceName[OCL_DEVICE_NAME_MAX - 1] = '\0';
+
+    char name[MEMORY_DEVICE_NAME_MAX];
+    snprintf(name, sizeof(name), "opencl %s", deviceName);
+    return registerOCLMemoryDevice(deviceId, name);
+}
+
+///
+/// Enable or disable building programs specialized for each graph
+///
+void setOCLKernelSpecialization( bool enable )
+{
+    kernelSpecialization = enable;
+}
+
+///
+/// Enable or disable push/pull direction switching
+///
+void setOCLDirectionSwitching( bool enable )
+{
+    directionSwitching = enable;
+}
+
+///
+/// Enable or disable the persistent-threads kernel
+///
+void setOCLPersistentKernel( bool enable )
+{
+    persistentKernel = enable;
+}
+
+///
+/// Enable or disable hybrid host/device execution
+///
+void setOCLHybrid( bool enable, int deviceFrontier, int hostFrontier )
+{
+    hybridExecution = enable;
+    hybridDeviceFrontier = deviceFrontier;
+    hybridHostFrontier = hostFrontier;
+}
+
+///
+/// Enable or disable warm-started batches
+///
+void setOCLWarmStart( bool enable )
+{
+    warmStart = enable;
+}
+
+///
+/// Work done by the searches since the last reset
+///
+OCLSearchStats getOCLSearchStats()
+{
+    return searchStats;
+}
+
+///
+/// Reset the search counters
+///
+void resetOCLSearchStats()
+{
+    memset(&searchStats, 0, sizeof(OCLSearchStats));
+}
+
+///
+/// Release every program in the program cache
+///
+void releaseOCLProgramCache()
+{
+    pthread_mutex_lock(&programCacheLock);
+    for (size_t i = 0; i < programCache.size(); i++)
     {
-        devicePlans[curDevice].context = cpuContext;
-        devicePlans[curDevice].deviceId = oclGetDev(cpuContext, i);;
-        devicePlans[curDevice].graph = graph;
-        devicePlans[curDevice].sourceVertices = &sourceVertices[offset];
-        devicePlans[curDevice].outResultCosts = &outResultCosts[offset * graph->vertexCount];
-        devicePlans[curDevice].numResults = resultsPerCPU;
+        clReleaseProgram(programCache[i].program);
+    }
+    programCache.clear();
+    pthread_mutex_unlock(&programCacheLock);
+}
+
+///
+/// Add the binary of every cached program to a snapshot
+///
+bool snapshotOCLEngine( SnapshotWriter *writer )
+{
+    bool written = true;
+    int programCount = 0;
+
+    pthread_mutex_lock(&programCacheLock);
+    for (size_t i = 0; i < programCache.size() && written; i++)
+    {
+        // The program holds a binary slot for every device of its context,
+        // only the one it was built for is filled in
+        cl_uint deviceCount = 0;
+        clGetProgramInfo(programCache[i].program, CL_PROGRAM_NUM_DEVICES, sizeof(cl_uint), &deviceCount, NULL);
+        std::vector<cl_device_id> devices(deviceCount);
+        std::vector<size_t> sizes(deviceCount);
+        clGetProgramInfo(programCache[i].program, CL_PROGRAM_DEVICES, sizeof(cl_device_id) * deviceCount, &devices[0], NULL);
+        clGetProgramInfo(programCache[i].program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t) * deviceCount, &sizes[0], NULL);
+
+        std::vector< std::vector<unsigned char> > binaries(deviceCount);
+        std::vector<unsigned char*> binaryPointers(deviceCount);
+        int slot = -1;
+        for (cl_uint d = 0; d < deviceCount; d++)
+        {
+            binaries[d].resize(sizes[d] + 1);
+            binaryPointers[d] = &binaries[d][0];
+            slot = (devices[d] == programCache[i].deviceId) ? (int) d : slot;
+        }
+        if (slot < 0 || sizes[slot] == 0 ||
+            clGetProgramInfo(programCache[i].program, CL_PROGRAM_BINARIES, sizeof(unsigned char*) * deviceCount,
+                             &binaryPointers[0], NULL) != CL_SUCCESS)
+        {
+            continue;
+        }
 
-        oclPrintDevInfo(LOGBOTH, devicePlans[curDevice].deviceId);
-        offset += resultsPerCPU;
-        curDevice++;
+        std::vector<unsigned char> section(sizeof(OCLProgramRecord) + sizes[slot]);
+        OCLProgramRecord *record = (OCLProgramRecord*) &section[0];
+        clGetDeviceInfo(programCache[i].deviceId, CL_DEVICE_NAME, OCL_DEVICE_NAME_MAX, record->deviceName, NULL);
+        clGetDeviceInfo(programCache[i].deviceId, CL_DRIVER_VERSION, OCL_DRIVER_VERSION_MAX, record->driverVersion, NULL);
+        strncpy(record->options, programCache[i].options.c_str(), OCL_BUILD_OPTIONS_MAX - 1);
+        record->binarySize = (long long) sizes[slot];
+        memcpy(&section[sizeof(OCLProgramRecord)], binaryPointers[slot], sizes[slot]);
+
+        char tag[SNAPSHOT_TAG_MAX];
+        snprintf(tag, sizeof(tag), "ocl.program.%d", programCount++);
+        written = addSnapshotSection(writer, tag, &section[0], section.size());
     }
+    pthread_mutex_unlock(&programCacheLock);
+
+    return written;
+}
 
-    // Add any remaining work to the last GPU
-    if (offset < numResults)
+///
+/// Load the program binaries of a snapshot
+///
+int restoreOCLEngine( const Snapshot *snapshot, cl_context context )
+{
+    size_t size;
+    size_t deviceBytes = 0;
+    if (context == NULL || clGetContextInfo(context, CL_CONTEXT_DEVICES, 0, NULL, &deviceBytes) != CL_SUCCESS)
     {
-        devicePlans[totalDeviceCount - 1].numResults += (numResults - offset);
+        return 0;
     }
+    std::vector<cl_device_id> devices(deviceBytes / sizeof(cl_device_id));
+    clGetContextInfo(context, CL_CONTEXT_DEVICES, deviceBytes, &devices[0], NULL);
 
-    // Launch all the threads
-    for (unsigned int i = 0; i < totalDeviceCount; i++)
+    int restoredCount = 0;
+    for (int i = 0; ; i++)
     {
-        pthread_create(&threadIDs[i], NULL, (void* (*)(void*))dijkstraThread, (void*)(devicePlans + i));
+        char tag[SNAPSHOT_TAG_MAX];
+        snprintf(tag, sizeof(tag), "ocl.program.%d", i);
+        const OCLProgramRecord *record = (const OCLProgramRecord*) findSnapshotSection(snapshot, tag, &size);
+        if (record == NULL)
+        {
+            break;
+        }
+        if (size < sizeof(OCLProgramRecord) || size - sizeof(OCLProgramRecord) != (size_t) record->binarySize)
+        {
+            continue;
+        }
+
+        for (size_t d = 0; d < devices.size(); d++)
+        {
+            char deviceName[OCL_DEVICE_NAME_MAX] = "";
+            char driverVersion[OCL_DRIVER_VERSION_MAX] = "";
+            clGetDeviceInfo(devices[d], CL_DEVICE_NAME, sizeof(deviceName), deviceName, NULL);
+            clGetDeviceInfo(devices[d], CL_DRIVER_VERSION, sizeof(driverVersion), driverVersion, NULL);
+            if (strncmp(deviceName, record->deviceName, OCL_DEVICE_NAME_MAX) != 0 ||
+                strncmp(driverVersion, record->driverVersion, OCL_DRIVER_VERSION_MAX) != 0)
+            {
+                continue;
+            }
+
+            // Binaries still need clBuildProgram(), which only links them
+            const unsigned char *binary = (const unsigned char*) (record + 1);
+            size_t binarySize = (size_t) record->binarySize;
+            cl_int binaryStatus;
+            cl_int errNum;
+            cl_program program = clCreateProgramWithBinary(context, 1, &devices[d], &binarySize, &binary,
+                                                           &binaryStatus, &errNum);
+            if (errNum != CL_SUCCESS || binaryStatus != CL_SUCCESS)
+            {
+                continue;
+            }
+            if (clBuildProgram(program, 1, &devices[d], record->options, NULL, NULL) != CL_SUCCESS)
+            {
+                clReleaseProgram(program);
+                continue;
+            }
+
+            CachedProgram entry;
+            entry.context = context;
+            entry.deviceId = devices[d];
+            entry.options = record->options;
+            entry.program = program;
+
+            pthread_mutex_lock(&programCacheLock);
+            programCache.push_back(entry);
+            pthread_mutex_unlock(&programCacheLock);
+            restoredCount++;
+        }
     }
 
-    // Wait for the results from all threads
-    for (unsigned int i = 0; i < totalDeviceCount; i++)
+    return restoredCount;
+}
+
+///
+/// Run Dijkstra's shortest path on the GraphData provided to this function.  This
+/// function will compute the shortest path distance from sourceVertices[n] ->
+/// endVertices[n] and store the cost in outResultCosts[n].  The number of results
+/// it will compute is given by numResults.
+///
+/// This function will run the algorithm on a single GPU.
+///
+/// \param gpuContext Current GPU context, must be created by caller
+/// \param deviceId The device ID on which to run the kernel.  This can
+///                 be determined externally by the caller or the multi
+///                 GPU version will automatically split the work across
+///                 devices
+/// \param graph Structure containing the vertex, edge, and weight arra
+///              for the input graph
+/// \param startVertices Indices into the vertex array from which to
+///                      start the search
+/// \param outResultsCosts A pre-allocated array where the results for
+///                        each shortest path search will be written
+/// \param numResults Should be the size of all three passed inarrays
+///
+void runDijkstra( cl_context gpuContext, cl_device_id deviceId, GraphData* graph,
+                  int *sourceVertices, float *outResultCosts, int numResults)
+{
+    OCLDijkstraSession *session = createOCLDijkstraSession( gpuContext, deviceId, graph );
+    if (session == NULL)
     {
-        pthread_join(threadIDs[i], NULL);
+        return;
     }
 
-    free (devicePlans);
-    free (threadIDs);
+    runOCLDijkstraSession( session, sourceVertices, outResultCosts, numResults );
+    releaseOCLDijkstraSession( session );
 }
 
 ///
@@ -591,102 +1527,449 @@ void runDijkstraMultiGPUandCPU( cl_context gpuContext, cl_context cpuContext, Gr
 /// endVertices[n] and store the cost in outResultCosts[n].  The number of results
 /// it will compute is given by numResults.
 ///
-/// This is a CPU *REFERENCE* implementation for use as a fallback.
+/// This function will run the algorithm on as many GPUs as is available.  It will
+/// create N threads, one for each GPU, which take chunks of the sources from a
+/// shared queue (see runSSSPMultiBackend()).
 ///
+/// \param gpuContext Current GPU context, must be created by caller
 /// \param graph Structure containing the vertex, edge, and weight arra
 ///              for the input graph
 /// \param startVertices Indices into the vertex array from which to
 ///                      start the search
+/// \param endVertices Indices into the vertex array from which to end
+///                    the search.
 /// \param outResultsCosts A pre-allocated array where the results for
-///                        each shortest path search will be written.
-///                        This must be sized numResults * graph->numVertices.
+///                        each shortest path search will be written
 /// \param numResults Should be the size of all three passed inarrays
 ///
-void runDijkstraRef( GraphData* graph, int *sourceVertices,
-                     float *outResultCosts, int numResults )
+///
+void runDijkstraMultiGPU( cl_context gpuContext, GraphData* graph, int *sourceVertices,
+                          float *outResultCosts, int numResults )
+{
+    runDijkstraMultiGPUandCPU( gpuContext, NULL, graph, sourceVertices, outResultCosts, numResults );
+}
+
+///
+/// Run Dijkstra's shortest path on the GraphData provided to this function.  This
+/// function will compute the shortest path distance from sourceVertices[n] ->
+/// endVertices[n] and store the cost in outResultCosts[n].  The number of results
+/// it will compute is given by numResults.
+///
+/// This function will run the algorithm on as many GPUs as is available along with
+/// the CPU.  It will create N threads, one for each device, which take chunks of
+/// the sources from a shared queue, so each device does as much work as its
+/// speed allows.
+///
+/// \param gpuContext Current GPU context, must be created by caller
+/// \param cpuContext Current CPU context, must be created by caller, NULL for
+///                   GPUs only
+/// \param graph Structure containing the vertex, edge, and weight arra
+///              for the input graph
+/// \param startVertices Indices into the vertex array from which to
+///                      start the search
+/// \param outResultsCosts A pre-allocated array where the results for
+///                        each shortest path search will be written
+/// \param numResults Should be the size of all three passed inarrays
+///
+///
+void runDijkstraMultiGPUandCPU( cl_context gpuContext, cl_context cpuContext, GraphData* graph,
+                                int *sourceVertices,
+                                float *outResultCosts, int numResults )
+{
+    std::vector<SSSPBackend*> backends;
+    createDeviceBackends(gpuContext, cpuContext, &backends);
+    if (backends.empty())
+    {
+        shrLog("ERROR: no devices present!");
+        return;
+    }
+
+    runSSSPMultiBackend(&backends[0], (int) backends.size(), graph, sourceVertices,
+                        outResultCosts, numResults);
+
+    for (size_t i = 0; i < backends.size(); i++)
+    {
+        delete backends[i];
+    }
+}
+
+///
+/// Run a long batch on every GPU and CPU device like runDijkstraMultiGPUandCPU,
+/// saving each finished chunk of sources to jobDirectory and skipping the
+/// chunks an earlier run of the same job saved there
+///
+bool runDijkstraMultiGPUCheckpointed( cl_context gpuContext, cl_context cpuContext, GraphData* graph,
+                                      int *sourceVertices, float *outResultCosts, int numResults,
+                                      const char *jobDirectory )
+{
+    std::vector<SSSPBackend*> backends;
+    createDeviceBackends(gpuContext, cpuContext, &backends);
+    if (backends.empty())
+    {
+        shrLog("ERROR: no devices present!");
+        return false;
+    }
+
+    CheckpointStats stats;
+    bool succeeded = runSSSPCheckpointed(&backends[0], (int) backends.size(), graph, sourceVertices,
+                                         outResultCosts, numResults, jobDirectory, &stats);
+    shrLog("Checkpointed job %s: %d chunks of %d sources, %d resumed, %d completed on %d devices\n",
+           jobDirectory, stats.chunkCount, stats.chunkSources, stats.resumedChunks, stats.completedChunks,
+           (int) backends.size());
+
+    for (size_t i = 0; i < backends.size(); i++)
+    {
+        delete backends[i];
+    }
+
+    return succeeded;
+}
+
+///
+/// Run one search for each (graph, source) query over a set of small graphs.
+/// The graphs whose costs fit in the local memory of a work-group are packed
+/// into one set of buffers and all of their queries run in a single launch of
+/// OCL_SSSP_BATCHED, one work-group per query.  Queries on larger graphs fall
+/// back to a session per graph.
+///
+bool runDijkstraBatchedGraphs( cl_context context, cl_device_id deviceId, const GraphData *graphs,
+                               int graphCount, const int *queryGraphs, const int *querySources,
+                               float *outResultCosts, int numQueries )
 {
+    cl_int errNum;
 
-    // Create the arrays needed for processing the algorithm
-    float *costArray = new float[graph->vertexCount];
-    float *updatingCostArray = new float[graph->vertexCount];
-    int *maskArray = new int[graph->vertexCount];
+    // Local memory per vertex holds its cost bits and its flag in both
+    // frontiers, plus three activity flags per work-group
+    cl_ulong localMemSize;
+    errNum = clGetDeviceInfo(deviceId, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &localMemSize, NULL);
+    shrCheckError(errNum, CL_SUCCESS);
 
-    for (int i = 0; i < numResults; i++)
+    size_t localVertexBytes = sizeof(cl_int) + 2 * sizeof(cl_uchar);
+    size_t localFixedBytes = 3 * sizeof(cl_int);
+    int localVertexMax = (localMemSize > localFixedBytes) ?
+                         (int) ((localMemSize - localFixedBytes) / localVertexBytes) : 0;
+
+    // Offsets of the graphs that fit in the packed arrays, with one extra
+    // entry for the end
+    std::vector<int> graphVertexOffsets(graphCount + 1, 0);
+    std::vector<int> graphEdgeOffsets(graphCount + 1, 0);
+    int maxVertexCount = 0;
+    for (int g = 0; g < graphCount; g++)
     {
-        // Initialize the buffer for this run
-        for (int v = 0; v < graph->vertexCount; v++)
+        bool fits = (graphs[g].vertexCount <= localVertexMax);
+        graphVertexOffsets[g + 1] = graphVertexOffsets[g] + (fits ? graphs[g].vertexCount : 0);
+        graphEdgeOffsets[g + 1] = graphEdgeOffsets[g] + (fits ? graphs[g].edgeCount : 0);
+        if (fits && graphs[g].vertexCount > maxVertexCount)
         {
-            if (v == sourceVertices[i])
-            {
-                maskArray[v] = 1;
-                costArray[v] = 0.0;
-                updatingCostArray[v] = 0.0;
-            }
-            else
+            maxVertexCount = graphs[g].vertexCount;
+        }
+    }
+
+    // The results are laid out in query order
+    std::vector<int> resultOffsets(numQueries);
+    std::vector<int> batchedGraphs;
+    std::vector<int> batchedSources;
+    std::vector<int> batchedResultOffsets;
+    int resultCount = 0;
+    for (int q = 0; q < numQueries; q++)
+    {
+        const GraphData *graph = &graphs[queryGraphs[q]];
+        resultOffsets[q] = resultCount;
+        if (graph->vertexCount <= localVertexMax)
+        {
+            batchedGraphs.push_back(queryGraphs[q]);
+            batchedSources.push_back(querySources[q]);
+            batchedResultOffsets.push_back(resultCount);
+        }
+        resultCount += graph->vertexCount;
+    }
+
+    int batchedCount = (int) batchedGraphs.size();
+    shrLog("Batched graphs: %d queries in one launch, %d on sessions\n",
+           batchedCount, numQueries - batchedCount);
+
+    if (batchedCount > 0)
+    {
+        // Pack the graphs, with a spare entry so that no buffer is empty
+        int packedVertexCount = graphVertexOffsets[graphCount];
+        int packedEdgeCount = graphEdgeOffsets[graphCount];
+        std::vector<int> vertexArray(packedVertexCount + 1);
+        std::vector<int> edgeArray(packedEdgeCount + 1);
+        std::vector<float> weightArray(packedEdgeCount + 1);
+        for (int g = 0; g < graphCount; g++)
+        {
+            if (graphVertexOffsets[g + 1] == graphVertexOffsets[g])
             {
-                maskArray[v] = 0;
-                costArray[v] = FLT_MAX;
-                updatingCostArray[v] = FLT_MAX;
+                continue;
             }
+            std::copy(graphs[g].vertexArray, graphs[g].vertexArray + graphs[g].vertexCount,
+                      vertexArray.begin() + graphVertexOffsets[g]);
+            std::copy(graphs[g].edgeArray, graphs[g].edgeArray + graphs[g].edgeCount,
+                      edgeArray.begin() + graphEdgeOffsets[g]);
+            std::copy(graphs[g].weightArray, graphs[g].weightArray + graphs[g].edgeCount,
+                      weightArray.begin() + graphEdgeOffsets[g]);
         }
 
-        while(!maskArrayEmpty(maskArray, graph->vertexCount))
+        cl_program program = getCachedProgram( context, deviceId, "" );
+        if (program == NULL)
         {
-            // Equivalent of OCL_SSSP_KERNEL1()
-            for (int tid = 0; tid < graph->vertexCount; tid++)
-            {
-                if ( maskArray[tid] != 0 )
-                {
-                    maskArray[tid] = 0;
+            return false;
+        }
 
-                    int edgeStart = graph->vertexArray[tid];
-                    int edgeEnd;
-                    if (tid + 1 < (graph->vertexCount))
-                    {
-                        edgeEnd = graph->vertexArray[tid + 1];
-                    }
-                    else
-                    {
-                        edgeEnd = graph->edgeCount;
-                    }
+        cl_command_queue commandQueue = clCreateCommandQueue( context, deviceId, 0, &errNum );
+        shrCheckError(errNum, CL_SUCCESS);
 
-                    for(int edge = edgeStart; edge < edgeEnd; edge++)
-                    {
-                        int nid = graph->edgeArray[edge];
-
-                        // One note here: whereas the paper specified weightArray[nid], I
-                        //  found that the correct thing to do was weightArray[edge].  I think
-                        //  this was a typo in the paper.  Either that, or I misunderstood
-                        //  the data structure.
-                        if (updatingCostArray[nid] > (costArray[tid] + graph->weightArray[edge]))
-                        {
-                            updatingCostArray[nid] = (costArray[tid] + graph->weightArray[edge]);
-                        }
-                    }
-                }
+        cl_kernel batchedKernel = clCreateKernel(program, "OCL_SSSP_BATCHED", &errNum);
+        shrCheckError(errNum, CL_SUCCESS);
+
+        // Input buffers, in kernel argument order
+        const void *inputs[] = { &graphVertexOffsets[0], &graphEdgeOffsets[0], &vertexArray[0],
+                                 &edgeArray[0], &weightArray[0], &batchedGraphs[0],
+                                 &batchedSources[0], &batchedResultOffsets[0] };
+        size_t inputBytes[] = { sizeof(int) * graphVertexOffsets.size(), sizeof(int) * graphEdgeOffsets.size(),
+                                sizeof(int) * vertexArray.size(), sizeof(int) * edgeArray.size(),
+                                sizeof(float) * weightArray.size(), sizeof(int) * batchedGraphs.size(),
+                                sizeof(int) * batchedSources.size(), sizeof(int) * batchedResultOffsets.size() };
+        const int inputCount = sizeof(inputs) / sizeof(inputs[0]);
+
+        // Charged for the duration of the launch only
+        int memoryDevice = getOCLMemoryDevice(deviceId);
+        size_t packedBytes = 0;
+        for (int i = 0; i < inputCount; i++)
+        {
+            packedBytes += inputBytes[i];
+        }
+        chargeMemory(memoryDevice, MEMORY_GRAPH, packedBytes);
+        chargeMemory(memoryDevice, MEMORY_RESULTS, sizeof(float) * resultCount);
+
+        cl_mem inputBuffers[inputCount];
+        for (int i = 0; i < inputCount; i++)
+        {
+            inputBuffers[i] = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                             inputBytes[i], const_cast<void*>(inputs[i]), &errNum);
+            shrCheckError(errNum, CL_SUCCESS);
+            errNum = clSetKernelArg(batchedKernel, i, sizeof(cl_mem), &inputBuffers[i]);
+            shrCheckError(errNum, CL_SUCCESS);
+        }
+
+        cl_mem resultCostsDevice = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * resultCount,
+                                                  NULL, &errNum);
+        shrCheckError(errNum, CL_SUCCESS);
+
+        errNum |= clSetKernelArg(batchedKernel, 8, sizeof(cl_mem), &resultCostsDevice);
+        errNum |= clSetKernelArg(batchedKernel, 9, sizeof(cl_int) * maxVertexCount, NULL);
+        errNum |= clSetKernelArg(batchedKernel, 10, 2 * sizeof(cl_uchar) * maxVertexCount, NULL);
+        errNum |= clSetKernelArg(batchedKernel, 11, 3 * sizeof(cl_int), NULL);
+        errNum |= clSetKernelArg(batchedKernel, 12, sizeof(int), &maxVertexCount);
+        shrCheckError(errNum, CL_SUCCESS);
+
+        size_t localWorkSize;
+        errNum = clGetKernelWorkGroupInfo(batchedKernel, deviceId, CL_KERNEL_WORK_GROUP_SIZE,
+                                          sizeof(size_t), &localWorkSize, NULL);
+        shrCheckError(errNum, CL_SUCCESS);
+        localWorkSize = (localWorkSize < BATCHED_LOCAL_SIZE_MAX) ? localWorkSize : BATCHED_LOCAL_SIZE_MAX;
+        size_t globalWorkSize = localWorkSize * batchedCount;
+
+        errNum = clEnqueueNDRangeKernel(commandQueue, batchedKernel, 1, NULL, &globalWorkSize, &localWorkSize,
+                                        0, NULL, NULL);
+        shrCheckError(errNum, CL_SUCCESS);
+
+        // Queries that fall back below overwrite their part of the results
+        errNum = clEnqueueReadBuffer(commandQueue, resultCostsDevice, CL_TRUE, 0, sizeof(float) * resultCount,
+                                     outResultCosts, 0, NULL, NULL);
+        shrCheckError(errNum, CL_SUCCESS);
+
+        for (int i = 0; i < inputCount; i++)
+        {
+            clReleaseMemObject(inputBuffers[i]);
+        }
+        clReleaseMemObject(resultCostsDevice);
+        clReleaseKernel(batchedKernel);
+        clReleaseCommandQueue(commandQueue);
+        clReleaseProgram(program);
+
+        releaseMemory(memoryDevice, MEMORY_GRAPH, packedBytes);
+        releaseMemory(memoryDevice, MEMORY_RESULTS, sizeof(float) * resultCount);
+    }
+
+    // Graphs too large for local memory
+    bool succeeded = true;
+    for (int g = 0; g < graphCount; g++)
+    {
+        if (graphs[g].vertexCount <= localVertexMax)
+        {
+            continue;
+        }
+
+        OCLDijkstraSession *session = NULL;
+        for (int q = 0; q < numQueries && succeeded; q++)
+        {
+            if (queryGraphs[q] != g)
+            {
+                continue;
             }
 
-            // Equivalent of OCL_SSSP_KERNEL2()
-            for (int tid = 0; tid < graph->vertexCount; tid++)
+            if (session == NULL)
             {
-                if (costArray[tid] > updatingCostArray[tid])
+                session = createOCLDijkstraSession( context, deviceId, &graphs[g] );
+                if (session == NULL)
                 {
-                    costArray[tid] = updatingCostArray[tid];
-                    maskArray[tid] = 1;
+                    return false;
                 }
-
-                updatingCostArray[tid] = costArray[tid];
             }
-        }
 
-        // Copy the result back
-        memcpy(&outResultCosts[i * graph->vertexCount], costArray, sizeof(float) * graph->vertexCount);
+            succeeded = runOCLDijkstraSession( session, &querySources[q],
+                                               &outResultCosts[resultOffsets[q]], 1 );
+        }
+        releaseOCLDijkstraSession( session );
     }
 
-    // Free temporary computation buffers
-    delete [] costArray;
-    delete [] updatingCostArray;
-    delete [] maskArray;
+    return succeeded;
 }
 
+///
+/// Check result rows against the shortest-path optimality conditions: the
+/// edges on a device with OCL_SSSP_VERIFY, one launch per row over the
+/// reverse graph, and the tight-edge paths on the host.
+///
+bool verifyOCLDijkstraResults( cl_context context, cl_device_id deviceId, const GraphData *graph,
+                               const int *sourceVertices, const float *costs, int numResults,
+                               SSSPVerification *outVerification )
+{
+    cl_int errNum;
+
+    SSSPVerification verification;
+    initSSSPVerification(&verification);
+    if (outVerification != NULL)
+    {
+        *outVerification = verification;
+    }
+
+    cl_program program = getCachedProgram( context, deviceId, "" );
+    if (program == NULL)
+    {
+        return false;
+    }
+
+    cl_command_queue commandQueue = clCreateCommandQueue( context, deviceId, 0, &errNum );
+    shrCheckError(errNum, CL_SUCCESS);
+
+    cl_kernel verifyKernel = clCreateKernel(program, "OCL_SSSP_VERIFY", &errNum);
+    shrCheckError(errNum, CL_SUCCESS);
+
+    size_t localWorkSize;
+    errNum = clGetKernelWorkGroupInfo(verifyKernel, deviceId, CL_KERNEL_WORK_GROUP_SIZE,
+                                      sizeof(size_t), &localWorkSize, NULL);
+    shrCheckError(errNum, CL_SUCCESS);
+    size_t globalWorkSize = shrRoundUp(localWorkSize, graph->vertexCount);
+
+    // The in-edges of every vertex, with a spare entry so that no buffer is empty
+    GraphData reverseGraph;
+    buildReverseGraph(graph, &reverseGraph);
+    size_t reverseBytes = sizeof(int) * (graph->vertexCount + 1) +
+                          (sizeof(int) + sizeof(float)) * (graph->edgeCount + 1);
+    size_t rowBytes = sizeof(float) * graph->vertexCount;
+    int memoryDevice = getOCLMemoryDevice(deviceId);
+    chargeMemory(memoryDevice, MEMORY_GRAPH, reverseBytes);
+    chargeMemory(memoryDevice, MEMORY_STATE, rowBytes);
+
+    cl_mem reverseVertexArrayDevice = clCreateBuffer(context, CL_MEM_READ_ONLY,
+                                                     sizeof(int) * (graph->vertexCount + 1), NULL, &errNum);
+    shrCheckError(errNum, CL_SUCCESS);
+    cl_mem reverseEdgeArrayDevice = clCreateBuffer(context, CL_MEM_READ_ONLY,
+                                                   sizeof(int) * (graph->edgeCount + 1), NULL, &errNum);
+    shrCheckError(errNum, CL_SUCCESS);
+    cl_mem reverseWeightArrayDevice = clCreateBuffer(context, CL_MEM_READ_ONLY,
+                                                     sizeof(float) * (graph->edgeCount + 1), NULL, &errNum);
+    shrCheckError(errNum, CL_SUCCESS);
+    cl_mem costArrayDevice = clCreateBuffer(context, CL_MEM_READ_ONLY, rowBytes + sizeof(float), NULL, &errNum);
+    shrCheckError(errNum, CL_SUCCESS);
+    cl_mem countersDevice = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_int) * 5, NULL, &errNum);
+    shrCheckError(errNum, CL_SUCCESS);
 
+    if (graph->vertexCount > 0)
+    {
+        errNum = clEnqueueWriteBuffer(commandQueue, reverseVertexArrayDevice, CL_FALSE, 0,
+                                      sizeof(int) * graph->vertexCount, reverseGraph.vertexArray, 0, NULL, NULL);
+        shrCheckError(errNum, CL_SUCCESS);
+    }
+    if (graph->edgeCount > 0)
+    {
+        errNum = clEnqueueWriteBuffer(commandQueue, reverseEdgeArrayDevice, CL_FALSE, 0,
+                                      sizeof(int) * graph->edgeCount, reverseGraph.edgeArray, 0, NULL, NULL);
+        errNum |= clEnqueueWriteBuffer(commandQueue, reverseWeightArrayDevice, CL_FALSE, 0,
+                                       sizeof(float) * graph->edgeCount, reverseGraph.weightArray, 0, NULL, NULL);
+        shrCheckError(errNum, CL_SUCCESS);
+    }
+
+    float absoluteTolerance = SSSP_VERIFY_ABSOLUTE_TOLERANCE;
+    float ulpTolerance = SSSP_VERIFY_ULPS * FLT_EPSILON;
+    errNum = clSetKernelArg(verifyKernel, 0, sizeof(cl_mem), &reverseVertexArrayDevice);
+    errNum |= clSetKernelArg(verifyKernel, 1, sizeof(cl_mem), &reverseEdgeArrayDevice);
+    errNum |= clSetKernelArg(verifyKernel, 2, sizeof(cl_mem), &reverseWeightArrayDevice);
+    errNum |= clSetKernelArg(verifyKernel, 3, sizeof(cl_mem), &costArrayDevice);
+    errNum |= clSetKernelArg(verifyKernel, 4, sizeof(cl_mem), &countersDevice);
+    errNum |= clSetKernelArg(verifyKernel, 6, sizeof(float), &absoluteTolerance);
+    errNum |= clSetKernelArg(verifyKernel, 7, sizeof(float), &ulpTolerance);
+    errNum |= clSetKernelArg(verifyKernel, 8, sizeof(int), &graph->vertexCount);
+    errNum |= clSetKernelArg(verifyKernel, 9, sizeof(int), &graph->edgeCount);
+    shrCheckError(errNum, CL_SUCCESS);
+
+    verification.rows = numResults;
+    for (int row = 0; row < numResults && graph->vertexCount > 0; row++)
+    {
+        // Failure counts, then the lowest failing vertex
+        cl_int counters[5] = { 0, 0, 0, 0, INT_MAX };
+        errNum = clEnqueueWriteBuffer(commandQueue, countersDevice, CL_FALSE, 0, sizeof(counters), counters,
+                                      0, NULL, NULL);
+        errNum |= clEnqueueWriteBuffer(commandQueue, costArrayDevice, CL_FALSE, 0, rowBytes,
+                                       &costs[(size_t) row * graph->vertexCount], 0, NULL, NULL);
+        errNum |= clSetKernelArg(verifyKernel, 5, sizeof(int), &sourceVertices[row]);
+        shrCheckError(errNum, CL_SUCCESS);
+
+        errNum = clEnqueueNDRangeKernel(commandQueue, verifyKernel, 1, NULL, &globalWorkSize, &localWorkSize,
+                                        0, NULL, NULL);
+        shrCheckError(errNum, CL_SUCCESS);
+
+        errNum = clEnqueueReadBuffer(commandQueue, countersDevice, CL_TRUE, 0, sizeof(counters), counters,
+                                     0, NULL, NULL);
+        shrCheckError(errNum, CL_SUCCESS);
+
+        SSSPVerification rowVerification;
+        initSSSPVerification(&rowVerification);
+        rowVerification.sourceErrors = counters[0];
+        rowVerification.edgeViolations = counters[1];
+        rowVerification.untightVertices = counters[2];
+        rowVerification.invalidCosts = counters[3];
+        if (counters[4] != INT_MAX)
+        {
+            rowVerification.firstBadRow = row;
+            rowVerification.firstBadVertex = counters[4];
+        }
+        mergeSSSPVerification(&verification, &rowVerification);
+    }
+
+    clReleaseMemObject(reverseVertexArrayDevice);
+    clReleaseMemObject(reverseEdgeArrayDevice);
+    clReleaseMemObject(reverseWeightArrayDevice);
+    clReleaseMemObject(costArrayDevice);
+    clReleaseMemObject(countersDevice);
+    clReleaseKernel(verifyKernel);
+    clReleaseCommandQueue(commandQueue);
+    clReleaseProgram(program);
+
+    releaseMemory(memoryDevice, MEMORY_GRAPH, reverseBytes);
+    releaseMemory(memoryDevice, MEMORY_STATE, rowBytes);
+    freeGraph(&reverseGraph);
+
+    // A traversal does not suit the one-vertex-per-work-item kernel
+    SSSPVerification pathVerification;
+    verifySSSPPaths(graph, sourceVertices, costs, numResults, 1, &pathVerification);
+    mergeSSSPVerification(&verification, &pathVerification);
+
+    if (outVerification != NULL)
+    {
+        *outVerification = verification;
+    }
+    return isSSSPVerified(&verification);
+}
@@ -18,33 +18,174 @@
 #define DIJKSTRA_KERNEL_H
 
 #include <CL/cl.h>
+#include <dijkstraGraph.h>
+#include <dijkstraBackend.h>
+#include <dijkstraSnapshot.h>
+#include <dijkstraVerify.h>
 
 ///
 //  Types
 //
+
+//
+//  Graph resident on one OpenCL device: the built program, kernels, command
+//  queue and device buffers.  Created once per graph and device, then used
+//  for any number of runs.
 //
-//  This data structure and algorithm implementation is based on
-//  Accelerating large graph algorithms on the GPU using CUDA by
-//  Parwan Harish and P.J. Narayanan
+typedef struct OCLDijkstraSession OCLDijkstraSession;
+
+//
+//  Work done by the searches of the frontier engine, summed over all sessions.
+//  The persistent and hybrid engines are not counted.
 //
 typedef struct
 {
-    // (V) This contains a pointer to the edge list for each vertex
-    int *vertexArray;
+    // Searches run, and how many of them were warm-started
+    long long searches;
+    long long warmStartedSearches;
+
+    // Frontier iterations, and out-edges of every frontier relaxed by them
+    long long iterations;
+    long long relaxations;
+
+} OCLSearchStats;
+
+///
+/// Upload a graph to a device and build the kernels for it.
+///
+/// \param context Context the device belongs to, must be created by caller
+/// \param deviceId Device to run on
+/// \param graph Graph to upload, only read during this call unless hybrid
+///              execution is enabled, see setOCLHybrid()
+/// \return The session, or NULL if the program could not be built
+///
+OCLDijkstraSession *createOCLDijkstraSession( cl_context context, cl_device_id deviceId,
+                                              const GraphData *graph );
+
+///
+/// Run a batch of sources on a session.  outResultCosts must be sized
+/// numResults * graph->vertexCount.
+///
+bool runOCLDijkstraSession( OCLDijkstraSession *session, const int *sourceVertices,
+                            float *outResultCosts, int numResults );
+
+///
+/// Release the device resources of a session
+///
+void releaseOCLDijkstraSession( OCLDijkstraSession *session );
+
+///
+/// Device memory in bytes a session of the graph would allocate with the
+/// current settings, used to keep several graphs resident under a budget
+///
+size_t estimateOCLDijkstraSessionBytes( cl_device_id deviceId, const GraphData *graph );
+
+///
+/// Memory account of a device (see dijkstraMemory.h), registered under the
+/// given name on first use.  Sessions reserve their device memory in it and
+/// are refused if that would exceed its limit.
+///
+int registerOCLMemoryDevice( cl_device_id deviceId, const char *name );
+
+///
+/// Memory account of a device, registered as "opencl <device name>" if
+/// registerOCLMemoryDevice() was not called for it
+///
+int getOCLMemoryDevice( cl_device_id deviceId );
 
-    // Vertex count
-    int vertexCount;
+///
+/// Enable or disable kernel specialization (on by default).  When enabled a
+/// session builds dijkstra.cl with the vertex and edge counts, work-group size
+/// and, for graphs where every vertex has the same degree, that degree as
+/// compile-time constants.  Programs are cached per device and build options;
+/// if a specialized build fails the generic program is used instead.
+///
+void setOCLKernelSpecialization( bool enable );
+
+///
+/// Enable or disable push/pull direction switching (off by default).  When
+/// enabled a session also uploads the reverse graph and picks push
+/// (OCL_SSSP_KERNEL1) or pull (OCL_SSSP_PULL) for each iteration with the
+/// policy of getSSSPDirectionPolicy(), see dijkstraDirection.h.
+///
+void setOCLDirectionSwitching( bool enable );
 
-    // (E) This contains pointers to the vertices that each edge is attached to
-    int *edgeArray;
+///
+/// Enable or disable the persistent-threads kernel (off by default).  When
+/// enabled a session runs each search in a single launch of
+/// OCL_SSSP_PERSISTENT: one work-group per compute unit pulls vertices from a
+/// queue in device memory until the device detects that the queue has
+/// drained, with no host round trip per iteration.  Takes precedence over
+/// push/pull switching.
+///
+void setOCLPersistentKernel( bool enable );
 
-    // Edge count
-    int edgeCount;
+///
+/// Enable or disable hybrid host/device execution (off by default).  When
+/// enabled each search starts on the host and moves to the device once its
+/// frontier holds more than deviceFrontier vertices, and back to the host
+/// once it holds fewer than hostFrontier.  Only the frontier and the blocks
+/// of costs changed since the last move are transferred.  The host side
+/// needs the graph, which must then outlive the session.
+///
+void setOCLHybrid( bool enable, int deviceFrontier, int hostFrontier );
 
-    // (W) Weight array
-    float *weightArray;
+///
+/// Enable or disable warm-started batches (off by default).  When enabled a
+/// session runs each batch in a greedy nearest-source-first order and seeds
+/// every search with the previous search's costs shifted by the distance
+/// between the two sources, see dijkstraWarmStart.h.  Results are exact and
+/// stay in batch order.  The session needs the graph, which must then
+/// outlive it.  Not used by the persistent and hybrid engines.
+///
+void setOCLWarmStart( bool enable );
 
-} GraphData;
+///
+/// Work done by the searches since the last call to resetOCLSearchStats()
+///
+OCLSearchStats getOCLSearchStats();
+
+///
+/// Reset the counters returned by getOCLSearchStats()
+///
+void resetOCLSearchStats();
+
+///
+/// Release the programs cached by the sessions.  Sessions that are still open
+/// keep their own reference to their program.
+///
+void releaseOCLProgramCache();
+
+///
+/// Add the binary of every cached program to a snapshot, see
+/// dijkstraSnapshot.h.  Call before releaseOCLProgramCache().
+///
+/// \return false if the snapshot could not be written
+///
+bool snapshotOCLEngine( SnapshotWriter *writer );
+
+///
+/// Put the program binaries of a snapshot into the program cache, for every
+/// device of context with the name and driver version they were built with.
+/// Sessions created afterwards use the ones built with their options instead
+/// of compiling dijkstra.cl.  The engine settings are not part of a snapshot,
+/// they always come from the command line.
+///
+/// \return Number of programs restored
+///
+int restoreOCLEngine( const Snapshot *snapshot, cl_context context );
+
+///
+/// Create an SSSPBackend for one OpenCL device.  The context must outlive
+/// the backend.
+///
+SSSPBackend *createOCLBackend( cl_context context, cl_device_id deviceId, const char *name );
+
+///
+/// Register one backend per device of each context, named opencl-gpu<n> and
+/// opencl-cpu<n>.  Either context may be NULL.
+///
+void registerOCLBackends( cl_context gpuContext, cl_context cpuContext );
 
 ///
 /// Run Dijkstra's shortest path on the GraphData provided to this function.  This
@@ -72,6 +213,48 @@ void runDijkstra( cl_context gpuContext, cl_device_id deviceId, GraphData* graph
                   int *sourceVertices, float *outResultCosts, int numResults );
 
 
+///
+/// Run one search for each query of a batch over many small graphs.  Query n
+/// searches graphs[queryGraphs[n]] from querySources[n].  Graphs whose costs
+/// fit in a work-group's local memory (a few thousand vertices) are solved
+/// together in a single launch, one work-group per query; larger graphs fall
+/// back to a session per graph.
+///
+/// \param context Context the device belongs to, must be created by caller
+/// \param deviceId Device to run on
+/// \param graphs The graphs, only read during this call
+/// \param graphCount Number of graphs
+/// \param queryGraphs Index of the graph of each query
+/// \param querySources Source vertex of each query, local to its graph
+/// \param outResultCosts A pre-allocated array receiving the costs of each query
+///                       in query order, one per vertex of the query's graph
+/// \param numQueries Number of queries
+/// \return false if a program could not be built or a search failed
+///
+bool runDijkstraBatchedGraphs( cl_context context, cl_device_id deviceId, const GraphData *graphs,
+                               int graphCount, const int *queryGraphs, const int *querySources,
+                               float *outResultCosts, int numQueries );
+
+///
+/// Check result rows against the shortest-path optimality conditions (see
+/// dijkstraVerify.h) on an OpenCL device instead of the host.  The reverse
+/// graph is built on the host and uploaded for this call only.  The check
+/// that every reached vertex has a path of tight edges from the source runs
+/// on the host.
+///
+/// \param context Context the device belongs to, must be created by caller
+/// \param deviceId Device to run on
+/// \param graph The graph the results were computed on
+/// \param sourceVertices Source of each row
+/// \param costs numResults rows of graph->vertexCount costs
+/// \param outVerification Receives the counts, may be NULL
+/// \return true if every row satisfies the conditions, false if one does not
+///         or the program could not be built
+///
+bool verifyOCLDijkstraResults( cl_context context, cl_device_id deviceId, const GraphData *graph,
+                               const int *sourceVertices, const float *costs, int numResults,
+                               SSSPVerification *outVerification );
+
 ///
 /// Run Dijkstra's shortest path on the GraphData provided to this function.  This
 /// function will compute the shortest path distance from sourceVertices[n] ->
@@ -122,23 +305,19 @@ void runDijkstraMultiGPUandCPU( cl_context gpuContext, cl_context cpuContext, Gr
                                 int *sourceVertices, float *outResultCosts, int numResults );
 
 ///
-/// Run Dijkstra's shortest path on the GraphData provided to this function.  This
-/// function will compute the shortest path distance from sourceVertices[n] ->
-/// endVertices[n] and store the cost in outResultCosts[n].  The number of results
-/// it will compute is given by numResults.
+/// Run a long batch on every GPU and CPU device like runDijkstraMultiGPUandCPU(),
+/// checkpointing it in jobDirectory, see dijkstraCheckpoint.h.  A job that was
+/// interrupted resumes where it stopped when run again on the same directory,
+/// with the same sources and on any set of devices.
 ///
-/// This is a CPU *REFERENCE* implementation for use as a fallback.
-///
-/// \param graph Structure containing the vertex, edge, and weight arra
-///              for the input graph
-/// \param startVertices Indices into the vertex array from which to
-///                      start the search
-/// \param outResultsCosts A pre-allocated array where the results for
-///                        each shortest path search will be written.
-///                        This must be sized numResults * graph->numVertices.
-/// \param numResults Should be the size of all three passed inarrays
+/// \param cpuContext Current CPU context, NULL for GPUs only
+/// \param outResultCosts numResults * graph->vertexCount costs, or NULL to keep
+///                       the rows in <jobDirectory>/rows only
+/// \param jobDirectory Directory holding the job's manifest and rows
+/// \return false if the job could not be checkpointed or a device failed
 ///
-void runDijkstraRef( GraphData* graph, int *sourceVertices,
-                     float *outResultCosts, int numResults );
+bool runDijkstraMultiGPUCheckpointed( cl_context gpuContext, cl_context cpuContext, GraphData* graph,
+                                      int *sourceVertices, float *outResultCosts, int numResults,
+                                      const char *jobDirectory );
 
 #endif // DIJKSTRA_KERNEL_H
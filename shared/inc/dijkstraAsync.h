@@ -0,0 +1,288 @@
+//
+//
+//  Description:
+//      Asynchronous front end to the SSSP backends.  An SSSPEngine keeps one
+//      worker thread and one session per backend alive for a graph; submitting
+//      a batch of sources returns immediately with an SSSPFuture that is
+//      completed from the worker threads.  Batches are run in order of
+//      priority and can be cancelled while they are queued or running.
+//
+//      Every batch belongs to a class.  Interactive batches are dispatched
+//      before bulk batches, which are split into single-source chunks so that
+//      an interactive batch waits for at most one search per worker.  Bulk
+//      batches are still given a minimum share of the chunks, and the engine
+//      keeps latency figures and target misses per class.
+//
+//      SSSPFuture can be waited on, given completion callbacks, or awaited
+//      from a C++20 coroutine (co_await future) without this header depending
+//      on <coroutine>.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#ifndef DIJKSTRA_ASYNC_H
+#define DIJKSTRA_ASYNC_H
+
+#include <pthread.h>
+#include <vector>
+#include "dijkstraBackend.h"
+
+///
+//  Types
+//
+
+//
+//  Life cycle of a submitted batch.  COMPLETED, FAILED and CANCELLED are final.
+//
+typedef enum
+{
+    SSSP_REQUEST_QUEUED,
+    SSSP_REQUEST_RUNNING,
+    SSSP_REQUEST_COMPLETED,
+    SSSP_REQUEST_FAILED,
+    SSSP_REQUEST_CANCELLED
+
+} SSSPRequestState;
+
+//
+//  Scheduling class of a batch
+//
+typedef enum
+{
+    // Latency-sensitive queries, dispatched first
+    SSSP_CLASS_INTERACTIVE,
+
+    // Throughput jobs such as all-pairs batches, run between interactive chunks
+    SSSP_CLASS_BULK,
+
+    SSSP_CLASS_COUNT
+
+} SSSPRequestClass;
+
+//
+//  How the engine shares its workers between the classes
+//
+typedef struct
+{
+    // Sources per chunk of a bulk batch, the longest an interactive batch
+    // waits for a busy worker
+    int bulkChunkSources;
+
+    // Interactive chunks dispatched in a row while bulk chunks wait before
+    // one bulk chunk goes first, so bulk batches get at least
+    // 1 / (interactivePerBulk + 1) of the chunks
+    int interactivePerBulk;
+
+    // Latency target of each class in seconds, from submission to the final
+    // state, counted in SSSPClassStats::sloMisses
+    double latencyTarget[SSSP_CLASS_COUNT];
+
+} SSSPClassPolicy;
+
+//
+//  Latency figures of one class, see SSSPEngine::getClassStats().  The
+//  latencies are of completed batches; percentiles are accurate to one
+//  histogram bucket (25%).
+//
+typedef struct
+{
+    long long submitted;
+    long long completed;
+
+    // Batches that failed or were cancelled
+    long long abandoned;
+
+    // Chunks dispatched to the workers
+    long long chunks;
+
+    // Completed batches slower than the class's latency target
+    long long sloMisses;
+
+    double meanLatency;
+    double p50Latency;
+    double p95Latency;
+    double p99Latency;
+    double maxLatency;
+
+} SSSPClassStats;
+
+//
+//  Completion callback.  Called once, on the worker thread that finished the
+//  batch, or on the thread that registered or cancelled it if that happened
+//  first.  Must not block on other requests of the same engine.
+//
+typedef void (*SSSPCallback)( void *userData );
+
+// Shared state of one submitted batch, see dijkstraAsync.cpp
+struct SSSPRequest;
+
+// Latency counters of one class, see dijkstraAsync.cpp
+struct SSSPClassMetrics;
+
+// Query log, see dijkstraWorkload.h
+struct WorkloadRecorder;
+
+//
+//  Handle to a submitted batch.  Copies refer to the same batch; the batch
+//  state lives until the engine and every copy are done with it.
+//
+class SSSPFuture
+{
+public:
+    SSSPFuture();
+    SSSPFuture( const SSSPFuture &other );
+    SSSPFuture &operator=( const SSSPFuture &other );
+    ~SSSPFuture();
+
+    /// false for a default constructed future
+    bool valid() const { return request != NULL; }
+
+    /// Current state, without blocking
+    SSSPRequestState getState() const;
+
+    /// true once the state is final
+    bool isReady() const;
+
+    /// Block until the state is final and the callbacks registered before
+    /// then have run, and return the state.  On the thread running those
+    /// callbacks it returns once the state is final.
+    SSSPRequestState wait() const;
+
+    ///
+    /// Stop the batch.  A queued batch is cancelled at once; a running batch
+    /// takes no more chunks and becomes CANCELLED when the chunks already on a
+    /// device finish.  The costs of a cancelled batch are undefined.
+    ///
+    /// \return false if the batch had already finished
+    ///
+    bool cancel();
+
+    ///
+    /// Call callback(userData) when the batch finishes, or right away on this
+    /// thread if it already has.  Several callbacks run in registration order.
+    ///
+    void then( SSSPCallback callback, void *userData );
+
+    ///
+    /// C++20 awaitable interface, co_await returns the final state.  The
+    /// coroutine is resumed on the worker thread that completes the batch.
+    ///
+    bool await_ready() const { return isReady(); }
+
+    template <class Handle>
+    bool await_suspend( Handle handle )
+    {
+        return addCallback(resumeHandle<Handle>, handle.address());
+    }
+
+    SSSPRequestState await_resume() const { return getState(); }
+
+private:
+    explicit SSSPFuture( SSSPRequest *request );
+
+    /// Register a callback unless the batch has finished.  Returns false,
+    /// without calling it, if it has.
+    bool addCallback( SSSPCallback callback, void *userData );
+
+    template <class Handle>
+    static void resumeHandle( void *address )
+    {
+        Handle::from_address(address).resume();
+    }
+
+    SSSPRequest *request;
+
+    friend class SSSPEngine;
+};
+
+//
+//  Worker pool over a set of backends bound to one graph.
+//
+class SSSPEngine
+{
+public:
+    SSSPEngine();
+    ~SSSPEngine();
+
+    ///
+    /// Start one worker per backend and create its session.  The graph and
+    /// the backends must stay valid until shutdown().
+    ///
+    /// \return false if no backend could create a session
+    ///
+    bool start( SSSPBackend **backends, int backendCount, const GraphData *graph );
+
+    ///
+    /// Queue a batch.  The source vertices are copied; outResultCosts must hold
+    /// numResults * vertexCount costs and stay valid until the batch finishes.
+    /// Batches of higher priority are dispatched first, batches of equal
+    /// priority in submission order.  Large batches are split into chunks so
+    /// that they are spread over the backends and a more urgent batch can be
+    /// dispatched between two chunks.  Priorities order batches within a
+    /// class; interactive batches go before bulk ones, see SSSPClassPolicy.
+    /// callback, if not NULL, is registered as with SSSPFuture::then() before
+    /// the batch can start, so that it cannot run late for a batch that
+    /// finishes before submit() returns.
+    ///
+    SSSPFuture submit( const int *sourceVertices, float *outResultCosts, int numResults,
+                       int priority = 0, SSSPRequestClass requestClass = SSSP_CLASS_INTERACTIVE,
+                       SSSPCallback callback = NULL, void *userData = NULL );
+
+    /// Change how the classes share the workers, applies to batches
+    /// submitted from then on
+    void setClassPolicy( const SSSPClassPolicy &policy );
+
+    /// Current class policy
+    SSSPClassPolicy getClassPolicy() const;
+
+    /// Latency figures of a class since the engine was created
+    SSSPClassStats getClassStats( SSSPRequestClass requestClass ) const;
+
+    /// Log every batch submitted from then on, NULL to stop.  The recorder
+    /// must stay open while it is set.
+    void setWorkloadRecorder( WorkloadRecorder *recorder );
+
+    ///
+    /// Cancel every queued batch, wait for the chunks on the devices and stop
+    /// the workers.  Called by the destructor.
+    ///
+    void shutdown();
+
+    /// Number of workers that created a session
+    int getWorkerCount() const { return workerCount; }
+
+private:
+    struct Worker;
+    static void *workerThread( void *arg );
+
+    bool nextChunk( SSSPRequest **outRequest, int *outFirst, int *outCount );
+    int nextRequestIndex( SSSPRequestClass requestClass ) const;
+
+    const GraphData *graph;
+    std::vector<Worker*> workers;
+    int workerCount;
+
+    // Batches with chunks left to dispatch, guarded by queueLock
+    std::vector<SSSPRequest*> queue;
+    mutable pthread_mutex_t queueLock;
+    pthread_cond_t queueChanged;
+    pthread_cond_t workerStarted;
+    int workersStarting;
+    unsigned long long submitted;
+    bool stopping;
+    int chunksPerBatch;
+
+    // Class scheduling, guarded by queueLock
+    SSSPClassPolicy classPolicy;
+    int interactiveStreak;
+    SSSPClassMetrics *classMetrics;
+
+    // Query log, guarded by queueLock
+    WorkloadRecorder *recorder;
+
+    // Not copyable
+    SSSPEngine( const SSSPEngine & );
+    SSSPEngine &operator=( const SSSPEngine & );
+};
+
+#endif // DIJKSTRA_ASYNC_H
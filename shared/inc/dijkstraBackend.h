@@ -0,0 +1,174 @@
+//
+//
+//  Description:
+//      Engine-independent interface to the single-source shortest path engines.
+//      Every engine (CUDA device, OpenCL device, native CPU) is exposed as an
+//      SSSPBackend and registered by name, so schedulers, caches and benchmarks
+//      can be written once against this interface and run over whatever
+//      engines are available on the machine.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#ifndef DIJKSTRA_BACKEND_H
+#define DIJKSTRA_BACKEND_H
+
+#include "dijkstraGraph.h"
+
+///
+//  Constants
+//
+#define SSSP_BACKEND_CPU_HEAP     "cpu-heap"
+#define SSSP_BACKEND_CPU_BUCKET   "cpu-bucket"
+#define SSSP_BACKEND_CPU_PUSHPULL "cpu-pushpull"
+
+///
+//  Types
+//
+
+//
+//  Kind of hardware a backend runs on, used by schedulers to decide how to
+//  split work.  Several backends may share the same CPU cores.
+//
+typedef enum
+{
+    SSSP_DEVICE_CPU,
+    SSSP_DEVICE_GPU,
+    SSSP_DEVICE_ACCELERATOR
+
+} SSSPDeviceType;
+
+//
+//  A graph bound to one backend.  Creating a session does the per-graph work
+//  once (device allocation and upload, program build, scratch buffers), after
+//  which any number of batches of sources can be run against it.  A session is
+//  used by one thread at a time.
+//
+class SSSPSession
+{
+public:
+    virtual ~SSSPSession() {}
+
+    ///
+    /// Compute the shortest path cost from every source to every vertex.
+    ///
+    /// \param sourceVertices Source vertex of each search
+    /// \param outResultCosts Pre-allocated, numResults * vertexCount costs,
+    ///                       FLT_MAX for unreachable vertices
+    /// \param numResults Number of sources
+    /// \return false if the engine failed, the results are then undefined
+    ///
+    virtual bool run( const int *sourceVertices, float *outResultCosts, int numResults ) = 0;
+};
+
+//
+//  An SSSP engine.  Backends are stateless apart from the device they drive;
+//  all per-graph state lives in the sessions they create.
+//
+class SSSPBackend
+{
+public:
+    virtual ~SSSPBackend() {}
+
+    /// Unique registry name, e.g. "cpu-heap" or "opencl-gpu0"
+    virtual const char *getName() const = 0;
+
+    /// Kind of hardware the backend runs on
+    virtual SSSPDeviceType getDeviceType() const = 0;
+
+    /// Bind a graph to the backend.  The graph arrays must stay valid for the
+    /// lifetime of the session.  Returns NULL if the graph does not fit.
+    virtual SSSPSession *createSession( const GraphData *graph ) = 0;
+
+    /// Memory in bytes the sessions of the backend may hold together, for
+    /// caches that keep several graphs resident.  0 if unlimited.
+    virtual size_t getMemoryBudget() const { return 0; }
+
+    /// Estimated memory in bytes a session of the graph holds
+    virtual size_t estimateSessionBytes( const GraphData *graph ) const;
+};
+
+// Registered metric, see dijkstraMetrics.h
+struct Metric;
+
+//
+//  Metrics of one backend, looked up once by initBackendMeters() so that
+//  every run only pays for a few atomic adds
+//
+typedef struct
+{
+    // Seconds spent in SSSPSession::run(), sources searched, runs and failed runs
+    Metric *busySeconds;
+    Metric *sources;
+    Metric *runs;
+    Metric *failures;
+
+} BackendMeters;
+
+///
+/// Look up the metrics of a backend, labelled with its name
+///
+void initBackendMeters( SSSPBackend *backend, BackendMeters *outMeters );
+
+///
+/// Run a batch on a session and add it to the backend's metrics
+///
+bool runMeteredSession( const BackendMeters *meters, SSSPSession *session, const int *sourceVertices,
+                        float *outResultCosts, int numResults );
+
+///
+/// Run one batch through a temporary session, added to the backend's metrics
+///
+/// \return false if the session could not be created or the run failed
+///
+bool runSSSP( SSSPBackend *backend, const GraphData *graph, const int *sourceVertices,
+              float *outResultCosts, int numResults );
+
+///
+/// Split a batch of sources over several backends.  One thread per backend
+/// creates a session and pulls chunks of sources from a shared queue until
+/// the batch is done, so faster backends automatically take more of the work.
+///
+/// \return false if any backend failed
+///
+bool runSSSPMultiBackend( SSSPBackend **backends, int backendCount, const GraphData *graph,
+                          const int *sourceVertices, float *outResultCosts, int numResults );
+
+///
+/// Add a backend to the registry.  The registry takes ownership and deletes
+/// the backend in releaseSSSPBackends().  A backend with the name of one that
+/// is already registered replaces it.
+///
+void registerSSSPBackend( SSSPBackend *backend );
+
+///
+/// Look up a registered backend by name, NULL if there is none
+///
+SSSPBackend *findSSSPBackend( const char *name );
+
+///
+/// Number of registered backends
+///
+int getSSSPBackendCount();
+
+///
+/// Registered backend by index, in registration order
+///
+SSSPBackend *getSSSPBackend( int index );
+
+///
+/// Delete every registered backend
+///
+void releaseSSSPBackends();
+
+///
+/// Register the native CPU backends, which are always available:
+///
+///     cpu-heap      Dijkstra with a binary heap
+///     cpu-bucket    Delta-stepping over buckets of width delta
+///     cpu-pushpull  Frontier algorithm switching between push and pull,
+///                   see dijkstraDirection.h
+///
+void registerCPUBackends();
+
+#endif // DIJKSTRA_BACKEND_H
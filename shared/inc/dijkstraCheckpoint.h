@@ -0,0 +1,82 @@
+//
+//
+//  Description:
+//      Checkpointed multi-source jobs.  A long batch (up to all sources of the
+//      graph) is split into fixed chunks of sources, and each finished chunk
+//      is written to a job directory before it is recorded as done:
+//
+//          <dir>/rows       numResults * vertexCount costs in source order
+//          <dir>/manifest   job header followed by one record per finished
+//                           chunk, appended as chunks complete
+//
+//      A job restarted on the same directory skips every chunk the manifest
+//      records.  The chunks belong to the job rather than to a device, so the
+//      restart may run on any number and kind of backends.  A record is only
+//      appended once the chunk's rows are on disk, and a torn record at the end
+//      of the manifest is ignored, so a crash at any point loses at most the
+//      chunks that were in flight.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#ifndef DIJKSTRA_CHECKPOINT_H
+#define DIJKSTRA_CHECKPOINT_H
+
+#include "dijkstraGraph.h"
+#include "dijkstraBackend.h"
+
+///
+//  Constants
+//
+#define CHECKPOINT_MAGIC        0x4b504843  // 'CHPK'
+#define CHECKPOINT_VERSION      1
+
+// Chunks hold about this many bytes of rows, and there are at least
+// CHECKPOINT_MIN_CHUNKS of them so that progress is saved regularly
+#define CHECKPOINT_CHUNK_BYTES  (64 << 20)
+#define CHECKPOINT_MIN_CHUNKS   256
+
+///
+//  Types
+//
+
+//
+//  Progress of a checkpointed job, see runSSSPCheckpointed()
+//
+typedef struct
+{
+    // Chunks of the job and sources per chunk (the last may be shorter)
+    int chunkCount;
+    int chunkSources;
+
+    // Chunks found finished in the manifest when the job started
+    int resumedChunks;
+
+    // Chunks finished by this run
+    int completedChunks;
+
+} CheckpointStats;
+
+///
+//  Functions
+//
+
+///
+/// Run a batch of sources over several backends, saving each finished chunk
+/// to jobDirectory, which is created if needed.  If jobDirectory already holds
+/// a job it must be for the same graph and sources, and its finished chunks
+/// are not run again.
+///
+/// \param outResultCosts numResults * vertexCount costs receiving every row,
+///                       including those of resumed chunks, or NULL to keep
+///                       the rows in <jobDirectory>/rows only
+/// \param outStats Receives the progress of the job, may be NULL
+/// \return false if the job directory could not be used, belongs to another
+///         job, or a backend failed.  Chunks finished before the failure stay
+///         recorded.
+///
+bool runSSSPCheckpointed( SSSPBackend **backends, int backendCount, const GraphData *graph,
+                          const int *sourceVertices, float *outResultCosts, int numResults,
+                          const char *jobDirectory, CheckpointStats *outStats );
+
+#endif // DIJKSTRA_CHECKPOINT_H
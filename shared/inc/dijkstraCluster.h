@@ -0,0 +1,112 @@
+//
+//
+//  Description:
+//      Multi-node source sharding.  A coordinator process splits a batch of
+//      sources into chunks and hands them out over TCP to worker processes,
+//      each running its own SSSPBackend on its own copy of the graph (or on a
+//      shared graph segment, see dijkstraSharedGraph.h).  Workers stream the
+//      result rows of each chunk back and are given the next chunk as soon as
+//      they are done, so faster nodes take more of the batch.
+//
+//      Workers may join at any time while the job runs.  A worker that drops
+//      its connection gives its chunk back to the queue.  Once the queue is
+//      empty, idle workers are given copies of chunks still running on other
+//      workers, so a slow node cannot hold up the end of the job: the first
+//      copy to finish is used and the others are discarded.
+//
+//      Every worker sends a checksum of its graph when it connects and is
+//      turned away if it does not match the coordinator's.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#ifndef DIJKSTRA_CLUSTER_H
+#define DIJKSTRA_CLUSTER_H
+
+#include "dijkstraGraph.h"
+#include "dijkstraBackend.h"
+
+///
+//  Constants
+//
+#define CLUSTER_MAGIC           0x53554c43  // 'CLUS'
+#define CLUSTER_VERSION         1
+#define CLUSTER_NAME_MAX        64
+
+// Chunks hold about this many bytes of rows, and there are at least
+// CLUSTER_MIN_CHUNKS of them so that the work can be balanced
+#define CLUSTER_CHUNK_BYTES     (16 << 20)
+#define CLUSTER_MIN_CHUNKS      64
+
+// Copies of one chunk that may run at the same time
+#define CLUSTER_MAX_COPIES      2
+
+// The coordinator gives up if no worker is connected for this long
+#define CLUSTER_IDLE_TIMEOUT_MS 60000
+
+///
+//  Types
+//
+
+//
+//  What one worker did for a job, see runSSSPCoordinator()
+//
+typedef struct
+{
+    // Name the worker connected with, by default its host and backend
+    char name[CLUSTER_NAME_MAX];
+
+    // Chunks and sources whose results were used
+    int chunks;
+    int sources;
+
+    // Copies of running chunks this worker was given because the queue was
+    // empty, and how many of those finished first
+    int backupChunks;
+    int backupsWon;
+
+    // Results discarded because another copy of the chunk finished first
+    int discardedChunks;
+
+    // Seconds from the first chunk sent to the last result received
+    double busySeconds;
+
+    // Whether the connection failed before the job was done
+    bool failed;
+
+} ClusterWorkerStats;
+
+///
+//  Functions
+//
+
+///
+/// Coordinate a batch of sources over the workers that connect to port.
+/// Returns once every chunk has a result.
+///
+/// \param outResultCosts Pre-allocated numResults * vertexCount costs
+/// \param outWorkerStats Receives one entry per worker that connected, in
+///                       order of connection, may be NULL
+/// \param maxWorkers Size of outWorkerStats; further workers still work but
+///                   are not reported
+/// \param outWorkerCount Receives the number of workers that connected, may be NULL
+/// \return false if the port could not be opened or no worker was connected
+///         for CLUSTER_IDLE_TIMEOUT_MS while work remained
+///
+bool runSSSPCoordinator( int port, const GraphData *graph, const int *sourceVertices,
+                         float *outResultCosts, int numResults,
+                         ClusterWorkerStats *outWorkerStats, int maxWorkers, int *outWorkerCount );
+
+///
+/// Serve chunks from the coordinator at host:port with a backend until the
+/// coordinator reports the job done.  Retries the connection for a few
+/// seconds so that workers can be started before the coordinator.
+///
+/// \param name Name to report, NULL for "<hostname>/<backend>"
+/// \return false if the coordinator could not be reached, rejected the
+///         graph, or the backend failed
+///
+bool runSSSPWorker( const char *host, int port, SSSPBackend *backend, const GraphData *graph,
+                    const char *name );
+
+#endif // DIJKSTRA_CLUSTER_H
@@ -0,0 +1,126 @@
+//
+//
+//  Description:
+//      Connected component index.  Random and real graphs often fall apart into
+//      many components, and a search can never leave the weakly connected
+//      component (WCC) of its source, yet every engine initializes and scans
+//      all V vertices per source.  The index records the weakly and strongly
+//      connected components (SCC) of a graph, so that searches can run on their
+//      source's component only, unreachable pairs can be rejected without a
+//      search, and sources can be scheduled by component.
+//
+//      The WCCs are found by a lock-free union-find over several threads while
+//      one more thread finds the SCCs with Tarjan's algorithm.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#ifndef DIJKSTRA_COMPONENTS_H
+#define DIJKSTRA_COMPONENTS_H
+
+#include "dijkstraGraph.h"
+#include "dijkstraBackend.h"
+
+///
+//  Types
+//
+
+//
+//  Whether one vertex can reach another, as far as the index can tell
+//  without a search
+//
+typedef enum
+{
+    SSSP_UNREACHABLE,
+    SSSP_REACHABLE,
+    SSSP_MAYBE_REACHABLE
+
+} SSSPReachability;
+
+//
+//  Components of a graph.  Build with buildComponentIndex(), release with
+//  freeComponentIndex().
+//
+typedef struct
+{
+    int vertexCount;
+
+    // WCC of each vertex.  WCCs are numbered in the order of their lowest
+    // vertex.
+    int *wcc;
+    int wccCount;
+
+    // Vertices of WCC c are wccVertices[wccStart[c] .. wccStart[c + 1]), in
+    // ascending order.  wccStart has wccCount + 1 entries.
+    int *wccStart;
+    int *wccVertices;
+
+    // Position of each vertex within the vertex list of its WCC
+    int *wccLocalVertex;
+
+    // SCC of each vertex.  SCCs are numbered in reverse topological order: an
+    // edge between two SCCs always runs from a higher to a lower number.
+    int *scc;
+    int sccCount;
+
+    // Vertices in each SCC
+    int *sccSize;
+
+} ComponentIndex;
+
+///
+//  Functions
+//
+
+///
+/// Find the weakly and strongly connected components of a graph
+///
+/// \param threadCount Threads for the WCC search, the SCC search runs on one
+///                    more thread alongside them
+/// \param outIndex Filled with the components
+///
+void buildComponentIndex( const GraphData *graph, int threadCount, ComponentIndex *outIndex );
+
+///
+/// Free everything allocated by buildComponentIndex()
+///
+void freeComponentIndex( ComponentIndex *index );
+
+///
+/// Vertex count of the WCC of a vertex
+///
+inline int componentSize( const ComponentIndex *index, int vertex )
+{
+    int c = index->wcc[vertex];
+    return index->wccStart[c + 1] - index->wccStart[c];
+}
+
+///
+/// Whether source can reach target.  Different WCCs, or an SCC that comes
+/// later in topological order, can never be reached; the same SCC always can.
+///
+SSSPReachability componentReachability( const ComponentIndex *index, int source, int target );
+
+///
+/// Order a batch of sources so that the sources of the largest WCCs come first
+/// and the sources of one WCC are consecutive.  Sources of the same WCC keep
+/// their relative order.
+///
+/// \param outOrder Receives numSources indices into sourceVertices
+///
+void orderSourcesByComponent( const ComponentIndex *index, const int *sourceVertices,
+                              int numSources, int *outOrder );
+
+///
+/// Bind a graph and its component index to a backend.  Each search runs on
+/// the WCC of its source only, through a session created for that WCC the
+/// first time one of its vertices is used as a source.  Sources whose WCC is
+/// a single vertex need no search.  A batch is grouped by WCC, so every WCC
+/// of the batch is one run on its session.  run() fails if the backend
+/// cannot load a WCC.  Graph and index must stay valid for the lifetime of the
+/// session.
+///
+SSSPSession *createComponentSession( SSSPBackend *backend, const GraphData *graph,
+                                     const ComponentIndex *index );
+
+#endif // DIJKSTRA_COMPONENTS_H
@@ -0,0 +1,160 @@
+//
+//
+//  Description:
+//      Degree-2 chain contraction.  Road and utility networks consist mostly of
+//      vertices that only continue a path: one way in and one way out, or a
+//      two-way street with exactly two neighbors.  Every such vertex costs the
+//      frontier engines an iteration step and a relaxation.  contractGraph()
+//      replaces each maximal chain of them by a single weighted edge between
+//      the chain's end vertices and keeps the chain so that the costs of the
+//      interior vertices can be recovered in one linear pass after the search.
+//
+//      Any backend runs on the reduced graph through createContractedSession(),
+//      which takes and returns vertices of the original graph.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#ifndef DIJKSTRA_CONTRACT_H
+#define DIJKSTRA_CONTRACT_H
+
+#include "dijkstraGraph.h"
+#include "dijkstraBackend.h"
+
+///
+//  Types
+//
+
+//
+//  A maximal chain of interior vertices between two kept vertices.  The
+//  forward direction runs from startVertex through the interior vertices to
+//  endVertex.  Two-way chains can also be walked backwards, possibly with
+//  different weights.  startVertex and endVertex are the same vertex for a
+//  chain that loops back to where it started.
+//
+typedef struct
+{
+    // End vertices, in the original graph
+    int startVertex;
+    int endVertex;
+
+    // Interior vertices in forward order are
+    // interiorVertices[firstInterior .. firstInterior + interiorCount)
+    int firstInterior;
+    int interiorCount;
+
+    // Cost of walking the whole chain forward, and backward for two-way chains.
+    // Chain costs are summed in double so that the differences taken when
+    // expanding costs do not cancel to a few float ulps of the chain length.
+    double forwardLength;
+    double backwardLength;
+
+    bool twoWay;
+
+} ContractedChain;
+
+//
+//  A graph with its degree-2 chains contracted, plus everything needed to map
+//  results back to the original graph.  Build with contractGraph(), release
+//  with freeContractedGraph().
+//
+typedef struct
+{
+    // The reduced graph, only the kept vertices
+    GraphData graph;
+
+    // Vertex count of the original graph
+    int originalVertexCount;
+
+    // Edge count of the original graph
+    int originalEdgeCount;
+
+    // Vertex of the reduced graph for each original vertex, -1 for interior
+    // vertices
+    int *reducedVertex;
+
+    // Original vertex of each vertex of the reduced graph
+    int *originalVertex;
+
+    // Chain each interior vertex lies on, -1 for kept vertices
+    int *vertexChain;
+
+    // Cost from the chain's start vertex to each interior vertex, and from the
+    // interior vertex back to the start vertex for two-way chains
+    double *costFromStart;
+    double *costToStart;
+
+    // Chain each edge of the reduced graph replaces, -1 for edges copied from
+    // the original graph.  Edges of a two-way chain that run from endVertex
+    // to startVertex are stored as -2 - chain.
+    int *edgeChain;
+
+    // Interior vertices of all chains, grouped by chain in forward order
+    int *interiorVertices;
+
+    ContractedChain *chains;
+    int chainCount;
+
+} ContractedGraph;
+
+///
+//  Functions
+//
+
+///
+/// Contract every chain of degree-2 vertices of a graph.  Vertices listed in
+/// keepVertices are never contracted, which is cheaper for vertices that will
+/// be used as sources often.  Any other vertex can still be used as a source.
+///
+/// \param graph Input graph, not referenced after the call
+/// \param keepVertices Vertices to keep, may be NULL
+/// \param keepCount Number of entries in keepVertices
+/// \param outContracted Filled with the reduced graph and the chains
+///
+void contractGraph( const GraphData *graph, const int *keepVertices, int keepCount,
+                    ContractedGraph *outContracted );
+
+///
+/// Free everything allocated by contractGraph()
+///
+void freeContractedGraph( ContractedGraph *contracted );
+
+///
+/// Fill in the costs of the interior vertices of a search from a kept vertex.
+///
+/// \param reducedCosts Costs of the reduced graph's vertices
+/// \param outCosts originalVertexCount costs, the kept vertices are copied
+///                 from reducedCosts
+///
+void expandContractedCosts( const ContractedGraph *contracted, const float *reducedCosts,
+                            float *outCosts );
+
+///
+/// Original vertices along one edge of the reduced graph, excluding both of its
+/// end vertices.
+///
+/// \param outVertices Receives up to maxVertices vertices in path order
+/// \return Number of interior vertices on the edge, 0 for copied edges.  If
+///         this is more than maxVertices only the first maxVertices were
+///         written.
+///
+int unpackContractedEdge( const ContractedGraph *contracted, int reducedEdge,
+                          int *outVertices, int maxVertices );
+
+///
+/// Bind a contracted graph to a backend.  The backend runs on the reduced
+/// graph; sources and results use the vertices of the original graph.  A
+/// source on a chain is searched from the chain's end vertices.  The
+/// contracted graph must stay valid for the lifetime of the session.
+///
+/// \return NULL if the backend could not load the reduced graph
+///
+SSSPSession *createContractedSession( SSSPBackend *backend, const ContractedGraph *contracted );
+
+///
+/// Run one batch through a temporary contracted session, see runSSSP()
+///
+bool runSSSPContracted( SSSPBackend *backend, const ContractedGraph *contracted,
+                        const int *sourceVertices, float *outResultCosts, int numResults );
+
+#endif // DIJKSTRA_CONTRACT_H
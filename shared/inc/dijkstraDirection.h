@@ -0,0 +1,80 @@
+//
+//
+//  Description:
+//      Direction switching for the frontier SSSP engines.  Each iteration either
+//      pushes (every frontier vertex scatters updates along its out-edges, with
+//      contended writes) or pulls (every vertex gathers from its in-edges whose
+//      source is in the frontier and writes only its own cost).  Pushing costs
+//      work proportional to the frontier's out-edges, pulling always reads every
+//      in-edge but needs no atomics, so pulling wins once the frontier covers
+//      most of the graph.  Pulling needs the reverse graph, see
+//      buildReverseGraph().
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#ifndef DIJKSTRA_DIRECTION_H
+#define DIJKSTRA_DIRECTION_H
+
+#include "dijkstraGraph.h"
+#include "dijkstraFrontier.h"
+
+///
+//  Types
+//
+typedef enum
+{
+    SSSP_PUSH,
+    SSSP_PULL
+
+} SSSPDirection;
+
+//
+//  Switch thresholds.  The gap between the two gives hysteresis, so the
+//  direction does not flip back and forth on a frontier near one threshold.
+//
+typedef struct
+{
+    // Switch from push to pull once the frontier's out-edges exceed
+    // edgeCount / pullFactor
+    float pullFactor;
+
+    // Switch from pull back to push once the frontier holds fewer than
+    // vertexCount / pushFactor vertices
+    float pushFactor;
+
+    // Print every switch with the numbers it was based on
+    bool logSwitches;
+
+} SSSPDirectionPolicy;
+
+///
+/// Set the policy used by engines created from now on.  Defaults are
+/// pullFactor 2, pushFactor 4, no logging.
+///
+void setSSSPDirectionPolicy( const SSSPDirectionPolicy *policy );
+
+///
+/// Current policy
+///
+SSSPDirectionPolicy getSSSPDirectionPolicy();
+
+///
+/// Direction of the next iteration.  Logs the decision if it differs from
+/// current and the policy asks for it.
+///
+/// \param engineName Name printed with the log line
+/// \param iteration Iteration of the current search, for the log line
+/// \param frontierVertices Vertices in the frontier
+/// \param frontierEdges Out-edges of the frontier, see frontierEdgeCount()
+///
+SSSPDirection chooseSSSPDirection( const SSSPDirectionPolicy *policy, const GraphData *graph,
+                                   SSSPDirection current, const char *engineName, int iteration,
+                                   int frontierVertices, long long frontierEdges );
+
+///
+/// Number of out-edges of the vertices in a frontier
+///
+long long frontierEdgeCount( const GraphData *graph, const FrontierWord *frontier, int wordCount );
+
+#endif // DIJKSTRA_DIRECTION_H
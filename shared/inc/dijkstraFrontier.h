@@ -0,0 +1,123 @@
+//
+//
+//  Description:
+//      Frontier (mask) bitmaps shared by the CUDA, OpenCL and CPU Dijkstra engines.
+//      Each vertex owns one bit; bits are packed little-endian into 32-bit words so
+//      that vertex v lives in word (v >> 5), bit (v & 31).  The same layout is used
+//      on the devices, so a mask read back from a device can be scanned directly.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#ifndef DIJKSTRA_FRONTIER_H
+#define DIJKSTRA_FRONTIER_H
+
+///
+//  Constants
+//
+#define FRONTIER_WORD_BITS  32
+#define FRONTIER_WORD_SHIFT 5
+#define FRONTIER_WORD_MASK  31
+
+///
+//  Types
+//
+typedef unsigned int FrontierWord;
+
+///
+/// Number of words needed to hold one bit per vertex
+///
+inline int frontierWordCount(int vertexCount)
+{
+    return (vertexCount + FRONTIER_WORD_BITS - 1) >> FRONTIER_WORD_SHIFT;
+}
+
+///
+/// Test whether a vertex is in the frontier
+///
+inline bool frontierTest(const FrontierWord *frontier, int vertex)
+{
+    return (frontier[vertex >> FRONTIER_WORD_SHIFT] >> (vertex & FRONTIER_WORD_MASK)) & 1;
+}
+
+///
+/// Add a vertex to the frontier
+///
+inline void frontierSet(FrontierWord *frontier, int vertex)
+{
+    frontier[vertex >> FRONTIER_WORD_SHIFT] |= (1u << (vertex & FRONTIER_WORD_MASK));
+}
+
+///
+/// Remove a vertex from the frontier
+///
+inline void frontierReset(FrontierWord *frontier, int vertex)
+{
+    frontier[vertex >> FRONTIER_WORD_SHIFT] &= ~(1u << (vertex & FRONTIER_WORD_MASK));
+}
+
+///
+/// Number of set bits in a word
+///
+inline int frontierWordPopCount(FrontierWord word)
+{
+#if defined(__GNUC__)
+    return __builtin_popcount(word);
+#else
+    word = word - ((word >> 1) & 0x55555555);
+    word = (word & 0x33333333) + ((word >> 2) & 0x33333333);
+    return (int) ((((word + (word >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+#endif
+}
+
+///
+/// Index of the lowest set bit of a non-zero word.  Used together with
+/// word &= word - 1 to visit only the vertices that are in the frontier.
+///
+inline int frontierWordLowestBit(FrontierWord word)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(word);
+#else
+    int bit = 0;
+    while ((word & 1) == 0)
+    {
+        word >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+///
+/// Check whether the frontier is empty.  This tells the algorithm whether
+/// it needs to continue running or not.
+///
+inline bool frontierEmpty(const FrontierWord *frontier, int wordCount)
+{
+    for (int i = 0; i < wordCount; i++)
+    {
+        if (frontier[i] != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+///
+/// Number of vertices in the frontier
+///
+inline int frontierSize(const FrontierWord *frontier, int wordCount)
+{
+    int size = 0;
+    for (int i = 0; i < wordCount; i++)
+    {
+        size += frontierWordPopCount(frontier[i]);
+    }
+
+    return size;
+}
+
+#endif // DIJKSTRA_FRONTIER_H
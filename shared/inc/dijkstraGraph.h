@@ -0,0 +1,115 @@
+//
+//
+//  Description:
+//      Graph representation and CPU helpers shared by the CUDA, OpenCL and native
+//      CPU Dijkstra engines.  The graph is stored in the compressed adjacency
+//      (CSR) layout of Harish & Narayanan:
+//
+//          "Accelerating large graph algorithms on the GPU using CUDA" by
+//          Parwan Harish and P.J. Narayanan
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#ifndef DIJKSTRA_GRAPH_H
+#define DIJKSTRA_GRAPH_H
+
+///
+//  Types
+//
+//
+//  This data structure and algorithm implementation is based on
+//  Accelerating large graph algorithms on the GPU using CUDA by
+//  Parwan Harish and P.J. Narayanan
+//
+typedef struct
+{
+    // (V) This contains a pointer to the edge list for each vertex
+    int *vertexArray;
+
+    // Vertex count
+    int vertexCount;
+
+    // (E) This contains pointers to the vertices that each edge is attached to
+    int *edgeArray;
+
+    // Edge count
+    int edgeCount;
+
+    // (W) Weight array
+    float *weightArray;
+
+} GraphData;
+
+///
+/// Index one past the last edge of a vertex
+///
+inline int graphEdgeEnd(const GraphData *graph, int vertex)
+{
+    return (vertex + 1 < graph->vertexCount) ? graph->vertexArray[vertex + 1] : graph->edgeCount;
+}
+
+///
+/// Allocate the arrays of a graph of the given size, charged to the host
+/// memory account as graph memory (see dijkstraMemory.h).  Every function in
+/// this library that builds a GraphData allocates it this way.
+///
+void allocateGraph( GraphData *graph, int vertexCount, int edgeCount );
+
+///
+/// Generate a random graph where every vertex has neighborsPerVertex outgoing
+/// edges with weights in [0, 1).  The arrays are allocated with
+/// allocateGraph() and released by freeGraph().
+///
+void generateRandomGraph( GraphData *graph, int numVertices, int neighborsPerVertex );
+
+///
+/// Generate a road-like graph: a square grid of intersections joined by two-way
+/// streets, each subdivided into segmentsPerStreet edges with weights in
+/// (0, 1].  Most vertices lie on a street and have exactly two neighbors, see
+/// dijkstraContract.h.  Release with freeGraph().
+///
+/// \param numVertices Approximate vertex count
+///
+void generateRoadGraph( GraphData *graph, int numVertices, int segmentsPerStreet );
+
+///
+/// Build the reverse graph: vertex v of the reverse graph has one edge per
+/// edge u -> v of the input, pointing back at u with the same weight.  Used by
+/// the engines that pull costs along in-edges.  Release with freeGraph().
+///
+void buildReverseGraph( const GraphData *graph, GraphData *outReverse );
+
+///
+/// Free the arrays of a graph allocated by allocateGraph(), generateRandomGraph()
+/// or any other function in this library that builds a GraphData
+///
+void freeGraph( GraphData *graph );
+
+///
+/// 64-bit FNV-1a checksum of the dimensions and arrays of a graph, used to
+/// tell whether state derived from a graph still belongs to it
+///
+unsigned long long graphChecksum( const GraphData *graph );
+
+///
+/// Run Dijkstra's shortest path on the GraphData provided to this function.  This
+/// function will compute the shortest path distance from sourceVertices[n] to
+/// every vertex and store the costs in outResultCosts[n * vertexCount].
+///
+/// This is a CPU *REFERENCE* implementation of the frontier algorithm the
+/// devices run, for use as a fallback and to validate the other engines.
+///
+/// \param graph Structure containing the vertex, edge, and weight arra
+///              for the input graph
+/// \param sourceVertices Indices into the vertex array from which to
+///                       start the search
+/// \param outResultCosts A pre-allocated array where the results for
+///                       each shortest path search will be written.
+///                       This must be sized numResults * graph->vertexCount.
+/// \param numResults Number of source vertices
+///
+void runDijkstraRef( const GraphData *graph, const int *sourceVertices,
+                     float *outResultCosts, int numResults );
+
+#endif // DIJKSTRA_GRAPH_H
@@ -0,0 +1,166 @@
+//
+//
+//  Description:
+//      Pruned landmark (hub) labeling for exact distance queries.  Every vertex
+//      v gets an out label of (hub, d(v, hub)) pairs and an in label of
+//      (hub, d(hub, v)) pairs such that for every pair u, v some shortest path
+//      from u to v passes through a hub in both the out label of u and the in
+//      label of v.  The exact cost is then
+//
+//          d(u, v) = min over common hubs h of d(u, h) + d(h, v)
+//
+//      found by merging the two labels, which are sorted by hub.
+//
+//      The labels are built with one pruned Dijkstra search per vertex in each
+//      direction, in rank order: a search from the root r stops at any vertex
+//      whose cost the labels of the higher ranked roots already give.  Ranking
+//      the hubs of the graph (high degree vertices by default) first keeps the
+//      labels small.  Roots are searched in batches, one root per thread at a
+//      time, and each search only prunes with the labels of earlier batches.
+//      This adds some redundant entries but keeps the labels exact.
+//
+//      The finished labels live in two flat arrays, the entries of all labels
+//      back to back and the offset of each label, and are written to disk and
+//      memory-mapped in that layout.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#ifndef DIJKSTRA_HUB_LABELS_H
+#define DIJKSTRA_HUB_LABELS_H
+
+#include <stddef.h>
+#include <float.h>
+#include <limits.h>
+#include "dijkstraGraph.h"
+
+///
+//  Constants
+//
+#define HUB_LABELS_MAGIC            0x4c425548  // 'HUBL'
+#define HUB_LABELS_VERSION          1
+
+// Hub of the entry that ends every label, above every rank
+#define HUB_LABELS_SENTINEL         INT_MAX
+
+// Roots searched by each thread per batch, once the batches are fully grown.
+// The first batches hold a single root, since the highest ranked roots prune
+// the most, and each batch is twice the size of the previous one.
+#define HUB_LABELS_ROOTS_PER_THREAD 8
+
+///
+//  Types
+//
+
+//
+//  One label entry.  The hub is a rank, so the entries of a label are sorted
+//  by rank.
+//
+typedef struct
+{
+    int hub;
+    float cost;
+
+} HubLabelEntry;
+
+//
+//  Labels of every vertex.  Build with buildHubLabels() or loadHubLabels(),
+//  release with freeHubLabels().
+//
+typedef struct
+{
+    int vertexCount;
+
+    // Vertex of each rank, hubs are stored as ranks
+    int *order;
+
+    // The out label of v starts at entries[labelStart[2 * v]] and its in label
+    // at entries[labelStart[2 * v + 1]].  Each ends with a
+    // HUB_LABELS_SENTINEL entry, labelStart[2 * vertexCount] is the entry count.
+    long long *labelStart;
+    HubLabelEntry *entries;
+
+    // File mapping the arrays point into, NULL if they were allocated
+    void *mapping;
+    size_t mappingSize;
+
+} HubLabels;
+
+///
+//  Functions
+//
+
+///
+/// Build the labels of a graph.
+///
+/// \param order Vertices from the highest rank down, e.g. the order of an
+///              existing hierarchy.  NULL ranks by total degree.
+/// \param threadCount Threads searching roots concurrently
+///
+void buildHubLabels( const GraphData *graph, const int *order, int threadCount, HubLabels *outLabels );
+
+///
+/// Free or unmap everything allocated by buildHubLabels() or loadHubLabels()
+///
+void freeHubLabels( HubLabels *labels );
+
+///
+/// Exact cost of the shortest path from u to v, FLT_MAX if there is none
+///
+inline float queryHubLabels( const HubLabels *labels, int u, int v )
+{
+    const HubLabelEntry *out = &labels->entries[labels->labelStart[2 * u]];
+    const HubLabelEntry *in = &labels->entries[labels->labelStart[2 * v + 1]];
+
+    // Both labels end with the same sentinel, so only equal hubs need a check
+    float best = FLT_MAX;
+    for (;;)
+    {
+        if (out->hub == in->hub)
+        {
+            if (out->hub == HUB_LABELS_SENTINEL)
+            {
+                break;
+            }
+
+            float cost = out->cost + in->cost;
+            best = (cost < best) ? cost : best;
+            out++;
+            in++;
+        }
+        else if (out->hub < in->hub)
+        {
+            out++;
+        }
+        else
+        {
+            in++;
+        }
+    }
+
+    return best;
+}
+
+///
+/// Number of entries of the labels, not counting the sentinels
+///
+inline long long hubLabelEntryCount( const HubLabels *labels )
+{
+    return labels->labelStart[2 * labels->vertexCount] - 2LL * labels->vertexCount;
+}
+
+///
+/// Write labels to a file
+///
+/// \return false if the file could not be written
+///
+bool saveHubLabels( const HubLabels *labels, const char *fileName );
+
+///
+/// Map labels written by saveHubLabels() read-only into memory
+///
+/// \return false if the file could not be mapped or holds no labels
+///
+bool loadHubLabels( const char *fileName, HubLabels *outLabels );
+
+#endif // DIJKSTRA_HUB_LABELS_H
@@ -0,0 +1,143 @@
+//
+//
+//  Description:
+//      Open-loop load generation.  Queries are issued to an SSSPEngine at
+//      arrival times drawn in advance from a Poisson or bursty process at a
+//      target rate, whether or not earlier queries have finished, and each
+//      latency is measured from the query's scheduled arrival rather than
+//      from when it was actually submitted.  A generator that falls behind
+//      schedule therefore cannot hide the queueing it caused (coordinated
+//      omission), and the tail percentiles reflect what clients arriving at
+//      that rate would see.
+//
+//      A sweep raises the rate until the engine stops keeping up, giving the
+//      saturation throughput of one backend configuration.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#ifndef DIJKSTRA_LOAD_H
+#define DIJKSTRA_LOAD_H
+
+#include "dijkstraGraph.h"
+#include "dijkstraAsync.h"
+
+///
+//  Constants
+//
+
+// Queries kept in flight before the generator waits for the oldest; the
+// generator then falls behind schedule, which the latencies account for
+#define LOAD_MAX_IN_FLIGHT      128
+
+// A sweep step keeps up if it completes at least this share of the offered rate
+#define LOAD_KEEP_UP_RATIO      0.95
+
+// Bisection steps a sweep takes between the last rate that kept up and the
+// first that did not
+#define LOAD_SWEEP_REFINEMENTS  4
+
+// Doublings a sweep gives up after if the engine keeps up with every rate
+#define LOAD_SWEEP_MAX_DOUBLINGS 20
+
+///
+//  Types
+//
+
+//
+//  Arrival process of the queries
+//
+typedef enum
+{
+    // Exponential inter-arrival times at the target rate
+    LOAD_ARRIVAL_POISSON,
+
+    // Poisson at burstFactor times the rate for the first burstFraction of
+    // every burstPeriod and at a lower rate for the rest, with the target
+    // rate on average
+    LOAD_ARRIVAL_BURSTY
+
+} LoadArrivalPattern;
+
+//
+//  Load to generate, see initLoadSpec() for the defaults
+//
+typedef struct
+{
+    // Queries per second, on average
+    double rate;
+
+    // Seconds over which queries are issued
+    double duration;
+
+    LoadArrivalPattern arrivals;
+    double burstFactor;
+    double burstFraction;
+    double burstPeriod;
+
+    // Random sources per query and the class they are submitted in
+    int sourcesPerQuery;
+    SSSPRequestClass requestClass;
+
+    // Seed of the arrival times and sources
+    unsigned int seed;
+
+} LoadSpec;
+
+//
+//  Outcome of one load run, latencies in seconds from the scheduled arrival
+//
+typedef struct
+{
+    double offeredRate;
+    double achievedRate;
+
+    long long issued;
+    long long completed;
+    long long failed;
+
+    double meanLatency;
+    double p50Latency;
+    double p90Latency;
+    double p99Latency;
+    double p999Latency;
+    double maxLatency;
+
+    // Longest the generator was behind schedule when submitting
+    double maxSubmitLag;
+
+} LoadResult;
+
+///
+//  Functions
+//
+
+///
+/// Fill a spec with the defaults: 10 single-source interactive queries per
+/// second for 10 seconds, Poisson arrivals, bursts of 4x for 10% of each second
+///
+void initLoadSpec( LoadSpec *spec );
+
+///
+/// Issue the load to a started engine and wait for every query
+///
+/// \return false if a query failed
+///
+bool runLoad( SSSPEngine *engine, const GraphData *graph, const LoadSpec *spec, LoadResult *outResult );
+
+///
+/// Find the highest rate the engine keeps up with: starting at spec->rate,
+/// the rate is doubled until a run completes less than LOAD_KEEP_UP_RATIO of
+/// it or its p99 latency exceeds p99Limit, then refined by bisection.
+///
+/// \param outRate Saturation throughput, the highest achieved rate of the
+///                runs that kept up, 0 if none did
+/// \param outSteps Receives the run at each rate tried, in order
+/// \param maxSteps Size of outSteps; further runs are not reported
+/// \param outStepCount Receives the number of runs, may be NULL
+/// \return false if a query failed
+///
+bool findSaturationRate( SSSPEngine *engine, const GraphData *graph, const LoadSpec *spec, double p99Limit,
+                         double *outRate, LoadResult *outSteps, int maxSteps, int *outStepCount );
+
+#endif // DIJKSTRA_LOAD_H
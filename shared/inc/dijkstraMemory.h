@@ -0,0 +1,154 @@
+//
+//
+//  Description:
+//      Memory accounting.  Every sizeable allocation of the engines is
+//      charged to an account per device (the host, or one OpenCL device) and
+//      per category, so the footprint of a run can be reported: current and
+//      peak bytes of graphs, search state, staging buffers, results and
+//      preprocessed indexes.
+//
+//      Host memory is charged through trackedMalloc()/trackedFree(), which
+//      remember the size and category of each block.  Device buffers are
+//      charged by their owner with chargeMemory()/releaseMemory().
+//
+//      A device can be given a hard limit.  It is enforced where the engines
+//      can refuse work cleanly: sessions reserve their memory with
+//      reserveMemory() and are not created if it would exceed the limit.
+//      Allocations of code that has no way to fail, such as the graph
+//      generators, are charged but never refused.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#ifndef DIJKSTRA_MEMORY_H
+#define DIJKSTRA_MEMORY_H
+
+#include <stddef.h>
+#include <string>
+
+///
+//  Constants
+//
+
+// Account of host memory, always registered
+#define MEMORY_HOST             0
+
+#define MEMORY_DEVICES_MAX      16
+#define MEMORY_DEVICE_NAME_MAX  64
+
+///
+//  Types
+//
+
+//
+//  What an allocation holds
+//
+typedef enum
+{
+    // Graph arrays, on the host or uploaded to a device
+    MEMORY_GRAPH,
+
+    // Per-search state: costs, frontiers, queues
+    MEMORY_STATE,
+
+    // Temporary buffers of transfers between host and device
+    MEMORY_STAGING,
+
+    // Cost rows handed back to the caller
+    MEMORY_RESULTS,
+
+    // Indexes built ahead of the queries: oracles, hub labels, components,
+    // contracted graphs
+    MEMORY_PREPROCESSING,
+
+    MEMORY_CATEGORY_COUNT
+
+} MemoryCategory;
+
+//
+//  Snapshot of one device's account, see getMemoryReport()
+//
+typedef struct
+{
+    char device[MEMORY_DEVICE_NAME_MAX];
+
+    size_t currentBytes[MEMORY_CATEGORY_COUNT];
+    size_t peakBytes[MEMORY_CATEGORY_COUNT];
+
+    // All categories together; the peak of the sum, not the sum of the peaks
+    size_t totalBytes;
+    size_t peakTotalBytes;
+
+    // Hard limit, 0 for none, and allocations refused because of it
+    size_t limitBytes;
+    unsigned long long refusals;
+
+} MemoryReport;
+
+///
+//  Functions
+//
+
+///
+/// Account of a device by name, registered on first use.  MEMORY_HOST is
+/// "host".
+///
+/// \return Device index, -1 if MEMORY_DEVICES_MAX devices are registered;
+///         charges to -1 are ignored
+///
+int getMemoryDevice( const char *name );
+
+///
+/// Number of registered devices, indices 0 to count - 1
+///
+int getMemoryDeviceCount();
+
+///
+/// Set the hard limit of a device in bytes, 0 for none
+///
+void setMemoryLimit( int device, size_t bytes );
+
+///
+/// Charge an allocation about to be made if it fits in the device's limit
+///
+/// \return false, charging nothing, if it would exceed the limit
+///
+bool reserveMemory( int device, MemoryCategory category, size_t bytes );
+
+///
+/// Charge an allocation regardless of the limit, for memory that is already
+/// allocated or that was checked with reserveMemory() as a whole
+///
+void chargeMemory( int device, MemoryCategory category, size_t bytes );
+
+///
+/// Give back bytes charged by reserveMemory() or chargeMemory()
+///
+void releaseMemory( int device, MemoryCategory category, size_t bytes );
+
+///
+/// malloc() charged to the host account, regardless of the limit
+///
+void *trackedMalloc( MemoryCategory category, size_t bytes );
+
+///
+/// Free a block of trackedMalloc() and give back its bytes.  NULL is ignored.
+///
+void trackedFree( void *block );
+
+///
+/// Current state of a device's account
+///
+void getMemoryReport( int device, MemoryReport *outReport );
+
+///
+/// Name of a category as used in the reports
+///
+const char *getMemoryCategoryName( MemoryCategory category );
+
+///
+/// Append a table of every device's current and peak bytes per category
+///
+void formatMemoryReport( std::string &out );
+
+#endif // DIJKSTRA_MEMORY_H
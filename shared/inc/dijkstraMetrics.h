@@ -0,0 +1,135 @@
+//
+//
+//  Description:
+//      Engine metrics in the Prometheus text format.  Counters, gauges and
+//      histograms are registered once by name and labels and then updated
+//      with atomic operations only, so they can be bumped from any thread
+//      without a lock.  The engines update them per batch or per chunk,
+//      never per relaxation, so the search kernels run as before.
+//
+//      The current values can be served over HTTP on a local port (GET
+//      /metrics) for scraping, or written to a file for batch jobs.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#ifndef DIJKSTRA_METRICS_H
+#define DIJKSTRA_METRICS_H
+
+#include <string>
+
+///
+//  Constants
+//
+#define METRIC_NAME_MAX         64
+#define METRIC_LABELS_MAX       128
+#define METRIC_BUCKETS_MAX      24
+
+///
+//  Types
+//
+
+//
+//  Kind of a metric, as in the TYPE line of the exposition format
+//
+typedef enum
+{
+    METRIC_COUNTER,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM
+
+} MetricType;
+
+//
+//  One time series, or one histogram.  Registered metrics live until
+//  releaseMetrics(); their values are only changed through the functions
+//  below.
+//
+typedef struct Metric
+{
+    MetricType type;
+    char name[METRIC_NAME_MAX];
+    char labels[METRIC_LABELS_MAX];
+    const char *help;
+
+    // Counter or gauge value, or histogram sum
+    volatile double value;
+
+    // Histogram bucket upper bounds and observations per bucket, made
+    // cumulative on export; the last count is the +Inf bucket
+    int bucketCount;
+    double bounds[METRIC_BUCKETS_MAX];
+    volatile unsigned long long counts[METRIC_BUCKETS_MAX + 1];
+
+} Metric;
+
+///
+//  Functions
+//
+
+///
+/// Find or register a metric.  The same name and labels always give the same
+/// metric.  Thread safe, but takes a lock; look metrics up once and keep the
+/// pointer rather than on every update.
+///
+/// \param help Description, a string literal that outlives the metric
+/// \param labels Prometheus labels without braces, e.g. backend="cpu-heap",
+///               or NULL for none
+///
+Metric *getMetricCounter( const char *name, const char *help, const char *labels );
+Metric *getMetricGauge( const char *name, const char *help, const char *labels );
+
+///
+/// Find or register a histogram with bucketCount ascending upper bounds,
+/// at most METRIC_BUCKETS_MAX
+///
+Metric *getMetricHistogram( const char *name, const char *help, const char *labels,
+                            const double *bounds, int bucketCount );
+
+///
+/// Add to a counter or gauge
+///
+void addMetric( Metric *metric, double amount );
+
+///
+/// Set a gauge
+///
+void setMetric( Metric *metric, double value );
+
+///
+/// Record one observation in a histogram
+///
+void observeMetric( Metric *metric, double value );
+
+///
+/// Append every metric in the Prometheus text format, followed by the
+/// resident memory of the process
+///
+void formatMetrics( std::string &out );
+
+///
+/// Write formatMetrics() to a file, replacing it atomically
+///
+/// \return false if the file could not be written
+///
+bool writeMetricsFile( const char *fileName );
+
+///
+/// Serve formatMetrics() at http://127.0.0.1:port/metrics from a background thread
+///
+/// \return false if the port could not be opened or a server is running
+///
+bool startMetricsServer( int port );
+
+///
+/// Stop the server started by startMetricsServer()
+///
+void stopMetricsServer();
+
+///
+/// Stop the server and free every metric.  Pointers from the get functions
+/// become invalid.
+///
+void releaseMetrics();
+
+#endif // DIJKSTRA_METRICS_H
@@ -0,0 +1,158 @@
+//
+//
+//  Description:
+//      Landmark distance oracle.  A handful of landmark vertices are chosen and
+//      the batched SSSP engines compute the cost from every landmark to every
+//      vertex and, on the reverse graph, from every vertex to every landmark.
+//      The cost from u to v is then estimated without a search as the shortest
+//      detour through a landmark,
+//
+//          d(u, v) <= min_i d(u, L_i) + d(L_i, v)
+//
+//      which never underestimates, and bounded from below by the triangle
+//      inequality.  Both read the 2k costs of u and v, which are stored next to
+//      each other per vertex.  More landmarks give tighter estimates.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#ifndef DIJKSTRA_ORACLE_H
+#define DIJKSTRA_ORACLE_H
+
+#include <float.h>
+#include "dijkstraGraph.h"
+#include "dijkstraBackend.h"
+
+///
+//  Constants
+//
+#define DISTANCE_ORACLE_MAGIC       0x4c524f44  // 'DORL'
+#define DISTANCE_ORACLE_VERSION     1
+
+///
+//  Types
+//
+
+//
+//  Landmark costs of every vertex.  Build with buildDistanceOracle() or
+//  loadDistanceOracle(), release with freeDistanceOracle().
+//
+typedef struct
+{
+    int vertexCount;
+    int landmarkCount;
+
+    // The landmark vertices
+    int *landmarks;
+
+    // Cost from vertex v to landmark i at toLandmark[v * landmarkCount + i],
+    // and from landmark i to vertex v at fromLandmark[v * landmarkCount + i].
+    // FLT_MAX where there is no path.
+    float *toLandmark;
+    float *fromLandmark;
+
+} DistanceOracle;
+
+//
+//  Error of the oracle's estimates against exact costs, see
+//  measureDistanceOracleError().  Only reachable pairs are counted.
+//
+typedef struct
+{
+    // Pairs compared
+    long long pairs;
+
+    // Pairs whose estimate was exact
+    long long exactPairs;
+
+    // Pairs that are reachable but that no landmark connects, so the estimate
+    // is FLT_MAX
+    long long missedPairs;
+
+    // Mean and largest estimate / exact cost, over the pairs with a finite
+    // estimate and a nonzero cost
+    double meanStretch;
+    double maxStretch;
+
+} DistanceOracleError;
+
+///
+//  Functions
+//
+
+///
+/// Choose landmarkCount landmarks by farthest-point sampling and compute their
+/// costs.  The first landmark is firstLandmark, every further one is the vertex
+/// farthest from the landmarks chosen so far, preferring vertices none of them
+/// reaches.  The forward and reverse searches of each landmark run on one
+/// session each of the backend.
+///
+/// \return false if the backend failed
+///
+bool buildDistanceOracle( SSSPBackend *backend, const GraphData *graph, int landmarkCount,
+                          int firstLandmark, DistanceOracle *outOracle );
+
+///
+/// Free everything allocated by buildDistanceOracle() or loadDistanceOracle()
+///
+void freeDistanceOracle( DistanceOracle *oracle );
+
+///
+/// Upper bound of the cost from u to v: the cheapest path through a landmark.
+/// FLT_MAX if no landmark is on a path from u to v.
+///
+inline float estimateDistance( const DistanceOracle *oracle, int u, int v )
+{
+    if (u == v)
+    {
+        return 0.0f;
+    }
+
+    const float *to = &oracle->toLandmark[(size_t) u * oracle->landmarkCount];
+    const float *from = &oracle->fromLandmark[(size_t) v * oracle->landmarkCount];
+
+    // A sum with FLT_MAX never drops below FLT_MAX
+    float best = FLT_MAX;
+    for (int i = 0; i < oracle->landmarkCount; i++)
+    {
+        float cost = to[i] + from[i];
+        if (cost < best)
+        {
+            best = cost;
+        }
+    }
+
+    return best;
+}
+
+///
+/// Lower bound of the cost from u to v by the triangle inequality over the
+/// landmarks, 0 if no landmark gives a bound
+///
+float estimateDistanceLowerBound( const DistanceOracle *oracle, int u, int v );
+
+///
+/// Write an oracle to a file
+///
+/// \return false if the file could not be written
+///
+bool saveDistanceOracle( const DistanceOracle *oracle, const char *fileName );
+
+///
+/// Read an oracle written by saveDistanceOracle()
+///
+/// \return false if the file could not be read or is not an oracle
+///
+bool loadDistanceOracle( const char *fileName, DistanceOracle *outOracle );
+
+///
+/// Compare the oracle's estimates against exact costs computed by a backend,
+/// from sampleCount sources spread evenly over the graph to every vertex.
+///
+/// \return false if the backend failed
+///
+bool measureDistanceOracleError( const DistanceOracle *oracle, SSSPBackend *backend,
+                                 const GraphData *graph, int sampleCount,
+                                 DistanceOracleError *outError );
+
+#endif // DIJKSTRA_ORACLE_H
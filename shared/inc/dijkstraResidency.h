@@ -0,0 +1,155 @@
+//
+//
+//  Description:
+//      Multi-graph residency.  A GraphRegistry keeps the sessions of several
+//      graphs alive on one backend, so that a request for a graph that is
+//      already resident pays no upload.  Graphs are named by the caller (for
+//      instance by region) and pinned while a request uses them; when a new
+//      graph does not fit in the backend's memory budget, unpinned graphs are
+//      evicted, least recently used first or by a size-aware policy that
+//      prefers to evict large graphs that are rarely reused.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#ifndef DIJKSTRA_RESIDENCY_H
+#define DIJKSTRA_RESIDENCY_H
+
+#include <pthread.h>
+#include <vector>
+#include "dijkstraBackend.h"
+
+///
+//  Constants
+//
+#define GRAPH_REGISTRY_NAME_MAX 64
+
+///
+//  Types
+//
+
+//
+//  Choice of graph to evict when a new graph does not fit
+//
+typedef enum
+{
+    // Least recently used first
+    GRAPH_EVICT_LRU,
+
+    // GreedyDual-Size: every graph is given a credit of clock + 1/bytes when
+    // it is used and the graph with the lowest credit is evicted, its credit
+    // becoming the new clock.  Large graphs go first unless they are reused
+    // more often than the small ones.
+    GRAPH_EVICT_SIZE_AWARE
+
+} GraphEvictionPolicy;
+
+//
+//  Counters of a GraphRegistry, see GraphRegistry::getStats()
+//
+typedef struct
+{
+    // Calls to acquire(), and those that found the graph resident
+    unsigned long long lookups;
+    unsigned long long hits;
+
+    // Graphs uploaded, and acquire() calls that failed because the graph is
+    // larger than the budget or could not be loaded
+    unsigned long long misses;
+    unsigned long long rejections;
+
+    // Graphs evicted to make room, and their estimated device bytes
+    unsigned long long evictions;
+    unsigned long long evictedBytes;
+
+    // Graphs resident now and their estimated device bytes
+    int residentGraphs;
+    size_t residentBytes;
+
+} GraphRegistryStats;
+
+//
+//  Sessions of several graphs resident on one backend.  Thread safe; each
+//  resident session is handed to one caller at a time.
+//
+class GraphRegistry
+{
+public:
+    ///
+    /// \param backend Backend the sessions are created on, must outlive the registry
+    /// \param budgetBytes Device bytes the resident graphs may use, 0 for the
+    ///                    backend's own budget (getMemoryBudget())
+    ///
+    GraphRegistry( SSSPBackend *backend, size_t budgetBytes = 0,
+                   GraphEvictionPolicy policy = GRAPH_EVICT_LRU );
+
+    /// Deletes every resident session; none may still be acquired
+    ~GraphRegistry();
+
+    ///
+    /// Get the session of a graph, uploading it if it is not resident.  The
+    /// session stays pinned until release(); if another caller holds it, this
+    /// waits for it.  If the graph only fits once pinned graphs are released,
+    /// this waits for them too, so a caller must not hold one session while
+    /// acquiring another.  The graph arrays must stay valid while the graph
+    /// is resident.  A name is bound to the first graph it was acquired with.
+    ///
+    /// \return NULL if the graph is larger than the whole budget or the
+    ///         backend could not create the session
+    ///
+    SSSPSession *acquire( const char *graphName, const GraphData *graph );
+
+    /// Unpin a session returned by acquire()
+    void release( SSSPSession *session );
+
+    ///
+    /// Evict a graph now if it is resident and not pinned
+    ///
+    /// \return false if it is not resident or is pinned
+    ///
+    bool evict( const char *graphName );
+
+    /// Current counters
+    GraphRegistryStats getStats() const;
+
+    /// Budget in bytes the registry evicts against, 0 if unlimited
+    size_t getBudget() const { return budget; }
+
+private:
+    struct Entry;
+
+    Entry *findEntry( const char *graphName ) const;
+    Entry *findVictim() const;
+    void removeEntry( Entry *entry );
+    static void deleteEntries( std::vector<Entry*> &list );
+    void touch( Entry *entry );
+
+    SSSPBackend *backend;
+    size_t budget;
+    GraphEvictionPolicy policy;
+
+    // Resident graphs and counters, guarded by lock
+    std::vector<Entry*> entries;
+    mutable pthread_mutex_t lock;
+    pthread_cond_t changed;
+    GraphRegistryStats stats;
+
+    // Bytes of resident graphs plus those being uploaded
+    size_t reservedBytes;
+
+    // Exported counters, see dijkstraMetrics.h
+    struct Metric *hitsMetric;
+    struct Metric *missesMetric;
+    struct Metric *evictionsMetric;
+    struct Metric *residentMetric;
+
+    // Recency counter (LRU) and GreedyDual-Size clock
+    unsigned long long useCounter;
+    double clock;
+
+    // Not copyable
+    GraphRegistry( const GraphRegistry & );
+    GraphRegistry &operator=( const GraphRegistry & );
+};
+
+#endif // DIJKSTRA_RESIDENCY_H
@@ -0,0 +1,150 @@
+//
+//
+//  Description:
+//      Publishes a GraphData CSR into a named POSIX shared memory segment so that
+//      several worker processes (typically one per device) can attach to a single
+//      read-only copy of the graph instead of each loading their own.
+//
+//      The header records the pid of every process using the segment, so
+//      that a crash does not leave the graph unusable: a segment whose
+//      publisher died before finishing it is removed by the next process
+//      that tries to attach, and the slots of attached processes that died
+//      are reclaimed.  The name is removed when the last live process
+//      detaches.  If every process died, the segment stays in /dev/shm and
+//      is reused by the next attach; removeSharedGraph() deletes it.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#ifndef DIJKSTRA_SHARED_GRAPH_H
+#define DIJKSTRA_SHARED_GRAPH_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "dijkstraGraph.h"
+
+///
+//  Constants
+//
+#define SHARED_GRAPH_MAGIC      0x44474853  // 'SHGD'
+#define SHARED_GRAPH_VERSION    2
+#define SHARED_GRAPH_NAME_MAX   256
+
+// Processes that can use one segment at the same time
+#define SHARED_GRAPH_PROCESSES_MAX 64
+
+///
+//  Types
+//
+
+//
+//  Header stored at the start of the shared memory segment.  It lives on its
+//  own page so that it can stay writable (for the process table) while the
+//  graph arrays that follow are mapped read-only.
+//
+typedef struct
+{
+    // Must be SHARED_GRAPH_MAGIC for a valid segment
+    unsigned int magic;
+
+    // Layout version, must be SHARED_GRAPH_VERSION
+    unsigned int version;
+
+    // Pids of the processes attached, including the publisher, 0 for a
+    // free slot.  Slots of processes that died are reclaimed.
+    volatile pid_t processes[SHARED_GRAPH_PROCESSES_MAX];
+
+    // Publisher, checked for liveness while ready is 0
+    pid_t publisherPid;
+
+    // Set to 1 by the publisher once all arrays have been written
+    volatile int ready;
+
+    // Set to 1 by the process that removes the segment name once no live
+    // process is attached; the segment may not be attached afterwards
+    volatile int closed;
+
+    // Graph dimensions
+    int vertexCount;
+    int edgeCount;
+
+    // Byte offsets of the arrays from the start of the data region
+    size_t vertexOffset;
+    size_t edgeOffset;
+    size_t weightOffset;
+
+    // Size in bytes of the data region (everything after the header page)
+    size_t dataSize;
+
+} SharedGraphHeader;
+
+//
+//  Per-process handle to a shared graph segment
+//
+typedef struct
+{
+    // Name of the segment as passed to shm_open()
+    char name[SHARED_GRAPH_NAME_MAX];
+
+    // Writable mapping of the header page
+    SharedGraphHeader *header;
+
+    // Size of the header mapping (one page)
+    size_t headerSize;
+
+    // This process's slot in header->processes
+    int slot;
+
+    // Read-only mapping of the graph arrays
+    void *data;
+
+    // Graph whose arrays point directly into the shared mapping.  The arrays
+    // must not be written to or freed.
+    GraphData graph;
+
+} SharedGraph;
+
+///
+/// Create a new named shared memory segment holding a copy of the graph and
+/// attach to it.  Fails with a message if a segment with the same name already
+/// exists, in which case the caller should use attachSharedGraph() instead.
+///
+/// \param name Segment name, e.g. "/oclDijkstra".  A leading '/' is added if missing.
+/// \param graph Graph to publish, the caller keeps ownership of its arrays
+/// \param sharedGraph Handle filled in on success
+/// \return true on success
+///
+bool publishSharedGraph( const char *name, const GraphData *graph, SharedGraph *sharedGraph );
+
+///
+/// Attach read-only to a graph previously published by another process.  This
+/// waits (up to a few seconds) for a publisher that is still writing the arrays.
+/// A segment whose publisher died before finishing it is removed, so that the
+/// caller can publish the graph again.
+///
+/// \param name Segment name used by the publisher
+/// \param vertexCount Vertices the graph must have, -1 for any
+/// \param edgeCount Edges the graph must have, -1 for any
+/// \param sharedGraph Handle filled in on success, sharedGraph->graph is usable
+///                    by any of the runDijkstra* functions
+/// \return true on success, false if there is no such segment or it holds a
+///         graph of other dimensions
+///
+bool attachSharedGraph( const char *name, int vertexCount, int edgeCount, SharedGraph *sharedGraph );
+
+///
+/// Detach from a shared graph.  The segment name is removed when no live
+/// process is left attached.
+///
+void detachSharedGraph( SharedGraph *sharedGraph );
+
+///
+/// Remove a segment that no live process is attached to, such as one left
+/// behind when every process using it crashed
+///
+/// \return true if the segment was removed, false if it does not exist or is
+///         in use
+///
+bool removeSharedGraph( const char *name );
+
+#endif // DIJKSTRA_SHARED_GRAPH_H
@@ -0,0 +1,165 @@
+//
+//
+//  Description:
+//      Engine snapshots.  Everything a worker derives from its graph before it
+//      can serve, the landmark tables, hub labels and component index as well
+//      as the compiled device programs, is written into one file of tagged
+//      sections.  A new worker maps the file and restores each piece instead
+//      of recomputing it.
+//
+//      A snapshot records a checksum of the graph it was taken on and is only
+//      opened for a graph with the same checksum.  Each piece is copied out
+//      of the mapping when it is restored, so it outlives the snapshot;
+//      sections are aligned only so that the copy reads them as typed arrays.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#ifndef DIJKSTRA_SNAPSHOT_H
+#define DIJKSTRA_SNAPSHOT_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "dijkstraGraph.h"
+#include "dijkstraComponents.h"
+#include "dijkstraHubLabels.h"
+#include "dijkstraOracle.h"
+
+///
+//  Constants
+//
+#define SNAPSHOT_MAGIC          0x50414e53  // 'SNAP'
+#define SNAPSHOT_VERSION        1
+#define SNAPSHOT_TAG_MAX        32
+#define SNAPSHOT_SECTION_MAX    64
+
+///
+//  Types
+//
+
+//
+//  Location of one section in the file
+//
+typedef struct
+{
+    // NUL-terminated tag, e.g. "oracle" or "ocl.program.0"
+    char tag[SNAPSHOT_TAG_MAX];
+
+    // Byte offset from the start of the file and size
+    long long offset;
+    long long size;
+
+} SnapshotSection;
+
+//
+//  Header at the start of a snapshot file
+//
+typedef struct
+{
+    // Must be SNAPSHOT_MAGIC and SNAPSHOT_VERSION
+    unsigned int magic;
+    unsigned int version;
+
+    // Graph the snapshot was taken on, see graphChecksum()
+    unsigned long long graphChecksum;
+    int vertexCount;
+    int edgeCount;
+
+    int sectionCount;
+    int reserved;
+    SnapshotSection sections[SNAPSHOT_SECTION_MAX];
+
+} SnapshotHeader;
+
+//
+//  Snapshot being written, see beginSnapshot()
+//
+typedef struct
+{
+    FILE *file;
+    SnapshotHeader header;
+
+    // End of the last section written
+    long long offset;
+
+    // Set once a write has failed, finishSnapshot() then fails
+    bool failed;
+
+} SnapshotWriter;
+
+//
+//  Snapshot mapped read-only, see openSnapshot()
+//
+typedef struct
+{
+    void *mapping;
+    size_t mappingSize;
+    const SnapshotHeader *header;
+
+} Snapshot;
+
+///
+//  Functions
+//
+
+///
+/// Start writing a snapshot of the state derived from graph
+///
+/// \return false if the file could not be created
+///
+bool beginSnapshot( const char *fileName, const GraphData *graph, SnapshotWriter *outWriter );
+
+///
+/// Append a section.  The section data is copied into the file.
+///
+/// \return false if the write failed or the section table is full
+///
+bool addSnapshotSection( SnapshotWriter *writer, const char *tag, const void *data, size_t size );
+
+///
+/// Write the section table and close the file
+///
+/// \return false if any write of the snapshot failed
+///
+bool finishSnapshot( SnapshotWriter *writer );
+
+///
+/// Map a snapshot read-only and check that it was taken on graph
+///
+/// \return false if the file could not be mapped, is not a snapshot of this
+///         version or belongs to another graph
+///
+bool openSnapshot( const char *fileName, const GraphData *graph, Snapshot *outSnapshot );
+
+///
+/// Find a section of an open snapshot
+///
+/// \param outSize Receives the size of the section
+/// \return The section data inside the mapping, NULL if there is no such section
+///
+const void *findSnapshotSection( const Snapshot *snapshot, const char *tag, size_t *outSize );
+
+///
+/// Unmap a snapshot.  Data restored from it stays valid.
+///
+void closeSnapshot( Snapshot *snapshot );
+
+///
+/// Add the landmark tables of an oracle, the hub labels or the component
+/// index to a snapshot
+///
+bool snapshotDistanceOracle( SnapshotWriter *writer, const DistanceOracle *oracle );
+bool snapshotHubLabels( SnapshotWriter *writer, const HubLabels *labels );
+bool snapshotComponentIndex( SnapshotWriter *writer, const ComponentIndex *index );
+
+///
+/// Restore an oracle, hub labels or a component index from a snapshot into
+/// newly allocated arrays, released by the usual free function
+///
+/// \return false if the snapshot holds none
+///
+bool restoreDistanceOracle( const Snapshot *snapshot, DistanceOracle *outOracle );
+bool restoreHubLabels( const Snapshot *snapshot, HubLabels *outLabels );
+bool restoreComponentIndex( const Snapshot *snapshot, ComponentIndex *outIndex );
+
+#endif // DIJKSTRA_SNAPSHOT_H
@@ -0,0 +1,138 @@
+//
+//
+//  Description:
+//      Linear-time verification of SSSP results.  Instead of running a
+//      second search and comparing, the costs are checked against the
+//      optimality conditions of shortest paths, which together certify
+//      them for non-negative weights:
+//
+//          - the source has cost 0
+//          - no edge u -> v can improve v: cost[v] <= cost[u] + w
+//          - every other reached vertex is reached from the source along
+//            tight edges, ones with cost[v] == cost[u] + w, so its cost is
+//            the length of a path
+//
+//      Unreached vertices have cost FLT_MAX; the edge condition then fails
+//      for any of them with a reached in-neighbor.  A pass over the in-edges
+//      of every vertex checks the edges, split across threads by vertex, and
+//      a traversal of the tight edges from the source checks the paths, split
+//      across threads by row; both are O(V + E) per row.  Checking only that
+//      every vertex has a tight in-edge is not enough: a cycle of zero-weight
+//      edges gives all of its vertices one, whatever their costs.
+//
+//      Costs are floats and engines may sum a path in a different order or,
+//      like the contracted engine, subtract sums along a chain, so both
+//      comparisons allow a small absolute tolerance plus a few units in the
+//      last place of the larger side.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#ifndef DIJKSTRA_VERIFY_H
+#define DIJKSTRA_VERIFY_H
+
+#include <float.h>
+#include <math.h>
+#include "dijkstraGraph.h"
+
+///
+//  Constants
+//
+
+// Tolerance of the comparisons: an absolute part for costs near zero plus
+// units in the last place of the larger side
+#define SSSP_VERIFY_ABSOLUTE_TOLERANCE  1e-6f
+#define SSSP_VERIFY_ULPS                32.0f
+
+///
+//  Types
+//
+
+//
+//  Outcome of a verification, counts summed over every result row
+//
+typedef struct
+{
+    long long rows;
+
+    // Sources whose cost is not 0
+    long long sourceErrors;
+
+    // Edges u -> v with cost[v] > cost[u] + w
+    long long edgeViolations;
+
+    // Reached vertices other than the source without a tight in-edge
+    long long untightVertices;
+
+    // Reached vertices without a path of tight edges from the source
+    long long unsupportedVertices;
+
+    // Negative or NaN costs
+    long long invalidCosts;
+
+    // Row and vertex of the first failure, -1 if none
+    int firstBadRow;
+    int firstBadVertex;
+
+} SSSPVerification;
+
+///
+//  Functions
+//
+
+///
+/// Check result rows against the shortest-path optimality conditions
+///
+/// \param reverseGraph The in-edges of graph from buildReverseGraph(), or
+///                     NULL to build them for this call
+/// \param sourceVertices Source of each row
+/// \param costs numResults rows of graph->vertexCount costs
+/// \param threadCount Threads to split the vertices and rows across
+/// \param outVerification Receives the counts, may be NULL
+/// \return true if every row satisfies the conditions
+///
+bool verifySSSP( const GraphData *graph, const GraphData *reverseGraph, const int *sourceVertices,
+                 const float *costs, int numResults, int threadCount, SSSPVerification *outVerification );
+
+///
+/// Check only that every reached vertex of each row has a path of tight edges
+/// from the source, for verifiers that check the edges elsewhere
+///
+/// \param outVerification Receives unsupportedVertices and the first failure
+/// \return true if every reached vertex has such a path
+///
+bool verifySSSPPaths( const GraphData *graph, const int *sourceVertices, const float *costs, int numResults,
+                      int threadCount, SSSPVerification *outVerification );
+
+///
+/// Clear a verification: no rows, no failures
+///
+void initSSSPVerification( SSSPVerification *verification );
+
+///
+/// Add the failure counts of one verification to another, keeping the
+/// earliest first failure.  rows is left to the caller.
+///
+void mergeSSSPVerification( SSSPVerification *total, const SSSPVerification *part );
+
+///
+/// true if a verification found no failure
+///
+inline bool isSSSPVerified( const SSSPVerification *verification )
+{
+    return verification->sourceErrors == 0 && verification->edgeViolations == 0 &&
+           verification->untightVertices == 0 && verification->unsupportedVertices == 0 &&
+           verification->invalidCosts == 0;
+}
+
+///
+/// Slack allowed between a cost and the bound cost[u] + w of an in-edge.  An
+/// unreached cost (FLT_MAX) does not widen it.
+///
+inline float ssspVerifySlack( float cost, float bound )
+{
+    float magnitude = (cost == FLT_MAX) ? bound : fmaxf(cost, bound);
+    return SSSP_VERIFY_ABSOLUTE_TOLERANCE + SSSP_VERIFY_ULPS * FLT_EPSILON * magnitude;
+}
+
+#endif // DIJKSTRA_VERIFY_H
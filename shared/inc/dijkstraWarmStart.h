@@ -0,0 +1,73 @@
+//
+//
+//  Description:
+//      Warm-started searches for batches of nearby sources.  If a search from p
+//      has finished with costs d_p, then for a new source s every vertex v
+//      satisfies d_s(v) <= d(s, p) + d_p(v).  Seeding the new search with these
+//      upper bounds instead of infinity keeps it exact: the seeded costs already
+//      satisfy the triangle inequality along every edge, because d_p does, so
+//      the frontier algorithm only has to lower the costs that the bounds
+//      overestimate, starting from s alone.  When s and p are close most bounds
+//      are tight and the search touches little of the graph.
+//
+//      The batch is processed in a greedy order in which each source is the
+//      pending source nearest to the previous one, and d(s, p) is found with a
+//      Dijkstra search from s that stops at p.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#ifndef DIJKSTRA_WARM_START_H
+#define DIJKSTRA_WARM_START_H
+
+#include "dijkstraGraph.h"
+
+///
+//  Constants
+//
+
+// Pending sources considered by nextWarmStartSource(), in batch order
+#define WARM_START_WINDOW           64
+
+// A search for d(s, p) gives up after settling this fraction of the vertices
+#define WARM_START_SETTLE_DIVISOR   16
+
+///
+//  Functions
+//
+
+///
+/// Pick the next source of a warm-started batch: of the first
+/// WARM_START_WINDOW pending sources, the one the previous search reached at
+/// the lowest cost.
+///
+/// \param previousCosts Costs of the previous search
+/// \param sourceVertices Source vertex of each search of the batch
+/// \param pending Indices into sourceVertices of the searches not yet run
+/// \param pendingCount Number of entries in pending
+/// \return Index into pending
+///
+int nextWarmStartSource( const float *previousCosts, const int *sourceVertices,
+                         const int *pending, int pendingCount );
+
+///
+/// Cost of the shortest path from one vertex to another, searching no further
+/// than vertexCount / WARM_START_SETTLE_DIVISOR settled vertices.
+///
+/// \return The cost, FLT_MAX if the search gave up or to is unreachable
+///
+float boundedSourceDistance( const GraphData *graph, int from, int to );
+
+///
+/// Seed a search from source with the costs of a finished search from
+/// previousSource.
+///
+/// \param previousCosts Costs of the search from previousSource
+/// \param outCosts Receives vertexCount upper bounds, 0 for source
+/// \return false if no bound was found for d(source, previousSource), the
+///         search must then start cold
+///
+bool seedWarmStart( const GraphData *graph, const float *previousCosts, int previousSource,
+                    int source, float *outCosts );
+
+#endif // DIJKSTRA_WARM_START_H
@@ -0,0 +1,170 @@
+//
+//
+//  Description:
+//      Query workload recording and replay.  An SSSPEngine given a recorder
+//      logs every batch submitted to it, and the callers of the direct
+//      searches and distance queries log theirs with recordWorkloadQuery(),
+//      each as a compact binary record: the sources, the query type and
+//      target, the class and priority, and the arrival time relative to the
+//      start of the recording.  The file header
+//      holds the checksum of the graph, so a workload is only replayed on the
+//      graph version it was captured on.
+//
+//      The replayer drives a fresh engine with the recorded stream, either
+//      with the original inter-arrival times (optionally sped up) or as fast
+//      as possible, and reports the latency distribution from each query's
+//      scheduled arrival, so that queueing behind earlier queries counts as
+//      it did in production.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#ifndef DIJKSTRA_WORKLOAD_H
+#define DIJKSTRA_WORKLOAD_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include "dijkstraGraph.h"
+#include "dijkstraAsync.h"
+
+///
+//  Constants
+//
+#define WORKLOAD_MAGIC          0x44414f57  // 'WOAD'
+#define WORKLOAD_VERSION        1
+
+// Queries the replayer keeps in flight before it waits for the oldest
+#define WORKLOAD_MAX_IN_FLIGHT  64
+
+///
+//  Types
+//
+
+//
+//  What a recorded query asked for
+//
+typedef enum
+{
+    // Costs from every source to every vertex
+    WORKLOAD_QUERY_SSSP,
+
+    // Cost from one source to one target
+    WORKLOAD_QUERY_DISTANCE
+
+} WorkloadQueryType;
+
+//
+//  Header at the start of a workload file
+//
+typedef struct
+{
+    // Must be WORKLOAD_MAGIC and WORKLOAD_VERSION
+    unsigned int magic;
+    unsigned int version;
+
+    // Graph the workload was recorded on, see graphChecksum()
+    unsigned long long graphChecksum;
+    int vertexCount;
+    int edgeCount;
+
+    // Wall clock time the recording started, seconds since the epoch
+    double startTime;
+
+} WorkloadHeader;
+
+//
+//  One query in a workload file, followed by its sourceCount source vertices
+//
+typedef struct
+{
+    // Seconds from the start of the recording
+    double arrival;
+
+    // WorkloadQueryType and SSSPRequestClass
+    int type;
+    int requestClass;
+    int priority;
+
+    // Target vertex of a WORKLOAD_QUERY_DISTANCE query, -1 otherwise
+    int target;
+
+    int sourceCount;
+    int reserved;
+
+} WorkloadRecord;
+
+//
+//  Workload being recorded, see beginWorkloadRecording().  Shared by every
+//  thread that submits queries.
+//
+struct WorkloadRecorder
+{
+    FILE *file;
+    pthread_mutex_t lock;
+    double startTime;
+
+    long long records;
+    bool failed;
+};
+
+//
+//  Outcome of a replay, see replayWorkload()
+//
+typedef struct
+{
+    long long queries;
+    long long failed;
+
+    // Seconds from the first submission to the last completion
+    double duration;
+
+    // Latencies of the completed queries, from their scheduled arrival
+    double meanLatency;
+    double p50Latency;
+    double p95Latency;
+    double p99Latency;
+    double maxLatency;
+
+    // Longest a query was submitted after its scheduled arrival, because the
+    // replayer had WORKLOAD_MAX_IN_FLIGHT queries outstanding
+    double maxSubmitLag;
+
+} WorkloadReplayStats;
+
+///
+//  Functions
+//
+
+///
+/// Start recording the queries on a graph into fileName
+///
+/// \return false if the file could not be created
+///
+bool beginWorkloadRecording( const char *fileName, const GraphData *graph, WorkloadRecorder *outRecorder );
+
+///
+/// Append one query, stamped with the current time.  Thread safe.
+///
+void recordWorkloadQuery( WorkloadRecorder *recorder, WorkloadQueryType type, SSSPRequestClass requestClass,
+                          int priority, const int *sourceVertices, int sourceCount, int target );
+
+///
+/// Flush and close a recording
+///
+/// \return false if any record could not be written
+///
+bool finishWorkloadRecording( WorkloadRecorder *recorder );
+
+///
+/// Replay a recorded workload on an engine started for the call over the
+/// given backends.  Distance queries run as single-source searches.
+///
+/// \param speedup How much faster than recorded to replay, 1 for the
+///                original timing, 0 for as fast as possible
+/// \return false if the file is not a workload of this graph, no backend
+///         could load the graph, or a query failed
+///
+bool replayWorkload( const char *fileName, SSSPBackend **backends, int backendCount, const GraphData *graph,
+                     double speedup, WorkloadReplayStats *outStats );
+
+#endif // DIJKSTRA_WORKLOAD_H
@@ -0,0 +1,857 @@
+//
+//
+//  Description:
+//      SSSPEngine worker pool and the SSSPFuture handles it hands out.  See
+//      dijkstraAsync.h.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "dijkstraAsync.h"
+#include "dijkstraWorkload.h"
+#include "dijkstraMetrics.h"
+
+///
+//  Constants
+//
+
+// Number of chunks per worker a batch is split into, as in runSSSPMultiBackend()
+const int CHUNKS_PER_WORKER = 8;
+
+// Default class policy: single-source bulk chunks, bulk gets at least a
+// quarter of the chunks, 100 ms target for interactive batches and none to
+// speak of for bulk ones
+const int DEFAULT_BULK_CHUNK_SOURCES = 1;
+const int DEFAULT_INTERACTIVE_PER_BULK = 3;
+const double DEFAULT_INTERACTIVE_TARGET = 0.1;
+const double DEFAULT_BULK_TARGET = 3600.0;
+
+// Latency histogram: bucket i holds latencies up to LATENCY_BUCKET_BASE *
+// LATENCY_BUCKET_GROWTH^i seconds, the last one everything above
+const int LATENCY_BUCKETS = 80;
+const double LATENCY_BUCKET_BASE = 1.0e-5;
+const double LATENCY_BUCKET_GROWTH = 1.25;
+
+// Bucket bounds of the exported latency (seconds) and batch size histograms
+const double EXPORTED_LATENCY_BOUNDS[] = { 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0,
+                                           2.5, 5.0, 10.0, 30.0, 60.0, 300.0 };
+const double EXPORTED_BATCH_BOUNDS[] = { 1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 4096, 16384, 65536 };
+
+// Names of the classes in the metric labels
+static const char *CLASS_LABELS[SSSP_CLASS_COUNT] = { "class=\"interactive\"", "class=\"bulk\"" };
+
+///
+//  Types
+//
+
+// Callback registered with SSSPFuture::then()
+typedef std::pair<SSSPCallback, void*> PendingCallback;
+
+//
+//  Shared state of one submitted batch.  Everything below refCount is guarded
+//  by lock.  The engine queue and every SSSPFuture hold a reference.
+//
+struct SSSPRequest
+{
+    int *sourceVertices;
+    float *outResultCosts;
+    int numResults;
+    int priority;
+    unsigned long long sequence;
+
+    // Class counters the final state is recorded in, and submission time
+    SSSPClassMetrics *metrics;
+    double submitTime;
+
+    // Size of the chunks handed to the workers
+    int chunkSize;
+
+    int refCount;
+
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+    SSSPRequestState state;
+
+    // First source not yet handed to a worker
+    int nextSource;
+
+    // Chunks on a worker right now
+    int chunksRunning;
+
+    bool cancelRequested;
+    bool failed;
+
+    std::vector<PendingCallback> callbacks;
+
+    // Set while callbackThread runs the callbacks of the final state, which
+    // wait() covers
+    bool runningCallbacks;
+    pthread_t callbackThread;
+};
+
+//
+//  Latency counters of one class, guarded by lock
+//
+struct SSSPClassMetrics
+{
+    pthread_mutex_t lock;
+    double latencyTarget;
+
+    long long submitted;
+    long long completed;
+    long long abandoned;
+    long long chunks;
+    long long sloMisses;
+
+    double latencySum;
+    double maxLatency;
+    long long histogram[LATENCY_BUCKETS];
+
+    // Exported metrics of the class, updated without the lock
+    Metric *queuedMetric;
+    Metric *batchSizeMetric;
+    Metric *chunksMetric;
+    Metric *completedMetric;
+    Metric *abandonedMetric;
+    Metric *latencyMetric;
+};
+
+//
+//  One backend and the thread that drives it
+//
+struct SSSPEngine::Worker
+{
+    SSSPEngine *engine;
+    SSSPBackend *backend;
+    BackendMeters meters;
+    pthread_t thread;
+    bool started;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+///
+/// Wall clock time in seconds
+///
+static double engineTime()
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec + now.tv_usec * 1.0e-6;
+}
+
+///
+/// Record the final state of a request in its class counters
+///
+static void recordFinalState(SSSPRequest *request, SSSPRequestState state)
+{
+    SSSPClassMetrics *metrics = request->metrics;
+    double latency = engineTime() - request->submitTime;
+
+    pthread_mutex_lock(&metrics->lock);
+    if (state != SSSP_REQUEST_COMPLETED)
+    {
+        metrics->abandoned++;
+    }
+    else
+    {
+        int bucket = 0;
+        for (double bound = LATENCY_BUCKET_BASE; latency > bound && bucket < LATENCY_BUCKETS - 1;
+             bound *= LATENCY_BUCKET_GROWTH)
+        {
+            bucket++;
+        }
+
+        metrics->completed++;
+        metrics->histogram[bucket]++;
+        metrics->latencySum += latency;
+        metrics->maxLatency = (latency > metrics->maxLatency) ? latency : metrics->maxLatency;
+        if (latency > metrics->latencyTarget)
+        {
+            metrics->sloMisses++;
+        }
+    }
+    pthread_mutex_unlock(&metrics->lock);
+
+    if (state != SSSP_REQUEST_COMPLETED)
+    {
+        addMetric(metrics->abandonedMetric, 1.0);
+    }
+    else
+    {
+        addMetric(metrics->completedMetric, 1.0);
+        observeMetric(metrics->latencyMetric, latency);
+    }
+}
+
+///
+/// Upper bound of the histogram bucket holding the given fraction of the
+/// completed latencies
+///
+static double latencyPercentile(const SSSPClassMetrics *metrics, double fraction)
+{
+    long long rank = (long long) (fraction * metrics->completed);
+    long long seen = 0;
+    double bound = LATENCY_BUCKET_BASE;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS - 1; bucket++)
+    {
+        seen += metrics->histogram[bucket];
+        if (seen > rank)
+        {
+            return (bound < metrics->maxLatency) ? bound : metrics->maxLatency;
+        }
+        bound *= LATENCY_BUCKET_GROWTH;
+    }
+    return metrics->maxLatency;
+}
+
+///
+/// Add a reference to a request
+///
+static void retainRequest(SSSPRequest *request)
+{
+    pthread_mutex_lock(&request->lock);
+    request->refCount++;
+    pthread_mutex_unlock(&request->lock);
+}
+
+///
+/// Drop a reference to a request, freeing it with the last one
+///
+static void releaseRequest(SSSPRequest *request)
+{
+    pthread_mutex_lock(&request->lock);
+    bool last = (--request->refCount == 0);
+    pthread_mutex_unlock(&request->lock);
+
+    if (last)
+    {
+        pthread_mutex_destroy(&request->lock);
+        pthread_cond_destroy(&request->finished);
+        free(request->sourceVertices);
+        delete request;
+    }
+}
+
+///
+/// true for COMPLETED, FAILED and CANCELLED
+///
+static bool isFinalState(SSSPRequestState state)
+{
+    return state == SSSP_REQUEST_COMPLETED || state == SSSP_REQUEST_FAILED ||
+           state == SSSP_REQUEST_CANCELLED;
+}
+
+///
+/// Move a request to its final state and run its callbacks, then wake the
+/// threads in wait().  Must be called with request->lock held; returns with
+/// it released.
+///
+static void finishRequestLocked(SSSPRequest *request, SSSPRequestState state)
+{
+    recordFinalState(request, state);
+    request->state = state;
+
+    std::vector<PendingCallback> callbacks;
+    callbacks.swap(request->callbacks);
+    if (callbacks.empty())
+    {
+        pthread_cond_broadcast(&request->finished);
+        pthread_mutex_unlock(&request->lock);
+        return;
+    }
+
+    // A callback may drop the last future of the request
+    request->runningCallbacks = true;
+    request->callbackThread = pthread_self();
+    request->refCount++;
+    pthread_mutex_unlock(&request->lock);
+
+    for (size_t i = 0; i < callbacks.size(); i++)
+    {
+        callbacks[i].first(callbacks[i].second);
+    }
+
+    pthread_mutex_lock(&request->lock);
+    request->runningCallbacks = false;
+    pthread_cond_broadcast(&request->finished);
+    pthread_mutex_unlock(&request->lock);
+    releaseRequest(request);
+}
+
+///
+/// Final state of a request whose last chunk has come back
+///
+static SSSPRequestState settledState(const SSSPRequest *request)
+{
+    if (request->failed)
+    {
+        return SSSP_REQUEST_FAILED;
+    }
+    return (request->nextSource < request->numResults || request->cancelRequested) ?
+           SSSP_REQUEST_CANCELLED : SSSP_REQUEST_COMPLETED;
+}
+
+///
+/// Stop dispatching a request, used by cancellation and on shutdown.  A request
+/// with no chunk on a worker finishes right away.
+///
+static bool cancelRequest(SSSPRequest *request)
+{
+    pthread_mutex_lock(&request->lock);
+    if (isFinalState(request->state) || request->cancelRequested)
+    {
+        pthread_mutex_unlock(&request->lock);
+        return false;
+    }
+
+    request->cancelRequested = true;
+    if (request->chunksRunning == 0)
+    {
+        finishRequestLocked(request, SSSP_REQUEST_CANCELLED);
+    }
+    else
+    {
+        pthread_mutex_unlock(&request->lock);
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  SSSPFuture
+//
+//
+
+SSSPFuture::SSSPFuture() :
+    request(NULL)
+{
+}
+
+SSSPFuture::SSSPFuture( SSSPRequest *request ) :
+    request(request)
+{
+    if (request != NULL)
+    {
+        retainRequest(request);
+    }
+}
+
+SSSPFuture::SSSPFuture( const SSSPFuture &other ) :
+    request(other.request)
+{
+    if (request != NULL)
+    {
+        retainRequest(request);
+    }
+}
+
+SSSPFuture &SSSPFuture::operator=( const SSSPFuture &other )
+{
+    if (other.request != NULL)
+    {
+        retainRequest(other.request);
+    }
+    if (request != NULL)
+    {
+        releaseRequest(request);
+    }
+    request = other.request;
+
+    return *this;
+}
+
+SSSPFuture::~SSSPFuture()
+{
+    if (request != NULL)
+    {
+        releaseRequest(request);
+    }
+}
+
+SSSPRequestState SSSPFuture::getState() const
+{
+    if (request == NULL)
+    {
+        return SSSP_REQUEST_FAILED;
+    }
+
+    pthread_mutex_lock(&request->lock);
+    SSSPRequestState state = request->state;
+    pthread_mutex_unlock(&request->lock);
+
+    return state;
+}
+
+bool SSSPFuture::isReady() const
+{
+    return isFinalState(getState());
+}
+
+SSSPRequestState SSSPFuture::wait() const
+{
+    if (request == NULL)
+    {
+        return SSSP_REQUEST_FAILED;
+    }
+
+    // A callback waiting on its own batch must not wait for itself
+    pthread_mutex_lock(&request->lock);
+    while (!isFinalState(request->state) ||
+           (request->runningCallbacks && !pthread_equal(request->callbackThread, pthread_self())))
+    {
+        pthread_cond_wait(&request->finished, &request->lock);
+    }
+    SSSPRequestState state = request->state;
+    pthread_mutex_unlock(&request->lock);
+
+    return state;
+}
+
+bool SSSPFuture::cancel()
+{
+    return (request != NULL) && cancelRequest(request);
+}
+
+void SSSPFuture::then( SSSPCallback callback, void *userData )
+{
+    if (!addCallback(callback, userData))
+    {
+        callback(userData);
+    }
+}
+
+bool SSSPFuture::addCallback( SSSPCallback callback, void *userData )
+{
+    if (request == NULL)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&request->lock);
+    bool pending = !isFinalState(request->state);
+    if (pending)
+    {
+        request->callbacks.push_back(PendingCallback(callback, userData));
+    }
+    pthread_mutex_unlock(&request->lock);
+
+    return pending;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  SSSPEngine
+//
+//
+
+SSSPEngine::SSSPEngine() :
+    graph(NULL),
+    workerCount(0),
+    workersStarting(0),
+    submitted(0),
+    stopping(false),
+    chunksPerBatch(1),
+    interactiveStreak(0),
+    recorder(NULL)
+{
+    pthread_mutex_init(&queueLock, NULL);
+    pthread_cond_init(&queueChanged, NULL);
+    pthread_cond_init(&workerStarted, NULL);
+
+    classPolicy.bulkChunkSources = DEFAULT_BULK_CHUNK_SOURCES;
+    classPolicy.interactivePerBulk = DEFAULT_INTERACTIVE_PER_BULK;
+    classPolicy.latencyTarget[SSSP_CLASS_INTERACTIVE] = DEFAULT_INTERACTIVE_TARGET;
+    classPolicy.latencyTarget[SSSP_CLASS_BULK] = DEFAULT_BULK_TARGET;
+
+    classMetrics = new SSSPClassMetrics[SSSP_CLASS_COUNT];
+    for (int c = 0; c < SSSP_CLASS_COUNT; c++)
+    {
+        memset(&classMetrics[c], 0, sizeof(SSSPClassMetrics));
+        pthread_mutex_init(&classMetrics[c].lock, NULL);
+        classMetrics[c].latencyTarget = classPolicy.latencyTarget[c];
+
+        SSSPClassMetrics *metrics = &classMetrics[c];
+        metrics->queuedMetric = getMetricGauge("sssp_engine_queued_batches",
+                                               "Batches waiting for a worker to take their last chunk.",
+                                               CLASS_LABELS[c]);
+        metrics->batchSizeMetric = getMetricHistogram("sssp_engine_batch_sources", "Sources per submitted batch.",
+                                                      CLASS_LABELS[c], EXPORTED_BATCH_BOUNDS,
+                                                      sizeof(EXPORTED_BATCH_BOUNDS) / sizeof(double));
+        metrics->chunksMetric = getMetricCounter("sssp_engine_chunks_total", "Chunks handed to the workers.",
+                                                 CLASS_LABELS[c]);
+        metrics->completedMetric = getMetricCounter("sssp_engine_completed_total", "Batches completed.",
+                                                    CLASS_LABELS[c]);
+        metrics->abandonedMetric = getMetricCounter("sssp_engine_abandoned_total",
+                                                    "Batches cancelled or failed.", CLASS_LABELS[c]);
+        metrics->latencyMetric = getMetricHistogram("sssp_engine_latency_seconds",
+                                                    "Seconds from submission to completion of a batch.",
+                                                    CLASS_LABELS[c], EXPORTED_LATENCY_BOUNDS,
+                                                    sizeof(EXPORTED_LATENCY_BOUNDS) / sizeof(double));
+    }
+}
+
+SSSPEngine::~SSSPEngine()
+{
+    shutdown();
+
+    pthread_mutex_destroy(&queueLock);
+    pthread_cond_destroy(&queueChanged);
+    pthread_cond_destroy(&workerStarted);
+
+    for (int c = 0; c < SSSP_CLASS_COUNT; c++)
+    {
+        pthread_mutex_destroy(&classMetrics[c].lock);
+    }
+    delete [] classMetrics;
+}
+
+///
+/// Worker thread: create the session, then run chunks until shutdown
+///
+void *SSSPEngine::workerThread( void *arg )
+{
+    Worker *worker = (Worker*) arg;
+    SSSPEngine *engine = worker->engine;
+
+    // Sessions are created on the thread that uses them, device backends bind
+    // their device to the calling thread
+    SSSPSession *session = worker->backend->createSession(engine->graph);
+    if (session == NULL)
+    {
+        fprintf(stderr, "SSSPEngine: %s could not load the graph\n", worker->backend->getName());
+    }
+
+    pthread_mutex_lock(&engine->queueLock);
+    worker->started = (session != NULL);
+    if (worker->started)
+    {
+        engine->workerCount++;
+    }
+    engine->workersStarting--;
+    pthread_cond_broadcast(&engine->workerStarted);
+    pthread_mutex_unlock(&engine->queueLock);
+
+    if (session == NULL)
+    {
+        return NULL;
+    }
+
+    SSSPRequest *request;
+    int first;
+    int count;
+    while (engine->nextChunk(&request, &first, &count))
+    {
+        bool succeeded = runMeteredSession(&worker->meters, session, &request->sourceVertices[first],
+                                           &request->outResultCosts[(size_t) first * engine->graph->vertexCount],
+                                           count);
+        if (!succeeded)
+        {
+            fprintf(stderr, "SSSPEngine: %s failed\n", worker->backend->getName());
+        }
+
+        pthread_mutex_lock(&request->lock);
+        request->chunksRunning--;
+        request->failed = request->failed || !succeeded;
+        bool dispatched = request->nextSource == request->numResults || request->cancelRequested ||
+                          request->failed;
+        if (request->chunksRunning == 0 && dispatched && !isFinalState(request->state))
+        {
+            finishRequestLocked(request, settledState(request));
+        }
+        else
+        {
+            pthread_mutex_unlock(&request->lock);
+        }
+
+        releaseRequest(request);
+    }
+
+    delete session;
+    return NULL;
+}
+
+///
+/// Take the next chunk of the most urgent batch, blocking until there is one.
+/// The caller gets a reference to the request.  Returns false on shutdown.
+///
+bool SSSPEngine::nextChunk( SSSPRequest **outRequest, int *outFirst, int *outCount )
+{
+    pthread_mutex_lock(&queueLock);
+
+    for (;;)
+    {
+        // Interactive first, unless bulk has waited for interactivePerBulk
+        // interactive chunks in a row
+        int interactive = nextRequestIndex(SSSP_CLASS_INTERACTIVE);
+        int bulk = nextRequestIndex(SSSP_CLASS_BULK);
+        int best = interactive;
+        if (bulk >= 0 && (interactive < 0 || interactiveStreak >= classPolicy.interactivePerBulk))
+        {
+            best = bulk;
+        }
+
+        if (best < 0)
+        {
+            if (stopping)
+            {
+                pthread_mutex_unlock(&queueLock);
+                return false;
+            }
+            pthread_cond_wait(&queueChanged, &queueLock);
+            continue;
+        }
+
+        SSSPRequest *request = queue[best];
+        pthread_mutex_lock(&request->lock);
+
+        bool dispatchable = !request->cancelRequested && !request->failed &&
+                            request->nextSource < request->numResults;
+        int first = request->nextSource;
+        int count = 0;
+        if (dispatchable)
+        {
+            count = request->numResults - first;
+            if (count > request->chunkSize)
+            {
+                count = request->chunkSize;
+            }
+            request->nextSource += count;
+            request->chunksRunning++;
+            request->refCount++;
+            request->state = SSSP_REQUEST_RUNNING;
+        }
+        bool exhausted = !dispatchable || request->nextSource == request->numResults;
+        pthread_mutex_unlock(&request->lock);
+
+        // The queue's reference goes once every chunk has been handed out
+        if (exhausted)
+        {
+            queue.erase(queue.begin() + best);
+            addMetric(request->metrics->queuedMetric, -1.0);
+            releaseRequest(request);
+        }
+
+        if (dispatchable)
+        {
+            interactiveStreak = (best == interactive && bulk >= 0) ? interactiveStreak + 1 : 0;
+            pthread_mutex_unlock(&queueLock);
+
+            pthread_mutex_lock(&request->metrics->lock);
+            request->metrics->chunks++;
+            pthread_mutex_unlock(&request->metrics->lock);
+            addMetric(request->metrics->chunksMetric, 1.0);
+
+            *outRequest = request;
+            *outFirst = first;
+            *outCount = count;
+            return true;
+        }
+    }
+}
+
+///
+/// Queue index of the next batch of a class: highest priority first, oldest
+/// first among equals.  -1 if the class has nothing queued.
+///
+int SSSPEngine::nextRequestIndex( SSSPRequestClass requestClass ) const
+{
+    int best = -1;
+    for (size_t i = 0; i < queue.size(); i++)
+    {
+        if (queue[i]->metrics != &classMetrics[requestClass])
+        {
+            continue;
+        }
+
+        if (best < 0 || queue[i]->priority > queue[best]->priority ||
+            (queue[i]->priority == queue[best]->priority && queue[i]->sequence < queue[best]->sequence))
+        {
+            best = (int) i;
+        }
+    }
+    return best;
+}
+
+bool SSSPEngine::start( SSSPBackend **backends, int backendCount, const GraphData *graph )
+{
+    this->graph = graph;
+    stopping = false;
+    workersStarting = backendCount;
+
+    for (int i = 0; i < backendCount; i++)
+    {
+        Worker *worker = new Worker;
+        worker->engine = this;
+        worker->backend = backends[i];
+        worker->started = false;
+        initBackendMeters(backends[i], &worker->meters);
+        workers.push_back(worker);
+
+        pthread_create(&worker->thread, NULL, workerThread, (void*) worker);
+    }
+
+    // Wait until every worker has its session, so submit() knows whether
+    // anything will ever run the batch
+    pthread_mutex_lock(&queueLock);
+    while (workersStarting > 0)
+    {
+        pthread_cond_wait(&workerStarted, &queueLock);
+    }
+    chunksPerBatch = workerCount * CHUNKS_PER_WORKER;
+    pthread_mutex_unlock(&queueLock);
+
+    return workerCount > 0;
+}
+
+SSSPFuture SSSPEngine::submit( const int *sourceVertices, float *outResultCosts, int numResults,
+                               int priority, SSSPRequestClass requestClass,
+                               SSSPCallback callback, void *userData )
+{
+    SSSPRequest *request = new SSSPRequest;
+    request->sourceVertices = (int*) malloc(sizeof(int) * (numResults > 0 ? numResults : 1));
+    memcpy(request->sourceVertices, sourceVertices, sizeof(int) * (numResults > 0 ? numResults : 0));
+    request->outResultCosts = outResultCosts;
+    request->numResults = numResults;
+    request->priority = priority;
+    request->refCount = 1;
+    pthread_mutex_init(&request->lock, NULL);
+    pthread_cond_init(&request->finished, NULL);
+    request->state = SSSP_REQUEST_QUEUED;
+    request->nextSource = 0;
+    request->chunksRunning = 0;
+    request->cancelRequested = false;
+    request->failed = false;
+    request->runningCallbacks = false;
+    if (callback != NULL)
+    {
+        request->callbacks.push_back(PendingCallback(callback, userData));
+    }
+    request->metrics = &classMetrics[requestClass];
+    request->submitTime = engineTime();
+
+    pthread_mutex_lock(&request->metrics->lock);
+    request->metrics->submitted++;
+    pthread_mutex_unlock(&request->metrics->lock);
+    observeMetric(request->metrics->batchSizeMetric, numResults);
+
+    SSSPFuture future(request);
+
+    pthread_mutex_lock(&queueLock);
+    if (recorder != NULL)
+    {
+        recordWorkloadQuery(recorder, WORKLOAD_QUERY_SSSP, requestClass, priority, sourceVertices, numResults, -1);
+    }
+    request->sequence = submitted++;
+    request->chunkSize = (requestClass == SSSP_CLASS_BULK) ? classPolicy.bulkChunkSources :
+                         numResults / (chunksPerBatch > 0 ? chunksPerBatch : 1);
+    if (request->chunkSize < 1)
+    {
+        request->chunkSize = 1;
+    }
+
+    bool accepted = !stopping && workerCount > 0 && numResults > 0;
+    if (accepted)
+    {
+        // The queue keeps the reference taken at creation
+        queue.push_back(request);
+        addMetric(request->metrics->queuedMetric, 1.0);
+        pthread_cond_broadcast(&queueChanged);
+    }
+    pthread_mutex_unlock(&queueLock);
+
+    if (!accepted)
+    {
+        pthread_mutex_lock(&request->lock);
+        finishRequestLocked(request, (numResults == 0 && workerCount > 0 && !stopping) ?
+                                     SSSP_REQUEST_COMPLETED : SSSP_REQUEST_FAILED);
+        releaseRequest(request);
+    }
+
+    return future;
+}
+
+void SSSPEngine::shutdown()
+{
+    pthread_mutex_lock(&queueLock);
+    stopping = true;
+    std::vector<SSSPRequest*> dropped;
+    dropped.swap(queue);
+    pthread_cond_broadcast(&queueChanged);
+    pthread_mutex_unlock(&queueLock);
+
+    for (size_t i = 0; i < dropped.size(); i++)
+    {
+        addMetric(dropped[i]->metrics->queuedMetric, -1.0);
+        cancelRequest(dropped[i]);
+        releaseRequest(dropped[i]);
+    }
+
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        pthread_join(workers[i]->thread, NULL);
+        delete workers[i];
+    }
+    workers.clear();
+    workerCount = 0;
+}
+
+void SSSPEngine::setClassPolicy( const SSSPClassPolicy &policy )
+{
+    pthread_mutex_lock(&queueLock);
+    classPolicy = policy;
+    pthread_mutex_unlock(&queueLock);
+
+    for (int c = 0; c < SSSP_CLASS_COUNT; c++)
+    {
+        pthread_mutex_lock(&classMetrics[c].lock);
+        classMetrics[c].latencyTarget = policy.latencyTarget[c];
+        pthread_mutex_unlock(&classMetrics[c].lock);
+    }
+}
+
+SSSPClassPolicy SSSPEngine::getClassPolicy() const
+{
+    pthread_mutex_lock(&queueLock);
+    SSSPClassPolicy policy = classPolicy;
+    pthread_mutex_unlock(&queueLock);
+
+    return policy;
+}
+
+SSSPClassStats SSSPEngine::getClassStats( SSSPRequestClass requestClass ) const
+{
+    SSSPClassMetrics *metrics = &classMetrics[requestClass];
+    SSSPClassStats stats;
+
+    pthread_mutex_lock(&metrics->lock);
+    stats.submitted = metrics->submitted;
+    stats.completed = metrics->completed;
+    stats.abandoned = metrics->abandoned;
+    stats.chunks = metrics->chunks;
+    stats.sloMisses = metrics->sloMisses;
+    stats.meanLatency = (metrics->completed > 0) ? metrics->latencySum / metrics->completed : 0.0;
+    stats.p50Latency = latencyPercentile(metrics, 0.50);
+    stats.p95Latency = latencyPercentile(metrics, 0.95);
+    stats.p99Latency = latencyPercentile(metrics, 0.99);
+    stats.maxLatency = metrics->maxLatency;
+    pthread_mutex_unlock(&metrics->lock);
+
+    return stats;
+}
+
+void SSSPEngine::setWorkloadRecorder( WorkloadRecorder *recorder )
+{
+    pthread_mutex_lock(&queueLock);
+    this->recorder = recorder;
+    pthread_mutex_unlock(&queueLock);
+}
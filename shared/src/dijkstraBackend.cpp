@@ -0,0 +1,320 @@
+//
+//
+//  Description:
+//      Backend registry and the engine-independent drivers built on top of the
+//      SSSPBackend interface.  See dijkstraBackend.h.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <vector>
+#include "dijkstraBackend.h"
+#include "dijkstraMetrics.h"
+
+///
+//  Constants
+//
+
+// Number of chunks per backend runSSSPMultiBackend() splits a batch into.
+// More chunks balance better between backends of different speed, fewer
+// chunks amortize the per-run overhead of the device backends.
+const int CHUNKS_PER_BACKEND = 8;
+
+///
+//  Types
+//
+
+// Workload of one backend thread in runSSSPMultiBackend()
+typedef struct
+{
+    // Backend this thread drives
+    SSSPBackend *backend;
+
+    // Input graph
+    const GraphData *graph;
+
+    // Whole batch
+    const int *sourceVertices;
+    float *outResultCosts;
+    int numResults;
+
+    // Shared queue position, next source not yet taken by any thread
+    int *nextSource;
+    pthread_mutex_t *queueLock;
+
+    // Sources taken per dequeue
+    int chunkSize;
+
+    BackendMeters meters;
+
+    // Set by the thread
+    bool succeeded;
+
+} BackendPlan;
+
+///
+//  Globals
+//
+static std::vector<SSSPBackend*> registeredBackends;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+///
+/// Wall clock time in seconds
+///
+static double backendTime()
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec + now.tv_usec * 1.0e-6;
+}
+
+///
+/// Worker thread for one backend of runSSSPMultiBackend()
+///
+static void *backendThread(void *arg)
+{
+    BackendPlan *plan = (BackendPlan*) arg;
+    plan->succeeded = true;
+
+    SSSPSession *session = plan->backend->createSession(plan->graph);
+    if (session == NULL)
+    {
+        fprintf(stderr, "runSSSPMultiBackend: %s could not load the graph\n", plan->backend->getName());
+        plan->succeeded = false;
+        return NULL;
+    }
+
+    for (;;)
+    {
+        pthread_mutex_lock(plan->queueLock);
+        int first = *plan->nextSource;
+        int count = plan->numResults - first;
+        if (count > plan->chunkSize)
+        {
+            count = plan->chunkSize;
+        }
+        *plan->nextSource = first + count;
+        pthread_mutex_unlock(plan->queueLock);
+
+        if (count <= 0)
+        {
+            break;
+        }
+
+        if (!runMeteredSession(&plan->meters, session, &plan->sourceVertices[first],
+                               &plan->outResultCosts[(size_t) first * plan->graph->vertexCount], count))
+        {
+            fprintf(stderr, "runSSSPMultiBackend: %s failed\n", plan->backend->getName());
+            plan->succeeded = false;
+            break;
+        }
+    }
+
+    delete session;
+    return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+/// Default session size: the graph arrays plus a cost and a mask entry per vertex
+///
+size_t SSSPBackend::estimateSessionBytes( const GraphData *graph ) const
+{
+    return sizeof(int) * (size_t) graph->vertexCount +
+           (sizeof(int) + sizeof(float)) * (size_t) graph->edgeCount +
+           (sizeof(float) + sizeof(int)) * (size_t) graph->vertexCount;
+}
+
+///
+/// Look up the metrics of a backend
+///
+void initBackendMeters( SSSPBackend *backend, BackendMeters *outMeters )
+{
+    char labels[METRIC_LABELS_MAX];
+    snprintf(labels, sizeof(labels), "backend=\"%s\"", backend->getName());
+
+    outMeters->busySeconds = getMetricCounter("sssp_backend_busy_seconds_total",
+                                              "Seconds a backend spent running searches.", labels);
+    outMeters->sources = getMetricCounter("sssp_backend_sources_total", "Sources a backend searched.", labels);
+    outMeters->runs = getMetricCounter("sssp_backend_runs_total", "Batches of sources a backend ran.", labels);
+    outMeters->failures = getMetricCounter("sssp_backend_failures_total", "Batches a backend failed to run.", labels);
+}
+
+///
+/// Run a batch on a session and add it to the backend's metrics
+///
+bool runMeteredSession( const BackendMeters *meters, SSSPSession *session, const int *sourceVertices,
+                        float *outResultCosts, int numResults )
+{
+    double start = backendTime();
+    bool succeeded = session->run(sourceVertices, outResultCosts, numResults);
+
+    addMetric(meters->busySeconds, backendTime() - start);
+    addMetric(meters->runs, 1.0);
+    if (succeeded)
+    {
+        addMetric(meters->sources, numResults);
+    }
+    else
+    {
+        addMetric(meters->failures, 1.0);
+    }
+
+    return succeeded;
+}
+
+///
+/// Run one batch through a temporary, metered session
+///
+bool runSSSP( SSSPBackend *backend, const GraphData *graph, const int *sourceVertices,
+              float *outResultCosts, int numResults )
+{
+    SSSPSession *session = backend->createSession(graph);
+    if (session == NULL)
+    {
+        return false;
+    }
+
+    BackendMeters meters;
+    initBackendMeters(backend, &meters);
+    bool succeeded = runMeteredSession(&meters, session, sourceVertices, outResultCosts, numResults);
+    delete session;
+
+    return succeeded;
+}
+
+///
+/// Split a batch of sources over several backends
+///
+bool runSSSPMultiBackend( SSSPBackend **backends, int backendCount, const GraphData *graph,
+                          const int *sourceVertices, float *outResultCosts, int numResults )
+{
+    if (backendCount <= 0)
+    {
+        fprintf(stderr, "runSSSPMultiBackend: no backends\n");
+        return false;
+    }
+
+    // A single backend needs no threads, runSSSP() meters it the same way
+    if (backendCount == 1)
+    {
+        return runSSSP(backends[0], graph, sourceVertices, outResultCosts, numResults);
+    }
+
+    BackendPlan *plans = (BackendPlan*) malloc(sizeof(BackendPlan) * backendCount);
+    pthread_t *threadIDs = (pthread_t*) malloc(sizeof(pthread_t) * backendCount);
+    pthread_mutex_t queueLock;
+    pthread_mutex_init(&queueLock, NULL);
+    int nextSource = 0;
+
+    int chunkSize = numResults / (backendCount * CHUNKS_PER_BACKEND);
+    if (chunkSize < 1)
+    {
+        chunkSize = 1;
+    }
+
+    for (int i = 0; i < backendCount; i++)
+    {
+        plans[i].backend = backends[i];
+        plans[i].graph = graph;
+        plans[i].sourceVertices = sourceVertices;
+        plans[i].outResultCosts = outResultCosts;
+        plans[i].numResults = numResults;
+        plans[i].nextSource = &nextSource;
+        plans[i].queueLock = &queueLock;
+        plans[i].chunkSize = chunkSize;
+        initBackendMeters(backends[i], &plans[i].meters);
+
+        pthread_create(&threadIDs[i], NULL, backendThread, (void*)(plans + i));
+    }
+
+    bool succeeded = true;
+    for (int i = 0; i < backendCount; i++)
+    {
+        pthread_join(threadIDs[i], NULL);
+        succeeded = succeeded && plans[i].succeeded;
+    }
+
+    pthread_mutex_destroy(&queueLock);
+    free(plans);
+    free(threadIDs);
+
+    return succeeded;
+}
+
+///
+/// Add a backend to the registry
+///
+void registerSSSPBackend( SSSPBackend *backend )
+{
+    for (size_t i = 0; i < registeredBackends.size(); i++)
+    {
+        if (strcmp(registeredBackends[i]->getName(), backend->getName()) == 0)
+        {
+            delete registeredBackends[i];
+            registeredBackends[i] = backend;
+            return;
+        }
+    }
+
+    registeredBackends.push_back(backend);
+}
+
+///
+/// Look up a registered backend by name
+///
+SSSPBackend *findSSSPBackend( const char *name )
+{
+    for (size_t i = 0; i < registeredBackends.size(); i++)
+    {
+        if (strcmp(registeredBackends[i]->getName(), name) == 0)
+        {
+            return registeredBackends[i];
+        }
+    }
+
+    return NULL;
+}
+
+///
+/// Number of registered backends
+///
+int getSSSPBackendCount()
+{
+    return (int) registeredBackends.size();
+}
+
+///
+/// Registered backend by index
+///
+SSSPBackend *getSSSPBackend( int index )
+{
+    return registeredBackends[index];
+}
+
+///
+/// Delete every registered backend
+///
+void releaseSSSPBackends()
+{
+    for (size_t i = 0; i < registeredBackends.size(); i++)
+    {
+        delete registeredBackends[i];
+    }
+    registeredBackends.clear();
+}
@@ -0,0 +1,490 @@
+//
+//
+//  Description:
+//      Native CPU SSSP backends.  These need neither CUDA nor OpenCL, so they
+//      are always registered and serve as the fallback and as the baseline
+//      the device backends are compared against.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <stdio.h>
+#include <float.h>
+#include <string.h>
+#include <functional>
+#include <queue>
+#include <vector>
+#include "dijkstraBackend.h"
+#include "dijkstraDirection.h"
+#include "dijkstraMemory.h"
+
+///
+//  Types
+//
+
+// Heap entry, ordered by cost
+typedef std::pair<float, int> HeapEntry;
+
+//
+//  Base of the sessions below.  The graph belongs to the caller; a session
+//  reserves host memory for its own per-vertex state when it is created and
+//  gives it back when it is released, see createCPUSession().
+//
+class CPUSession : public SSSPSession
+{
+public:
+    CPUSession(size_t reservedBytes) :
+        reservedBytes(reservedBytes)
+    {
+    }
+
+    virtual ~CPUSession()
+    {
+        releaseMemory(MEMORY_HOST, MEMORY_STATE, reservedBytes);
+    }
+
+private:
+    size_t reservedBytes;
+};
+
+///
+/// Reserve the state of a session in the host account and create it
+///
+/// \return NULL if the state does not fit in the host memory limit
+///
+template <class Session>
+static SSSPSession *createCPUSession(const char *backendName, const GraphData *graph)
+{
+    // A cost and a bookkeeping entry per vertex
+    size_t bytes = (sizeof(float) + sizeof(int)) * (size_t) graph->vertexCount;
+    if (!reserveMemory(MEMORY_HOST, MEMORY_STATE, bytes))
+    {
+        fprintf(stderr, "createSession: the state of %s does not fit in the host memory limit\n", backendName);
+        return NULL;
+    }
+
+    return new Session(graph, bytes);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Binary heap Dijkstra
+//
+//
+
+//
+//  Textbook Dijkstra with a binary heap.  Vertices are not decreased in place:
+//  an improved vertex is pushed again and stale entries are skipped on pop.
+//
+class CPUHeapSession : public CPUSession
+{
+public:
+    CPUHeapSession(const GraphData *graph, size_t reservedBytes) :
+        CPUSession(reservedBytes),
+        graph(graph)
+    {
+    }
+
+    virtual bool run( const int *sourceVertices, float *outResultCosts, int numResults )
+    {
+        for (int i = 0; i < numResults; i++)
+        {
+            float *costArray = &outResultCosts[(size_t) i * graph->vertexCount];
+            for (int v = 0; v < graph->vertexCount; v++)
+            {
+                costArray[v] = FLT_MAX;
+            }
+
+            costArray[sourceVertices[i]] = 0.0f;
+            heap.push(HeapEntry(0.0f, sourceVertices[i]));
+
+            while (!heap.empty())
+            {
+                HeapEntry top = heap.top();
+                heap.pop();
+
+                int vertex = top.second;
+                if (top.first > costArray[vertex])
+                {
+                    continue;
+                }
+
+                int edgeEnd = graphEdgeEnd(graph, vertex);
+                for (int edge = graph->vertexArray[vertex]; edge < edgeEnd; edge++)
+                {
+                    int nid = graph->edgeArray[edge];
+                    float cost = top.first + graph->weightArray[edge];
+                    if (cost < costArray[nid])
+                    {
+                        costArray[nid] = cost;
+                        heap.push(HeapEntry(cost, nid));
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+
+private:
+    const GraphData *graph;
+
+    // Kept between runs so its storage is reused
+    std::priority_queue<HeapEntry, std::vector<HeapEntry>, std::greater<HeapEntry> > heap;
+};
+
+class CPUHeapBackend : public SSSPBackend
+{
+public:
+    virtual const char *getName() const { return SSSP_BACKEND_CPU_HEAP; }
+    virtual SSSPDeviceType getDeviceType() const { return SSSP_DEVICE_CPU; }
+    virtual SSSPSession *createSession( const GraphData *graph )
+    {
+        return createCPUSession<CPUHeapSession>(SSSP_BACKEND_CPU_HEAP, graph);
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Delta-stepping
+//
+//
+
+//
+//  Delta-stepping (Meyer & Sanders).  Vertices are kept in buckets of width
+//  delta.  The lowest bucket is drained by relaxing only the light edges
+//  (weight <= delta) of its vertices, which may put vertices back into the
+//  same bucket; the heavy edges of everything removed from the bucket are
+//  relaxed once it is empty.  Tentative costs are never more than the largest
+//  weight above the current bucket, so the buckets are used cyclically.
+//
+class CPUBucketSession : public CPUSession
+{
+public:
+    CPUBucketSession(const GraphData *graph, size_t reservedBytes) :
+        CPUSession(reservedBytes),
+        graph(graph),
+        queuedBucket(graph->vertexCount, -1),
+        removedBucket(graph->vertexCount, -1)
+    {
+        // delta is the average weight: most edges of a vertex are then light
+        // and one bucket holds about a frontier's worth of vertices
+        double weightSum = 0.0;
+        float maxWeight = 0.0f;
+        for (int edge = 0; edge < graph->edgeCount; edge++)
+        {
+            weightSum += graph->weightArray[edge];
+            if (graph->weightArray[edge] > maxWeight)
+            {
+                maxWeight = graph->weightArray[edge];
+            }
+        }
+
+        delta = (graph->edgeCount > 0) ? (float) (weightSum / graph->edgeCount) : 1.0f;
+        if (delta <= 0.0f)
+        {
+            delta = 1.0f;
+        }
+
+        buckets.resize((size_t) (maxWeight / delta) + 2);
+    }
+
+    virtual bool run( const int *sourceVertices, float *outResultCosts, int numResults )
+    {
+        for (int i = 0; i < numResults; i++)
+        {
+            costArray = &outResultCosts[(size_t) i * graph->vertexCount];
+            for (int v = 0; v < graph->vertexCount; v++)
+            {
+                costArray[v] = FLT_MAX;
+                queuedBucket[v] = -1;
+                removedBucket[v] = -1;
+            }
+
+            pending = 0;
+            relax(sourceVertices[i], 0.0f);
+
+            for (long long current = 0; pending > 0; current++)
+            {
+                std::vector<int> &bucket = buckets[current % buckets.size()];
+                removed.clear();
+
+                // Light edges, until no vertex falls back into this bucket
+                while (!bucket.empty())
+                {
+                    taken.swap(bucket);
+                    bucket.clear();
+                    pending -= taken.size();
+
+                    for (size_t t = 0; t < taken.size(); t++)
+                    {
+                        int vertex = taken[t];
+                        if (queuedBucket[vertex] != current)
+                        {
+                            // Moved to a lower bucket after it was queued here
+                            continue;
+                        }
+                        queuedBucket[vertex] = -1;
+
+                        if (removedBucket[vertex] != current)
+                        {
+                            removedBucket[vertex] = current;
+                            removed.push_back(vertex);
+                        }
+                        relaxEdges(vertex, true);
+                    }
+                }
+
+                // Heavy edges of every vertex settled in this bucket
+                for (size_t r = 0; r < removed.size(); r++)
+                {
+                    relaxEdges(removed[r], false);
+                }
+            }
+        }
+
+        return true;
+    }
+
+private:
+    ///
+    /// Lower the cost of a vertex and move it to the matching bucket
+    ///
+    void relax(int vertex, float cost)
+    {
+        if (cost < costArray[vertex])
+        {
+            costArray[vertex] = cost;
+
+            long long bucket = (long long) (cost / delta);
+            if (queuedBucket[vertex] != bucket)
+            {
+                queuedBucket[vertex] = bucket;
+                buckets[bucket % buckets.size()].push_back(vertex);
+                pending++;
+            }
+        }
+    }
+
+    ///
+    /// Relax either the light or the heavy edges of a vertex
+    ///
+    void relaxEdges(int vertex, bool light)
+    {
+        int edgeEnd = graphEdgeEnd(graph, vertex);
+        for (int edge = graph->vertexArray[vertex]; edge < edgeEnd; edge++)
+        {
+            float weight = graph->weightArray[edge];
+            if ((weight <= delta) == light)
+            {
+                relax(graph->edgeArray[edge], costArray[vertex] + weight);
+            }
+        }
+    }
+
+private:
+    const GraphData *graph;
+
+    // Bucket width
+    float delta;
+
+    // Cyclic buckets, entry i holds the vertices of buckets i, i + n, ...
+    std::vector< std::vector<int> > buckets;
+
+    // Bucket each vertex is currently queued in, -1 if none.  Entries of
+    // vertices that moved on are skipped when their old bucket is drained.
+    std::vector<long long> queuedBucket;
+
+    // Last bucket each vertex was removed from, to list it in removed once
+    std::vector<long long> removedBucket;
+
+    // Scratch lists for draining a bucket
+    std::vector<int> taken;
+    std::vector<int> removed;
+
+    // Queue entries not yet drained, including stale ones
+    size_t pending;
+
+    // Costs of the search in progress
+    float *costArray;
+};
+
+class CPUBucketBackend : public SSSPBackend
+{
+public:
+    virtual const char *getName() const { return SSSP_BACKEND_CPU_BUCKET; }
+    virtual SSSPDeviceType getDeviceType() const { return SSSP_DEVICE_CPU; }
+    virtual SSSPSession *createSession( const GraphData *graph )
+    {
+        return createCPUSession<CPUBucketSession>(SSSP_BACKEND_CPU_BUCKET, graph);
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Push/pull frontier algorithm
+//
+//
+
+//
+//  The frontier algorithm of runDijkstraRef(), switching each iteration
+//  between pushing along the out-edges of the frontier and pulling along the
+//  in-edges of every vertex, see dijkstraDirection.h.
+//
+class CPUPushPullSession : public CPUSession
+{
+public:
+    CPUPushPullSession(const GraphData *graph, size_t reservedBytes) :
+        CPUSession(reservedBytes),
+        graph(graph),
+        policy(getSSSPDirectionPolicy()),
+        updatingCostArray(graph->vertexCount),
+        maskWordCount(frontierWordCount(graph->vertexCount)),
+        maskArray(maskWordCount > 0 ? maskWordCount : 1)
+    {
+        buildReverseGraph(graph, &reverseGraph);
+    }
+
+    virtual ~CPUPushPullSession()
+    {
+        freeGraph(&reverseGraph);
+    }
+
+    virtual bool run( const int *sourceVertices, float *outResultCosts, int numResults )
+    {
+        for (int i = 0; i < numResults; i++)
+        {
+            float *costArray = &outResultCosts[(size_t) i * graph->vertexCount];
+            for (int v = 0; v < graph->vertexCount; v++)
+            {
+                costArray[v] = FLT_MAX;
+                updatingCostArray[v] = FLT_MAX;
+            }
+            costArray[sourceVertices[i]] = 0.0f;
+            updatingCostArray[sourceVertices[i]] = 0.0f;
+
+            memset(&maskArray[0], 0, sizeof(FrontierWord) * maskWordCount);
+            frontierSet(&maskArray[0], sourceVertices[i]);
+
+            SSSPDirection direction = SSSP_PUSH;
+            int frontierVertices;
+            for (int iteration = 0; (frontierVertices = frontierSize(&maskArray[0], maskWordCount)) > 0; iteration++)
+            {
+                direction = chooseSSSPDirection(&policy, graph, direction, SSSP_BACKEND_CPU_PUSHPULL, iteration,
+                                                frontierVertices,
+                                                frontierEdgeCount(graph, &maskArray[0], maskWordCount));
+                if (direction == SSSP_PUSH)
+                {
+                    push(costArray);
+                }
+                else
+                {
+                    pull(costArray);
+                }
+
+                // Apply the updates and build the next frontier
+                memset(&maskArray[0], 0, sizeof(FrontierWord) * maskWordCount);
+                for (int v = 0; v < graph->vertexCount; v++)
+                {
+                    if (costArray[v] > updatingCostArray[v])
+                    {
+                        costArray[v] = updatingCostArray[v];
+                        frontierSet(&maskArray[0], v);
+                    }
+                    updatingCostArray[v] = costArray[v];
+                }
+            }
+        }
+
+        return true;
+    }
+
+private:
+    ///
+    /// Relax the out-edges of the frontier vertices
+    ///
+    void push(const float *costArray)
+    {
+        for (int word = 0; word < maskWordCount; word++)
+        {
+            FrontierWord bits = maskArray[word];
+            while (bits != 0)
+            {
+                int vertex = (word << FRONTIER_WORD_SHIFT) + frontierWordLowestBit(bits);
+                bits &= bits - 1;
+
+                int edgeEnd = graphEdgeEnd(graph, vertex);
+                for (int edge = graph->vertexArray[vertex]; edge < edgeEnd; edge++)
+                {
+                    int nid = graph->edgeArray[edge];
+                    float cost = costArray[vertex] + graph->weightArray[edge];
+                    if (updatingCostArray[nid] > cost)
+                    {
+                        updatingCostArray[nid] = cost;
+                    }
+                }
+            }
+        }
+    }
+
+    ///
+    /// Let every vertex take the cheapest in-edge from a frontier vertex
+    ///
+    void pull(const float *costArray)
+    {
+        for (int vertex = 0; vertex < graph->vertexCount; vertex++)
+        {
+            float best = updatingCostArray[vertex];
+            int edgeEnd = graphEdgeEnd(&reverseGraph, vertex);
+            for (int edge = reverseGraph.vertexArray[vertex]; edge < edgeEnd; edge++)
+            {
+                int source = reverseGraph.edgeArray[edge];
+                if (frontierTest(&maskArray[0], source))
+                {
+                    float cost = costArray[source] + reverseGraph.weightArray[edge];
+                    if (cost < best)
+                    {
+                        best = cost;
+                    }
+                }
+            }
+            updatingCostArray[vertex] = best;
+        }
+    }
+
+private:
+    const GraphData *graph;
+    GraphData reverseGraph;
+    SSSPDirectionPolicy policy;
+
+    std::vector<float> updatingCostArray;
+    int maskWordCount;
+    std::vector<FrontierWord> maskArray;
+};
+
+class CPUPushPullBackend : public SSSPBackend
+{
+public:
+    virtual const char *getName() const { return SSSP_BACKEND_CPU_PUSHPULL; }
+    virtual SSSPDeviceType getDeviceType() const { return SSSP_DEVICE_CPU; }
+    virtual SSSPSession *createSession( const GraphData *graph )
+    {
+        return createCPUSession<CPUPushPullSession>(SSSP_BACKEND_CPU_PUSHPULL, graph);
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+/// Register the native CPU backends
+///
+void registerCPUBackends()
+{
+    registerSSSPBackend(new CPUHeapBackend());
+    registerSSSPBackend(new CPUBucketBackend());
+    registerSSSPBackend(new CPUPushPullBackend());
+}
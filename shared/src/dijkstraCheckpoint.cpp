@@ -0,0 +1,415 @@
+//
+//
+//  Description:
+//      Checkpointed multi-source jobs.  See dijkstraCheckpoint.h.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <vector>
+#include "dijkstraCheckpoint.h"
+
+///
+//  Constants
+//
+
+// Longest path of a file in the job directory
+const int CHECKPOINT_PATH_MAX = 4096;
+
+// XORed into the chunk index of a record, so a torn record does not check out
+const unsigned int CHECKPOINT_RECORD_KEY = 0x5a5a5a5a;
+
+///
+//  Types
+//
+
+// Header at the start of the manifest
+typedef struct
+{
+    // Must be CHECKPOINT_MAGIC and CHECKPOINT_VERSION
+    unsigned int magic;
+    unsigned int version;
+
+    // The job: graph, sources and how they are chunked
+    unsigned long long graphChecksum;
+    unsigned long long sourcesChecksum;
+    int vertexCount;
+    int numResults;
+    int chunkSources;
+    int reserved;
+
+} CheckpointHeader;
+
+// One finished chunk in the manifest
+typedef struct
+{
+    unsigned int chunk;
+    unsigned int check;
+
+} CheckpointRecord;
+
+// State shared by the backend threads of runSSSPCheckpointed()
+typedef struct
+{
+    const GraphData *graph;
+    const int *sourceVertices;
+    float *outResultCosts;
+    int numResults;
+    int chunkSources;
+
+    // Chunks still to run, taken in order through nextPending
+    std::vector<int> pending;
+    size_t nextPending;
+    pthread_mutex_t queueLock;
+
+    // Files of the job directory; manifest appends hold manifestLock
+    int rowsFd;
+    int manifestFd;
+    pthread_mutex_t manifestLock;
+
+    int completedChunks;
+
+} CheckpointJob;
+
+// Workload of one backend thread of runSSSPCheckpointed()
+typedef struct
+{
+    SSSPBackend *backend;
+    CheckpointJob *job;
+
+    // Set by the thread
+    bool succeeded;
+
+} CheckpointPlan;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+///
+/// 64-bit FNV-1a checksum of a source list
+///
+static unsigned long long sourcesChecksum(const int *sourceVertices, int numResults)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    const unsigned char *bytes = (const unsigned char*) sourceVertices;
+    for (size_t i = 0; i < sizeof(int) * (size_t) numResults; i++)
+    {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+///
+/// pwrite() or pread() all of a buffer, retrying short transfers
+///
+static bool transferAll(int fd, void *buffer, size_t size, off_t offset, bool write)
+{
+    char *bytes = (char*) buffer;
+    while (size > 0)
+    {
+        ssize_t done = write ? pwrite(fd, bytes, size, offset) : pread(fd, bytes, size, offset);
+        if (done < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (done <= 0)
+        {
+            return false;
+        }
+
+        bytes += done;
+        size -= done;
+        offset += done;
+    }
+
+    return true;
+}
+
+///
+/// Open the manifest of a job directory, creating it for a new job, and mark
+/// the chunks it records as finished
+///
+/// \return The manifest's descriptor positioned at its end, -1 on error
+///
+static int openManifest(const char *path, const CheckpointHeader *header, int chunkCount,
+                        std::vector<bool> *finished)
+{
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        perror("runSSSPCheckpointed: open manifest");
+        return -1;
+    }
+
+    CheckpointHeader existing;
+    ssize_t headerBytes = pread(fd, &existing, sizeof(existing), 0);
+    if (headerBytes == 0)
+    {
+        // New job
+        if (!transferAll(fd, (void*) header, sizeof(CheckpointHeader), 0, true) || fdatasync(fd) != 0)
+        {
+            perror("runSSSPCheckpointed: write manifest");
+            close(fd);
+            return -1;
+        }
+        lseek(fd, sizeof(CheckpointHeader), SEEK_SET);
+        return fd;
+    }
+
+    if (headerBytes != sizeof(existing) || memcmp(&existing, header, sizeof(CheckpointHeader)) != 0)
+    {
+        fprintf(stderr, "runSSSPCheckpointed: %s belongs to another job\n", path);
+        close(fd);
+        return -1;
+    }
+
+    // Whole records only, a torn one at the end is overwritten by the next
+    off_t end = sizeof(CheckpointHeader);
+    CheckpointRecord record;
+    while (pread(fd, &record, sizeof(record), end) == sizeof(record) &&
+           record.check == (record.chunk ^ CHECKPOINT_RECORD_KEY) && (int) record.chunk < chunkCount)
+    {
+        (*finished)[record.chunk] = true;
+        end += sizeof(record);
+    }
+    lseek(fd, end, SEEK_SET);
+
+    return fd;
+}
+
+///
+/// Worker thread for one backend of runSSSPCheckpointed()
+///
+static void *checkpointThread(void *arg)
+{
+    CheckpointPlan *plan = (CheckpointPlan*) arg;
+    CheckpointJob *job = plan->job;
+    size_t rowSize = sizeof(float) * job->graph->vertexCount;
+    plan->succeeded = true;
+
+    SSSPSession *session = plan->backend->createSession(job->graph);
+    if (session == NULL)
+    {
+        fprintf(stderr, "runSSSPCheckpointed: %s could not load the graph\n", plan->backend->getName());
+        plan->succeeded = false;
+        return NULL;
+    }
+
+    BackendMeters meters;
+    initBackendMeters(plan->backend, &meters);
+
+    // Rows of a chunk when the caller keeps none in memory
+    std::vector<float> chunkCosts;
+    if (job->outResultCosts == NULL)
+    {
+        chunkCosts.resize((size_t) job->chunkSources * job->graph->vertexCount + 1);
+    }
+
+    for (;;)
+    {
+        pthread_mutex_lock(&job->queueLock);
+        int chunk = (job->nextPending < job->pending.size()) ? job->pending[job->nextPending++] : -1;
+        pthread_mutex_unlock(&job->queueLock);
+
+        if (chunk < 0)
+        {
+            break;
+        }
+
+        int first = chunk * job->chunkSources;
+        int count = (job->numResults - first < job->chunkSources) ? job->numResults - first : job->chunkSources;
+        float *costs = (job->outResultCosts != NULL) ?
+                       &job->outResultCosts[(size_t) first * job->graph->vertexCount] : &chunkCosts[0];
+
+        if (!runMeteredSession(&meters, session, &job->sourceVertices[first], costs, count))
+        {
+            fprintf(stderr, "runSSSPCheckpointed: %s failed\n", plan->backend->getName());
+            plan->succeeded = false;
+            break;
+        }
+
+        // Rows first, then the record that says they are there
+        if (!transferAll(job->rowsFd, costs, rowSize * count, (off_t) rowSize * first, true) ||
+            fdatasync(job->rowsFd) != 0)
+        {
+            perror("runSSSPCheckpointed: write rows");
+            plan->succeeded = false;
+            break;
+        }
+
+        CheckpointRecord record = { (unsigned int) chunk, (unsigned int) chunk ^ CHECKPOINT_RECORD_KEY };
+        pthread_mutex_lock(&job->manifestLock);
+        bool recorded = write(job->manifestFd, &record, sizeof(record)) == sizeof(record) &&
+                        fdatasync(job->manifestFd) == 0;
+        job->completedChunks += recorded ? 1 : 0;
+        pthread_mutex_unlock(&job->manifestLock);
+
+        if (!recorded)
+        {
+            perror("runSSSPCheckpointed: write manifest");
+            plan->succeeded = false;
+            break;
+        }
+    }
+
+    delete session;
+    return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+/// Run a batch of sources over several backends, saving each finished chunk
+///
+bool runSSSPCheckpointed( SSSPBackend **backends, int backendCount, const GraphData *graph,
+                          const int *sourceVertices, float *outResultCosts, int numResults,
+                          const char *jobDirectory, CheckpointStats *outStats )
+{
+    CheckpointStats stats;
+    memset(&stats, 0, sizeof(stats));
+    if (outStats != NULL)
+    {
+        *outStats = stats;
+    }
+
+    if (backendCount <= 0)
+    {
+        fprintf(stderr, "runSSSPCheckpointed: no backends\n");
+        return false;
+    }
+
+    if (mkdir(jobDirectory, 0755) != 0 && errno != EEXIST)
+    {
+        perror("runSSSPCheckpointed: mkdir");
+        return false;
+    }
+
+    size_t rowSize = sizeof(float) * graph->vertexCount;
+    long long chunkSources = CHECKPOINT_CHUNK_BYTES / (rowSize > 0 ? rowSize : 1);
+    long long minChunkSources = (numResults + CHECKPOINT_MIN_CHUNKS - 1) / CHECKPOINT_MIN_CHUNKS;
+    chunkSources = (chunkSources > minChunkSources) ? minChunkSources : chunkSources;
+    stats.chunkSources = (chunkSources > 1) ? (int) chunkSources : 1;
+    stats.chunkCount = (numResults + stats.chunkSources - 1) / stats.chunkSources;
+
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CHECKPOINT_MAGIC;
+    header.version = CHECKPOINT_VERSION;
+    header.graphChecksum = graphChecksum(graph);
+    header.sourcesChecksum = sourcesChecksum(sourceVertices, numResults);
+    header.vertexCount = graph->vertexCount;
+    header.numResults = numResults;
+    header.chunkSources = stats.chunkSources;
+
+    char manifestPath[CHECKPOINT_PATH_MAX];
+    char rowsPath[CHECKPOINT_PATH_MAX];
+    snprintf(manifestPath, sizeof(manifestPath), "%s/manifest", jobDirectory);
+    snprintf(rowsPath, sizeof(rowsPath), "%s/rows", jobDirectory);
+
+    std::vector<bool> finished(stats.chunkCount, false);
+    int manifestFd = openManifest(manifestPath, &header, stats.chunkCount, &finished);
+    if (manifestFd < 0)
+    {
+        return false;
+    }
+
+    int rowsFd = open(rowsPath, O_RDWR | O_CREAT, 0644);
+    if (rowsFd < 0 || ftruncate(rowsFd, (off_t) rowSize * numResults) != 0)
+    {
+        perror("runSSSPCheckpointed: rows");
+        close(manifestFd);
+        if (rowsFd >= 0)
+        {
+            close(rowsFd);
+        }
+        return false;
+    }
+
+    CheckpointJob *job = new CheckpointJob;
+    job->graph = graph;
+    job->sourceVertices = sourceVertices;
+    job->outResultCosts = outResultCosts;
+    job->numResults = numResults;
+    job->chunkSources = stats.chunkSources;
+    job->nextPending = 0;
+    job->rowsFd = rowsFd;
+    job->manifestFd = manifestFd;
+    job->completedChunks = 0;
+    pthread_mutex_init(&job->queueLock, NULL);
+    pthread_mutex_init(&job->manifestLock, NULL);
+
+    // Resumed chunks are read back, the others queued
+    bool succeeded = true;
+    for (int chunk = 0; chunk < stats.chunkCount; chunk++)
+    {
+        if (!finished[chunk])
+        {
+            job->pending.push_back(chunk);
+            continue;
+        }
+
+        stats.resumedChunks++;
+        int first = chunk * stats.chunkSources;
+        int count = (numResults - first < stats.chunkSources) ? numResults - first : stats.chunkSources;
+        if (outResultCosts != NULL && succeeded &&
+            !transferAll(rowsFd, &outResultCosts[(size_t) first * graph->vertexCount],
+                         rowSize * count, (off_t) rowSize * first, false))
+        {
+            perror("runSSSPCheckpointed: read rows");
+            succeeded = false;
+        }
+    }
+
+    CheckpointPlan *plans = (CheckpointPlan*) malloc(sizeof(CheckpointPlan) * backendCount);
+    pthread_t *threadIDs = (pthread_t*) malloc(sizeof(pthread_t) * backendCount);
+    for (int i = 0; i < backendCount && succeeded; i++)
+    {
+        plans[i].backend = backends[i];
+        plans[i].job = job;
+
+        pthread_create(&threadIDs[i], NULL, checkpointThread, (void*)(plans + i));
+    }
+
+    for (int i = 0; i < backendCount && succeeded; i++)
+    {
+        pthread_join(threadIDs[i], NULL);
+    }
+    for (int i = 0; i < backendCount && succeeded; i++)
+    {
+        succeeded = plans[i].succeeded;
+    }
+
+    stats.completedChunks = job->completedChunks;
+    succeeded = succeeded && stats.resumedChunks + stats.completedChunks == stats.chunkCount;
+
+    free(plans);
+    free(threadIDs);
+    close(rowsFd);
+    close(manifestFd);
+    pthread_mutex_destroy(&job->queueLock);
+    pthread_mutex_destroy(&job->manifestLock);
+    delete job;
+
+    if (outStats != NULL)
+    {
+        *outStats = stats;
+    }
+
+    return succeeded;
+}
@@ -0,0 +1,647 @@
+//
+//
+//  Description:
+//      Multi-node source sharding over TCP.  See dijkstraCluster.h.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <deque>
+#include <vector>
+#include "dijkstraCluster.h"
+
+///
+//  Constants
+//
+
+// How often the coordinator checks for new workers and the end of the job
+const int CLUSTER_POLL_MS = 100;
+
+// How long a new connection has to send its HELLO
+const int CLUSTER_HELLO_TIMEOUT_MS = 5000;
+
+// How long a worker keeps retrying to reach the coordinator
+const int CLUSTER_CONNECT_RETRIES = 50;
+const int CLUSTER_CONNECT_RETRY_MS = 100;
+
+// Message types
+enum
+{
+    CLUSTER_HELLO = 1,
+    CLUSTER_CHUNK,
+    CLUSTER_RESULT,
+    CLUSTER_DONE,
+    CLUSTER_REJECT
+};
+
+///
+//  Types
+//
+
+// Every message starts with this.  A CHUNK is followed by count sources, a
+// RESULT by count rows of costs.
+typedef struct
+{
+    unsigned int type;
+    int chunk;
+    int count;
+    int reserved;
+
+} ClusterMessage;
+
+// Payload of the HELLO a worker sends when it connects
+typedef struct
+{
+    // Must be CLUSTER_MAGIC and CLUSTER_VERSION
+    unsigned int magic;
+    unsigned int version;
+
+    // Graph of the worker, see graphChecksum()
+    unsigned long long graphChecksum;
+    int vertexCount;
+    int edgeCount;
+
+    char name[CLUSTER_NAME_MAX];
+
+} ClusterHello;
+
+// State of a job shared by the connection threads of runSSSPCoordinator()
+struct ClusterJob
+{
+    const GraphData *graph;
+    const int *sourceVertices;
+    float *outResultCosts;
+    int numResults;
+    int chunkSources;
+    int chunkCount;
+
+    // Chunks not handed out, running copies of each chunk, when the first
+    // copy was handed out, and which chunks have a result
+    std::deque<int> pending;
+    std::vector<int> copies;
+    std::vector<double> started;
+    std::vector<bool> done;
+    int doneCount;
+
+    // Set when the job ends without a result for every chunk
+    bool aborted;
+
+    // One entry per worker, in order of connection.  Connections count as
+    // active workers once their HELLO is accepted.
+    std::vector<ClusterWorkerStats> workers;
+    int activeWorkers;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+};
+
+// One worker connection of runSSSPCoordinator()
+typedef struct
+{
+    ClusterJob *job;
+    int fd;
+    pthread_t thread;
+
+    // Whether the worker's HELLO was accepted and whether a chunk is out on
+    // this connection, guarded by the job's lock
+    bool greeted;
+    bool busy;
+
+} ClusterConnection;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+///
+/// Wall clock time in seconds
+///
+static double clusterTime()
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec + now.tv_usec * 1.0e-6;
+}
+
+///
+/// Send all of a buffer, false if the connection failed
+///
+static bool sendAll(int fd, const void *buffer, size_t size)
+{
+    const char *bytes = (const char*) buffer;
+    while (size > 0)
+    {
+        ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (sent <= 0)
+        {
+            return false;
+        }
+
+        bytes += sent;
+        size -= sent;
+    }
+
+    return true;
+}
+
+///
+/// Receive all of a buffer, false if the connection failed or was closed
+///
+static bool receiveAll(int fd, void *buffer, size_t size)
+{
+    char *bytes = (char*) buffer;
+    while (size > 0)
+    {
+        ssize_t received = recv(fd, bytes, size, 0);
+        if (received < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (received <= 0)
+        {
+            return false;
+        }
+
+        bytes += received;
+        size -= received;
+    }
+
+    return true;
+}
+
+///
+/// Set how long a receive on a connection may block, 0 for no limit
+///
+static void setReceiveTimeout(int fd, int timeoutMs)
+{
+    struct timeval timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_usec = (timeoutMs % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+///
+/// Send a message header
+///
+static bool sendMessage(int fd, unsigned int type, int chunk, int count)
+{
+    ClusterMessage message = { type, chunk, count, 0 };
+    return sendAll(fd, &message, sizeof(message));
+}
+
+///
+/// Take a chunk for a worker: the next queued chunk, or once the queue is
+/// empty a copy of the running chunk that was handed out first.  Waits while
+/// every unfinished chunk already runs CLUSTER_MAX_COPIES times.
+///
+/// \return The chunk, -1 once the job is over
+///
+static int takeChunk(ClusterJob *job, ClusterConnection *connection, bool *outBackup)
+{
+    pthread_mutex_lock(&job->lock);
+
+    int chunk = -1;
+    while (job->doneCount < job->chunkCount && !job->aborted && chunk < 0)
+    {
+        if (!job->pending.empty())
+        {
+            chunk = job->pending.front();
+            job->pending.pop_front();
+            job->started[chunk] = clusterTime();
+            *outBackup = false;
+        }
+        else
+        {
+            for (int c = 0; c < job->chunkCount; c++)
+            {
+                if (!job->done[c] && job->copies[c] > 0 && job->copies[c] < CLUSTER_MAX_COPIES &&
+                    (chunk < 0 || job->started[c] < job->started[chunk]))
+                {
+                    chunk = c;
+                }
+            }
+            *outBackup = true;
+        }
+
+        if (chunk >= 0)
+        {
+            job->copies[chunk]++;
+        }
+        else
+        {
+            pthread_cond_wait(&job->changed, &job->lock);
+        }
+    }
+    connection->busy = chunk >= 0;
+
+    pthread_mutex_unlock(&job->lock);
+    return chunk;
+}
+
+///
+/// Serve one worker until the job is over or the connection fails
+///
+static void *connectionThread(void *arg)
+{
+    ClusterConnection *connection = (ClusterConnection*) arg;
+    ClusterJob *job = connection->job;
+    const GraphData *graph = job->graph;
+    int fd = connection->fd;
+
+    ClusterWorkerStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    // A connection that never speaks must not hold its thread forever
+    ClusterMessage message;
+    ClusterHello hello;
+    setReceiveTimeout(fd, CLUSTER_HELLO_TIMEOUT_MS);
+    bool greeted = receiveAll(fd, &message, sizeof(message)) && message.type == CLUSTER_HELLO &&
+                   receiveAll(fd, &hello, sizeof(hello));
+    if (!greeted)
+    {
+        fprintf(stderr, "runSSSPCoordinator: dropped a connection without a HELLO\n");
+        return NULL;
+    }
+
+    bool accepted = hello.magic == CLUSTER_MAGIC && hello.version == CLUSTER_VERSION &&
+                    hello.vertexCount == graph->vertexCount && hello.edgeCount == graph->edgeCount &&
+                    hello.graphChecksum == graphChecksum(graph);
+    if (!accepted)
+    {
+        fprintf(stderr, "runSSSPCoordinator: turned away a worker with another graph\n");
+        sendMessage(fd, CLUSTER_REJECT, -1, 0);
+        return NULL;
+    }
+    memcpy(stats.name, hello.name, CLUSTER_NAME_MAX);
+    stats.name[CLUSTER_NAME_MAX - 1] = '\0';
+
+    // Searching a chunk takes as long as it takes
+    setReceiveTimeout(fd, 0);
+
+    pthread_mutex_lock(&job->lock);
+    int worker = (int) job->workers.size();
+    job->workers.push_back(stats);
+    job->activeWorkers++;
+    connection->greeted = true;
+    pthread_mutex_unlock(&job->lock);
+
+    size_t rowSize = sizeof(float) * graph->vertexCount;
+    std::vector<float> rows((size_t) job->chunkSources * graph->vertexCount + 1);
+    double firstSent = 0.0;
+    double lastReceived = 0.0;
+    bool failed = false;
+
+    bool backup;
+    int chunk;
+    while ((chunk = takeChunk(job, connection, &backup)) >= 0)
+    {
+        int first = chunk * job->chunkSources;
+        int count = (job->numResults - first < job->chunkSources) ? job->numResults - first : job->chunkSources;
+        firstSent = (firstSent > 0.0) ? firstSent : clusterTime();
+
+        failed = !sendMessage(fd, CLUSTER_CHUNK, chunk, count) ||
+                 !sendAll(fd, &job->sourceVertices[first], sizeof(int) * count) ||
+                 !receiveAll(fd, &message, sizeof(message)) ||
+                 message.type != CLUSTER_RESULT || message.chunk != chunk || message.count != count ||
+                 !receiveAll(fd, &rows[0], rowSize * count);
+
+        // The first copy to finish claims the chunk
+        pthread_mutex_lock(&job->lock);
+        connection->busy = false;
+        job->copies[chunk]--;
+        bool claimed = !failed && !job->done[chunk];
+        ClusterWorkerStats *workerStats = &job->workers[worker];
+        if (claimed)
+        {
+            job->done[chunk] = true;
+            job->doneCount++;
+            workerStats->chunks++;
+            workerStats->sources += count;
+        }
+        else if (!failed)
+        {
+            workerStats->discardedChunks++;
+        }
+        else if (!job->done[chunk] && job->copies[chunk] == 0)
+        {
+            job->pending.push_front(chunk);
+        }
+        workerStats->backupChunks += backup ? 1 : 0;
+        workerStats->backupsWon += (backup && claimed) ? 1 : 0;
+        pthread_cond_broadcast(&job->changed);
+        pthread_mutex_unlock(&job->lock);
+
+        if (failed)
+        {
+            break;
+        }
+
+        lastReceived = clusterTime();
+        if (claimed)
+        {
+            memcpy(&job->outResultCosts[(size_t) first * graph->vertexCount], &rows[0], rowSize * count);
+        }
+    }
+
+    if (!failed)
+    {
+        sendMessage(fd, CLUSTER_DONE, -1, 0);
+    }
+
+    pthread_mutex_lock(&job->lock);
+    job->workers[worker].busySeconds = (lastReceived > firstSent) ? lastReceived - firstSent : 0.0;
+
+    // Connections cut by the coordinator at the end of the job are not failures
+    job->workers[worker].failed = failed && job->doneCount < job->chunkCount;
+    job->activeWorkers--;
+    pthread_cond_broadcast(&job->changed);
+    pthread_mutex_unlock(&job->lock);
+
+    return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+/// Coordinate a batch of sources over the workers that connect to port
+///
+bool runSSSPCoordinator( int port, const GraphData *graph, const int *sourceVertices,
+                         float *outResultCosts, int numResults,
+                         ClusterWorkerStats *outWorkerStats, int maxWorkers, int *outWorkerCount )
+{
+    if (outWorkerCount != NULL)
+    {
+        *outWorkerCount = 0;
+    }
+
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons((unsigned short) port);
+    if (listenFd < 0 || bind(listenFd, (struct sockaddr*) &address, sizeof(address)) != 0 ||
+        listen(listenFd, SOMAXCONN) != 0)
+    {
+        perror("runSSSPCoordinator: listen");
+        if (listenFd >= 0)
+        {
+            close(listenFd);
+        }
+        return false;
+    }
+
+    size_t rowSize = sizeof(float) * graph->vertexCount;
+    long long chunkSources = CLUSTER_CHUNK_BYTES / (rowSize > 0 ? rowSize : 1);
+    long long minChunkSources = (numResults + CLUSTER_MIN_CHUNKS - 1) / CLUSTER_MIN_CHUNKS;
+    chunkSources = (chunkSources > minChunkSources) ? minChunkSources : chunkSources;
+
+    ClusterJob *job = new ClusterJob;
+    job->graph = graph;
+    job->sourceVertices = sourceVertices;
+    job->outResultCosts = outResultCosts;
+    job->numResults = numResults;
+    job->chunkSources = (chunkSources > 1) ? (int) chunkSources : 1;
+    job->chunkCount = (numResults + job->chunkSources - 1) / job->chunkSources;
+    job->copies.assign(job->chunkCount, 0);
+    job->started.assign(job->chunkCount, 0.0);
+    job->done.assign(job->chunkCount, false);
+    job->doneCount = 0;
+    job->aborted = false;
+    job->activeWorkers = 0;
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->changed, NULL);
+    for (int c = 0; c < job->chunkCount; c++)
+    {
+        job->pending.push_back(c);
+    }
+
+    // Accept workers until every chunk has a result
+    std::vector<ClusterConnection*> connections;
+    int idleMs = 0;
+    for (;;)
+    {
+        pthread_mutex_lock(&job->lock);
+        bool finished = job->doneCount == job->chunkCount;
+        idleMs = (job->activeWorkers > 0) ? 0 : idleMs;
+        if (!finished && idleMs >= CLUSTER_IDLE_TIMEOUT_MS)
+        {
+            job->aborted = true;
+            pthread_cond_broadcast(&job->changed);
+        }
+        bool aborted = job->aborted;
+        pthread_mutex_unlock(&job->lock);
+
+        if (finished || aborted)
+        {
+            break;
+        }
+
+        struct pollfd listenPoll = { listenFd, POLLIN, 0 };
+        double waitStart = clusterTime();
+        if (poll(&listenPoll, 1, CLUSTER_POLL_MS) > 0)
+        {
+            int fd = accept(listenFd, NULL, NULL);
+            if (fd >= 0)
+            {
+                int noDelay = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+                ClusterConnection *connection = new ClusterConnection;
+                connection->job = job;
+                connection->fd = fd;
+                connection->greeted = false;
+                connection->busy = false;
+
+                pthread_create(&connection->thread, NULL, connectionThread, (void*) connection);
+                connections.push_back(connection);
+            }
+        }
+        idleMs += (int) ((clusterTime() - waitStart) * 1000.0);
+    }
+    close(listenFd);
+
+    // Cut the workers still running discarded copies of finished chunks and
+    // the connections still waiting for a HELLO.  The others are told the job
+    // is done, so only their receiving side is shut down, which no thread can
+    // then block on.
+    pthread_mutex_lock(&job->lock);
+    for (size_t i = 0; i < connections.size(); i++)
+    {
+        bool cut = connections[i]->busy || !connections[i]->greeted;
+        shutdown(connections[i]->fd, cut ? SHUT_RDWR : SHUT_RD);
+    }
+    pthread_mutex_unlock(&job->lock);
+    for (size_t i = 0; i < connections.size(); i++)
+    {
+        pthread_join(connections[i]->thread, NULL);
+        close(connections[i]->fd);
+        delete connections[i];
+    }
+
+    bool succeeded = job->doneCount == job->chunkCount;
+    if (!succeeded)
+    {
+        fprintf(stderr, "runSSSPCoordinator: no workers for %d ms, %d of %d chunks done\n",
+                CLUSTER_IDLE_TIMEOUT_MS, job->doneCount, job->chunkCount);
+    }
+
+    int workerCount = (int) job->workers.size();
+    for (int i = 0; i < workerCount && i < maxWorkers && outWorkerStats != NULL; i++)
+    {
+        outWorkerStats[i] = job->workers[i];
+    }
+    if (outWorkerCount != NULL)
+    {
+        *outWorkerCount = workerCount;
+    }
+
+    pthread_mutex_destroy(&job->lock);
+    pthread_cond_destroy(&job->changed);
+    delete job;
+
+    return succeeded;
+}
+
+///
+/// Serve chunks from the coordinator with a backend until the job is done
+///
+bool runSSSPWorker( const char *host, int port, SSSPBackend *backend, const GraphData *graph,
+                    const char *name )
+{
+    char portName[16];
+    snprintf(portName, sizeof(portName), "%d", port);
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo *addresses = NULL;
+    if (getaddrinfo(host, portName, &hints, &addresses) != 0 || addresses == NULL)
+    {
+        fprintf(stderr, "runSSSPWorker: cannot resolve %s\n", host);
+        return false;
+    }
+
+    int fd = -1;
+    for (int attempt = 0; attempt < CLUSTER_CONNECT_RETRIES && fd < 0; attempt++)
+    {
+        fd = socket(addresses->ai_family, addresses->ai_socktype, addresses->ai_protocol);
+        if (fd >= 0 && connect(fd, addresses->ai_addr, addresses->ai_addrlen) != 0)
+        {
+            close(fd);
+            fd = -1;
+            usleep(CLUSTER_CONNECT_RETRY_MS * 1000);
+        }
+    }
+    freeaddrinfo(addresses);
+
+    if (fd < 0)
+    {
+        fprintf(stderr, "runSSSPWorker: cannot reach %s:%d\n", host, port);
+        return false;
+    }
+
+    int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    ClusterHello hello;
+    memset(&hello, 0, sizeof(hello));
+    hello.magic = CLUSTER_MAGIC;
+    hello.version = CLUSTER_VERSION;
+    hello.graphChecksum = graphChecksum(graph);
+    hello.vertexCount = graph->vertexCount;
+    hello.edgeCount = graph->edgeCount;
+    if (name != NULL)
+    {
+        strncpy(hello.name, name, CLUSTER_NAME_MAX - 1);
+    }
+    else
+    {
+        char hostName[CLUSTER_NAME_MAX] = "";
+        gethostname(hostName, sizeof(hostName) - 1);
+        snprintf(hello.name, CLUSTER_NAME_MAX, "%s/%s", hostName, backend->getName());
+    }
+
+    SSSPSession *session = backend->createSession(graph);
+    if (session == NULL)
+    {
+        fprintf(stderr, "runSSSPWorker: %s could not load the graph\n", backend->getName());
+        close(fd);
+        return false;
+    }
+
+    bool succeeded = sendMessage(fd, CLUSTER_HELLO, -1, 0) && sendAll(fd, &hello, sizeof(hello));
+    bool served = false;
+    std::vector<int> sources;
+    std::vector<float> rows;
+    ClusterMessage message;
+    memset(&message, 0, sizeof(message));
+
+    // A connection closed by the coordinator after the first chunk means the
+    // job finished without this worker's last copy
+    while (succeeded && receiveAll(fd, &message, sizeof(message)) && message.type == CLUSTER_CHUNK)
+    {
+        sources.resize(message.count + 1);
+        rows.resize((size_t) message.count * graph->vertexCount + 1);
+        if (!receiveAll(fd, &sources[0], sizeof(int) * message.count))
+        {
+            break;
+        }
+
+        if (!session->run(&sources[0], &rows[0], message.count))
+        {
+            fprintf(stderr, "runSSSPWorker: %s failed\n", backend->getName());
+            succeeded = false;
+            break;
+        }
+
+        if (!sendMessage(fd, CLUSTER_RESULT, message.chunk, message.count) ||
+            !sendAll(fd, &rows[0], sizeof(float) * (size_t) message.count * graph->vertexCount))
+        {
+            break;
+        }
+        served = true;
+    }
+
+    if (message.type == CLUSTER_REJECT)
+    {
+        fprintf(stderr, "runSSSPWorker: %s:%d runs the job on another graph\n", host, port);
+        succeeded = false;
+    }
+    else if (succeeded && !served && message.type != CLUSTER_DONE)
+    {
+        fprintf(stderr, "runSSSPWorker: %s:%d closed the connection\n", host, port);
+        succeeded = false;
+    }
+
+    delete session;
+    close(fd);
+    return succeeded;
+}
@@ -0,0 +1,577 @@
+//
+//
+//  Description:
+//      Connected component index and the session that runs searches on their
+//      source's component only.  See dijkstraComponents.h.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <pthread.h>
+#include <algorithm>
+#include <vector>
+#include "dijkstraComponents.h"
+#include "dijkstraMemory.h"
+
+///
+//  Types
+//
+
+// Workload of one union-find thread of buildComponentIndex()
+typedef struct
+{
+    const GraphData *graph;
+
+    // Shared union-find forest, every root is the lowest vertex of its tree
+    volatile int *parent;
+
+    // Vertices whose out-edges this thread unites
+    int firstVertex;
+    int lastVertex;
+
+} UnionFindPlan;
+
+// Workload of the SCC thread of buildComponentIndex()
+typedef struct
+{
+    const GraphData *graph;
+    ComponentIndex *index;
+
+} TarjanPlan;
+
+// Sort order of orderSourcesByComponent(), by WCC size, then WCC
+struct ComponentOrder
+{
+    const ComponentIndex *index;
+    const int *sourceVertices;
+
+    bool operator()( int a, int b ) const
+    {
+        int componentA = index->wcc[sourceVertices[a]];
+        int componentB = index->wcc[sourceVertices[b]];
+        int sizeA = index->wccStart[componentA + 1] - index->wccStart[componentA];
+        int sizeB = index->wccStart[componentB + 1] - index->wccStart[componentB];
+
+        return (sizeA != sizeB) ? sizeA > sizeB : componentA < componentB;
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+///
+/// Root of a vertex in the union-find forest, halving the path on the way
+///
+static int findRoot( volatile int *parent, int v )
+{
+    for (;;)
+    {
+        int p = parent[v];
+        if (p == v)
+        {
+            return v;
+        }
+
+        int grandParent = parent[p];
+        if (grandParent != p)
+        {
+            // Skipping to an ancestor is always safe, even if another thread
+            // changed parent[v] in the meantime
+            __sync_bool_compare_and_swap(&parent[v], p, grandParent);
+        }
+        v = grandParent;
+    }
+}
+
+///
+/// Merge the trees of two vertices by hanging the higher root under the lower
+///
+static void uniteRoots( volatile int *parent, int a, int b )
+{
+    for (;;)
+    {
+        a = findRoot(parent, a);
+        b = findRoot(parent, b);
+        if (a == b)
+        {
+            return;
+        }
+
+        if (a < b)
+        {
+            int t = a;
+            a = b;
+            b = t;
+        }
+
+        // Fails if a stopped being a root, then retry from the new roots
+        if (__sync_bool_compare_and_swap(&parent[a], a, b))
+        {
+            return;
+        }
+    }
+}
+
+///
+/// Union-find thread of buildComponentIndex()
+///
+static void *unionFindThread( void *arg )
+{
+    UnionFindPlan *plan = (UnionFindPlan*) arg;
+    const GraphData *graph = plan->graph;
+
+    for (int v = plan->firstVertex; v < plan->lastVertex; v++)
+    {
+        int edgeEnd = graphEdgeEnd(graph, v);
+        for (int edge = graph->vertexArray[v]; edge < edgeEnd; edge++)
+        {
+            uniteRoots(plan->parent, v, graph->edgeArray[edge]);
+        }
+    }
+
+    return NULL;
+}
+
+///
+/// SCC thread of buildComponentIndex(), Tarjan's algorithm with an explicit
+/// call stack
+///
+static void *tarjanThread( void *arg )
+{
+    TarjanPlan *plan = (TarjanPlan*) arg;
+    const GraphData *graph = plan->graph;
+    ComponentIndex *index = plan->index;
+    int vertexCount = graph->vertexCount;
+
+    std::vector<int> order(vertexCount, -1);
+    std::vector<int> low(vertexCount, 0);
+    std::vector<bool> onStack(vertexCount, false);
+    std::vector<int> stack;
+    std::vector<int> callVertex;
+    std::vector<int> callEdge;
+    std::vector<int> sizes;
+    int nextOrder = 0;
+
+    for (int root = 0; root < vertexCount; root++)
+    {
+        if (order[root] >= 0)
+        {
+            continue;
+        }
+
+        order[root] = low[root] = nextOrder++;
+        stack.push_back(root);
+        onStack[root] = true;
+        callVertex.push_back(root);
+        callEdge.push_back(graph->vertexArray[root]);
+
+        while (!callVertex.empty())
+        {
+            int v = callVertex.back();
+            int edge = callEdge.back();
+
+            if (edge < graphEdgeEnd(graph, v))
+            {
+                callEdge.back() = edge + 1;
+
+                int w = graph->edgeArray[edge];
+                if (order[w] < 0)
+                {
+                    order[w] = low[w] = nextOrder++;
+                    stack.push_back(w);
+                    onStack[w] = true;
+                    callVertex.push_back(w);
+                    callEdge.push_back(graph->vertexArray[w]);
+                }
+                else if (onStack[w] && order[w] < low[v])
+                {
+                    low[v] = order[w];
+                }
+                continue;
+            }
+
+            // All edges of v done, pop it and close its SCC if it is the root
+            callVertex.pop_back();
+            callEdge.pop_back();
+            if (!callVertex.empty() && low[v] < low[callVertex.back()])
+            {
+                low[callVertex.back()] = low[v];
+            }
+
+            if (low[v] == order[v])
+            {
+                int component = (int) sizes.size();
+                int size = 0;
+                int w;
+                do
+                {
+                    w = stack.back();
+                    stack.pop_back();
+                    onStack[w] = false;
+                    index->scc[w] = component;
+                    size++;
+                } while (w != v);
+
+                sizes.push_back(size);
+            }
+        }
+    }
+
+    index->sccCount = (int) sizes.size();
+    index->sccSize = (int*) trackedMalloc(MEMORY_PREPROCESSING, sizeof(int) * (sizes.empty() ? 1 : sizes.size()));
+    if (!sizes.empty())
+    {
+        memcpy(index->sccSize, &sizes[0], sizeof(int) * sizes.size());
+    }
+
+    return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Component session
+//
+//
+
+//
+//  Runs each search on the subgraph of its source's WCC.  Subgraphs and their
+//  sessions are built on first use and kept for the lifetime of the session.
+//  A WCC that spans the whole graph runs on the graph itself.
+//
+class ComponentSession : public SSSPSession
+{
+public:
+    ComponentSession(SSSPBackend *backend, const GraphData *graph, const ComponentIndex *index) :
+        backend(backend),
+        graph(graph),
+        index(index),
+        subgraphs(index->wccCount),
+        sessions(index->wccCount, (SSSPSession*) NULL)
+    {
+        if (!subgraphs.empty())
+        {
+            memset(&subgraphs[0], 0, sizeof(GraphData) * subgraphs.size());
+        }
+    }
+
+    virtual ~ComponentSession()
+    {
+        for (int c = 0; c < index->wccCount; c++)
+        {
+            delete sessions[c];
+            if (subgraphs[c].vertexArray != NULL)
+            {
+                freeGraph(&subgraphs[c]);
+            }
+        }
+    }
+
+    virtual bool run( const int *sourceVertices, float *outResultCosts, int numResults )
+    {
+        if (numResults <= 0)
+        {
+            return true;
+        }
+
+        order.resize(numResults);
+        orderSourcesByComponent(index, sourceVertices, numResults, &order[0]);
+
+        int first = 0;
+        while (first < numResults)
+        {
+            int component = index->wcc[sourceVertices[order[first]]];
+            int last = first + 1;
+            while (last < numResults && index->wcc[sourceVertices[order[last]]] == component)
+            {
+                last++;
+            }
+
+            if (!runComponent(component, sourceVertices, outResultCosts, first, last))
+            {
+                return false;
+            }
+            first = last;
+        }
+
+        return true;
+    }
+
+private:
+    ///
+    /// Run the sources order[first .. last), all in one WCC
+    ///
+    bool runComponent( int component, const int *sourceVertices, float *outResultCosts,
+                       int first, int last )
+    {
+        int count = last - first;
+        int size = index->wccStart[component + 1] - index->wccStart[component];
+        const int *vertices = &index->wccVertices[index->wccStart[component]];
+
+        for (int n = first; n < last; n++)
+        {
+            float *costArray = &outResultCosts[(size_t) order[n] * graph->vertexCount];
+            if (size < graph->vertexCount)
+            {
+                for (int v = 0; v < graph->vertexCount; v++)
+                {
+                    costArray[v] = FLT_MAX;
+                }
+            }
+            costArray[sourceVertices[order[n]]] = 0.0f;
+        }
+
+        if (size == 1)
+        {
+            return true;
+        }
+
+        SSSPSession *session = getSession(component);
+        if (session == NULL)
+        {
+            return false;
+        }
+
+        // A WCC that spans the whole graph holds every source of the batch in
+        // their original order, so the batch runs in place
+        if (size == graph->vertexCount)
+        {
+            return session->run(sourceVertices, outResultCosts, count);
+        }
+
+        localSources.resize(count);
+        for (int n = 0; n < count; n++)
+        {
+            localSources[n] = index->wccLocalVertex[sourceVertices[order[first + n]]];
+        }
+
+        localCosts.resize((size_t) count * size);
+        if (!session->run(&localSources[0], &localCosts[0], count))
+        {
+            return false;
+        }
+
+        for (int n = 0; n < count; n++)
+        {
+            float *costArray = &outResultCosts[(size_t) order[first + n] * graph->vertexCount];
+            const float *local = &localCosts[(size_t) n * size];
+            for (int v = 0; v < size; v++)
+            {
+                costArray[vertices[v]] = local[v];
+            }
+        }
+
+        return true;
+    }
+
+    ///
+    /// Session of a WCC, created with its subgraph on first use
+    ///
+    SSSPSession *getSession( int component )
+    {
+        if (sessions[component] != NULL)
+        {
+            return sessions[component];
+        }
+
+        int size = index->wccStart[component + 1] - index->wccStart[component];
+        if (size == graph->vertexCount)
+        {
+            sessions[component] = backend->createSession(graph);
+            return sessions[component];
+        }
+
+        const int *vertices = &index->wccVertices[index->wccStart[component]];
+        int edgeCount = 0;
+        for (int v = 0; v < size; v++)
+        {
+            edgeCount += graphEdgeEnd(graph, vertices[v]) - graph->vertexArray[vertices[v]];
+        }
+
+        GraphData *subgraph = &subgraphs[component];
+        allocateGraph(subgraph, size, edgeCount);
+
+        int localEdge = 0;
+        for (int v = 0; v < size; v++)
+        {
+            subgraph->vertexArray[v] = localEdge;
+
+            int edgeEnd = graphEdgeEnd(graph, vertices[v]);
+            for (int edge = graph->vertexArray[vertices[v]]; edge < edgeEnd; edge++)
+            {
+                subgraph->edgeArray[localEdge] = index->wccLocalVertex[graph->edgeArray[edge]];
+                subgraph->weightArray[localEdge] = graph->weightArray[edge];
+                localEdge++;
+            }
+        }
+
+        sessions[component] = backend->createSession(subgraph);
+        return sessions[component];
+    }
+
+    SSSPBackend *backend;
+    const GraphData *graph;
+    const ComponentIndex *index;
+
+    // Per WCC, built on first use
+    std::vector<GraphData> subgraphs;
+    std::vector<SSSPSession*> sessions;
+
+    // Scratch kept between runs so its storage is reused
+    std::vector<int> order;
+    std::vector<int> localSources;
+    std::vector<float> localCosts;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+/// Find the weakly and strongly connected components of a graph
+///
+void buildComponentIndex( const GraphData *graph, int threadCount, ComponentIndex *outIndex )
+{
+    int vertexCount = graph->vertexCount;
+    size_t vertexSlots = (vertexCount > 0) ? vertexCount : 1;
+    if (threadCount < 1)
+    {
+        threadCount = 1;
+    }
+
+    outIndex->vertexCount = vertexCount;
+    outIndex->wcc = (int*) trackedMalloc(MEMORY_PREPROCESSING, sizeof(int) * vertexSlots);
+    outIndex->wccLocalVertex = (int*) trackedMalloc(MEMORY_PREPROCESSING, sizeof(int) * vertexSlots);
+    outIndex->wccVertices = (int*) trackedMalloc(MEMORY_PREPROCESSING, sizeof(int) * vertexSlots);
+    outIndex->scc = (int*) trackedMalloc(MEMORY_PREPROCESSING, sizeof(int) * vertexSlots);
+
+    // SCCs on their own thread, WCCs on the others
+    TarjanPlan tarjanPlan;
+    tarjanPlan.graph = graph;
+    tarjanPlan.index = outIndex;
+    pthread_t tarjanThreadID;
+    pthread_create(&tarjanThreadID, NULL, tarjanThread, &tarjanPlan);
+
+    volatile int *parent = (volatile int*) malloc(sizeof(int) * vertexSlots);
+    for (int v = 0; v < vertexCount; v++)
+    {
+        parent[v] = v;
+    }
+
+    UnionFindPlan *plans = (UnionFindPlan*) malloc(sizeof(UnionFindPlan) * threadCount);
+    pthread_t *threadIDs = (pthread_t*) malloc(sizeof(pthread_t) * threadCount);
+    for (int i = 0; i < threadCount; i++)
+    {
+        plans[i].graph = graph;
+        plans[i].parent = parent;
+        plans[i].firstVertex = (int) ((long long) vertexCount * i / threadCount);
+        plans[i].lastVertex = (int) ((long long) vertexCount * (i + 1) / threadCount);
+
+        pthread_create(&threadIDs[i], NULL, unionFindThread, (void*)(plans + i));
+    }
+
+    for (int i = 0; i < threadCount; i++)
+    {
+        pthread_join(threadIDs[i], NULL);
+    }
+    free(plans);
+    free(threadIDs);
+
+    // Every root is the lowest vertex of its WCC, so numbering the roots in
+    // vertex order numbers the WCCs by their lowest vertex
+    std::vector<int> sizes;
+    for (int v = 0; v < vertexCount; v++)
+    {
+        int root = findRoot(parent, v);
+        if (root == v)
+        {
+            outIndex->wcc[v] = (int) sizes.size();
+            sizes.push_back(0);
+        }
+        else
+        {
+            outIndex->wcc[v] = outIndex->wcc[root];
+        }
+        outIndex->wccLocalVertex[v] = sizes[outIndex->wcc[v]]++;
+    }
+    free((void*) parent);
+
+    outIndex->wccCount = (int) sizes.size();
+    outIndex->wccStart = (int*) trackedMalloc(MEMORY_PREPROCESSING, sizeof(int) * (sizes.size() + 1));
+    outIndex->wccStart[0] = 0;
+    for (int c = 0; c < outIndex->wccCount; c++)
+    {
+        outIndex->wccStart[c + 1] = outIndex->wccStart[c] + sizes[c];
+    }
+
+    for (int v = 0; v < vertexCount; v++)
+    {
+        int c = outIndex->wcc[v];
+        outIndex->wccVertices[outIndex->wccStart[c] + outIndex->wccLocalVertex[v]] = v;
+    }
+
+    pthread_join(tarjanThreadID, NULL);
+}
+
+///
+/// Free everything allocated by buildComponentIndex()
+///
+void freeComponentIndex( ComponentIndex *index )
+{
+    trackedFree(index->wcc);
+    trackedFree(index->wccStart);
+    trackedFree(index->wccVertices);
+    trackedFree(index->wccLocalVertex);
+    trackedFree(index->scc);
+    trackedFree(index->sccSize);
+    memset(index, 0, sizeof(ComponentIndex));
+}
+
+///
+/// Whether source can reach target
+///
+SSSPReachability componentReachability( const ComponentIndex *index, int source, int target )
+{
+    if (index->wcc[source] != index->wcc[target] || index->scc[target] > index->scc[source])
+    {
+        return SSSP_UNREACHABLE;
+    }
+
+    if (index->scc[target] == index->scc[source])
+    {
+        return SSSP_REACHABLE;
+    }
+
+    return SSSP_MAYBE_REACHABLE;
+}
+
+///
+/// Order a batch of sources by WCC, largest WCC first
+///
+void orderSourcesByComponent( const ComponentIndex *index, const int *sourceVertices,
+                              int numSources, int *outOrder )
+{
+    for (int i = 0; i < numSources; i++)
+    {
+        outOrder[i] = i;
+    }
+
+    ComponentOrder compare = { index, sourceVertices };
+    std::stable_sort(outOrder, outOrder + numSources, compare);
+}
+
+///
+/// Bind a graph and its component index to a backend
+///
+SSSPSession *createComponentSession( SSSPBackend *backend, const GraphData *graph,
+                                     const ComponentIndex *index )
+{
+    return new ComponentSession(backend, graph, index);
+}
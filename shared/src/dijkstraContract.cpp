@@ -0,0 +1,550 @@
+//
+//
+//  Description:
+//      Degree-2 chain contraction and the session that runs any backend on the
+//      reduced graph.  See dijkstraContract.h.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <vector>
+#include "dijkstraContract.h"
+#include "dijkstraMemory.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+///
+/// Whether a vertex only continues a path: one in-edge and one out-edge to two
+/// other vertices, or in- and out-edges to the same two other vertices
+///
+static bool isChainVertex( const GraphData *graph, const GraphData *reverse, int v, bool *outTwoWay )
+{
+    int outBegin = graph->vertexArray[v];
+    int outCount = graphEdgeEnd(graph, v) - outBegin;
+    int inBegin = reverse->vertexArray[v];
+    int inCount = graphEdgeEnd(reverse, v) - inBegin;
+
+    if (outCount == 1 && inCount == 1)
+    {
+        int to = graph->edgeArray[outBegin];
+        int from = reverse->edgeArray[inBegin];
+
+        *outTwoWay = false;
+        return to != v && from != v && to != from;
+    }
+
+    if (outCount == 2 && inCount == 2)
+    {
+        int to0 = graph->edgeArray[outBegin];
+        int to1 = graph->edgeArray[outBegin + 1];
+        int from0 = reverse->edgeArray[inBegin];
+        int from1 = reverse->edgeArray[inBegin + 1];
+
+        *outTwoWay = true;
+        return to0 != v && to1 != v && to0 != to1 &&
+               ((from0 == to0 && from1 == to1) || (from0 == to1 && from1 == to0));
+    }
+
+    return false;
+}
+
+///
+/// Weight of the edge from -> to, which must exist
+///
+static float edgeWeight( const GraphData *graph, int from, int to )
+{
+    int edgeEnd = graphEdgeEnd(graph, from);
+    for (int edge = graph->vertexArray[from]; edge < edgeEnd; edge++)
+    {
+        if (graph->edgeArray[edge] == to)
+        {
+            return graph->weightArray[edge];
+        }
+    }
+
+    return FLT_MAX;
+}
+
+///
+/// Walk the chain entered from kept vertex start along an edge to interior
+/// vertex first, until the next kept vertex
+///
+static void walkChain( const GraphData *graph, const std::vector<bool> &interior,
+                       const std::vector<bool> &twoWay, int start, int first, float firstWeight,
+                       ContractedGraph *contracted, std::vector<int> &interiorVertices,
+                       std::vector<ContractedChain> &chains )
+{
+    ContractedChain chain;
+    chain.startVertex = start;
+    chain.firstInterior = (int) interiorVertices.size();
+    chain.twoWay = twoWay[first];
+
+    int chainIndex = (int) chains.size();
+    int prev = start;
+    int cur = first;
+    double forward = firstWeight;
+    double backward = chain.twoWay ? edgeWeight(graph, first, start) : FLT_MAX;
+
+    while (interior[cur])
+    {
+        contracted->vertexChain[cur] = chainIndex;
+        contracted->costFromStart[cur] = forward;
+        contracted->costToStart[cur] = backward;
+        interiorVertices.push_back(cur);
+
+        // The out-edge that does not lead back
+        int edge = graph->vertexArray[cur];
+        if (graph->edgeArray[edge] == prev && chain.twoWay)
+        {
+            edge++;
+        }
+
+        int next = graph->edgeArray[edge];
+        forward += graph->weightArray[edge];
+        if (chain.twoWay)
+        {
+            backward += edgeWeight(graph, next, cur);
+        }
+
+        prev = cur;
+        cur = next;
+    }
+
+    chain.endVertex = cur;
+    chain.interiorCount = (int) interiorVertices.size() - chain.firstInterior;
+    chain.forwardLength = forward;
+    chain.backwardLength = backward;
+    chains.push_back(chain);
+}
+
+///
+/// Walk every chain leaving a kept vertex that has not been walked yet
+///
+static void walkChainsFrom( const GraphData *graph, const std::vector<bool> &interior,
+                            const std::vector<bool> &twoWay, int start,
+                            ContractedGraph *contracted, std::vector<int> &interiorVertices,
+                            std::vector<ContractedChain> &chains )
+{
+    int edgeEnd = graphEdgeEnd(graph, start);
+    for (int edge = graph->vertexArray[start]; edge < edgeEnd; edge++)
+    {
+        int first = graph->edgeArray[edge];
+        if (interior[first] && contracted->vertexChain[first] < 0)
+        {
+            walkChain(graph, interior, twoWay, start, first, graph->weightArray[edge],
+                      contracted, interiorVertices, chains);
+        }
+    }
+}
+
+///
+/// Cost of an interior vertex given the costs of its chain's end vertices
+///
+static float chainVertexCost( const ContractedGraph *contracted, const ContractedChain *chain,
+                              int vertex, float startCost, float endCost )
+{
+    float cost = FLT_MAX;
+    if (startCost != FLT_MAX)
+    {
+        cost = (float) (startCost + contracted->costFromStart[vertex]);
+    }
+
+    if (chain->twoWay && endCost != FLT_MAX)
+    {
+        float fromEnd = (float) (endCost + (chain->backwardLength - contracted->costToStart[vertex]));
+        if (fromEnd < cost)
+        {
+            cost = fromEnd;
+        }
+    }
+
+    return cost;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Contracted session
+//
+//
+
+//
+//  Runs the wrapped backend's session on the reduced graph.  A kept source is
+//  one search on the reduced graph; a source on a chain is a search from each
+//  end vertex it can reach along the chain, combined with the cost of getting
+//  there.  Every result is expanded to the original graph afterwards.
+//
+class ContractedSession : public SSSPSession
+{
+public:
+    ContractedSession(const ContractedGraph *contracted, SSSPSession *reducedSession) :
+        contracted(contracted),
+        reducedSession(reducedSession)
+    {
+    }
+
+    virtual ~ContractedSession()
+    {
+        delete reducedSession;
+    }
+
+    virtual bool run( const int *sourceVertices, float *outResultCosts, int numResults )
+    {
+        const GraphData *reduced = &contracted->graph;
+
+        // Reduced sources of each source: the vertex itself, or the chain's end
+        // vertex and, for two-way chains, its start vertex
+        reducedSources.clear();
+        for (int i = 0; i < numResults; i++)
+        {
+            int source = sourceVertices[i];
+            int chainIndex = contracted->vertexChain[source];
+            if (chainIndex < 0)
+            {
+                reducedSources.push_back(contracted->reducedVertex[source]);
+                continue;
+            }
+
+            const ContractedChain *chain = &contracted->chains[chainIndex];
+            reducedSources.push_back(contracted->reducedVertex[chain->endVertex]);
+            if (chain->twoWay)
+            {
+                reducedSources.push_back(contracted->reducedVertex[chain->startVertex]);
+            }
+        }
+
+        reducedCosts.resize(reducedSources.size() * reduced->vertexCount);
+        if (!reducedSources.empty() &&
+            !reducedSession->run(&reducedSources[0], &reducedCosts[0], (int) reducedSources.size()))
+        {
+            return false;
+        }
+
+        combinedCosts.resize(reduced->vertexCount);
+        const float *searchCosts = reducedSources.empty() ? NULL : &reducedCosts[0];
+        for (int i = 0; i < numResults; i++)
+        {
+            int source = sourceVertices[i];
+            float *costArray = &outResultCosts[(size_t) i * contracted->originalVertexCount];
+            int chainIndex = contracted->vertexChain[source];
+            if (chainIndex < 0)
+            {
+                expandContractedCosts(contracted, searchCosts, costArray);
+                searchCosts += reduced->vertexCount;
+                continue;
+            }
+
+            const ContractedChain *chain = &contracted->chains[chainIndex];
+            double toEnd = chain->forwardLength - contracted->costFromStart[source];
+            for (int v = 0; v < reduced->vertexCount; v++)
+            {
+                combinedCosts[v] = (searchCosts[v] == FLT_MAX) ? FLT_MAX : (float) (toEnd + searchCosts[v]);
+            }
+            searchCosts += reduced->vertexCount;
+
+            if (chain->twoWay)
+            {
+                double toStart = contracted->costToStart[source];
+                for (int v = 0; v < reduced->vertexCount; v++)
+                {
+                    float viaStart = (float) (toStart + searchCosts[v]);
+                    if (searchCosts[v] != FLT_MAX && viaStart < combinedCosts[v])
+                    {
+                        combinedCosts[v] = viaStart;
+                    }
+                }
+                searchCosts += reduced->vertexCount;
+            }
+
+            expandContractedCosts(contracted, &combinedCosts[0], costArray);
+
+            // Vertices of the source's own chain can also be reached directly
+            const int *chainVertices = &contracted->interiorVertices[chain->firstInterior];
+            int position = 0;
+            while (chainVertices[position] != source)
+            {
+                position++;
+            }
+
+            for (int n = 0; n < chain->interiorCount; n++)
+            {
+                int vertex = chainVertices[n];
+                float direct = FLT_MAX;
+                if (n > position)
+                {
+                    direct = (float) (contracted->costFromStart[vertex] - contracted->costFromStart[source]);
+                }
+                else if (n < position && chain->twoWay)
+                {
+                    direct = (float) (contracted->costToStart[source] - contracted->costToStart[vertex]);
+                }
+                else if (n == position)
+                {
+                    direct = 0.0f;
+                }
+
+                if (direct < costArray[vertex])
+                {
+                    costArray[vertex] = direct;
+                }
+            }
+        }
+
+        return true;
+    }
+
+private:
+    const ContractedGraph *contracted;
+    SSSPSession *reducedSession;
+
+    // Scratch kept between runs so its storage is reused
+    std::vector<int> reducedSources;
+    std::vector<float> reducedCosts;
+    std::vector<float> combinedCosts;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+/// Contract every chain of degree-2 vertices of a graph
+///
+void contractGraph( const GraphData *graph, const int *keepVertices, int keepCount,
+                    ContractedGraph *outContracted )
+{
+    int vertexCount = graph->vertexCount;
+    outContracted->originalVertexCount = vertexCount;
+    outContracted->originalEdgeCount = graph->edgeCount;
+
+    size_t vertexSlots = (vertexCount > 0) ? vertexCount : 1;
+    outContracted->reducedVertex = (int*) trackedMalloc(MEMORY_PREPROCESSING, sizeof(int) * vertexSlots);
+    outContracted->vertexChain = (int*) trackedMalloc(MEMORY_PREPROCESSING, sizeof(int) * vertexSlots);
+    outContracted->costFromStart = (double*) trackedMalloc(MEMORY_PREPROCESSING, sizeof(double) * vertexSlots);
+    outContracted->costToStart = (double*) trackedMalloc(MEMORY_PREPROCESSING, sizeof(double) * vertexSlots);
+
+    // Classify the vertices
+    GraphData reverse;
+    buildReverseGraph(graph, &reverse);
+
+    std::vector<bool> interior(vertexCount, false);
+    std::vector<bool> twoWay(vertexCount, false);
+    for (int v = 0; v < vertexCount; v++)
+    {
+        bool vertexTwoWay = false;
+        interior[v] = isChainVertex(graph, &reverse, v, &vertexTwoWay);
+        twoWay[v] = vertexTwoWay;
+        outContracted->vertexChain[v] = -1;
+        outContracted->costFromStart[v] = 0.0;
+        outContracted->costToStart[v] = 0.0;
+    }
+    freeGraph(&reverse);
+
+    for (int k = 0; k < keepCount; k++)
+    {
+        interior[keepVertices[k]] = false;
+    }
+
+    // Walk the chains from the kept vertices, then break the cycles made only
+    // of chain vertices by keeping their first vertex
+    std::vector<int> interiorVertices;
+    std::vector<ContractedChain> chains;
+    for (int v = 0; v < vertexCount; v++)
+    {
+        if (!interior[v])
+        {
+            walkChainsFrom(graph, interior, twoWay, v, outContracted, interiorVertices, chains);
+        }
+    }
+
+    for (int v = 0; v < vertexCount; v++)
+    {
+        if (interior[v] && outContracted->vertexChain[v] < 0)
+        {
+            interior[v] = false;
+            walkChainsFrom(graph, interior, twoWay, v, outContracted, interiorVertices, chains);
+        }
+    }
+
+    // Number the kept vertices and count the reduced edges, one per copied
+    // edge or chain end
+    int reducedCount = 0;
+    int reducedEdgeCount = 0;
+    for (int v = 0; v < vertexCount; v++)
+    {
+        outContracted->reducedVertex[v] = interior[v] ? -1 : reducedCount++;
+        if (!interior[v])
+        {
+            reducedEdgeCount += graphEdgeEnd(graph, v) - graph->vertexArray[v];
+        }
+    }
+
+    GraphData *reduced = &outContracted->graph;
+    allocateGraph(reduced, reducedCount, reducedEdgeCount);
+    outContracted->edgeChain = (int*) trackedMalloc(MEMORY_PREPROCESSING,
+                                                    sizeof(int) * (reducedEdgeCount > 0 ? reducedEdgeCount : 1));
+    outContracted->originalVertex = (int*) trackedMalloc(MEMORY_PREPROCESSING,
+                                                         sizeof(int) * (reducedCount > 0 ? reducedCount : 1));
+
+    int reducedEdge = 0;
+    for (int v = 0; v < vertexCount; v++)
+    {
+        int reducedV = outContracted->reducedVertex[v];
+        if (reducedV < 0)
+        {
+            continue;
+        }
+
+        outContracted->originalVertex[reducedV] = v;
+        reduced->vertexArray[reducedV] = reducedEdge;
+
+        int edgeEnd = graphEdgeEnd(graph, v);
+        for (int edge = graph->vertexArray[v]; edge < edgeEnd; edge++)
+        {
+            int to = graph->edgeArray[edge];
+            int chainIndex = outContracted->vertexChain[to];
+            if (chainIndex < 0)
+            {
+                reduced->edgeArray[reducedEdge] = outContracted->reducedVertex[to];
+                reduced->weightArray[reducedEdge] = graph->weightArray[edge];
+                outContracted->edgeChain[reducedEdge] = -1;
+            }
+            else if (chains[chainIndex].startVertex == v &&
+                     interiorVertices[chains[chainIndex].firstInterior] == to)
+            {
+                reduced->edgeArray[reducedEdge] = outContracted->reducedVertex[chains[chainIndex].endVertex];
+                reduced->weightArray[reducedEdge] = (float) chains[chainIndex].forwardLength;
+                outContracted->edgeChain[reducedEdge] = chainIndex;
+            }
+            else
+            {
+                reduced->edgeArray[reducedEdge] = outContracted->reducedVertex[chains[chainIndex].startVertex];
+                reduced->weightArray[reducedEdge] = (float) chains[chainIndex].backwardLength;
+                outContracted->edgeChain[reducedEdge] = -2 - chainIndex;
+            }
+            reducedEdge++;
+        }
+    }
+
+    outContracted->chainCount = (int) chains.size();
+    size_t chainSlots = chains.empty() ? 1 : chains.size();
+    size_t interiorSlots = interiorVertices.empty() ? 1 : interiorVertices.size();
+    outContracted->chains = (ContractedChain*) trackedMalloc(MEMORY_PREPROCESSING, sizeof(ContractedChain) * chainSlots);
+    outContracted->interiorVertices = (int*) trackedMalloc(MEMORY_PREPROCESSING, sizeof(int) * interiorSlots);
+    if (!chains.empty())
+    {
+        memcpy(outContracted->chains, &chains[0], sizeof(ContractedChain) * chains.size());
+        memcpy(outContracted->interiorVertices, &interiorVertices[0], sizeof(int) * interiorVertices.size());
+    }
+}
+
+///
+/// Free everything allocated by contractGraph()
+///
+void freeContractedGraph( ContractedGraph *contracted )
+{
+    freeGraph(&contracted->graph);
+    trackedFree(contracted->reducedVertex);
+    trackedFree(contracted->originalVertex);
+    trackedFree(contracted->vertexChain);
+    trackedFree(contracted->costFromStart);
+    trackedFree(contracted->costToStart);
+    trackedFree(contracted->edgeChain);
+    trackedFree(contracted->interiorVertices);
+    trackedFree(contracted->chains);
+    memset(contracted, 0, sizeof(ContractedGraph));
+}
+
+///
+/// Fill in the costs of the interior vertices of a search from a kept vertex
+///
+void expandContractedCosts( const ContractedGraph *contracted, const float *reducedCosts,
+                            float *outCosts )
+{
+    for (int v = 0; v < contracted->graph.vertexCount; v++)
+    {
+        outCosts[contracted->originalVertex[v]] = reducedCosts[v];
+    }
+
+    for (int c = 0; c < contracted->chainCount; c++)
+    {
+        const ContractedChain *chain = &contracted->chains[c];
+        float startCost = reducedCosts[contracted->reducedVertex[chain->startVertex]];
+        float endCost = reducedCosts[contracted->reducedVertex[chain->endVertex]];
+
+        const int *chainVertices = &contracted->interiorVertices[chain->firstInterior];
+        for (int n = 0; n < chain->interiorCount; n++)
+        {
+            outCosts[chainVertices[n]] = chainVertexCost(contracted, chain, chainVertices[n],
+                                                         startCost, endCost);
+        }
+    }
+}
+
+///
+/// Original vertices along one edge of the reduced graph
+///
+int unpackContractedEdge( const ContractedGraph *contracted, int reducedEdge,
+                          int *outVertices, int maxVertices )
+{
+    int chainIndex = contracted->edgeChain[reducedEdge];
+    if (chainIndex == -1)
+    {
+        return 0;
+    }
+
+    bool backward = chainIndex < -1;
+    if (backward)
+    {
+        chainIndex = -2 - chainIndex;
+    }
+
+    const ContractedChain *chain = &contracted->chains[chainIndex];
+    const int *chainVertices = &contracted->interiorVertices[chain->firstInterior];
+    for (int n = 0; n < chain->interiorCount && n < maxVertices; n++)
+    {
+        outVertices[n] = backward ? chainVertices[chain->interiorCount - 1 - n] : chainVertices[n];
+    }
+
+    return chain->interiorCount;
+}
+
+///
+/// Bind a contracted graph to a backend
+///
+SSSPSession *createContractedSession( SSSPBackend *backend, const ContractedGraph *contracted )
+{
+    SSSPSession *reducedSession = backend->createSession(&contracted->graph);
+    if (reducedSession == NULL)
+    {
+        return NULL;
+    }
+
+    return new ContractedSession(contracted, reducedSession);
+}
+
+///
+/// Run one batch through a temporary contracted session
+///
+bool runSSSPContracted( SSSPBackend *backend, const ContractedGraph *contracted,
+                        const int *sourceVertices, float *outResultCosts, int numResults )
+{
+    SSSPSession *session = createContractedSession(backend, contracted);
+    if (session == NULL)
+    {
+        return false;
+    }
+
+    bool succeeded = session->run(sourceVertices, outResultCosts, numResults);
+    delete session;
+
+    return succeeded;
+}
@@ -0,0 +1,87 @@
+//
+//
+//  Description:
+//      Push/pull direction policy shared by the frontier SSSP engines.  See
+//      dijkstraDirection.h.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <stdio.h>
+#include "dijkstraDirection.h"
+
+///
+//  Globals
+//
+static SSSPDirectionPolicy directionPolicy = { 2.0f, 4.0f, false };
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+/// Set the policy used by engines created from now on
+///
+void setSSSPDirectionPolicy( const SSSPDirectionPolicy *policy )
+{
+    directionPolicy = *policy;
+}
+
+///
+/// Current policy
+///
+SSSPDirectionPolicy getSSSPDirectionPolicy()
+{
+    return directionPolicy;
+}
+
+///
+/// Direction of the next iteration
+///
+SSSPDirection chooseSSSPDirection( const SSSPDirectionPolicy *policy, const GraphData *graph,
+                                   SSSPDirection current, const char *engineName, int iteration,
+                                   int frontierVertices, long long frontierEdges )
+{
+    SSSPDirection next = current;
+    if (current == SSSP_PUSH && frontierEdges * policy->pullFactor > graph->edgeCount)
+    {
+        next = SSSP_PULL;
+    }
+    else if (current == SSSP_PULL && frontierVertices * policy->pushFactor < graph->vertexCount)
+    {
+        next = SSSP_PUSH;
+    }
+
+    if (next != current && policy->logSwitches)
+    {
+        printf("%s: iteration %d %s -> %s, frontier %d of %d vertices, %lld of %d edges\n",
+               engineName, iteration, (current == SSSP_PUSH) ? "push" : "pull",
+               (next == SSSP_PUSH) ? "push" : "pull",
+               frontierVertices, graph->vertexCount, frontierEdges, graph->edgeCount);
+    }
+
+    return next;
+}
+
+///
+/// Number of out-edges of the vertices in a frontier
+///
+long long frontierEdgeCount( const GraphData *graph, const FrontierWord *frontier, int wordCount )
+{
+    long long edges = 0;
+    for (int word = 0; word < wordCount; word++)
+    {
+        FrontierWord bits = frontier[word];
+        while (bits != 0)
+        {
+            int vertex = (word << FRONTIER_WORD_SHIFT) + frontierWordLowestBit(bits);
+            bits &= bits - 1;
+
+            edges += graphEdgeEnd(graph, vertex) - graph->vertexArray[vertex];
+        }
+    }
+
+    return edges;
+}
@@ -0,0 +1,272 @@
+//
+//
+//  Description:
+//      Graph representation and CPU helpers shared by the CUDA, OpenCL and native
+//      CPU Dijkstra engines.  See dijkstraGraph.h.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <vector>
+#include "dijkstraGraph.h"
+#include "dijkstraFrontier.h"
+#include "dijkstraMemory.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+/// Allocate the arrays of a graph
+///
+void allocateGraph( GraphData *graph, int vertexCount, int edgeCount )
+{
+    graph->vertexCount = vertexCount;
+    graph->edgeCount = edgeCount;
+    graph->vertexArray = (int*) trackedMalloc(MEMORY_GRAPH, sizeof(int) * vertexCount);
+    graph->edgeArray = (int*) trackedMalloc(MEMORY_GRAPH, sizeof(int) * edgeCount);
+    graph->weightArray = (float*) trackedMalloc(MEMORY_GRAPH, sizeof(float) * edgeCount);
+}
+
+///
+/// Generate a random graph
+///
+void generateRandomGraph( GraphData *graph, int numVertices, int neighborsPerVertex )
+{
+    allocateGraph(graph, numVertices, numVertices * neighborsPerVertex);
+
+    for(int i = 0; i < graph->vertexCount; i++)
+    {
+        graph->vertexArray[i] = i * neighborsPerVertex;
+    }
+
+    for(int i = 0; i < graph->edgeCount; i++)
+    {
+        graph->edgeArray[i] = (rand() % graph->vertexCount);
+        graph->weightArray[i] = (float)(rand() % 1000) / 1000.0f;
+    }
+}
+
+///
+/// Generate a road-like graph
+///
+void generateRoadGraph( GraphData *graph, int numVertices, int segmentsPerStreet )
+{
+    if (segmentsPerStreet < 1)
+    {
+        segmentsPerStreet = 1;
+    }
+
+    // Each intersection owns the streets to its right and below, and each
+    // street adds segmentsPerStreet - 1 vertices
+    int side = (int) sqrt((double) numVertices / (1 + 2 * (segmentsPerStreet - 1)));
+    if (side < 2)
+    {
+        side = 2;
+    }
+
+    int intersectionCount = side * side;
+    int streetCount = 2 * side * (side - 1);
+    int vertexCount = intersectionCount + streetCount * (segmentsPerStreet - 1);
+
+    std::vector< std::vector<int> > neighbors(vertexCount);
+    int nextVertex = intersectionCount;
+    for (int row = 0; row < side; row++)
+    {
+        for (int col = 0; col < side; col++)
+        {
+            int from = row * side + col;
+            for (int dir = 0; dir < 2; dir++)
+            {
+                if ((dir == 0 && col + 1 == side) || (dir == 1 && row + 1 == side))
+                {
+                    continue;
+                }
+
+                int to = (dir == 0) ? from + 1 : from + side;
+                int prev = from;
+                for (int segment = 1; segment < segmentsPerStreet; segment++)
+                {
+                    neighbors[prev].push_back(nextVertex);
+                    neighbors[nextVertex].push_back(prev);
+                    prev = nextVertex++;
+                }
+                neighbors[prev].push_back(to);
+                neighbors[to].push_back(prev);
+            }
+        }
+    }
+
+    allocateGraph(graph, vertexCount, 2 * streetCount * segmentsPerStreet);
+
+    int edge = 0;
+    for (int v = 0; v < vertexCount; v++)
+    {
+        graph->vertexArray[v] = edge;
+        for (size_t n = 0; n < neighbors[v].size(); n++)
+        {
+            graph->edgeArray[edge] = neighbors[v][n];
+            graph->weightArray[edge] = (float)(rand() % 1000 + 1) / 1000.0f;
+            edge++;
+        }
+    }
+}
+
+///
+/// Build the reverse graph with a counting sort on the edge targets
+///
+void buildReverseGraph( const GraphData *graph, GraphData *outReverse )
+{
+    allocateGraph(outReverse, graph->vertexCount, graph->edgeCount);
+
+    // In-degree of each vertex, then its first in-edge
+    memset(outReverse->vertexArray, 0, sizeof(int) * graph->vertexCount);
+    for (int edge = 0; edge < graph->edgeCount; edge++)
+    {
+        outReverse->vertexArray[graph->edgeArray[edge]]++;
+    }
+
+    int offset = 0;
+    for (int v = 0; v < graph->vertexCount; v++)
+    {
+        int inDegree = outReverse->vertexArray[v];
+        outReverse->vertexArray[v] = offset;
+        offset += inDegree;
+    }
+
+    // Place the edges, keeping the sources of each vertex in ascending order
+    int *nextEdge = (int*) malloc(sizeof(int) * (graph->vertexCount > 0 ? graph->vertexCount : 1));
+    memcpy(nextEdge, outReverse->vertexArray, sizeof(int) * graph->vertexCount);
+    for (int u = 0; u < graph->vertexCount; u++)
+    {
+        int edgeEnd = graphEdgeEnd(graph, u);
+        for (int edge = graph->vertexArray[u]; edge < edgeEnd; edge++)
+        {
+            int slot = nextEdge[graph->edgeArray[edge]]++;
+            outReverse->edgeArray[slot] = u;
+            outReverse->weightArray[slot] = graph->weightArray[edge];
+        }
+    }
+    free(nextEdge);
+}
+
+///
+/// Free the arrays of a graph
+///
+void freeGraph( GraphData *graph )
+{
+    trackedFree(graph->vertexArray);
+    trackedFree(graph->edgeArray);
+    trackedFree(graph->weightArray);
+    memset(graph, 0, sizeof(GraphData));
+}
+
+///
+/// 64-bit FNV-1a checksum of a graph
+///
+unsigned long long graphChecksum( const GraphData *graph )
+{
+    const unsigned long long prime = 1099511628211ULL;
+    unsigned long long hash = 14695981039346656037ULL;
+
+    const void *arrays[] = { &graph->vertexCount, &graph->edgeCount,
+                             graph->vertexArray, graph->edgeArray, graph->weightArray };
+    size_t sizes[] = { sizeof(int), sizeof(int), sizeof(int) * graph->vertexCount,
+                       sizeof(int) * graph->edgeCount, sizeof(float) * graph->edgeCount };
+    for (int a = 0; a < 5; a++)
+    {
+        const unsigned char *bytes = (const unsigned char*) arrays[a];
+        for (size_t i = 0; i < sizes[a]; i++)
+        {
+            hash = (hash ^ bytes[i]) * prime;
+        }
+    }
+
+    return hash;
+}
+
+///
+/// CPU reference implementation of the frontier algorithm
+///
+void runDijkstraRef( const GraphData *graph, const int *sourceVertices,
+                     float *outResultCosts, int numResults )
+{
+
+    // Create the arrays needed for processing the algorithm
+    float *costArray = new float[graph->vertexCount];
+    float *updatingCostArray = new float[graph->vertexCount];
+    int maskWordCount = frontierWordCount(graph->vertexCount);
+    FrontierWord *maskArray = new FrontierWord[maskWordCount];
+
+    size_t stateBytes = sizeof(float) * 2 * graph->vertexCount + sizeof(FrontierWord) * maskWordCount;
+    chargeMemory(MEMORY_HOST, MEMORY_STATE, stateBytes);
+
+    for (int i = 0; i < numResults; i++)
+    {
+        // Initialize the buffer for this run
+        for (int v = 0; v < graph->vertexCount; v++)
+        {
+            costArray[v] = FLT_MAX;
+            updatingCostArray[v] = FLT_MAX;
+        }
+        costArray[sourceVertices[i]] = 0.0f;
+        updatingCostArray[sourceVertices[i]] = 0.0f;
+
+        memset(maskArray, 0, sizeof(FrontierWord) * maskWordCount);
+        frontierSet(maskArray, sourceVertices[i]);
+
+        while(!frontierEmpty(maskArray, maskWordCount))
+        {
+            // Equivalent of SSSP_KERNEL1(), only visiting the set bits of each word
+            for (int word = 0; word < maskWordCount; word++)
+            {
+                FrontierWord bits = maskArray[word];
+                maskArray[word] = 0;
+
+                while (bits != 0)
+                {
+                    int tid = (word << FRONTIER_WORD_SHIFT) + frontierWordLowestBit(bits);
+                    bits &= bits - 1;
+
+                    int edgeEnd = graphEdgeEnd(graph, tid);
+                    for(int edge = graph->vertexArray[tid]; edge < edgeEnd; edge++)
+                    {
+                        int nid = graph->edgeArray[edge];
+
+                        if (updatingCostArray[nid] > (costArray[tid] + graph->weightArray[edge]))
+                        {
+                            updatingCostArray[nid] = (costArray[tid] + graph->weightArray[edge]);
+                        }
+                    }
+                }
+            }
+
+            // Equivalent of SSSP_KERNEL2()
+            for (int tid = 0; tid < graph->vertexCount; tid++)
+            {
+                if (costArray[tid] > updatingCostArray[tid])
+                {
+                    costArray[tid] = updatingCostArray[tid];
+                    frontierSet(maskArray, tid);
+                }
+
+                updatingCostArray[tid] = costArray[tid];
+            }
+        }
+
+        // Copy the result back
+        memcpy(&outResultCosts[i * graph->vertexCount], costArray, sizeof(float) * graph->vertexCount);
+    }
+
+    // Free temporary computation buffers
+    delete [] costArray;
+    delete [] updatingCostArray;
+    delete [] maskArray;
+    releaseMemory(MEMORY_HOST, MEMORY_STATE, stateBytes);
+}
@@ -0,0 +1,525 @@
+//
+//
+//  Description:
+//      Pruned landmark (hub) labeling.  See dijkstraHubLabels.h.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <vector>
+#include "dijkstraHubLabels.h"
+#include "dijkstraMemory.h"
+
+///
+//  Constants
+//
+
+// Alignment of each array inside a labels file
+const size_t HUB_LABELS_ALIGNMENT = 64;
+
+///
+//  Types
+//
+
+// Heap entry, ordered by cost
+typedef std::pair<float, int> HeapEntry;
+
+// Vertex reached by a root's search and its cost
+typedef std::pair<int, float> LabelHit;
+
+// Labels while they are being built
+typedef std::vector< std::vector<HubLabelEntry> > LabelLists;
+
+// Header at the start of a labels file, followed by the arrays at the given
+// byte offsets
+typedef struct
+{
+    // Must be HUB_LABELS_MAGIC and HUB_LABELS_VERSION
+    unsigned int magic;
+    unsigned int version;
+
+    int vertexCount;
+    int reserved;
+
+    long long orderOffset;
+    long long labelStartOffset;
+    long long entriesOffset;
+    long long fileSize;
+
+} HubLabelsHeader;
+
+// Workload of one thread of a batch of buildHubLabels()
+typedef struct
+{
+    const GraphData *graph;
+    const GraphData *reverse;
+    const int *order;
+
+    // Labels of the earlier batches, read-only during a batch
+    const LabelLists *outLabels;
+    const LabelLists *inLabels;
+
+    // Ranks of the batch, taken one at a time through nextRank
+    int firstRank;
+    int lastRank;
+    volatile int *nextRank;
+
+    // Hits of each root of the batch, forward then backward
+    std::vector<LabelHit> *hits;
+
+    // Scratch of this thread: costs of the current search and of the root's
+    // own label by hub, FLT_MAX outside a search
+    std::vector<float> *cost;
+    std::vector<float> *rootCost;
+
+} HubLabelPlan;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+///
+/// Round a byte offset up to HUB_LABELS_ALIGNMENT
+///
+static size_t alignOffset(size_t offset)
+{
+    return (offset + HUB_LABELS_ALIGNMENT - 1) & ~(HUB_LABELS_ALIGNMENT - 1);
+}
+
+///
+/// Whether the arrays a labels file header points at are aligned, in order,
+/// and inside a file of fileSize bytes.  Each offset is bounded before it is
+/// subtracted from, so that no corrupt value can overflow the checks.
+///
+static bool validLabelsLayout(const HubLabelsHeader *header, long long fileSize)
+{
+    if (header->vertexCount < 0 || header->fileSize != fileSize)
+    {
+        return false;
+    }
+
+    long long orderSize = (long long) sizeof(int) * header->vertexCount;
+    long long labelStartSize = (long long) sizeof(long long) * (2LL * header->vertexCount + 1);
+    return header->orderOffset >= (long long) sizeof(HubLabelsHeader) && header->orderOffset <= fileSize &&
+           header->orderOffset % HUB_LABELS_ALIGNMENT == 0 &&
+           header->labelStartOffset >= header->orderOffset && header->labelStartOffset <= fileSize &&
+           header->labelStartOffset % HUB_LABELS_ALIGNMENT == 0 &&
+           header->labelStartOffset - header->orderOffset >= orderSize &&
+           header->entriesOffset >= header->labelStartOffset && header->entriesOffset <= fileSize &&
+           header->entriesOffset % HUB_LABELS_ALIGNMENT == 0 &&
+           header->entriesOffset - header->labelStartOffset >= labelStartSize;
+}
+
+///
+/// Whether the label of every vertex lies inside the entryCount entries
+///
+static bool validLabelStarts(const long long *labelStart, int vertexCount, long long entryCount)
+{
+    if (labelStart[0] != 0 || labelStart[2LL * vertexCount] != entryCount)
+    {
+        return false;
+    }
+    for (long long i = 0; i < 2LL * vertexCount; i++)
+    {
+        if (labelStart[i + 1] < labelStart[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+///
+/// Pruned Dijkstra search from root on graph.  A vertex v reached at cost d is
+/// pruned if rootLabel and targetLabels[v] already give d, otherwise it is
+/// appended to hits.
+///
+static void prunedSearch( const HubLabelPlan *plan, const GraphData *graph, int root,
+                          const std::vector<HubLabelEntry> &rootLabel,
+                          const LabelLists &targetLabels, std::vector<LabelHit> *hits )
+{
+    std::vector<float> &cost = *plan->cost;
+    std::vector<float> &rootCost = *plan->rootCost;
+    for (size_t i = 0; i < rootLabel.size(); i++)
+    {
+        rootCost[rootLabel[i].hub] = rootLabel[i].cost;
+    }
+
+    std::priority_queue<HeapEntry, std::vector<HeapEntry>, std::greater<HeapEntry> > heap;
+    std::vector<int> touched;
+
+    cost[root] = 0.0f;
+    touched.push_back(root);
+    heap.push(HeapEntry(0.0f, root));
+    while (!heap.empty())
+    {
+        HeapEntry top = heap.top();
+        heap.pop();
+
+        int vertex = top.second;
+        if (top.first > cost[vertex])
+        {
+            continue;
+        }
+
+        // A sum with FLT_MAX never drops to a finite cost
+        const std::vector<HubLabelEntry> &label = targetLabels[vertex];
+        bool covered = false;
+        for (size_t i = 0; i < label.size() && !covered; i++)
+        {
+            covered = rootCost[label[i].hub] + label[i].cost <= top.first;
+        }
+        if (covered)
+        {
+            continue;
+        }
+        hits->push_back(LabelHit(vertex, top.first));
+
+        int edgeEnd = graphEdgeEnd(graph, vertex);
+        for (int edge = graph->vertexArray[vertex]; edge < edgeEnd; edge++)
+        {
+            int nid = graph->edgeArray[edge];
+            float nextCost = top.first + graph->weightArray[edge];
+            if (nextCost < cost[nid])
+            {
+                if (cost[nid] == FLT_MAX)
+                {
+                    touched.push_back(nid);
+                }
+                cost[nid] = nextCost;
+                heap.push(HeapEntry(nextCost, nid));
+            }
+        }
+    }
+
+    for (size_t i = 0; i < touched.size(); i++)
+    {
+        cost[touched[i]] = FLT_MAX;
+    }
+    for (size_t i = 0; i < rootLabel.size(); i++)
+    {
+        rootCost[rootLabel[i].hub] = FLT_MAX;
+    }
+}
+
+///
+/// Search the roots of a batch until none is left
+///
+static void *hubLabelThread( void *arg )
+{
+    HubLabelPlan *plan = (HubLabelPlan*) arg;
+
+    int rank;
+    while ((rank = __sync_fetch_and_add(plan->nextRank, 1)) < plan->lastRank)
+    {
+        int root = plan->order[rank];
+        int slot = rank - plan->firstRank;
+
+        // Forward search adds to in labels, backward search to out labels
+        prunedSearch(plan, plan->graph, root, (*plan->outLabels)[root], *plan->inLabels,
+                     &plan->hits[2 * slot]);
+        prunedSearch(plan, plan->reverse, root, (*plan->inLabels)[root], *plan->outLabels,
+                     &plan->hits[2 * slot + 1]);
+    }
+
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+/// Build the labels of a graph
+///
+void buildHubLabels( const GraphData *graph, const int *order, int threadCount, HubLabels *outLabels )
+{
+    int vertexCount = graph->vertexCount;
+    if (threadCount < 1)
+    {
+        threadCount = 1;
+    }
+
+    memset(outLabels, 0, sizeof(HubLabels));
+    outLabels->vertexCount = vertexCount;
+    outLabels->order = (int*) trackedMalloc(MEMORY_PREPROCESSING, sizeof(int) * (vertexCount > 0 ? vertexCount : 1));
+    if (order != NULL)
+    {
+        memcpy(outLabels->order, order, sizeof(int) * vertexCount);
+    }
+    else
+    {
+        // Highest total degree first, ties by vertex
+        std::vector<long long> key(vertexCount);
+        for (int v = 0; v < vertexCount; v++)
+        {
+            key[v] = (long long) (graphEdgeEnd(graph, v) - graph->vertexArray[v]) * vertexCount - v;
+        }
+        for (int edge = 0; edge < graph->edgeCount; edge++)
+        {
+            key[graph->edgeArray[edge]] += vertexCount;
+        }
+
+        std::vector< std::pair<long long, int> > ranking(vertexCount);
+        for (int v = 0; v < vertexCount; v++)
+        {
+            ranking[v] = std::make_pair(-key[v], v);
+        }
+        std::sort(ranking.begin(), ranking.end());
+        for (int r = 0; r < vertexCount; r++)
+        {
+            outLabels->order[r] = ranking[r].second;
+        }
+    }
+
+    GraphData reverse;
+    buildReverseGraph(graph, &reverse);
+
+    LabelLists outLists(vertexCount);
+    LabelLists inLists(vertexCount);
+
+    int maxBatch = threadCount * HUB_LABELS_ROOTS_PER_THREAD;
+    std::vector<LabelHit> *hits = new std::vector<LabelHit>[2 * maxBatch];
+    std::vector<float> *costs = new std::vector<float>[threadCount];
+    std::vector<float> *rootCosts = new std::vector<float>[threadCount];
+    for (int i = 0; i < threadCount; i++)
+    {
+        costs[i].assign(vertexCount, FLT_MAX);
+        rootCosts[i].assign(vertexCount, FLT_MAX);
+    }
+
+    HubLabelPlan *plans = (HubLabelPlan*) malloc(sizeof(HubLabelPlan) * threadCount);
+    pthread_t *threadIDs = (pthread_t*) malloc(sizeof(pthread_t) * threadCount);
+
+    int batchSize = 1;
+    for (int firstRank = 0; firstRank < vertexCount; firstRank += batchSize, batchSize = std::min(2 * batchSize, maxBatch))
+    {
+        int lastRank = std::min(firstRank + batchSize, vertexCount);
+        int batchThreads = std::min(threadCount, lastRank - firstRank);
+        volatile int nextRank = firstRank;
+
+        for (int i = 0; i < batchThreads; i++)
+        {
+            plans[i].graph = graph;
+            plans[i].reverse = &reverse;
+            plans[i].order = outLabels->order;
+            plans[i].outLabels = &outLists;
+            plans[i].inLabels = &inLists;
+            plans[i].firstRank = firstRank;
+            plans[i].lastRank = lastRank;
+            plans[i].nextRank = &nextRank;
+            plans[i].hits = hits;
+            plans[i].cost = &costs[i];
+            plans[i].rootCost = &rootCosts[i];
+        }
+
+        if (batchThreads == 1)
+        {
+            hubLabelThread(&plans[0]);
+        }
+        else
+        {
+            for (int i = 0; i < batchThreads; i++)
+            {
+                pthread_create(&threadIDs[i], NULL, hubLabelThread, (void*)(plans + i));
+            }
+            for (int i = 0; i < batchThreads; i++)
+            {
+                pthread_join(threadIDs[i], NULL);
+            }
+        }
+
+        // Every rank of the batch is above those already in the labels, so
+        // appending in rank order keeps them sorted
+        for (int rank = firstRank; rank < lastRank; rank++)
+        {
+            int slot = rank - firstRank;
+            for (size_t i = 0; i < hits[2 * slot].size(); i++)
+            {
+                HubLabelEntry entry = { rank, hits[2 * slot][i].second };
+                inLists[hits[2 * slot][i].first].push_back(entry);
+            }
+            for (size_t i = 0; i < hits[2 * slot + 1].size(); i++)
+            {
+                HubLabelEntry entry = { rank, hits[2 * slot + 1][i].second };
+                outLists[hits[2 * slot + 1][i].first].push_back(entry);
+            }
+            hits[2 * slot].clear();
+            hits[2 * slot + 1].clear();
+        }
+    }
+
+    free(plans);
+    free(threadIDs);
+    delete [] hits;
+    delete [] costs;
+    delete [] rootCosts;
+    freeGraph(&reverse);
+
+    // Flatten, out and in label of each vertex next to each other
+    outLabels->labelStart = (long long*) trackedMalloc(MEMORY_PREPROCESSING,
+                                                       sizeof(long long) * (2 * (size_t) vertexCount + 1));
+    long long entryCount = 0;
+    for (int v = 0; v < vertexCount; v++)
+    {
+        outLabels->labelStart[2 * v] = entryCount;
+        entryCount += (long long) outLists[v].size() + 1;
+        outLabels->labelStart[2 * v + 1] = entryCount;
+        entryCount += (long long) inLists[v].size() + 1;
+    }
+    outLabels->labelStart[2 * vertexCount] = entryCount;
+
+    HubLabelEntry sentinel = { HUB_LABELS_SENTINEL, 0.0f };
+    outLabels->entries = (HubLabelEntry*) trackedMalloc(MEMORY_PREPROCESSING,
+                                                        sizeof(HubLabelEntry) * (entryCount > 0 ? entryCount : 1));
+    HubLabelEntry *entry = outLabels->entries;
+    for (int v = 0; v < vertexCount; v++)
+    {
+        entry = std::copy(outLists[v].begin(), outLists[v].end(), entry);
+        *entry++ = sentinel;
+        entry = std::copy(inLists[v].begin(), inLists[v].end(), entry);
+        *entry++ = sentinel;
+    }
+}
+
+///
+/// Free or unmap everything allocated by buildHubLabels() or loadHubLabels()
+///
+void freeHubLabels( HubLabels *labels )
+{
+    if (labels->mapping != NULL)
+    {
+        munmap(labels->mapping, labels->mappingSize);
+    }
+    else
+    {
+        trackedFree(labels->order);
+        trackedFree(labels->labelStart);
+        trackedFree(labels->entries);
+    }
+    memset(labels, 0, sizeof(HubLabels));
+}
+
+///
+/// Write labels to a file
+///
+bool saveHubLabels( const HubLabels *labels, const char *fileName )
+{
+    FILE *file = fopen(fileName, "wb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "saveHubLabels: cannot open %s\n", fileName);
+        return false;
+    }
+
+    size_t orderSize = sizeof(int) * labels->vertexCount;
+    size_t labelStartSize = sizeof(long long) * (2 * (size_t) labels->vertexCount + 1);
+    size_t entriesSize = sizeof(HubLabelEntry) * labels->labelStart[2 * labels->vertexCount];
+
+    HubLabelsHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = HUB_LABELS_MAGIC;
+    header.version = HUB_LABELS_VERSION;
+    header.vertexCount = labels->vertexCount;
+    header.orderOffset = alignOffset(sizeof(header));
+    header.labelStartOffset = alignOffset(header.orderOffset + orderSize);
+    header.entriesOffset = alignOffset(header.labelStartOffset + labelStartSize);
+    header.fileSize = header.entriesOffset + entriesSize;
+
+    // Zero padding up to each aligned offset
+    char padding[HUB_LABELS_ALIGNMENT];
+    memset(padding, 0, sizeof(padding));
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(padding, 1, header.orderOffset - sizeof(header), file) == header.orderOffset - sizeof(header) &&
+                   fwrite(labels->order, 1, orderSize, file) == orderSize &&
+                   fwrite(padding, 1, header.labelStartOffset - header.orderOffset - orderSize, file) ==
+                       header.labelStartOffset - header.orderOffset - orderSize &&
+                   fwrite(labels->labelStart, 1, labelStartSize, file) == labelStartSize &&
+                   fwrite(padding, 1, header.entriesOffset - header.labelStartOffset - labelStartSize, file) ==
+                       header.entriesOffset - header.labelStartOffset - labelStartSize &&
+                   fwrite(labels->entries, 1, entriesSize, file) == entriesSize;
+
+    written = (fclose(file) == 0) && written;
+    if (!written)
+    {
+        fprintf(stderr, "saveHubLabels: error writing %s\n", fileName);
+    }
+
+    return written;
+}
+
+///
+/// Map labels written by saveHubLabels() read-only into memory
+///
+bool loadHubLabels( const char *fileName, HubLabels *outLabels )
+{
+    memset(outLabels, 0, sizeof(HubLabels));
+
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "loadHubLabels: cannot open %s\n", fileName);
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(HubLabelsHeader))
+    {
+        fprintf(stderr, "loadHubLabels: %s is not a labels file\n", fileName);
+        close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        perror("loadHubLabels: mmap");
+        return false;
+    }
+
+    const HubLabelsHeader *header = (const HubLabelsHeader*) mapping;
+    if (header->magic != HUB_LABELS_MAGIC || header->version != HUB_LABELS_VERSION ||
+        !validLabelsLayout(header, (long long) info.st_size))
+    {
+        fprintf(stderr, "loadHubLabels: %s is not a labels file\n", fileName);
+        munmap(mapping, info.st_size);
+        return false;
+    }
+
+    char *data = (char*) mapping;
+    outLabels->vertexCount = header->vertexCount;
+    outLabels->order = (int*) (data + header->orderOffset);
+    outLabels->labelStart = (long long*) (data + header->labelStartOffset);
+    outLabels->entries = (HubLabelEntry*) (data + header->entriesOffset);
+    outLabels->mapping = mapping;
+    outLabels->mappingSize = info.st_size;
+
+    // The entries run to the end of the file
+    long long entryCount = (header->fileSize - header->entriesOffset) / (long long) sizeof(HubLabelEntry);
+    if ((header->fileSize - header->entriesOffset) % (long long) sizeof(HubLabelEntry) != 0 ||
+        !validLabelStarts(outLabels->labelStart, header->vertexCount, entryCount))
+    {
+        fprintf(stderr, "loadHubLabels: %s is truncated or corrupt\n", fileName);
+        freeHubLabels(outLabels);
+        return false;
+    }
+
+    return true;
+}
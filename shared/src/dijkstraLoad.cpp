@@ -0,0 +1,315 @@
+//
+//
+//  Description:
+//      Open-loop load generator and saturation sweep.  See dijkstraLoad.h.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include "dijkstraLoad.h"
+#include "dijkstraMemory.h"
+
+///
+//  Types
+//
+
+//
+//  State of the arrival process of one run
+//
+typedef struct
+{
+    const LoadSpec *spec;
+    unsigned long long random;
+
+    // Seconds from the start of the run of the last arrival
+    double time;
+
+} ArrivalProcess;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+///
+/// Wall clock time in seconds
+///
+static double loadTime()
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec + now.tv_usec * 1.0e-6;
+}
+
+///
+/// Completion callback of a query, stamps its finish time
+///
+static void onLoadQueryFinished(void *userData)
+{
+    *(double*) userData = loadTime();
+}
+
+///
+/// Uniform in (0, 1]
+///
+static double nextUniform(ArrivalProcess *process)
+{
+    process->random = process->random * 6364136223846793005ULL + 1442695040888963407ULL;
+    return ((process->random >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+///
+/// Arrival rate at a time of the run, and the time it next changes
+///
+static double rateAt(const LoadSpec *spec, double time, double *outPhaseEnd)
+{
+    if (spec->arrivals != LOAD_ARRIVAL_BURSTY || spec->burstPeriod <= 0.0)
+    {
+        *outPhaseEnd = HUGE_VAL;
+        return spec->rate;
+    }
+
+    double fraction = std::min(std::max(spec->burstFraction, 0.0), 1.0);
+    double burstRate = spec->rate * spec->burstFactor;
+    double quietRate = (fraction < 1.0) ? std::max(spec->rate * (1.0 - fraction * spec->burstFactor) / (1.0 - fraction), 0.0) :
+                                          burstRate;
+
+    double periodStart = floor(time / spec->burstPeriod) * spec->burstPeriod;
+    double burstEnd = periodStart + fraction * spec->burstPeriod;
+    if (time < burstEnd)
+    {
+        *outPhaseEnd = burstEnd;
+        return burstRate;
+    }
+    *outPhaseEnd = periodStart + spec->burstPeriod;
+    return quietRate;
+}
+
+///
+/// Advance to the next arrival.  Inter-arrival times are exponential at the
+/// rate of the current phase; an arrival drawn past the end of the phase is
+/// redrawn from there, which the memoryless distribution allows.
+///
+static double nextArrival(ArrivalProcess *process)
+{
+    for (;;)
+    {
+        double phaseEnd;
+        double rate = rateAt(process->spec, process->time, &phaseEnd);
+        double next = (rate > 0.0) ? process->time - log(nextUniform(process)) / rate : HUGE_VAL;
+        if (next < phaseEnd)
+        {
+            process->time = next;
+            return next;
+        }
+        process->time = phaseEnd;
+    }
+}
+
+///
+/// Latency below which the given fraction of the sorted latencies fall
+///
+static double sortedPercentile(const std::vector<double> &latencies, double fraction)
+{
+    size_t rank = (size_t) ceil(fraction * latencies.size());
+    return latencies[(rank > 0) ? rank - 1 : 0];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+/// Fill a spec with the defaults
+///
+void initLoadSpec( LoadSpec *spec )
+{
+    memset(spec, 0, sizeof(LoadSpec));
+    spec->rate = 10.0;
+    spec->duration = 10.0;
+    spec->arrivals = LOAD_ARRIVAL_POISSON;
+    spec->burstFactor = 4.0;
+    spec->burstFraction = 0.1;
+    spec->burstPeriod = 1.0;
+    spec->sourcesPerQuery = 1;
+    spec->requestClass = SSSP_CLASS_INTERACTIVE;
+    spec->seed = 1;
+}
+
+///
+/// Issue the load to a started engine and wait for every query
+///
+bool runLoad( SSSPEngine *engine, const GraphData *graph, const LoadSpec *spec, LoadResult *outResult )
+{
+    memset(outResult, 0, sizeof(LoadResult));
+    outResult->offeredRate = spec->rate;
+
+    int sourcesPerQuery = (spec->sourcesPerQuery > 0) ? spec->sourcesPerQuery : 1;
+    size_t slotCosts = (size_t) sourcesPerQuery * graph->vertexCount;
+    float *costs = (float*) trackedMalloc(MEMORY_RESULTS, sizeof(float) * slotCosts * LOAD_MAX_IN_FLIGHT);
+    int *sources = (int*) malloc(sizeof(int) * sourcesPerQuery);
+
+    ArrivalProcess process;
+    process.spec = spec;
+    process.random = spec->seed;
+    process.time = 0.0;
+
+    // Scheduled arrival and finish time of every query; a deque so that the
+    // finish times written by the callbacks never move
+    std::vector<double> scheduled;
+    std::deque<double> finished;
+    std::vector<SSSPRequestState> states;
+    std::vector<SSSPFuture> inFlight;
+    size_t oldest = 0;
+
+    double start = loadTime();
+    for (double arrival = nextArrival(&process); arrival < spec->duration; arrival = nextArrival(&process))
+    {
+        // Retire the oldest query so that its result slot can be reused
+        size_t query = scheduled.size();
+        if (query - oldest >= LOAD_MAX_IN_FLIGHT)
+        {
+            states[oldest] = inFlight[oldest].wait();
+            inFlight[oldest] = SSSPFuture();
+            oldest++;
+        }
+
+        double when = start + arrival;
+        double now = loadTime();
+        if (when > now)
+        {
+            usleep((useconds_t) ((when - now) * 1.0e6));
+            now = loadTime();
+        }
+        outResult->maxSubmitLag = std::max(outResult->maxSubmitLag, now - when);
+
+        for (int i = 0; i < sourcesPerQuery; i++)
+        {
+            sources[i] = (int) (nextUniform(&process) * graph->vertexCount) % graph->vertexCount;
+        }
+
+        scheduled.push_back(when);
+        finished.push_back(0.0);
+        states.push_back(SSSP_REQUEST_QUEUED);
+        inFlight.push_back(engine->submit(sources, &costs[(query % LOAD_MAX_IN_FLIGHT) * slotCosts],
+                                          sourcesPerQuery, 0, spec->requestClass,
+                                          onLoadQueryFinished, &finished[query]));
+    }
+
+    // wait() returns once the callbacks have stamped the finish times
+    for (size_t i = oldest; i < inFlight.size(); i++)
+    {
+        states[i] = inFlight[i].wait();
+    }
+
+    std::vector<double> latencies;
+    double end = start;
+    for (size_t i = 0; i < scheduled.size(); i++)
+    {
+        if (states[i] != SSSP_REQUEST_COMPLETED)
+        {
+            outResult->failed++;
+            continue;
+        }
+        latencies.push_back(finished[i] - scheduled[i]);
+        end = std::max(end, finished[i]);
+    }
+
+    outResult->issued = (long long) scheduled.size();
+    outResult->completed = (long long) latencies.size();
+    outResult->achievedRate = (end > start) ? latencies.size() / std::max(end - start, spec->duration) : 0.0;
+
+    if (!latencies.empty())
+    {
+        std::sort(latencies.begin(), latencies.end());
+        double sum = 0.0;
+        for (size_t i = 0; i < latencies.size(); i++)
+        {
+            sum += latencies[i];
+        }
+        outResult->meanLatency = sum / latencies.size();
+        outResult->p50Latency = sortedPercentile(latencies, 0.50);
+        outResult->p90Latency = sortedPercentile(latencies, 0.90);
+        outResult->p99Latency = sortedPercentile(latencies, 0.99);
+        outResult->p999Latency = sortedPercentile(latencies, 0.999);
+        outResult->maxLatency = latencies.back();
+    }
+
+    trackedFree(costs);
+    free(sources);
+    return outResult->failed == 0;
+}
+
+///
+/// Find the highest rate the engine keeps up with
+///
+bool findSaturationRate( SSSPEngine *engine, const GraphData *graph, const LoadSpec *spec, double p99Limit,
+                         double *outRate, LoadResult *outSteps, int maxSteps, int *outStepCount )
+{
+    *outRate = 0.0;
+
+    LoadSpec step = *spec;
+    double keptUp = 0.0;
+    double fellBehind = 0.0;
+    int doublings = 0;
+    int refinements = 0;
+    int stepCount = 0;
+    bool succeeded = true;
+    while (refinements < LOAD_SWEEP_REFINEMENTS && doublings <= LOAD_SWEEP_MAX_DOUBLINGS && step.rate > 0.0)
+    {
+        LoadResult result;
+        if (!runLoad(engine, graph, &step, &result))
+        {
+            succeeded = false;
+            break;
+        }
+
+        if (stepCount < maxSteps)
+        {
+            outSteps[stepCount] = result;
+        }
+        stepCount++;
+
+        bool keepsUp = result.achievedRate >= LOAD_KEEP_UP_RATIO * result.offeredRate &&
+                       result.p99Latency <= p99Limit;
+        if (keepsUp)
+        {
+            keptUp = step.rate;
+            *outRate = std::max(*outRate, result.achievedRate);
+        }
+        else
+        {
+            fellBehind = step.rate;
+        }
+
+        // Double until the first saturated run, then bisect
+        if (fellBehind == 0.0)
+        {
+            step.rate *= 2.0;
+            doublings++;
+        }
+        else
+        {
+            step.rate = 0.5 * (keptUp + fellBehind);
+            refinements++;
+        }
+    }
+
+    if (outStepCount != NULL)
+    {
+        *outStepCount = stepCount;
+    }
+    return succeeded;
+}
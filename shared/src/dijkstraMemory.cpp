@@ -0,0 +1,340 @@
+//
+//
+//  Description:
+//      Memory accounts per device and category.  See dijkstraMemory.h.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "dijkstraMemory.h"
+
+///
+//  Types
+//
+
+//
+//  Account of one device.  Updated with atomic operations only; the lock
+//  below guards registration.
+//
+typedef struct
+{
+    char name[MEMORY_DEVICE_NAME_MAX];
+
+    volatile size_t current[MEMORY_CATEGORY_COUNT];
+    volatile size_t peak[MEMORY_CATEGORY_COUNT];
+    volatile size_t total;
+    volatile size_t peakTotal;
+
+    volatile size_t limit;
+    volatile unsigned long long refusals;
+
+} MemoryAccount;
+
+//
+//  Header in front of every trackedMalloc() block, padded so that the block
+//  keeps malloc()'s alignment
+//
+typedef union
+{
+    struct
+    {
+        size_t bytes;
+        MemoryCategory category;
+    } block;
+
+    double align[2];
+
+} BlockHeader;
+
+///
+//  Globals
+//
+// Account 0 is the host's, named on first use by nameHostAccount()
+static MemoryAccount accounts[MEMORY_DEVICES_MAX];
+static volatile int accountCount = 1;
+static pthread_mutex_t accountsLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t hostAccountOnce = PTHREAD_ONCE_INIT;
+
+static const char *categoryNames[MEMORY_CATEGORY_COUNT] =
+{
+    "graph", "state", "staging", "results", "preprocessing"
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+///
+/// Account of a device index, NULL for -1 or an unregistered index
+///
+static MemoryAccount *findAccount(int device)
+{
+    return (device >= 0 && device < accountCount) ? &accounts[device] : NULL;
+}
+
+///
+/// Name the host account, once
+///
+static void nameHostAccount()
+{
+    snprintf(accounts[0].name, sizeof(accounts[0].name), "host");
+}
+
+///
+/// Atomically raise a peak to at least value
+///
+static void raisePeak(volatile size_t *peak, size_t value)
+{
+    for (size_t current = *peak; value > current; current = *peak)
+    {
+        if (__sync_bool_compare_and_swap(peak, current, value))
+        {
+            return;
+        }
+    }
+}
+
+///
+/// Add bytes already added to the total of an account to one of its categories
+///
+static void chargeCategory(MemoryAccount *account, MemoryCategory category, size_t total, size_t bytes)
+{
+    raisePeak(&account->peakTotal, total);
+    raisePeak(&account->peak[category], __sync_add_and_fetch(&account->current[category], bytes));
+}
+
+///
+/// Bytes in megabytes, for the report
+///
+static double megabytes(size_t bytes)
+{
+    return bytes / (1024.0 * 1024.0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+/// Account of a device by name, registered on first use
+///
+int getMemoryDevice( const char *name )
+{
+    pthread_once(&hostAccountOnce, nameHostAccount);
+    pthread_mutex_lock(&accountsLock);
+
+    int device = 0;
+    while (device < accountCount && strcmp(accounts[device].name, name) != 0)
+    {
+        device++;
+    }
+
+    if (device == accountCount)
+    {
+        if (accountCount == MEMORY_DEVICES_MAX)
+        {
+            fprintf(stderr, "getMemoryDevice: no account left for %s, its memory is not tracked\n", name);
+            device = -1;
+        }
+        else
+        {
+            snprintf(accounts[device].name, sizeof(accounts[device].name), "%s", name);
+            __sync_synchronize();
+            accountCount++;
+        }
+    }
+
+    pthread_mutex_unlock(&accountsLock);
+    return device;
+}
+
+///
+/// Number of registered devices
+///
+int getMemoryDeviceCount()
+{
+    return accountCount;
+}
+
+///
+/// Set the hard limit of a device
+///
+void setMemoryLimit( int device, size_t bytes )
+{
+    MemoryAccount *account = findAccount(device);
+    if (account != NULL)
+    {
+        account->limit = bytes;
+    }
+}
+
+///
+/// Charge an allocation if it fits in the device's limit
+///
+bool reserveMemory( int device, MemoryCategory category, size_t bytes )
+{
+    MemoryAccount *account = findAccount(device);
+    if (account == NULL)
+    {
+        return true;
+    }
+
+    size_t total;
+    do
+    {
+        total = account->total;
+        if (account->limit != 0 && total + bytes > account->limit)
+        {
+            __sync_fetch_and_add(&account->refusals, 1ULL);
+            return false;
+        }
+    }
+    while (!__sync_bool_compare_and_swap(&account->total, total, total + bytes));
+
+    chargeCategory(account, category, total + bytes, bytes);
+    return true;
+}
+
+///
+/// Charge an allocation regardless of the limit
+///
+void chargeMemory( int device, MemoryCategory category, size_t bytes )
+{
+    MemoryAccount *account = findAccount(device);
+    if (account != NULL)
+    {
+        chargeCategory(account, category, __sync_add_and_fetch(&account->total, bytes), bytes);
+    }
+}
+
+///
+/// Give back charged bytes
+///
+void releaseMemory( int device, MemoryCategory category, size_t bytes )
+{
+    MemoryAccount *account = findAccount(device);
+    if (account != NULL)
+    {
+        __sync_fetch_and_sub(&account->current[category], bytes);
+        __sync_fetch_and_sub(&account->total, bytes);
+    }
+}
+
+///
+/// malloc() charged to the host account
+///
+void *trackedMalloc( MemoryCategory category, size_t bytes )
+{
+    BlockHeader *header = (BlockHeader*) malloc(sizeof(BlockHeader) + bytes);
+    if (header == NULL)
+    {
+        return NULL;
+    }
+
+    chargeMemory(MEMORY_HOST, category, bytes);
+    header->block.bytes = bytes;
+    header->block.category = category;
+    return header + 1;
+}
+
+///
+/// Free a block of trackedMalloc()
+///
+void trackedFree( void *block )
+{
+    if (block == NULL)
+    {
+        return;
+    }
+
+    BlockHeader *header = (BlockHeader*) block - 1;
+    releaseMemory(MEMORY_HOST, header->block.category, header->block.bytes);
+    free(header);
+}
+
+///
+/// Current state of a device's account
+///
+void getMemoryReport( int device, MemoryReport *outReport )
+{
+    memset(outReport, 0, sizeof(MemoryReport));
+
+    MemoryAccount *account = findAccount(device);
+    if (account == NULL)
+    {
+        return;
+    }
+
+    pthread_once(&hostAccountOnce, nameHostAccount);
+    snprintf(outReport->device, sizeof(outReport->device), "%s", account->name);
+    for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++)
+    {
+        outReport->currentBytes[c] = account->current[c];
+        outReport->peakBytes[c] = account->peak[c];
+    }
+    outReport->totalBytes = account->total;
+    outReport->peakTotalBytes = account->peakTotal;
+    outReport->limitBytes = account->limit;
+    outReport->refusals = account->refusals;
+}
+
+///
+/// Name of a category
+///
+const char *getMemoryCategoryName( MemoryCategory category )
+{
+    return categoryNames[category];
+}
+
+///
+/// Append a table of every device's current and peak bytes per category
+///
+void formatMemoryReport( std::string &out )
+{
+    char line[256];
+    int written = snprintf(line, sizeof(line), "%-12s", "Memory (MB)");
+    for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++)
+    {
+        written += snprintf(line + written, sizeof(line) - written, " %13s", categoryNames[c]);
+    }
+    snprintf(line + written, sizeof(line) - written, " %13s\n", "total");
+    out += line;
+
+    for (int device = 0; device < getMemoryDeviceCount(); device++)
+    {
+        MemoryReport report;
+        getMemoryReport(device, &report);
+
+        if (report.limitBytes != 0)
+        {
+            snprintf(line, sizeof(line), "%s (limit %.1f MB, %llu refused)\n", report.device,
+                     megabytes(report.limitBytes), report.refusals);
+        }
+        else
+        {
+            snprintf(line, sizeof(line), "%s\n", report.device);
+        }
+        out += line;
+
+        for (int row = 0; row < 2; row++)
+        {
+            const size_t *bytes = (row == 0) ? report.currentBytes : report.peakBytes;
+            written = snprintf(line, sizeof(line), "  %-10s", (row == 0) ? "current" : "peak");
+            for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++)
+            {
+                written += snprintf(line + written, sizeof(line) - written, " %13.1f", megabytes(bytes[c]));
+            }
+            snprintf(line + written, sizeof(line) - written, " %13.1f\n",
+                     megabytes((row == 0) ? report.totalBytes : report.peakTotalBytes));
+            out += line;
+        }
+    }
+}
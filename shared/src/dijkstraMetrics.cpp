@@ -0,0 +1,501 @@
+//
+//
+//  Description:
+//      Lock-free engine metrics and their Prometheus exposition.  See
+//      dijkstraMetrics.h.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <vector>
+#include "dijkstraMetrics.h"
+
+///
+//  Constants
+//
+
+// How often the server thread checks whether it should stop
+const int METRICS_POLL_MS = 200;
+
+// Bytes of an HTTP request the server reads, enough for the request line
+const int METRICS_REQUEST_MAX = 1024;
+
+// Longest a client may take to send its request or read the response; a
+// client that stalls is dropped so that it cannot block later scrapes
+const int METRICS_CLIENT_TIMEOUT_MS = 2000;
+
+///
+//  Globals
+//
+static std::vector<Metric*> registeredMetrics;
+static pthread_mutex_t metricsLock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t serverThread;
+static int serverFd = -1;
+static volatile bool serverStopping = false;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+///
+/// Atomically add to a double
+///
+static void atomicAdd(volatile double *target, double amount)
+{
+    volatile unsigned long long *bits = (volatile unsigned long long*) target;
+    for (;;)
+    {
+        unsigned long long oldBits = *bits;
+        double oldValue;
+        memcpy(&oldValue, &oldBits, sizeof(double));
+        double newValue = oldValue + amount;
+        unsigned long long newBits;
+        memcpy(&newBits, &newValue, sizeof(double));
+        if (__sync_bool_compare_and_swap(bits, oldBits, newBits))
+        {
+            return;
+        }
+    }
+}
+
+///
+/// Find a registered metric, or register a new one.  Must be called with
+/// metricsLock held.
+///
+static Metric *findOrAddMetric(MetricType type, const char *name, const char *help, const char *labels)
+{
+    if (labels == NULL)
+    {
+        labels = "";
+    }
+
+    for (size_t i = 0; i < registeredMetrics.size(); i++)
+    {
+        Metric *metric = registeredMetrics[i];
+        if (strcmp(metric->name, name) == 0 && strcmp(metric->labels, labels) == 0)
+        {
+            return metric;
+        }
+    }
+
+    Metric *metric = (Metric*) calloc(1, sizeof(Metric));
+    metric->type = type;
+    strncpy(metric->name, name, METRIC_NAME_MAX - 1);
+    strncpy(metric->labels, labels, METRIC_LABELS_MAX - 1);
+    metric->help = help;
+    registeredMetrics.push_back(metric);
+
+    return metric;
+}
+
+///
+/// Append one sample line
+///
+static void appendSample(std::string &out, const char *name, const char *suffix, const char *labels,
+                         const char *extraLabel, double value)
+{
+    char line[METRIC_NAME_MAX + METRIC_LABELS_MAX + 128];
+    bool hasLabels = labels[0] != '\0' || extraLabel != NULL;
+    snprintf(line, sizeof(line), "%s%s%s%s%s%s%s %.17g\n", name, suffix,
+             hasLabels ? "{" : "", labels, (labels[0] != '\0' && extraLabel != NULL) ? "," : "",
+             (extraLabel != NULL) ? extraLabel : "", hasLabels ? "}" : "", value);
+    out += line;
+}
+
+///
+/// Resident set size of the process in bytes, 0 if unknown
+///
+static double residentMemoryBytes()
+{
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm == NULL)
+    {
+        return 0.0;
+    }
+
+    unsigned long long pages = 0;
+    unsigned long long residentPages = 0;
+    int fields = fscanf(statm, "%llu %llu", &pages, &residentPages);
+    fclose(statm);
+
+    return (fields == 2) ? (double) residentPages * sysconf(_SC_PAGESIZE) : 0.0;
+}
+
+///
+/// Whether a socket call that failed should be retried: it timed out after
+/// METRICS_POLL_MS (or was interrupted), the server is not stopping and the
+/// client has not used up METRICS_CLIENT_TIMEOUT_MS
+///
+static bool retryClientCall(int *waitedMs)
+{
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+    {
+        return false;
+    }
+
+    *waitedMs += METRICS_POLL_MS;
+    return !serverStopping && *waitedMs < METRICS_CLIENT_TIMEOUT_MS;
+}
+
+///
+/// Answer one HTTP connection.  The socket times out every METRICS_POLL_MS,
+/// so a stalled client holds the server thread for at most
+/// METRICS_CLIENT_TIMEOUT_MS and never past stopMetricsServer().
+///
+static void serveMetricsRequest(int fd)
+{
+    struct timeval timeout;
+    timeout.tv_sec = METRICS_POLL_MS / 1000;
+    timeout.tv_usec = (METRICS_POLL_MS % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // Read until the end of the request line
+    char request[METRICS_REQUEST_MAX];
+    size_t length = 0;
+    int waitedMs = 0;
+    while (length < sizeof(request) - 1)
+    {
+        ssize_t received = recv(fd, request + length, sizeof(request) - 1 - length, 0);
+        if (received == 0)
+        {
+            break;
+        }
+        if (received < 0)
+        {
+            if (retryClientCall(&waitedMs))
+            {
+                continue;
+            }
+            return;
+        }
+
+        length += received;
+        request[length] = '\0';
+        if (strchr(request, '\n') != NULL)
+        {
+            break;
+        }
+    }
+    if (length == 0)
+    {
+        return;
+    }
+    request[length] = '\0';
+
+    std::string body;
+    const char *status = "404 Not Found";
+    if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET / ", 6) == 0)
+    {
+        formatMetrics(body);
+        status = "200 OK";
+    }
+
+    char header[256];
+    snprintf(header, sizeof(header), "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\n"
+             "Content-Length: %lu\r\nConnection: close\r\n\r\n", status, (unsigned long) body.size());
+
+    std::string response = header + body;
+    const char *bytes = response.data();
+    size_t size = response.size();
+    while (size > 0)
+    {
+        ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (sent < 0 && retryClientCall(&waitedMs))
+        {
+            continue;
+        }
+        if (sent <= 0)
+        {
+            return;
+        }
+        bytes += sent;
+        size -= sent;
+    }
+}
+
+///
+/// Server thread of startMetricsServer(), one connection at a time
+///
+static void *metricsServerThread(void *)
+{
+    struct pollfd listenPoll;
+    listenPoll.fd = serverFd;
+    listenPoll.events = POLLIN;
+
+    while (!serverStopping)
+    {
+        if (poll(&listenPoll, 1, METRICS_POLL_MS) <= 0)
+        {
+            continue;
+        }
+
+        int fd = accept(serverFd, NULL, NULL);
+        if (fd >= 0)
+        {
+            serveMetricsRequest(fd);
+            close(fd);
+        }
+    }
+
+    return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+/// Find or register a counter
+///
+Metric *getMetricCounter( const char *name, const char *help, const char *labels )
+{
+    pthread_mutex_lock(&metricsLock);
+    Metric *metric = findOrAddMetric(METRIC_COUNTER, name, help, labels);
+    pthread_mutex_unlock(&metricsLock);
+
+    return metric;
+}
+
+///
+/// Find or register a gauge
+///
+Metric *getMetricGauge( const char *name, const char *help, const char *labels )
+{
+    pthread_mutex_lock(&metricsLock);
+    Metric *metric = findOrAddMetric(METRIC_GAUGE, name, help, labels);
+    pthread_mutex_unlock(&metricsLock);
+
+    return metric;
+}
+
+///
+/// Find or register a histogram
+///
+Metric *getMetricHistogram( const char *name, const char *help, const char *labels,
+                            const double *bounds, int bucketCount )
+{
+    pthread_mutex_lock(&metricsLock);
+    Metric *metric = findOrAddMetric(METRIC_HISTOGRAM, name, help, labels);
+    if (metric->bucketCount == 0)
+    {
+        metric->bucketCount = (bucketCount < METRIC_BUCKETS_MAX) ? bucketCount : METRIC_BUCKETS_MAX;
+        memcpy(metric->bounds, bounds, sizeof(double) * metric->bucketCount);
+    }
+    pthread_mutex_unlock(&metricsLock);
+
+    return metric;
+}
+
+///
+/// Add to a counter or gauge
+///
+void addMetric( Metric *metric, double amount )
+{
+    atomicAdd(&metric->value, amount);
+}
+
+///
+/// Set a gauge
+///
+void setMetric( Metric *metric, double value )
+{
+    unsigned long long bits;
+    memcpy(&bits, &value, sizeof(double));
+    __sync_lock_test_and_set((volatile unsigned long long*) &metric->value, bits);
+}
+
+///
+/// Record one observation in a histogram
+///
+void observeMetric( Metric *metric, double value )
+{
+    int bucket = 0;
+    while (bucket < metric->bucketCount && value > metric->bounds[bucket])
+    {
+        bucket++;
+    }
+
+    __sync_fetch_and_add(&metric->counts[bucket], 1ULL);
+    atomicAdd(&metric->value, value);
+}
+
+///
+/// Append every metric in the Prometheus text format
+///
+void formatMetrics( std::string &out )
+{
+    pthread_mutex_lock(&metricsLock);
+    std::vector<Metric*> metrics = registeredMetrics;
+    pthread_mutex_unlock(&metricsLock);
+
+    // Series of one name share their HELP and TYPE lines and are printed
+    // together, in the order the names were first registered
+    std::vector<bool> printed(metrics.size(), false);
+    for (size_t i = 0; i < metrics.size(); i++)
+    {
+        if (printed[i])
+        {
+            continue;
+        }
+
+        static const char *typeNames[] = { "counter", "gauge", "histogram" };
+        out += std::string("# HELP ") + metrics[i]->name + " " + (metrics[i]->help != NULL ? metrics[i]->help : "") + "\n";
+        out += std::string("# TYPE ") + metrics[i]->name + " " + typeNames[metrics[i]->type] + "\n";
+
+        for (size_t j = i; j < metrics.size(); j++)
+        {
+            Metric *metric = metrics[j];
+            if (printed[j] || strcmp(metric->name, metrics[i]->name) != 0)
+            {
+                continue;
+            }
+            printed[j] = true;
+
+            if (metric->type != METRIC_HISTOGRAM)
+            {
+                appendSample(out, metric->name, "", metric->labels, NULL, metric->value);
+                continue;
+            }
+
+            unsigned long long cumulative = 0;
+            for (int b = 0; b <= metric->bucketCount; b++)
+            {
+                char bound[64];
+                if (b < metric->bucketCount)
+                {
+                    snprintf(bound, sizeof(bound), "le=\"%g\"", metric->bounds[b]);
+                }
+                else
+                {
+                    snprintf(bound, sizeof(bound), "le=\"+Inf\"");
+                }
+                cumulative += metric->counts[b];
+                appendSample(out, metric->name, "_bucket", metric->labels, bound, (double) cumulative);
+            }
+            appendSample(out, metric->name, "_sum", metric->labels, NULL, metric->value);
+            appendSample(out, metric->name, "_count", metric->labels, NULL, (double) cumulative);
+        }
+    }
+
+    out += "# HELP process_resident_memory_bytes Resident memory size in bytes.\n";
+    out += "# TYPE process_resident_memory_bytes gauge\n";
+    appendSample(out, "process_resident_memory_bytes", "", "", NULL, residentMemoryBytes());
+}
+
+///
+/// Write formatMetrics() to a file, replacing it atomically
+///
+bool writeMetricsFile( const char *fileName )
+{
+    std::string text;
+    formatMetrics(text);
+
+    std::string temporary = std::string(fileName) + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, "writeMetricsFile: cannot open %s\n", temporary.c_str());
+        return false;
+    }
+
+    bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+    written = (fclose(file) == 0) && written;
+    written = written && rename(temporary.c_str(), fileName) == 0;
+    if (!written)
+    {
+        fprintf(stderr, "writeMetricsFile: error writing %s\n", fileName);
+        unlink(temporary.c_str());
+    }
+
+    return written;
+}
+
+///
+/// Serve formatMetrics() on a local port from a background thread
+///
+bool startMetricsServer( int port )
+{
+    if (serverFd >= 0)
+    {
+        return false;
+    }
+
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons((unsigned short) port);
+    if (listenFd < 0 || bind(listenFd, (struct sockaddr*) &address, sizeof(address)) != 0 ||
+        listen(listenFd, SOMAXCONN) != 0)
+    {
+        perror("startMetricsServer: listen");
+        if (listenFd >= 0)
+        {
+            close(listenFd);
+        }
+        return false;
+    }
+
+    serverFd = listenFd;
+    serverStopping = false;
+    if (pthread_create(&serverThread, NULL, metricsServerThread, NULL) != 0)
+    {
+        close(serverFd);
+        serverFd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+///
+/// Stop the server started by startMetricsServer()
+///
+void stopMetricsServer()
+{
+    if (serverFd < 0)
+    {
+        return;
+    }
+
+    serverStopping = true;
+    pthread_join(serverThread, NULL);
+    close(serverFd);
+    serverFd = -1;
+}
+
+///
+/// Stop the server and free every metric
+///
+void releaseMetrics()
+{
+    stopMetricsServer();
+
+    pthread_mutex_lock(&metricsLock);
+    for (size_t i = 0; i < registeredMetrics.size(); i++)
+    {
+        free(registeredMetrics[i]);
+    }
+    registeredMetrics.clear();
+    pthread_mutex_unlock(&metricsLock);
+}
@@ -0,0 +1,314 @@
+//
+//
+//  Description:
+//      Landmark distance oracle.  See dijkstraOracle.h.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <vector>
+#include "dijkstraOracle.h"
+#include "dijkstraMemory.h"
+
+///
+//  Types
+//
+
+// Header at the start of an oracle file, followed by the landmarks and the
+// toLandmark and fromLandmark tables
+typedef struct
+{
+    // Must be DISTANCE_ORACLE_MAGIC and DISTANCE_ORACLE_VERSION
+    unsigned int magic;
+    unsigned int version;
+
+    int vertexCount;
+    int landmarkCount;
+
+} DistanceOracleHeader;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+///
+/// Store the costs of one landmark's search into a vertex-major table
+///
+static void storeLandmarkCosts( float *table, int landmarkCount, int landmark,
+                                const float *costs, int vertexCount )
+{
+    for (int v = 0; v < vertexCount; v++)
+    {
+        table[(size_t) v * landmarkCount + landmark] = costs[v];
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+/// Choose landmarks by farthest-point sampling and compute their costs
+///
+bool buildDistanceOracle( SSSPBackend *backend, const GraphData *graph, int landmarkCount,
+                          int firstLandmark, DistanceOracle *outOracle )
+{
+    int vertexCount = graph->vertexCount;
+    if (landmarkCount > vertexCount)
+    {
+        landmarkCount = vertexCount;
+    }
+
+    memset(outOracle, 0, sizeof(DistanceOracle));
+    outOracle->vertexCount = vertexCount;
+    outOracle->landmarkCount = landmarkCount;
+    outOracle->landmarks = (int*) trackedMalloc(MEMORY_PREPROCESSING,
+                                                sizeof(int) * (landmarkCount > 0 ? landmarkCount : 1));
+    outOracle->toLandmark = (float*) trackedMalloc(MEMORY_PREPROCESSING,
+                                                   sizeof(float) * ((size_t) vertexCount * landmarkCount + 1));
+    outOracle->fromLandmark = (float*) trackedMalloc(MEMORY_PREPROCESSING,
+                                                     sizeof(float) * ((size_t) vertexCount * landmarkCount + 1));
+
+    GraphData reverse;
+    buildReverseGraph(graph, &reverse);
+
+    SSSPSession *forwardSession = backend->createSession(graph);
+    SSSPSession *reverseSession = backend->createSession(&reverse);
+    bool succeeded = forwardSession != NULL && reverseSession != NULL;
+
+    // Cost from the nearest chosen landmark, in either direction
+    std::vector<float> nearest(vertexCount, FLT_MAX);
+    std::vector<float> costs(vertexCount);
+    int landmark = firstLandmark;
+    for (int i = 0; i < landmarkCount && succeeded; i++)
+    {
+        outOracle->landmarks[i] = landmark;
+
+        succeeded = forwardSession->run(&landmark, &costs[0], 1);
+        storeLandmarkCosts(outOracle->fromLandmark, landmarkCount, i, &costs[0], vertexCount);
+        for (int v = 0; v < vertexCount; v++)
+        {
+            nearest[v] = (costs[v] < nearest[v]) ? costs[v] : nearest[v];
+        }
+
+        succeeded = succeeded && reverseSession->run(&landmark, &costs[0], 1);
+        storeLandmarkCosts(outOracle->toLandmark, landmarkCount, i, &costs[0], vertexCount);
+        for (int v = 0; v < vertexCount; v++)
+        {
+            nearest[v] = (costs[v] < nearest[v]) ? costs[v] : nearest[v];
+        }
+
+        // Next landmark: the vertex farthest from all landmarks so far, which
+        // is one that none of them connects to if there is any
+        landmark = 0;
+        for (int v = 1; v < vertexCount; v++)
+        {
+            if (nearest[v] > nearest[landmark])
+            {
+                landmark = v;
+            }
+        }
+    }
+
+    delete forwardSession;
+    delete reverseSession;
+    freeGraph(&reverse);
+
+    if (!succeeded)
+    {
+        fprintf(stderr, "buildDistanceOracle: %s failed\n", backend->getName());
+        freeDistanceOracle(outOracle);
+    }
+
+    return succeeded;
+}
+
+///
+/// Free everything allocated by buildDistanceOracle() or loadDistanceOracle()
+///
+void freeDistanceOracle( DistanceOracle *oracle )
+{
+    trackedFree(oracle->landmarks);
+    trackedFree(oracle->toLandmark);
+    trackedFree(oracle->fromLandmark);
+    memset(oracle, 0, sizeof(DistanceOracle));
+}
+
+///
+/// Lower bound of the cost from u to v by the triangle inequality
+///
+float estimateDistanceLowerBound( const DistanceOracle *oracle, int u, int v )
+{
+    const float *toU = &oracle->toLandmark[(size_t) u * oracle->landmarkCount];
+    const float *toV = &oracle->toLandmark[(size_t) v * oracle->landmarkCount];
+    const float *fromU = &oracle->fromLandmark[(size_t) u * oracle->landmarkCount];
+    const float *fromV = &oracle->fromLandmark[(size_t) v * oracle->landmarkCount];
+
+    // d(L, v) <= d(L, u) + d(u, v) and d(u, L) <= d(u, v) + d(v, L)
+    float best = 0.0f;
+    for (int i = 0; i < oracle->landmarkCount; i++)
+    {
+        if (fromU[i] != FLT_MAX && fromV[i] != FLT_MAX && fromV[i] - fromU[i] > best)
+        {
+            best = fromV[i] - fromU[i];
+        }
+        if (toU[i] != FLT_MAX && toV[i] != FLT_MAX && toU[i] - toV[i] > best)
+        {
+            best = toU[i] - toV[i];
+        }
+    }
+
+    return best;
+}
+
+///
+/// Write an oracle to a file
+///
+bool saveDistanceOracle( const DistanceOracle *oracle, const char *fileName )
+{
+    FILE *file = fopen(fileName, "wb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "saveDistanceOracle: cannot open %s\n", fileName);
+        return false;
+    }
+
+    DistanceOracleHeader header;
+    header.magic = DISTANCE_ORACLE_MAGIC;
+    header.version = DISTANCE_ORACLE_VERSION;
+    header.vertexCount = oracle->vertexCount;
+    header.landmarkCount = oracle->landmarkCount;
+
+    size_t tableSize = (size_t) oracle->vertexCount * oracle->landmarkCount;
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(oracle->landmarks, sizeof(int), oracle->landmarkCount, file) == (size_t) oracle->landmarkCount &&
+                   fwrite(oracle->toLandmark, sizeof(float), tableSize, file) == tableSize &&
+                   fwrite(oracle->fromLandmark, sizeof(float), tableSize, file) == tableSize;
+
+    written = (fclose(file) == 0) && written;
+    if (!written)
+    {
+        fprintf(stderr, "saveDistanceOracle: error writing %s\n", fileName);
+    }
+
+    return written;
+}
+
+///
+/// Read an oracle written by saveDistanceOracle()
+///
+bool loadDistanceOracle( const char *fileName, DistanceOracle *outOracle )
+{
+    memset(outOracle, 0, sizeof(DistanceOracle));
+
+    FILE *file = fopen(fileName, "rb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "loadDistanceOracle: cannot open %s\n", fileName);
+        return false;
+    }
+
+    DistanceOracleHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        header.magic != DISTANCE_ORACLE_MAGIC || header.version != DISTANCE_ORACLE_VERSION ||
+        header.vertexCount < 0 || header.landmarkCount < 0)
+    {
+        fprintf(stderr, "loadDistanceOracle: %s is not a distance oracle\n", fileName);
+        fclose(file);
+        return false;
+    }
+
+    size_t tableSize = (size_t) header.vertexCount * header.landmarkCount;
+    outOracle->vertexCount = header.vertexCount;
+    outOracle->landmarkCount = header.landmarkCount;
+    outOracle->landmarks = (int*) trackedMalloc(MEMORY_PREPROCESSING, sizeof(int) * (header.landmarkCount + 1));
+    outOracle->toLandmark = (float*) trackedMalloc(MEMORY_PREPROCESSING, sizeof(float) * (tableSize + 1));
+    outOracle->fromLandmark = (float*) trackedMalloc(MEMORY_PREPROCESSING, sizeof(float) * (tableSize + 1));
+
+    bool read = fread(outOracle->landmarks, sizeof(int), header.landmarkCount, file) == (size_t) header.landmarkCount &&
+                fread(outOracle->toLandmark, sizeof(float), tableSize, file) == tableSize &&
+                fread(outOracle->fromLandmark, sizeof(float), tableSize, file) == tableSize;
+    fclose(file);
+
+    if (!read)
+    {
+        fprintf(stderr, "loadDistanceOracle: %s is truncated\n", fileName);
+        freeDistanceOracle(outOracle);
+    }
+
+    return read;
+}
+
+///
+/// Compare the oracle's estimates against exact costs computed by a backend
+///
+bool measureDistanceOracleError( const DistanceOracle *oracle, SSSPBackend *backend,
+                                 const GraphData *graph, int sampleCount,
+                                 DistanceOracleError *outError )
+{
+    memset(outError, 0, sizeof(DistanceOracleError));
+    if (sampleCount > graph->vertexCount)
+    {
+        sampleCount = graph->vertexCount;
+    }
+
+    std::vector<int> sources(sampleCount);
+    for (int i = 0; i < sampleCount; i++)
+    {
+        sources[i] = (int) ((long long) graph->vertexCount * i / sampleCount);
+    }
+
+    std::vector<float> exact((size_t) sampleCount * graph->vertexCount);
+    if (sampleCount > 0 && !runSSSP(backend, graph, &sources[0], &exact[0], sampleCount))
+    {
+        fprintf(stderr, "measureDistanceOracleError: %s failed\n", backend->getName());
+        return false;
+    }
+
+    long long stretchPairs = 0;
+    double stretchSum = 0.0;
+    for (int i = 0; i < sampleCount; i++)
+    {
+        const float *costs = &exact[(size_t) i * graph->vertexCount];
+        for (int v = 0; v < graph->vertexCount; v++)
+        {
+            if (costs[v] == FLT_MAX)
+            {
+                continue;
+            }
+
+            outError->pairs++;
+            float estimate = estimateDistance(oracle, sources[i], v);
+            if (estimate >= FLT_MAX)
+            {
+                outError->missedPairs++;
+                continue;
+            }
+
+            if (estimate <= costs[v])
+            {
+                outError->exactPairs++;
+            }
+
+            if (costs[v] > 0.0f)
+            {
+                double stretch = (double) estimate / costs[v];
+                stretchSum += stretch;
+                stretchPairs++;
+                outError->maxStretch = (stretch > outError->maxStretch) ? stretch : outError->maxStretch;
+            }
+        }
+    }
+
+    outError->meanStretch = (stretchPairs > 0) ? stretchSum / stretchPairs : 0.0;
+
+    return true;
+}
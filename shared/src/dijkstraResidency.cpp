@@ -0,0 +1,362 @@
+//
+//
+//  Description:
+//      GraphRegistry, sessions of several graphs resident on one backend
+//      under a memory budget.  See dijkstraResidency.h.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dijkstraResidency.h"
+#include "dijkstraMetrics.h"
+
+///
+//  Types
+//
+
+//
+//  One graph known to the registry.  Guarded by the registry lock.
+//
+struct GraphRegistry::Entry
+{
+    char name[GRAPH_REGISTRY_NAME_MAX];
+    const GraphData *graph;
+
+    // NULL while uploading
+    SSSPSession *session;
+    size_t bytes;
+
+    // Session is being created by the caller that missed
+    bool uploading;
+
+    // Session is handed to a caller
+    bool busy;
+
+    // Callers waiting for the session; the entry is pinned while they wait
+    // and, if its upload fails, deleted by the last of them
+    int waiters;
+    bool failed;
+
+    // Recency (LRU) and GreedyDual-Size credit
+    unsigned long long lastUse;
+    double credit;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  GraphRegistry
+//
+//
+
+GraphRegistry::GraphRegistry( SSSPBackend *backend, size_t budgetBytes, GraphEvictionPolicy policy ) :
+    backend(backend),
+    budget(budgetBytes != 0 ? budgetBytes : backend->getMemoryBudget()),
+    policy(policy),
+    reservedBytes(0),
+    useCounter(0),
+    clock(0.0)
+{
+    memset(&stats, 0, sizeof(stats));
+    pthread_mutex_init(&lock, NULL);
+
+    char labels[METRIC_LABELS_MAX];
+    snprintf(labels, sizeof(labels), "backend=\"%s\"", backend->getName());
+    hitsMetric = getMetricCounter("sssp_registry_hits_total", "Graph lookups that found the graph resident.", labels);
+    missesMetric = getMetricCounter("sssp_registry_misses_total", "Graph lookups that had to upload the graph.",
+                                    labels);
+    evictionsMetric = getMetricCounter("sssp_registry_evictions_total", "Graphs evicted to make room.", labels);
+    residentMetric = getMetricGauge("sssp_registry_resident_bytes",
+                                    "Estimated bytes of resident and uploading graphs.", labels);
+    pthread_cond_init(&changed, NULL);
+}
+
+GraphRegistry::~GraphRegistry()
+{
+    addMetric(residentMetric, -(double) reservedBytes);
+    deleteEntries(entries);
+
+    pthread_mutex_destroy(&lock);
+    pthread_cond_destroy(&changed);
+}
+
+///
+/// Resident or uploading entry of a graph, NULL if there is none
+///
+GraphRegistry::Entry *GraphRegistry::findEntry( const char *graphName ) const
+{
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (strncmp(entries[i]->name, graphName, GRAPH_REGISTRY_NAME_MAX - 1) == 0)
+        {
+            return entries[i];
+        }
+    }
+    return NULL;
+}
+
+///
+/// Unpinned entry to evict next under the policy, NULL if every entry is pinned
+///
+GraphRegistry::Entry *GraphRegistry::findVictim() const
+{
+    Entry *victim = NULL;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        Entry *entry = entries[i];
+        if (entry->uploading || entry->busy || entry->waiters > 0)
+        {
+            continue;
+        }
+
+        if (victim == NULL ||
+            (policy == GRAPH_EVICT_LRU && entry->lastUse < victim->lastUse) ||
+            (policy == GRAPH_EVICT_SIZE_AWARE && entry->credit < victim->credit))
+        {
+            victim = entry;
+        }
+    }
+    return victim;
+}
+
+///
+/// Take an entry out of the registry and give back its bytes.  The caller
+/// deletes the session and the entry.
+///
+void GraphRegistry::removeEntry( Entry *entry )
+{
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (entries[i] == entry)
+        {
+            entries.erase(entries.begin() + i);
+            break;
+        }
+    }
+    reservedBytes -= entry->bytes;
+    addMetric(residentMetric, -(double) entry->bytes);
+}
+
+///
+/// Delete entries taken out of the registry and their sessions, and empty the list
+///
+void GraphRegistry::deleteEntries( std::vector<Entry*> &list )
+{
+    for (size_t i = 0; i < list.size(); i++)
+    {
+        delete list[i]->session;
+        delete list[i];
+    }
+    list.clear();
+}
+
+///
+/// Record a use of an entry for the eviction policy
+///
+void GraphRegistry::touch( Entry *entry )
+{
+    entry->lastUse = ++useCounter;
+    entry->credit = clock + 1.0 / (double) (entry->bytes > 0 ? entry->bytes : 1);
+}
+
+///
+/// Get the session of a graph, uploading it if it is not resident
+///
+SSSPSession *GraphRegistry::acquire( const char *graphName, const GraphData *graph )
+{
+    pthread_mutex_lock(&lock);
+    stats.lookups++;
+
+    size_t bytes = backend->estimateSessionBytes(graph);
+    bool counted = false;
+    std::vector<Entry*> victims;
+    for (;;)
+    {
+        Entry *entry = findEntry(graphName);
+        if (entry != NULL)
+        {
+            if (!counted)
+            {
+                stats.hits++;
+                addMetric(hitsMetric, 1.0);
+                counted = true;
+            }
+
+            if (!entry->uploading && !entry->busy)
+            {
+                entry->busy = true;
+                touch(entry);
+                pthread_mutex_unlock(&lock);
+                return entry->session;
+            }
+
+            entry->waiters++;
+            pthread_cond_wait(&changed, &lock);
+            entry->waiters--;
+
+            if (entry->failed && entry->waiters == 0)
+            {
+                delete entry;
+            }
+            continue;
+        }
+
+        if (!counted)
+        {
+            stats.misses++;
+            addMetric(missesMetric, 1.0);
+            counted = true;
+        }
+
+        if (budget != 0 && bytes > budget)
+        {
+            stats.rejections++;
+            pthread_mutex_unlock(&lock);
+            fprintf(stderr, "GraphRegistry: %s (%lu bytes) does not fit in %lu bytes of %s\n",
+                    graphName, (unsigned long) bytes, (unsigned long) budget, backend->getName());
+            return NULL;
+        }
+
+        // Make room for the graph, deleting the victims outside the lock
+        while (budget != 0 && reservedBytes + bytes > budget)
+        {
+            Entry *victim = findVictim();
+            if (victim == NULL)
+            {
+                break;
+            }
+
+            if (policy == GRAPH_EVICT_SIZE_AWARE)
+            {
+                clock = victim->credit;
+            }
+            removeEntry(victim);
+            victims.push_back(victim);
+            stats.evictions++;
+            addMetric(evictionsMetric, 1.0);
+            stats.evictedBytes += victim->bytes;
+        }
+
+        if (budget == 0 || reservedBytes + bytes <= budget)
+        {
+            break;
+        }
+
+        // The rest of the budget is pinned, wait for a release and look again
+        if (victims.empty())
+        {
+            pthread_cond_wait(&changed, &lock);
+        }
+        else
+        {
+            pthread_mutex_unlock(&lock);
+            deleteEntries(victims);
+            pthread_mutex_lock(&lock);
+        }
+    }
+
+    Entry *entry = new Entry;
+    memset(entry, 0, sizeof(Entry));
+    strncpy(entry->name, graphName, GRAPH_REGISTRY_NAME_MAX - 1);
+    entry->graph = graph;
+    entry->bytes = bytes;
+    entry->uploading = true;
+    entries.push_back(entry);
+    reservedBytes += bytes;
+    addMetric(residentMetric, (double) bytes);
+    pthread_mutex_unlock(&lock);
+    deleteEntries(victims);
+
+    SSSPSession *session = backend->createSession(graph);
+
+    pthread_mutex_lock(&lock);
+    entry->uploading = false;
+    if (session == NULL)
+    {
+        stats.rejections++;
+        removeEntry(entry);
+        if (entry->waiters > 0)
+        {
+            entry->failed = true;
+        }
+        else
+        {
+            delete entry;
+        }
+        fprintf(stderr, "GraphRegistry: %s could not load %s\n", backend->getName(), graphName);
+    }
+    else
+    {
+        entry->session = session;
+        entry->busy = true;
+        touch(entry);
+    }
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&lock);
+
+    return session;
+}
+
+///
+/// Unpin a session returned by acquire()
+///
+void GraphRegistry::release( SSSPSession *session )
+{
+    pthread_mutex_lock(&lock);
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (entries[i]->session == session)
+        {
+            entries[i]->busy = false;
+            break;
+        }
+    }
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&lock);
+}
+
+///
+/// Evict a graph now if it is resident and not pinned
+///
+bool GraphRegistry::evict( const char *graphName )
+{
+    pthread_mutex_lock(&lock);
+    Entry *entry = findEntry(graphName);
+    if (entry == NULL || entry->uploading || entry->busy || entry->waiters > 0)
+    {
+        pthread_mutex_unlock(&lock);
+        return false;
+    }
+
+    removeEntry(entry);
+    stats.evictions++;
+    stats.evictedBytes += entry->bytes;
+    addMetric(evictionsMetric, 1.0);
+    pthread_mutex_unlock(&lock);
+
+    delete entry->session;
+    delete entry;
+    return true;
+}
+
+///
+/// Current counters
+///
+GraphRegistryStats GraphRegistry::getStats() const
+{
+    pthread_mutex_lock(&lock);
+    GraphRegistryStats current = stats;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (!entries[i]->uploading)
+        {
+            current.residentGraphs++;
+            current.residentBytes += entries[i]->bytes;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+
+    return current;
+}
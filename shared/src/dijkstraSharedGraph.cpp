@@ -0,0 +1,436 @@
+//
+//
+//  Description:
+//      Publishes a GraphData CSR into a named POSIX shared memory segment so that
+//      several worker processes (typically one per device) can attach to a single
+//      read-only copy of the graph instead of each loading their own.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dijkstraSharedGraph.h"
+
+///
+//  Constants
+//
+
+// Alignment of each array inside the data region
+const size_t SHARED_GRAPH_ALIGNMENT = 64;
+
+// How long an attaching process waits for the publisher to finish writing
+const int SHARED_GRAPH_ATTACH_TIMEOUT_MS = 10000;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+///
+/// Round a byte offset up to SHARED_GRAPH_ALIGNMENT
+///
+static size_t alignOffset(size_t offset)
+{
+    return (offset + SHARED_GRAPH_ALIGNMENT - 1) & ~(SHARED_GRAPH_ALIGNMENT - 1);
+}
+
+///
+/// Copy the segment name into the handle, adding the leading '/' that
+/// shm_open() expects for portable names
+///
+static bool setSegmentName(SharedGraph *sharedGraph, const char *name)
+{
+    if (name == NULL || name[0] == '\0')
+    {
+        return false;
+    }
+
+    int written = snprintf(sharedGraph->name, SHARED_GRAPH_NAME_MAX, "%s%s",
+                           (name[0] == '/') ? "" : "/", name);
+
+    return written > 0 && written < SHARED_GRAPH_NAME_MAX;
+}
+
+///
+/// Point the handle's GraphData at the arrays inside the data mapping
+///
+static void bindGraphArrays(SharedGraph *sharedGraph)
+{
+    SharedGraphHeader *header = sharedGraph->header;
+    char *data = (char*) sharedGraph->data;
+
+    sharedGraph->graph.vertexCount = header->vertexCount;
+    sharedGraph->graph.edgeCount = header->edgeCount;
+    sharedGraph->graph.vertexArray = (int*) (data + header->vertexOffset);
+    sharedGraph->graph.edgeArray = (int*) (data + header->edgeOffset);
+    sharedGraph->graph.weightArray = (float*) (data + header->weightOffset);
+}
+
+///
+/// Whether a process exists.  A pid reused by an unrelated process counts as
+/// alive, which only delays the cleanup.
+///
+static bool isProcessAlive(pid_t pid)
+{
+    return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+///
+/// Take a free slot of the process table, or the slot of a process that
+/// died without detaching
+///
+/// \return The slot, -1 if every slot belongs to a live process
+///
+static int claimSlot(SharedGraphHeader *header)
+{
+    pid_t self = getpid();
+    for (int slot = 0; slot < SHARED_GRAPH_PROCESSES_MAX; slot++)
+    {
+        pid_t owner = header->processes[slot];
+        if ((owner == 0 || !isProcessAlive(owner)) &&
+            __sync_bool_compare_and_swap(&header->processes[slot], owner, self))
+        {
+            return slot;
+        }
+    }
+
+    return -1;
+}
+
+///
+/// Whether any live process is attached
+///
+static bool hasLiveProcess(const SharedGraphHeader *header)
+{
+    for (int slot = 0; slot < SHARED_GRAPH_PROCESSES_MAX; slot++)
+    {
+        if (isProcessAlive(header->processes[slot]))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+///
+/// Close a segment and remove its name.  Only the first of several processes
+/// that decide to close the same segment removes the name, so a segment
+/// published again under that name in the meantime is left alone.
+///
+static bool closeSegment(SharedGraphHeader *header, const char *name)
+{
+    if (!__sync_bool_compare_and_swap(&header->closed, 0, 1))
+    {
+        return false;
+    }
+
+    shm_unlink(name);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+/// Create a new named shared memory segment holding a copy of the graph and
+/// attach to it.
+///
+bool publishSharedGraph( const char *name, const GraphData *graph, SharedGraph *sharedGraph )
+{
+    memset(sharedGraph, 0, sizeof(SharedGraph));
+    if (!setSegmentName(sharedGraph, name))
+    {
+        fprintf(stderr, "publishSharedGraph: invalid segment name\n");
+        return false;
+    }
+
+    // Lay out the data region, each array on its own cache line
+    size_t vertexOffset = 0;
+    size_t edgeOffset = alignOffset(vertexOffset + sizeof(int) * graph->vertexCount);
+    size_t weightOffset = alignOffset(edgeOffset + sizeof(int) * graph->edgeCount);
+    size_t dataSize = alignOffset(weightOffset + sizeof(float) * graph->edgeCount);
+    size_t headerSize = (size_t) sysconf(_SC_PAGESIZE);
+
+    int fd = shm_open(sharedGraph->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        if (errno == EEXIST)
+        {
+            fprintf(stderr, "publishSharedGraph: segment %s already exists\n", sharedGraph->name);
+        }
+        else
+        {
+            perror("publishSharedGraph: shm_open");
+        }
+        return false;
+    }
+
+    if (ftruncate(fd, headerSize + dataSize) != 0)
+    {
+        perror("publishSharedGraph: ftruncate");
+        close(fd);
+        shm_unlink(sharedGraph->name);
+        return false;
+    }
+
+    void *header = mmap(NULL, headerSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    void *data = mmap(NULL, dataSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, headerSize);
+    close(fd);
+
+    if (header == MAP_FAILED || data == MAP_FAILED)
+    {
+        perror("publishSharedGraph: mmap");
+        if (header != MAP_FAILED) munmap(header, headerSize);
+        if (data != MAP_FAILED) munmap(data, dataSize);
+        shm_unlink(sharedGraph->name);
+        return false;
+    }
+
+    sharedGraph->header = (SharedGraphHeader*) header;
+    sharedGraph->headerSize = headerSize;
+    sharedGraph->data = data;
+    sharedGraph->slot = 0;
+
+    // Fill in the header, ready stays 0 until the arrays are in place
+    // The publisher is recorded before the magic, so attachers that see the
+    // magic can tell whether the publisher is still alive
+    SharedGraphHeader *h = sharedGraph->header;
+    h->publisherPid = getpid();
+    h->processes[0] = h->publisherPid;
+    __sync_synchronize();
+    h->magic = SHARED_GRAPH_MAGIC;
+    h->version = SHARED_GRAPH_VERSION;
+    h->vertexCount = graph->vertexCount;
+    h->edgeCount = graph->edgeCount;
+    h->vertexOffset = vertexOffset;
+    h->edgeOffset = edgeOffset;
+    h->weightOffset = weightOffset;
+    h->dataSize = dataSize;
+
+    memcpy((char*) data + vertexOffset, graph->vertexArray, sizeof(int) * graph->vertexCount);
+    memcpy((char*) data + edgeOffset, graph->edgeArray, sizeof(int) * graph->edgeCount);
+    memcpy((char*) data + weightOffset, graph->weightArray, sizeof(float) * graph->edgeCount);
+
+    // From here on nobody writes the arrays, including the publisher
+    mprotect(data, dataSize, PROT_READ);
+
+    __sync_synchronize();
+    h->ready = 1;
+
+    bindGraphArrays(sharedGraph);
+    return true;
+}
+
+///
+/// Attach read-only to a graph previously published by another process.
+///
+bool attachSharedGraph( const char *name, int vertexCount, int edgeCount, SharedGraph *sharedGraph )
+{
+    memset(sharedGraph, 0, sizeof(SharedGraph));
+    if (!setSegmentName(sharedGraph, name))
+    {
+        fprintf(stderr, "attachSharedGraph: invalid segment name\n");
+        return false;
+    }
+
+    // The header is opened read/write so the process table can be updated
+    int fd = shm_open(sharedGraph->name, O_RDWR, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    size_t headerSize = (size_t) sysconf(_SC_PAGESIZE);
+    struct stat info;
+
+    // A publisher that has created but not yet sized the segment shows up as
+    // an empty object, give it a chance to finish
+    int waitedMs = 0;
+    while (fstat(fd, &info) == 0 && (size_t) info.st_size < headerSize &&
+           waitedMs < SHARED_GRAPH_ATTACH_TIMEOUT_MS)
+    {
+        usleep(1000);
+        waitedMs++;
+    }
+
+    // The publisher died before sizing the segment; nobody else can use it
+    if ((size_t) info.st_size < headerSize)
+    {
+        fprintf(stderr, "attachSharedGraph: segment %s was never initialized, removing it\n", sharedGraph->name);
+        shm_unlink(sharedGraph->name);
+        close(fd);
+        return false;
+    }
+
+    SharedGraphHeader *header = (SharedGraphHeader*) mmap(NULL, headerSize, PROT_READ | PROT_WRITE,
+                                                          MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED)
+    {
+        perror("attachSharedGraph: mmap");
+        close(fd);
+        return false;
+    }
+
+    // A zero magic is a header the publisher has sized but not written yet
+    while (!header->ready && (header->magic == 0 || isProcessAlive(header->publisherPid)) &&
+           waitedMs < SHARED_GRAPH_ATTACH_TIMEOUT_MS)
+    {
+        usleep(1000);
+        waitedMs++;
+    }
+    __sync_synchronize();
+
+    // A publisher that died before finishing leaves a segment nobody can use;
+    // remove it so that the graph can be published again
+    bool abandoned = !header->ready &&
+                     (header->magic == 0 || (header->magic == SHARED_GRAPH_MAGIC &&
+                                             header->version == SHARED_GRAPH_VERSION &&
+                                             !isProcessAlive(header->publisherPid)));
+    if (abandoned)
+    {
+        fprintf(stderr, "attachSharedGraph: publisher of %s died before finishing it, removing it\n",
+                sharedGraph->name);
+        closeSegment(header, sharedGraph->name);
+    }
+
+    bool usable = header->ready && !header->closed && header->magic == SHARED_GRAPH_MAGIC &&
+                  header->version == SHARED_GRAPH_VERSION &&
+                  (size_t) info.st_size >= headerSize + header->dataSize;
+    if (usable && ((vertexCount >= 0 && header->vertexCount != vertexCount) ||
+                   (edgeCount >= 0 && header->edgeCount != edgeCount)))
+    {
+        fprintf(stderr, "attachSharedGraph: segment %s holds a graph of %d vertices and %d edges, "
+                "not %d and %d\n", sharedGraph->name, header->vertexCount, header->edgeCount, vertexCount, edgeCount);
+        munmap(header, headerSize);
+        close(fd);
+        return false;
+    }
+
+    int slot = usable ? claimSlot(header) : -1;
+    if (usable && slot < 0)
+    {
+        fprintf(stderr, "attachSharedGraph: segment %s has no free process slot\n", sharedGraph->name);
+    }
+
+    // The last process may have closed the segment while the slot was claimed
+    if (slot >= 0 && header->closed)
+    {
+        __sync_bool_compare_and_swap(&header->processes[slot], getpid(), 0);
+        slot = -1;
+    }
+
+    if (slot < 0)
+    {
+        if (!abandoned && !usable)
+        {
+            fprintf(stderr, "attachSharedGraph: segment %s is not a usable graph\n", sharedGraph->name);
+        }
+        munmap(header, headerSize);
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, header->dataSize, PROT_READ, MAP_SHARED, fd, headerSize);
+    close(fd);
+
+    sharedGraph->header = header;
+    sharedGraph->headerSize = headerSize;
+    sharedGraph->slot = slot;
+
+    if (data == MAP_FAILED)
+    {
+        perror("attachSharedGraph: mmap");
+        detachSharedGraph(sharedGraph);
+        return false;
+    }
+
+    sharedGraph->data = data;
+    bindGraphArrays(sharedGraph);
+    return true;
+}
+
+///
+/// Detach from a shared graph.  The segment name is removed when no live
+/// process is left attached.
+///
+void detachSharedGraph( SharedGraph *sharedGraph )
+{
+    SharedGraphHeader *header = sharedGraph->header;
+    if (header == NULL)
+    {
+        return;
+    }
+
+    if (sharedGraph->data != NULL)
+    {
+        munmap(sharedGraph->data, header->dataSize);
+    }
+
+    __sync_bool_compare_and_swap(&header->processes[sharedGraph->slot], getpid(), 0);
+    if (!hasLiveProcess(header))
+    {
+        closeSegment(header, sharedGraph->name);
+    }
+
+    munmap(header, sharedGraph->headerSize);
+    memset(sharedGraph, 0, sizeof(SharedGraph));
+}
+
+///
+/// Remove a segment that no live process is attached to
+///
+bool removeSharedGraph( const char *name )
+{
+    SharedGraph handle;
+    memset(&handle, 0, sizeof(SharedGraph));
+    if (!setSegmentName(&handle, name))
+    {
+        return false;
+    }
+
+    int fd = shm_open(handle.name, O_RDWR, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    // A segment that was never sized has no process table, and no user
+    size_t headerSize = (size_t) sysconf(_SC_PAGESIZE);
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t) info.st_size < headerSize)
+    {
+        close(fd);
+        return shm_unlink(handle.name) == 0;
+    }
+
+    SharedGraphHeader *header = (SharedGraphHeader*) mmap(NULL, headerSize, PROT_READ | PROT_WRITE,
+                                                          MAP_SHARED, fd, 0);
+    close(fd);
+    if (header == MAP_FAILED)
+    {
+        perror("removeSharedGraph: mmap");
+        return false;
+    }
+
+    bool removed = false;
+    if (header->magic == SHARED_GRAPH_MAGIC && header->version == SHARED_GRAPH_VERSION &&
+        !hasLiveProcess(header) && !(isProcessAlive(header->publisherPid) && !header->ready))
+    {
+        removed = closeSegment(header, handle.name);
+    }
+
+    munmap(header, headerSize);
+    return removed;
+}
@@ -0,0 +1,405 @@
+//
+//
+//  Description:
+//      Engine snapshots.  See dijkstraSnapshot.h.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dijkstraSnapshot.h"
+#include "dijkstraMemory.h"
+
+///
+//  Constants
+//
+
+// Alignment of each section in the file
+const size_t SNAPSHOT_ALIGNMENT = 64;
+
+///
+//  Types
+//
+
+// Dimensions stored ahead of the arrays of each kind of derived state
+typedef struct
+{
+    int vertexCount;
+    int landmarkCount;
+
+} OracleSection;
+
+typedef struct
+{
+    int vertexCount;
+    int reserved;
+
+} HubLabelsSection;
+
+typedef struct
+{
+    int vertexCount;
+    int wccCount;
+    int sccCount;
+    int reserved;
+
+} ComponentsSection;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+///
+/// Round a byte offset up to SNAPSHOT_ALIGNMENT
+///
+static long long alignOffset(long long offset)
+{
+    return (offset + SNAPSHOT_ALIGNMENT - 1) & ~((long long) SNAPSHOT_ALIGNMENT - 1);
+}
+
+///
+/// Copy a section of the expected size out of a snapshot
+///
+/// \return A trackedMalloc()ed copy, NULL if the section is missing or of another size
+///
+static void *restoreArray(const Snapshot *snapshot, const char *tag, size_t size)
+{
+    size_t sectionSize;
+    const void *data = findSnapshotSection(snapshot, tag, &sectionSize);
+    if (data == NULL || sectionSize != size)
+    {
+        return NULL;
+    }
+
+    void *copy = trackedMalloc(MEMORY_PREPROCESSING, size);
+    memcpy(copy, data, size);
+    return copy;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+/// Start writing a snapshot
+///
+bool beginSnapshot( const char *fileName, const GraphData *graph, SnapshotWriter *outWriter )
+{
+    memset(outWriter, 0, sizeof(SnapshotWriter));
+
+    outWriter->file = fopen(fileName, "wb");
+    if (outWriter->file == NULL)
+    {
+        fprintf(stderr, "beginSnapshot: cannot open %s\n", fileName);
+        return false;
+    }
+
+    outWriter->header.magic = SNAPSHOT_MAGIC;
+    outWriter->header.version = SNAPSHOT_VERSION;
+    outWriter->header.graphChecksum = graphChecksum(graph);
+    outWriter->header.vertexCount = graph->vertexCount;
+    outWriter->header.edgeCount = graph->edgeCount;
+
+    // The header is written again by finishSnapshot() once the sections are known
+    outWriter->offset = sizeof(SnapshotHeader);
+    outWriter->failed = fwrite(&outWriter->header, sizeof(SnapshotHeader), 1, outWriter->file) != 1;
+
+    return !outWriter->failed;
+}
+
+///
+/// Append a section
+///
+bool addSnapshotSection( SnapshotWriter *writer, const char *tag, const void *data, size_t size )
+{
+    SnapshotHeader *header = &writer->header;
+    if (header->sectionCount == SNAPSHOT_SECTION_MAX || strlen(tag) >= SNAPSHOT_TAG_MAX)
+    {
+        fprintf(stderr, "addSnapshotSection: no room for section %s\n", tag);
+        writer->failed = true;
+        return false;
+    }
+
+    // Zero padding up to the aligned start of the section
+    char padding[SNAPSHOT_ALIGNMENT];
+    memset(padding, 0, sizeof(padding));
+    long long offset = alignOffset(writer->offset);
+
+    bool written = !writer->failed &&
+                   fwrite(padding, 1, offset - writer->offset, writer->file) == (size_t) (offset - writer->offset) &&
+                   fwrite(data, 1, size, writer->file) == size;
+    if (!written)
+    {
+        writer->failed = true;
+        return false;
+    }
+
+    SnapshotSection *section = &header->sections[header->sectionCount++];
+    strcpy(section->tag, tag);
+    section->offset = offset;
+    section->size = size;
+    writer->offset = offset + size;
+
+    return true;
+}
+
+///
+/// Write the section table and close the file
+///
+bool finishSnapshot( SnapshotWriter *writer )
+{
+    bool written = !writer->failed && fseek(writer->file, 0, SEEK_SET) == 0 &&
+                   fwrite(&writer->header, sizeof(SnapshotHeader), 1, writer->file) == 1;
+
+    written = (fclose(writer->file) == 0) && written;
+    if (!written)
+    {
+        fprintf(stderr, "finishSnapshot: error writing the snapshot\n");
+    }
+
+    memset(writer, 0, sizeof(SnapshotWriter));
+    return written;
+}
+
+///
+/// Map a snapshot read-only and check that it was taken on graph
+///
+bool openSnapshot( const char *fileName, const GraphData *graph, Snapshot *outSnapshot )
+{
+    memset(outSnapshot, 0, sizeof(Snapshot));
+
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(SnapshotHeader))
+    {
+        fprintf(stderr, "openSnapshot: %s is not a snapshot\n", fileName);
+        close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        perror("openSnapshot: mmap");
+        return false;
+    }
+
+    const SnapshotHeader *header = (const SnapshotHeader*) mapping;
+    bool valid = header->magic == SNAPSHOT_MAGIC && header->version == SNAPSHOT_VERSION &&
+                 header->sectionCount >= 0 && header->sectionCount <= SNAPSHOT_SECTION_MAX;
+    for (int i = 0; i < header->sectionCount && valid; i++)
+    {
+        const SnapshotSection *section = &header->sections[i];
+        valid = section->offset >= 0 && section->size >= 0 &&
+                section->offset + section->size <= (long long) info.st_size &&
+                memchr(section->tag, '\0', SNAPSHOT_TAG_MAX) != NULL;
+    }
+    if (!valid)
+    {
+        fprintf(stderr, "openSnapshot: %s is not a snapshot of version %d\n", fileName, SNAPSHOT_VERSION);
+        munmap(mapping, info.st_size);
+        return false;
+    }
+
+    if (header->vertexCount != graph->vertexCount || header->edgeCount != graph->edgeCount ||
+        header->graphChecksum != graphChecksum(graph))
+    {
+        fprintf(stderr, "openSnapshot: %s was taken on another graph\n", fileName);
+        munmap(mapping, info.st_size);
+        return false;
+    }
+
+    outSnapshot->mapping = mapping;
+    outSnapshot->mappingSize = info.st_size;
+    outSnapshot->header = header;
+    return true;
+}
+
+///
+/// Find a section of an open snapshot
+///
+const void *findSnapshotSection( const Snapshot *snapshot, const char *tag, size_t *outSize )
+{
+    const SnapshotHeader *header = snapshot->header;
+    for (int i = 0; header != NULL && i < header->sectionCount; i++)
+    {
+        if (strcmp(header->sections[i].tag, tag) == 0)
+        {
+            *outSize = (size_t) header->sections[i].size;
+            return (const char*) snapshot->mapping + header->sections[i].offset;
+        }
+    }
+
+    return NULL;
+}
+
+///
+/// Unmap a snapshot
+///
+void closeSnapshot( Snapshot *snapshot )
+{
+    if (snapshot->mapping != NULL)
+    {
+        munmap(snapshot->mapping, snapshot->mappingSize);
+    }
+    memset(snapshot, 0, sizeof(Snapshot));
+}
+
+///
+/// Add the landmark tables of an oracle to a snapshot
+///
+bool snapshotDistanceOracle( SnapshotWriter *writer, const DistanceOracle *oracle )
+{
+    OracleSection section = { oracle->vertexCount, oracle->landmarkCount };
+    size_t tableSize = sizeof(float) * oracle->vertexCount * (size_t) oracle->landmarkCount;
+
+    return addSnapshotSection(writer, "oracle", &section, sizeof(section)) &&
+           addSnapshotSection(writer, "oracle.landmarks", oracle->landmarks, sizeof(int) * oracle->landmarkCount) &&
+           addSnapshotSection(writer, "oracle.to", oracle->toLandmark, tableSize) &&
+           addSnapshotSection(writer, "oracle.from", oracle->fromLandmark, tableSize);
+}
+
+///
+/// Add hub labels to a snapshot
+///
+bool snapshotHubLabels( SnapshotWriter *writer, const HubLabels *labels )
+{
+    HubLabelsSection section = { labels->vertexCount, 0 };
+    size_t startCount = 2 * (size_t) labels->vertexCount + 1;
+
+    return addSnapshotSection(writer, "hub", &section, sizeof(section)) &&
+           addSnapshotSection(writer, "hub.order", labels->order, sizeof(int) * labels->vertexCount) &&
+           addSnapshotSection(writer, "hub.start", labels->labelStart, sizeof(long long) * startCount) &&
+           addSnapshotSection(writer, "hub.entries", labels->entries,
+                              sizeof(HubLabelEntry) * labels->labelStart[startCount - 1]);
+}
+
+///
+/// Add a component index to a snapshot
+///
+bool snapshotComponentIndex( SnapshotWriter *writer, const ComponentIndex *index )
+{
+    ComponentsSection section = { index->vertexCount, index->wccCount, index->sccCount, 0 };
+    size_t vertexSize = sizeof(int) * index->vertexCount;
+
+    return addSnapshotSection(writer, "components", &section, sizeof(section)) &&
+           addSnapshotSection(writer, "components.wcc", index->wcc, vertexSize) &&
+           addSnapshotSection(writer, "components.wccStart", index->wccStart, sizeof(int) * (index->wccCount + 1)) &&
+           addSnapshotSection(writer, "components.wccVertices", index->wccVertices, vertexSize) &&
+           addSnapshotSection(writer, "components.wccLocal", index->wccLocalVertex, vertexSize) &&
+           addSnapshotSection(writer, "components.scc", index->scc, vertexSize) &&
+           addSnapshotSection(writer, "components.sccSize", index->sccSize, sizeof(int) * index->sccCount);
+}
+
+///
+/// Restore an oracle from a snapshot
+///
+bool restoreDistanceOracle( const Snapshot *snapshot, DistanceOracle *outOracle )
+{
+    memset(outOracle, 0, sizeof(DistanceOracle));
+
+    size_t size;
+    const OracleSection *section = (const OracleSection*) findSnapshotSection(snapshot, "oracle", &size);
+    if (section == NULL || size != sizeof(OracleSection))
+    {
+        return false;
+    }
+
+    size_t tableSize = sizeof(float) * section->vertexCount * (size_t) section->landmarkCount;
+    outOracle->vertexCount = section->vertexCount;
+    outOracle->landmarkCount = section->landmarkCount;
+    outOracle->landmarks = (int*) restoreArray(snapshot, "oracle.landmarks", sizeof(int) * section->landmarkCount);
+    outOracle->toLandmark = (float*) restoreArray(snapshot, "oracle.to", tableSize);
+    outOracle->fromLandmark = (float*) restoreArray(snapshot, "oracle.from", tableSize);
+
+    if (outOracle->landmarks == NULL || outOracle->toLandmark == NULL || outOracle->fromLandmark == NULL)
+    {
+        freeDistanceOracle(outOracle);
+        return false;
+    }
+
+    return true;
+}
+
+///
+/// Restore hub labels from a snapshot
+///
+bool restoreHubLabels( const Snapshot *snapshot, HubLabels *outLabels )
+{
+    memset(outLabels, 0, sizeof(HubLabels));
+
+    size_t size;
+    const HubLabelsSection *section = (const HubLabelsSection*) findSnapshotSection(snapshot, "hub", &size);
+    if (section == NULL || size != sizeof(HubLabelsSection))
+    {
+        return false;
+    }
+
+    size_t startCount = 2 * (size_t) section->vertexCount + 1;
+    outLabels->vertexCount = section->vertexCount;
+    outLabels->order = (int*) restoreArray(snapshot, "hub.order", sizeof(int) * section->vertexCount);
+    outLabels->labelStart = (long long*) restoreArray(snapshot, "hub.start", sizeof(long long) * startCount);
+    if (outLabels->labelStart != NULL)
+    {
+        outLabels->entries = (HubLabelEntry*) restoreArray(snapshot, "hub.entries",
+                                                           sizeof(HubLabelEntry) * outLabels->labelStart[startCount - 1]);
+    }
+
+    if (outLabels->order == NULL || outLabels->labelStart == NULL || outLabels->entries == NULL)
+    {
+        freeHubLabels(outLabels);
+        return false;
+    }
+
+    return true;
+}
+
+///
+/// Restore a component index from a snapshot
+///
+bool restoreComponentIndex( const Snapshot *snapshot, ComponentIndex *outIndex )
+{
+    memset(outIndex, 0, sizeof(ComponentIndex));
+
+    size_t size;
+    const ComponentsSection *section = (const ComponentsSection*) findSnapshotSection(snapshot, "components", &size);
+    if (section == NULL || size != sizeof(ComponentsSection))
+    {
+        return false;
+    }
+
+    size_t vertexSize = sizeof(int) * section->vertexCount;
+    outIndex->vertexCount = section->vertexCount;
+    outIndex->wccCount = section->wccCount;
+    outIndex->sccCount = section->sccCount;
+    outIndex->wcc = (int*) restoreArray(snapshot, "components.wcc", vertexSize);
+    outIndex->wccStart = (int*) restoreArray(snapshot, "components.wccStart", sizeof(int) * (section->wccCount + 1));
+    outIndex->wccVertices = (int*) restoreArray(snapshot, "components.wccVertices", vertexSize);
+    outIndex->wccLocalVertex = (int*) restoreArray(snapshot, "components.wccLocal", vertexSize);
+    outIndex->scc = (int*) restoreArray(snapshot, "components.scc", vertexSize);
+    outIndex->sccSize = (int*) restoreArray(snapshot, "components.sccSize", sizeof(int) * section->sccCount);
+
+    if (outIndex->wcc == NULL || outIndex->wccStart == NULL || outIndex->wccVertices == NULL ||
+        outIndex->wccLocalVertex == NULL || outIndex->scc == NULL || outIndex->sccSize == NULL)
+    {
+        freeComponentIndex(outIndex);
+        return false;
+    }
+
+    return true;
+}
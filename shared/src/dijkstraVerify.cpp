@@ -0,0 +1,313 @@
+//
+//
+//  Description:
+//      Linear-time certificate check of SSSP results.  See dijkstraVerify.h.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "dijkstraVerify.h"
+
+///
+//  Types
+//
+
+// Workload of one thread of verifySSSP()
+typedef struct
+{
+    const GraphData *graph;
+    const GraphData *reverseGraph;
+    const int *sourceVertices;
+    const float *costs;
+    int numResults;
+
+    // Vertices whose in-edges this thread checks in every row, none if
+    // reverseGraph is NULL
+    int firstVertex;
+    int lastVertex;
+
+    // Rows whose paths this thread checks: firstRow, firstRow + rowStride, ...
+    int firstRow;
+    int rowStride;
+
+    SSSPVerification verification;
+
+} VerifyPlan;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+///
+/// Record a failure at a vertex; rows are checked in order, so the first one
+/// recorded is the earliest of the thread
+///
+static void recordFailure(SSSPVerification *verification, long long *counter, int row, int vertex)
+{
+    (*counter)++;
+    if (verification->firstBadRow < 0)
+    {
+        verification->firstBadRow = row;
+        verification->firstBadVertex = vertex;
+    }
+}
+
+///
+/// Whether an edge with bound cost[u] + w accounts for cost, within the slack
+///
+static bool isTight(float cost, float bound)
+{
+    float slack = ssspVerifySlack(cost, bound);
+    return cost <= bound + slack && cost >= bound - slack;
+}
+
+///
+/// Traverse the tight edges of a row from its source and count the reached
+/// vertices the traversal misses
+///
+/// \param visited Scratch of graph->vertexCount bytes
+/// \param queue Scratch of graph->vertexCount vertices
+///
+static void checkPaths(const GraphData *graph, const float *costArray, int row, int sourceVertex,
+                       unsigned char *visited, int *queue, SSSPVerification *verification)
+{
+    memset(visited, 0, graph->vertexCount);
+
+    int head = 0;
+    int tail = 0;
+    visited[sourceVertex] = 1;
+    queue[tail++] = sourceVertex;
+    while (head < tail)
+    {
+        int u = queue[head++];
+        int edgeEnd = graphEdgeEnd(graph, u);
+        for (int edge = graph->vertexArray[u]; edge < edgeEnd; edge++)
+        {
+            int v = graph->edgeArray[edge];
+            if (!visited[v] && costArray[v] != FLT_MAX &&
+                isTight(costArray[v], costArray[u] + graph->weightArray[edge]))
+            {
+                visited[v] = 1;
+                queue[tail++] = v;
+            }
+        }
+    }
+
+    // Invalid costs are counted by the edge check already
+    for (int v = 0; v < graph->vertexCount; v++)
+    {
+        float cost = costArray[v];
+        if (!visited[v] && cost != FLT_MAX && !isnan(cost) && cost >= 0.0f)
+        {
+            recordFailure(verification, &verification->unsupportedVertices, row, v);
+        }
+    }
+}
+
+///
+/// Check the vertices of a plan in every row, then the paths of its rows
+///
+static void *verifyThread(void *arg)
+{
+    VerifyPlan *plan = (VerifyPlan*) arg;
+    const GraphData *graph = plan->graph;
+    const GraphData *reverseGraph = plan->reverseGraph;
+    SSSPVerification *verification = &plan->verification;
+
+    for (int row = 0; row < plan->numResults && reverseGraph != NULL; row++)
+    {
+        const float *costArray = &plan->costs[(size_t) row * reverseGraph->vertexCount];
+        int sourceVertex = plan->sourceVertices[row];
+
+        for (int v = plan->firstVertex; v < plan->lastVertex; v++)
+        {
+            float cost = costArray[v];
+            if (isnan(cost) || cost < 0.0f)
+            {
+                recordFailure(verification, &verification->invalidCosts, row, v);
+                continue;
+            }
+
+            if (v == sourceVertex)
+            {
+                if (cost != 0.0f)
+                {
+                    recordFailure(verification, &verification->sourceErrors, row, v);
+                }
+                continue;
+            }
+
+            // Every in-edge from a reached vertex must not improve v, and
+            // one of them must account for its cost
+            bool tight = false;
+            int edgeEnd = graphEdgeEnd(reverseGraph, v);
+            for (int edge = reverseGraph->vertexArray[v]; edge < edgeEnd; edge++)
+            {
+                float fromCost = costArray[reverseGraph->edgeArray[edge]];
+                if (fromCost == FLT_MAX)
+                {
+                    continue;
+                }
+
+                float bound = fromCost + reverseGraph->weightArray[edge];
+                float slack = ssspVerifySlack(cost, bound);
+                if (cost > bound + slack)
+                {
+                    recordFailure(verification, &verification->edgeViolations, row, v);
+                }
+                else if (cost >= bound - slack)
+                {
+                    tight = true;
+                }
+            }
+
+            if (cost != FLT_MAX && !tight)
+            {
+                recordFailure(verification, &verification->untightVertices, row, v);
+            }
+        }
+    }
+
+    if (plan->firstRow < plan->numResults)
+    {
+        unsigned char *visited = (unsigned char*) malloc(graph->vertexCount);
+        int *queue = (int*) malloc(sizeof(int) * graph->vertexCount);
+        for (int row = plan->firstRow; row < plan->numResults; row += plan->rowStride)
+        {
+            checkPaths(graph, &plan->costs[(size_t) row * graph->vertexCount], row, plan->sourceVertices[row],
+                       visited, queue, verification);
+        }
+        free(visited);
+        free(queue);
+    }
+
+    return NULL;
+}
+
+///
+/// Run the checks of verifySSSP() on threadCount threads, the edge checks only
+/// if reverseGraph is not NULL
+///
+static bool runVerifyThreads(const GraphData *graph, const GraphData *reverseGraph, const int *sourceVertices,
+                             const float *costs, int numResults, int threadCount,
+                             SSSPVerification *outVerification)
+{
+    if (threadCount < 1)
+    {
+        threadCount = 1;
+    }
+
+    VerifyPlan *plans = (VerifyPlan*) malloc(sizeof(VerifyPlan) * threadCount);
+    pthread_t *threadIDs = (pthread_t*) malloc(sizeof(pthread_t) * threadCount);
+    for (int i = 0; i < threadCount; i++)
+    {
+        plans[i].graph = graph;
+        plans[i].reverseGraph = reverseGraph;
+        plans[i].sourceVertices = sourceVertices;
+        plans[i].costs = costs;
+        plans[i].numResults = numResults;
+        plans[i].firstVertex = (int) ((long long) graph->vertexCount * i / threadCount);
+        plans[i].lastVertex = (int) ((long long) graph->vertexCount * (i + 1) / threadCount);
+        plans[i].firstRow = (graph->vertexCount > 0) ? i : numResults;
+        plans[i].rowStride = threadCount;
+        initSSSPVerification(&plans[i].verification);
+
+        pthread_create(&threadIDs[i], NULL, verifyThread, (void*)(plans + i));
+    }
+
+    SSSPVerification verification;
+    initSSSPVerification(&verification);
+    verification.rows = numResults;
+    for (int i = 0; i < threadCount; i++)
+    {
+        pthread_join(threadIDs[i], NULL);
+        mergeSSSPVerification(&verification, &plans[i].verification);
+    }
+    free(plans);
+    free(threadIDs);
+
+    if (outVerification != NULL)
+    {
+        *outVerification = verification;
+    }
+    return isSSSPVerified(&verification);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+/// Clear a verification
+///
+void initSSSPVerification( SSSPVerification *verification )
+{
+    verification->rows = 0;
+    verification->sourceErrors = 0;
+    verification->edgeViolations = 0;
+    verification->untightVertices = 0;
+    verification->unsupportedVertices = 0;
+    verification->invalidCosts = 0;
+    verification->firstBadRow = -1;
+    verification->firstBadVertex = -1;
+}
+
+///
+/// Add the failure counts of one verification to another
+///
+void mergeSSSPVerification( SSSPVerification *total, const SSSPVerification *part )
+{
+    total->sourceErrors += part->sourceErrors;
+    total->edgeViolations += part->edgeViolations;
+    total->untightVertices += part->untightVertices;
+    total->unsupportedVertices += part->unsupportedVertices;
+    total->invalidCosts += part->invalidCosts;
+
+    bool earlier = total->firstBadRow < 0 || part->firstBadRow < total->firstBadRow ||
+                   (part->firstBadRow == total->firstBadRow && part->firstBadVertex < total->firstBadVertex);
+    if (part->firstBadRow >= 0 && earlier)
+    {
+        total->firstBadRow = part->firstBadRow;
+        total->firstBadVertex = part->firstBadVertex;
+    }
+}
+
+///
+/// Check result rows against the shortest-path optimality conditions
+///
+bool verifySSSP( const GraphData *graph, const GraphData *reverseGraph, const int *sourceVertices,
+                 const float *costs, int numResults, int threadCount, SSSPVerification *outVerification )
+{
+    GraphData builtReverse;
+    if (reverseGraph == NULL)
+    {
+        buildReverseGraph(graph, &builtReverse);
+        reverseGraph = &builtReverse;
+    }
+
+    bool verified = runVerifyThreads(graph, reverseGraph, sourceVertices, costs, numResults, threadCount,
+                                     outVerification);
+
+    if (reverseGraph == &builtReverse)
+    {
+        freeGraph(&builtReverse);
+    }
+
+    return verified;
+}
+
+///
+/// Check the tight-edge paths of result rows
+///
+bool verifySSSPPaths( const GraphData *graph, const int *sourceVertices, const float *costs, int numResults,
+                      int threadCount, SSSPVerification *outVerification )
+{
+    return runVerifyThreads(graph, NULL, sourceVertices, costs, numResults, threadCount, outVerification);
+}
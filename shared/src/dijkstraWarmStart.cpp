@@ -0,0 +1,119 @@
+//
+//
+//  Description:
+//      Source ordering and seeding for warm-started searches.  See
+//      dijkstraWarmStart.h.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <float.h>
+#include <functional>
+#include <queue>
+#include <vector>
+#include "dijkstraWarmStart.h"
+
+///
+//  Types
+//
+
+// Heap entry, ordered by cost
+typedef std::pair<float, int> HeapEntry;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+/// Pick the next source of a warm-started batch
+///
+int nextWarmStartSource( const float *previousCosts, const int *sourceVertices,
+                         const int *pending, int pendingCount )
+{
+    int best = 0;
+    int window = (pendingCount < WARM_START_WINDOW) ? pendingCount : WARM_START_WINDOW;
+    for (int n = 1; n < window; n++)
+    {
+        if (previousCosts[sourceVertices[pending[n]]] < previousCosts[sourceVertices[pending[best]]])
+        {
+            best = n;
+        }
+    }
+
+    return best;
+}
+
+///
+/// Cost of the shortest path from one vertex to another, giving up after a
+/// fraction of the graph
+///
+float boundedSourceDistance( const GraphData *graph, int from, int to )
+{
+    if (from == to)
+    {
+        return 0.0f;
+    }
+
+    int settleLimit = graph->vertexCount / WARM_START_SETTLE_DIVISOR + 1;
+    int settled = 0;
+
+    std::priority_queue<HeapEntry, std::vector<HeapEntry>, std::greater<HeapEntry> > heap;
+    std::vector<float> costArray(graph->vertexCount, FLT_MAX);
+
+    costArray[from] = 0.0f;
+    heap.push(HeapEntry(0.0f, from));
+    while (!heap.empty() && settled < settleLimit)
+    {
+        HeapEntry top = heap.top();
+        heap.pop();
+
+        int vertex = top.second;
+        if (top.first > costArray[vertex])
+        {
+            continue;
+        }
+
+        if (vertex == to)
+        {
+            return top.first;
+        }
+        settled++;
+
+        int edgeEnd = graphEdgeEnd(graph, vertex);
+        for (int edge = graph->vertexArray[vertex]; edge < edgeEnd; edge++)
+        {
+            int nid = graph->edgeArray[edge];
+            float cost = top.first + graph->weightArray[edge];
+            if (cost < costArray[nid])
+            {
+                costArray[nid] = cost;
+                heap.push(HeapEntry(cost, nid));
+            }
+        }
+    }
+
+    return FLT_MAX;
+}
+
+///
+/// Seed a search from source with the costs of a finished search
+///
+bool seedWarmStart( const GraphData *graph, const float *previousCosts, int previousSource,
+                    int source, float *outCosts )
+{
+    float shift = boundedSourceDistance(graph, source, previousSource);
+    if (shift == FLT_MAX)
+    {
+        return false;
+    }
+
+    for (int v = 0; v < graph->vertexCount; v++)
+    {
+        outCosts[v] = (previousCosts[v] == FLT_MAX) ? FLT_MAX : shift + previousCosts[v];
+    }
+    outCosts[source] = 0.0f;
+
+    return true;
+}
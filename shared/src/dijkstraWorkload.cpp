@@ -0,0 +1,327 @@
+//
+//
+//  Description:
+//      Query workload recorder and replayer.  See dijkstraWorkload.h.
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <vector>
+#include "dijkstraWorkload.h"
+#include "dijkstraMemory.h"
+
+///
+//  Types
+//
+
+//
+//  One query loaded from a workload file
+//
+typedef struct
+{
+    WorkloadRecord record;
+
+    // Index of the first source in the loaded source list
+    size_t firstSource;
+
+} LoadedQuery;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+///
+/// Wall clock time in seconds
+///
+static double workloadTime()
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec + now.tv_usec * 1.0e-6;
+}
+
+///
+/// Completion callback of a replayed query, stamps its finish time
+///
+static void onQueryFinished(void *userData)
+{
+    *(double*) userData = workloadTime();
+}
+
+///
+/// Read every complete record of a workload file.  A record cut short at the
+/// end of the file, left by a recorder that did not finish, is ignored.
+///
+static bool loadWorkload(const char *fileName, const GraphData *graph,
+                         std::vector<LoadedQuery> &queries, std::vector<int> &sources)
+{
+    FILE *file = fopen(fileName, "rb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "replayWorkload: cannot open %s\n", fileName);
+        return false;
+    }
+
+    WorkloadHeader header;
+    if (fread(&header, sizeof(WorkloadHeader), 1, file) != 1 ||
+        header.magic != WORKLOAD_MAGIC || header.version != WORKLOAD_VERSION)
+    {
+        fprintf(stderr, "replayWorkload: %s is not a workload of version %d\n", fileName, WORKLOAD_VERSION);
+        fclose(file);
+        return false;
+    }
+
+    if (header.vertexCount != graph->vertexCount || header.edgeCount != graph->edgeCount ||
+        header.graphChecksum != graphChecksum(graph))
+    {
+        fprintf(stderr, "replayWorkload: %s was recorded on another graph\n", fileName);
+        fclose(file);
+        return false;
+    }
+
+    LoadedQuery query;
+    while (fread(&query.record, sizeof(WorkloadRecord), 1, file) == 1)
+    {
+        const WorkloadRecord *record = &query.record;
+        if (record->sourceCount < 0 || record->requestClass < 0 || record->requestClass >= SSSP_CLASS_COUNT)
+        {
+            fprintf(stderr, "replayWorkload: %s is corrupt after %lu queries\n", fileName,
+                    (unsigned long) queries.size());
+            break;
+        }
+
+        query.firstSource = sources.size();
+        sources.resize(query.firstSource + record->sourceCount);
+        if (record->sourceCount > 0 &&
+            fread(&sources[query.firstSource], sizeof(int), record->sourceCount, file) != (size_t) record->sourceCount)
+        {
+            sources.resize(query.firstSource);
+            break;
+        }
+
+        // Sources outside the graph would be read out of bounds by the engines
+        bool valid = true;
+        for (int i = 0; i < record->sourceCount && valid; i++)
+        {
+            int source = sources[query.firstSource + i];
+            valid = source >= 0 && source < graph->vertexCount;
+        }
+        if (!valid)
+        {
+            fprintf(stderr, "replayWorkload: %s is corrupt after %lu queries\n", fileName,
+                    (unsigned long) queries.size());
+            sources.resize(query.firstSource);
+            break;
+        }
+
+        queries.push_back(query);
+    }
+
+    fclose(file);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+///
+/// Start recording the queries on a graph into fileName
+///
+bool beginWorkloadRecording( const char *fileName, const GraphData *graph, WorkloadRecorder *outRecorder )
+{
+    memset(outRecorder, 0, sizeof(WorkloadRecorder));
+
+    outRecorder->file = fopen(fileName, "wb");
+    if (outRecorder->file == NULL)
+    {
+        fprintf(stderr, "beginWorkloadRecording: cannot open %s\n", fileName);
+        return false;
+    }
+
+    WorkloadHeader header;
+    memset(&header, 0, sizeof(WorkloadHeader));
+    header.magic = WORKLOAD_MAGIC;
+    header.version = WORKLOAD_VERSION;
+    header.graphChecksum = graphChecksum(graph);
+    header.vertexCount = graph->vertexCount;
+    header.edgeCount = graph->edgeCount;
+    header.startTime = workloadTime();
+
+    pthread_mutex_init(&outRecorder->lock, NULL);
+    outRecorder->startTime = header.startTime;
+    outRecorder->failed = fwrite(&header, sizeof(WorkloadHeader), 1, outRecorder->file) != 1;
+
+    return !outRecorder->failed;
+}
+
+///
+/// Append one query, stamped with the current time
+///
+void recordWorkloadQuery( WorkloadRecorder *recorder, WorkloadQueryType type, SSSPRequestClass requestClass,
+                          int priority, const int *sourceVertices, int sourceCount, int target )
+{
+    WorkloadRecord record;
+    memset(&record, 0, sizeof(WorkloadRecord));
+    record.type = type;
+    record.requestClass = requestClass;
+    record.priority = priority;
+    record.target = (type == WORKLOAD_QUERY_DISTANCE) ? target : -1;
+    record.sourceCount = (sourceCount > 0) ? sourceCount : 0;
+
+    // Stamped under the lock so that the arrivals in the file never go back
+    pthread_mutex_lock(&recorder->lock);
+    record.arrival = workloadTime() - recorder->startTime;
+    bool written = fwrite(&record, sizeof(WorkloadRecord), 1, recorder->file) == 1 &&
+                   fwrite(sourceVertices, sizeof(int), record.sourceCount, recorder->file) ==
+                   (size_t) record.sourceCount;
+    recorder->failed = recorder->failed || !written;
+    recorder->records++;
+    pthread_mutex_unlock(&recorder->lock);
+}
+
+///
+/// Flush and close a recording
+///
+bool finishWorkloadRecording( WorkloadRecorder *recorder )
+{
+    if (recorder->file == NULL)
+    {
+        return false;
+    }
+
+    bool written = !recorder->failed && fflush(recorder->file) == 0;
+    written = (fclose(recorder->file) == 0) && written;
+    recorder->file = NULL;
+    pthread_mutex_destroy(&recorder->lock);
+
+    if (!written)
+    {
+        fprintf(stderr, "finishWorkloadRecording: error writing the workload\n");
+    }
+    return written;
+}
+
+///
+/// Replay a recorded workload on an engine started for the call
+///
+bool replayWorkload( const char *fileName, SSSPBackend **backends, int backendCount, const GraphData *graph,
+                     double speedup, WorkloadReplayStats *outStats )
+{
+    memset(outStats, 0, sizeof(WorkloadReplayStats));
+
+    std::vector<LoadedQuery> queries;
+    std::vector<int> sources;
+    if (!loadWorkload(fileName, graph, queries, sources))
+    {
+        return false;
+    }
+
+    SSSPEngine engine;
+    if (!engine.start(backends, backendCount, graph))
+    {
+        fprintf(stderr, "replayWorkload: no backend could load the graph\n");
+        return false;
+    }
+
+    // Scheduled arrival, finish time and final state of every query.  The
+    // finish times are written by the completion callbacks.
+    size_t queryCount = queries.size();
+    std::vector<double> scheduled(queryCount);
+    std::vector<double> finished(queryCount);
+    std::vector<SSSPRequestState> states(queryCount);
+
+    // Queries in flight, oldest first, with their result buffers
+    std::vector<SSSPFuture> inFlight;
+    std::vector<float*> inFlightCosts;
+    size_t oldest = 0;
+
+    double start = workloadTime();
+    double firstArrival = queryCount > 0 ? queries[0].record.arrival : 0.0;
+    for (size_t q = 0; q < queryCount; q++)
+    {
+        const WorkloadRecord *record = &queries[q].record;
+
+        // Retire the oldest query once the window is full
+        if (inFlight.size() - oldest >= WORKLOAD_MAX_IN_FLIGHT)
+        {
+            states[oldest] = inFlight[oldest].wait();
+            trackedFree(inFlightCosts[oldest]);
+            inFlight[oldest] = SSSPFuture();
+            oldest++;
+        }
+
+        double now = workloadTime();
+        scheduled[q] = now;
+        if (speedup > 0.0)
+        {
+            scheduled[q] = start + (record->arrival - firstArrival) / speedup;
+            if (scheduled[q] > now)
+            {
+                usleep((useconds_t) ((scheduled[q] - now) * 1.0e6));
+                now = workloadTime();
+            }
+            outStats->maxSubmitLag = std::max(outStats->maxSubmitLag, now - scheduled[q]);
+        }
+
+        size_t costCount = (size_t) (record->sourceCount > 0 ? record->sourceCount : 1) * graph->vertexCount;
+        float *costs = (float*) trackedMalloc(MEMORY_RESULTS, sizeof(float) * costCount);
+        const int *querySources = (record->sourceCount > 0) ? &sources[queries[q].firstSource] : NULL;
+        // The callback is attached by submit() so that it is in place before
+        // a worker can pick the query up and finish it
+        inFlight.push_back(engine.submit(querySources, costs, record->sourceCount,
+                                         record->priority, (SSSPRequestClass) record->requestClass,
+                                         onQueryFinished, &finished[q]));
+        inFlightCosts.push_back(costs);
+    }
+
+    // wait() returns once the callbacks have stamped the finish times
+    for (size_t i = oldest; i < inFlight.size(); i++)
+    {
+        states[i] = inFlight[i].wait();
+        trackedFree(inFlightCosts[i]);
+    }
+
+    std::vector<double> latencies;
+    double end = start;
+    for (size_t i = 0; i < queryCount; i++)
+    {
+        if (states[i] != SSSP_REQUEST_COMPLETED)
+        {
+            outStats->failed++;
+            continue;
+        }
+        latencies.push_back(finished[i] - scheduled[i]);
+        end = std::max(end, finished[i]);
+    }
+    outStats->queries = (long long) queryCount;
+    outStats->duration = end - start;
+
+    if (!latencies.empty())
+    {
+        std::sort(latencies.begin(), latencies.end());
+        double sum = 0.0;
+        for (size_t i = 0; i < latencies.size(); i++)
+        {
+            sum += latencies[i];
+        }
+        size_t last = latencies.size() - 1;
+        outStats->meanLatency = sum / latencies.size();
+        outStats->p50Latency = latencies[(size_t) (0.50 * last)];
+        outStats->p95Latency = latencies[(size_t) (0.95 * last)];
+        outStats->p99Latency = latencies[(size_t) (0.99 * last)];
+        outStats->maxLatency = latencies[last];
+    }
+
+    return outStats->failed == 0;
+}
@@ -0,0 +1,495 @@
+//
+//
+//  Description:
+//      Host-side regression checks, run by "make test" in shared/.  Needs no
+//      device: every check runs on the CPU engines.
+//
+//          engines      every CPU backend, the multi-backend split, the
+//                       SSSPEngine, the contracted and the component engines
+//                       agree with runDijkstraRef() and pass verifySSSP()
+//          snapshot     the oracle, hub labels and component index come back
+//                       from a snapshot and from their own files unchanged
+//          checkpoint   a job resumed from its directory, including after a
+//                       torn manifest record, gives the same rows
+//          verifier     verifySSSP() rejects a lowered, a raised and a
+//                       non-zero source cost
+//
+//  Children's Hospital Boston
+//  GPL v2
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <unistd.h>
+#include <vector>
+#include <string>
+#include "dijkstraGraph.h"
+#include "dijkstraBackend.h"
+#include "dijkstraAsync.h"
+#include "dijkstraCheckpoint.h"
+#include "dijkstraComponents.h"
+#include "dijkstraContract.h"
+#include "dijkstraHubLabels.h"
+#include "dijkstraOracle.h"
+#include "dijkstraSnapshot.h"
+#include "dijkstraVerify.h"
+
+///
+//  Constants
+//
+
+// Vertices of the test graphs, small enough for the whole run to take seconds
+const int TEST_VERTICES = 3000;
+
+// Sources of each batch
+const int TEST_SOURCES = 12;
+
+// Threads of the verifier and of the index builds
+const int TEST_THREADS = 2;
+
+// Landmarks of the snapshotted oracle
+const int TEST_LANDMARKS = 4;
+
+// Relative difference allowed between an engine's cost and the reference's,
+// as in the driver's hub label check, plus an absolute part for costs near 0
+const float TEST_RELATIVE_TOLERANCE = 1.0e-4f;
+const float TEST_ABSOLUTE_TOLERANCE = 1.0e-5f;
+
+///
+//  Globals
+//
+
+// Checks that failed so far
+static int failures = 0;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Private Functions
+//
+//
+
+///
+/// Report one check and count it if it failed
+///
+static void check(bool passed, const char *graphName, const char *what)
+{
+    printf("%-8s %-6s %s\n", passed ? "PASSED" : "FAILED", graphName, what);
+    if (!passed)
+    {
+        failures++;
+    }
+}
+
+///
+/// Whether two sets of rows hold the same costs, up to the float tolerance
+///
+static bool sameCosts(const float *costs, const float *expected, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (costs[i] == expected[i])
+        {
+            continue;
+        }
+        if (costs[i] == FLT_MAX || expected[i] == FLT_MAX ||
+            fabsf(costs[i] - expected[i]) > TEST_ABSOLUTE_TOLERANCE + TEST_RELATIVE_TOLERANCE * expected[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+///
+/// Whether rows agree with the reference and pass the verifier
+///
+static bool matchesReference(const GraphData *graph, const int *sources, const float *costs,
+                             const float *reference)
+{
+    size_t count = (size_t) TEST_SOURCES * graph->vertexCount;
+    return sameCosts(costs, reference, count) &&
+           verifySSSP(graph, NULL, sources, costs, TEST_SOURCES, TEST_THREADS, NULL);
+}
+
+///
+/// Compare every host engine against runDijkstraRef()
+///
+static void checkEngines(const char *graphName, const GraphData *graph, const int *sources,
+                         const float *reference)
+{
+    size_t count = (size_t) TEST_SOURCES * graph->vertexCount;
+    std::vector<float> costs(count);
+
+    check(verifySSSP(graph, NULL, sources, reference, TEST_SOURCES, TEST_THREADS, NULL), graphName,
+          "reference passes the verifier");
+
+    std::vector<SSSPBackend*> backends;
+    for (int i = 0; i < getSSSPBackendCount(); i++)
+    {
+        SSSPBackend *backend = getSSSPBackend(i);
+        backends.push_back(backend);
+
+        std::string what = std::string(backend->getName()) + " matches the reference";
+        std::fill(costs.begin(), costs.end(), -1.0f);
+        check(runSSSP(backend, graph, sources, &costs[0], TEST_SOURCES) &&
+              matchesReference(graph, sources, &costs[0], reference), graphName, what.c_str());
+    }
+
+    std::fill(costs.begin(), costs.end(), -1.0f);
+    check(runSSSPMultiBackend(&backends[0], (int) backends.size(), graph, sources, &costs[0], TEST_SOURCES) &&
+          matchesReference(graph, sources, &costs[0], reference), graphName,
+          "multi-backend split matches the reference");
+
+    // One batch per source, so that the engine splits and reorders them
+    std::fill(costs.begin(), costs.end(), -1.0f);
+    bool completed = false;
+    {
+        SSSPEngine engine;
+        if (engine.start(&backends[0], (int) backends.size(), graph))
+        {
+            std::vector<SSSPFuture> futures;
+            for (int i = 0; i < TEST_SOURCES; i++)
+            {
+                futures.push_back(engine.submit(&sources[i], &costs[(size_t) i * graph->vertexCount], 1, i % 3,
+                                                (i % 2 == 0) ? SSSP_CLASS_INTERACTIVE : SSSP_CLASS_BULK));
+            }
+            completed = true;
+            for (size_t i = 0; i < futures.size(); i++)
+            {
+                completed = (futures[i].wait() == SSSP_REQUEST_COMPLETED) && completed;
+            }
+        }
+    }
+    check(completed && matchesReference(graph, sources, &costs[0], reference), graphName,
+          "async engine matches the reference");
+
+    // Nothing kept, so that sources on chains are searched from their ends
+    ContractedGraph contracted;
+    contractGraph(graph, NULL, 0, &contracted);
+    std::fill(costs.begin(), costs.end(), -1.0f);
+    check(runSSSPContracted(findSSSPBackend(SSSP_BACKEND_CPU_HEAP), &contracted, sources, &costs[0], TEST_SOURCES) &&
+          matchesReference(graph, sources, &costs[0], reference), graphName,
+          "contracted engine matches the reference");
+    freeContractedGraph(&contracted);
+
+    ComponentIndex components;
+    buildComponentIndex(graph, TEST_THREADS, &components);
+    SSSPSession *session = createComponentSession(findSSSPBackend(SSSP_BACKEND_CPU_BUCKET), graph, &components);
+    std::fill(costs.begin(), costs.end(), -1.0f);
+    check(session != NULL && session->run(sources, &costs[0], TEST_SOURCES) &&
+          matchesReference(graph, sources, &costs[0], reference), graphName,
+          "component engine matches the reference");
+    delete session;
+    freeComponentIndex(&components);
+}
+
+///
+/// Whether two sets of hub labels hold the same entries
+///
+static bool sameHubLabels(const HubLabels *labels, const HubLabels *expected)
+{
+    if (labels->vertexCount != expected->vertexCount ||
+        hubLabelEntryCount(labels) != hubLabelEntryCount(expected))
+    {
+        return false;
+    }
+
+    size_t startCount = 2 * (size_t) expected->vertexCount + 1;
+    return memcmp(labels->order, expected->order, sizeof(int) * expected->vertexCount) == 0 &&
+           memcmp(labels->labelStart, expected->labelStart, sizeof(long long) * startCount) == 0 &&
+           memcmp(labels->entries, expected->entries,
+                  sizeof(HubLabelEntry) * (size_t) expected->labelStart[2 * expected->vertexCount]) == 0;
+}
+
+///
+/// Whether two oracles hold the same landmarks and costs
+///
+static bool sameOracle(const DistanceOracle *oracle, const DistanceOracle *expected)
+{
+    size_t costCount = (size_t) expected->vertexCount * expected->landmarkCount;
+    return oracle->vertexCount == expected->vertexCount && oracle->landmarkCount == expected->landmarkCount &&
+           memcmp(oracle->landmarks, expected->landmarks, sizeof(int) * expected->landmarkCount) == 0 &&
+           memcmp(oracle->toLandmark, expected->toLandmark, sizeof(float) * costCount) == 0 &&
+           memcmp(oracle->fromLandmark, expected->fromLandmark, sizeof(float) * costCount) == 0;
+}
+
+///
+/// Whether two component indexes assign every vertex the same components
+///
+static bool sameComponents(const ComponentIndex *index, const ComponentIndex *expected)
+{
+    int n = expected->vertexCount;
+    return index->vertexCount == n && index->wccCount == expected->wccCount &&
+           index->sccCount == expected->sccCount &&
+           memcmp(index->wcc, expected->wcc, sizeof(int) * n) == 0 &&
+           memcmp(index->wccStart, expected->wccStart, sizeof(int) * (expected->wccCount + 1)) == 0 &&
+           memcmp(index->wccVertices, expected->wccVertices, sizeof(int) * n) == 0 &&
+           memcmp(index->wccLocalVertex, expected->wccLocalVertex, sizeof(int) * n) == 0 &&
+           memcmp(index->scc, expected->scc, sizeof(int) * n) == 0 &&
+           memcmp(index->sccSize, expected->sccSize, sizeof(int) * expected->sccCount) == 0;
+}
+
+///
+/// Round-trip the preprocessed indexes through a snapshot and their own files
+///
+static void checkSnapshots(const char *graphName, const GraphData *graph, const std::string &directory)
+{
+    DistanceOracle oracle;
+    HubLabels labels;
+    ComponentIndex components;
+    bool built = buildDistanceOracle(findSSSPBackend(SSSP_BACKEND_CPU_HEAP), graph, TEST_LANDMARKS, 0, &oracle);
+    buildHubLabels(graph, NULL, TEST_THREADS, &labels);
+    buildComponentIndex(graph, TEST_THREADS, &components);
+    check(built, graphName, "oracle builds");
+
+    std::string snapshotFile = directory + "/engine.snap";
+    SnapshotWriter writer;
+    bool written = built && beginSnapshot(snapshotFile.c_str(), graph, &writer);
+    if (written)
+    {
+        written = snapshotDistanceOracle(&writer, &oracle) && snapshotHubLabels(&writer, &labels) &&
+                  snapshotComponentIndex(&writer, &components);
+        written = finishSnapshot(&writer) && written;
+    }
+    check(written, graphName, "snapshot is written");
+
+    Snapshot snapshot;
+    bool opened = written && openSnapshot(snapshotFile.c_str(), graph, &snapshot);
+    check(opened, graphName, "snapshot opens on its graph");
+    if (opened)
+    {
+        DistanceOracle restoredOracle;
+        HubLabels restoredLabels;
+        ComponentIndex restoredComponents;
+        bool restored = restoreDistanceOracle(&snapshot, &restoredOracle);
+        check(restored && sameOracle(&restoredOracle, &oracle), graphName, "oracle survives the snapshot");
+        if (restored)
+        {
+            freeDistanceOracle(&restoredOracle);
+        }
+        restored = restoreHubLabels(&snapshot, &restoredLabels);
+        check(restored && sameHubLabels(&restoredLabels, &labels), graphName, "hub labels survive the snapshot");
+        if (restored)
+        {
+            freeHubLabels(&restoredLabels);
+        }
+        restored = restoreComponentIndex(&snapshot, &restoredComponents);
+        check(restored && sameComponents(&restoredComponents, &components), graphName,
+              "component index survives the snapshot");
+        if (restored)
+        {
+            freeComponentIndex(&restoredComponents);
+        }
+        closeSnapshot(&snapshot);
+    }
+
+    // Another graph of the same size must not open it
+    GraphData other;
+    generateRandomGraph(&other, graph->vertexCount, 3);
+    Snapshot rejected;
+    bool reopened = openSnapshot(snapshotFile.c_str(), &other, &rejected);
+    check(!reopened, graphName, "snapshot is refused on another graph");
+    if (reopened)
+    {
+        closeSnapshot(&rejected);
+    }
+    freeGraph(&other);
+    unlink(snapshotFile.c_str());
+
+    std::string oracleFile = directory + "/oracle.bin";
+    DistanceOracle loadedOracle;
+    bool loaded = built && saveDistanceOracle(&oracle, oracleFile.c_str()) &&
+                  loadDistanceOracle(oracleFile.c_str(), &loadedOracle);
+    check(loaded && sameOracle(&loadedOracle, &oracle), graphName, "oracle survives its file");
+    if (loaded)
+    {
+        freeDistanceOracle(&loadedOracle);
+    }
+    unlink(oracleFile.c_str());
+
+    std::string labelFile = directory + "/labels.bin";
+    HubLabels loadedLabels;
+    loaded = saveHubLabels(&labels, labelFile.c_str()) && loadHubLabels(labelFile.c_str(), &loadedLabels);
+    check(loaded && sameHubLabels(&loadedLabels, &labels), graphName, "hub labels survive their file");
+    if (loaded)
+    {
+        freeHubLabels(&loadedLabels);
+    }
+
+    // A file cut short must be refused rather than mapped
+    loaded = truncate(labelFile.c_str(), 200) == 0 && loadHubLabels(labelFile.c_str(), &loadedLabels);
+    check(!loaded, graphName, "truncated hub label file is refused");
+    if (loaded)
+    {
+        freeHubLabels(&loadedLabels);
+    }
+    unlink(labelFile.c_str());
+
+    if (built)
+    {
+        freeDistanceOracle(&oracle);
+    }
+    freeHubLabels(&labels);
+    freeComponentIndex(&components);
+}
+
+///
+/// Run a checkpointed job, resume it whole and after a torn manifest record
+///
+static void checkCheckpoints(const char *graphName, const GraphData *graph, const int *sources,
+                             const float *reference, const std::string &directory)
+{
+    std::vector<SSSPBackend*> backends;
+    for (int i = 0; i < getSSSPBackendCount(); i++)
+    {
+        backends.push_back(getSSSPBackend(i));
+    }
+
+    size_t count = (size_t) TEST_SOURCES * graph->vertexCount;
+    std::vector<float> costs(count, -1.0f);
+    std::string jobDirectory = directory + "/job";
+    CheckpointStats stats;
+    bool ran = runSSSPCheckpointed(&backends[0], (int) backends.size(), graph, sources, &costs[0], TEST_SOURCES,
+                                   jobDirectory.c_str(), &stats);
+    check(ran && stats.resumedChunks == 0 && stats.completedChunks == stats.chunkCount &&
+          matchesReference(graph, sources, &costs[0], reference), graphName,
+          "checkpointed job matches the reference");
+
+    // Every chunk is on disk, nothing runs again
+    std::fill(costs.begin(), costs.end(), -1.0f);
+    ran = ran && runSSSPCheckpointed(&backends[0], (int) backends.size(), graph, sources, &costs[0], TEST_SOURCES,
+                                     jobDirectory.c_str(), &stats);
+    check(ran && stats.resumedChunks == stats.chunkCount && stats.completedChunks == 0 &&
+          matchesReference(graph, sources, &costs[0], reference), graphName,
+          "finished job resumes from its rows");
+
+    // A crash while appending leaves a torn last record, whose chunk runs again
+    std::string manifest = jobDirectory + "/manifest";
+    std::string rows = jobDirectory + "/rows";
+    FILE *file = fopen(manifest.c_str(), "rb");
+    long manifestSize = -1;
+    if (file != NULL && fseek(file, 0, SEEK_END) == 0)
+    {
+        manifestSize = ftell(file);
+    }
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+    std::fill(costs.begin(), costs.end(), -1.0f);
+    ran = ran && manifestSize > 0 && truncate(manifest.c_str(), manifestSize - 1) == 0 &&
+          runSSSPCheckpointed(&backends[0], (int) backends.size(), graph, sources, &costs[0], TEST_SOURCES,
+                              jobDirectory.c_str(), &stats);
+    check(ran && stats.resumedChunks == stats.chunkCount - 1 && stats.completedChunks == 1 &&
+          matchesReference(graph, sources, &costs[0], reference), graphName,
+          "torn manifest record reruns its chunk");
+
+    unlink(manifest.c_str());
+    unlink(rows.c_str());
+    rmdir(jobDirectory.c_str());
+}
+
+///
+/// Corrupt one cost of a correct set of rows at a time and make sure the
+/// verifier notices each
+///
+static void checkVerifier(const char *graphName, const GraphData *graph, const int *sources,
+                          const float *reference)
+{
+    size_t count = (size_t) TEST_SOURCES * graph->vertexCount;
+    std::vector<float> costs(reference, reference + count);
+
+    // A reached vertex of the last row, not its source
+    int row = TEST_SOURCES - 1;
+    float *rowCosts = &costs[(size_t) row * graph->vertexCount];
+    int vertex = -1;
+    for (int v = 0; v < graph->vertexCount && vertex < 0; v++)
+    {
+        if (v != sources[row] && rowCosts[v] > 1.0f && rowCosts[v] < FLT_MAX)
+        {
+            vertex = v;
+        }
+    }
+    check(vertex >= 0, graphName, "last row reaches a vertex");
+    if (vertex < 0)
+    {
+        return;
+    }
+
+    SSSPVerification verification;
+    float cost = rowCosts[vertex];
+    rowCosts[vertex] = cost * 0.5f;
+    check(!verifySSSP(graph, NULL, sources, &costs[0], TEST_SOURCES, TEST_THREADS, &verification) &&
+          verification.firstBadRow == row, graphName, "verifier rejects a lowered cost");
+
+    rowCosts[vertex] = cost * 1.5f;
+    check(!verifySSSP(graph, NULL, sources, &costs[0], TEST_SOURCES, TEST_THREADS, &verification) &&
+          verification.firstBadRow == row, graphName, "verifier rejects a raised cost");
+
+    rowCosts[vertex] = cost;
+    rowCosts[sources[row]] = 1.0f;
+    check(!verifySSSP(graph, NULL, sources, &costs[0], TEST_SOURCES, TEST_THREADS, &verification) &&
+          verification.sourceErrors == 1, graphName, "verifier rejects a non-zero source cost");
+
+    rowCosts[sources[row]] = 0.0f;
+    check(verifySSSP(graph, NULL, sources, &costs[0], TEST_SOURCES, TEST_THREADS, &verification), graphName,
+          "verifier accepts the repaired rows");
+}
+
+///
+/// Run every check on one graph
+///
+static void checkGraph(const char *graphName, const GraphData *graph, const std::string &directory)
+{
+    std::vector<int> sources(TEST_SOURCES);
+    for (int i = 0; i < TEST_SOURCES; i++)
+    {
+        sources[i] = (int) ((long long) graph->vertexCount * i / TEST_SOURCES);
+    }
+
+    std::vector<float> reference((size_t) TEST_SOURCES * graph->vertexCount);
+    runDijkstraRef(graph, &sources[0], &reference[0], TEST_SOURCES);
+
+    checkEngines(graphName, graph, &sources[0], &reference[0]);
+    checkSnapshots(graphName, graph, directory);
+    checkCheckpoints(graphName, graph, &sources[0], &reference[0], directory);
+    checkVerifier(graphName, graph, &sources[0], &reference[0]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Public Functions
+//
+//
+
+int main()
+{
+    char directoryTemplate[] = "/tmp/dijkstraRegressionXXXXXX";
+    if (mkdtemp(directoryTemplate) == NULL)
+    {
+        perror("dijkstraRegression: mkdtemp");
+        return 1;
+    }
+    std::string directory = directoryTemplate;
+
+    registerCPUBackends();
+
+    GraphData random;
+    generateRandomGraph(&random, TEST_VERTICES, 6);
+    checkGraph("random", &random, directory);
+    freeGraph(&random);
+
+    // Long chains of degree-2 vertices, what the contracted engine removes
+    GraphData road;
+    generateRoadGraph(&road, TEST_VERTICES, 20);
+    checkGraph("road", &road, directory);
+    freeGraph(&road);
+
+    releaseSSSPBackends();
+    rmdir(directory.c_str());
+
+    printf("\n%s: %d check(s) failed\n", (failures == 0) ? "PASSED" : "FAILED", failures);
+    return (failures == 0) ? 0 : 1;
+}